@@ -65,7 +65,13 @@ const char* GetCollectiveName(const CollectiveParams* cp, bool nccl) {
       return "HierarchicalTreeBroadcast";
 
     case REDUCTION_COLLECTIVE:
-      return nccl ? "NcclReduce" : "RingReduce";
+      if (nccl) return "NcclReduce";
+      if (cp->instance.impl_details.communication_hint ==
+              "hierarchical_ring" &&
+          cp->group.device_type == DeviceType(DEVICE_CPU)) {
+        return "HierarchicalRingReduce";
+      }
+      return "RingReduce";
 
     case GATHER_COLLECTIVE:
       return "RingGather";
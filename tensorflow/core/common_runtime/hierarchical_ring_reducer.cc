@@ -0,0 +1,607 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/common_runtime/hierarchical_ring_reducer.h"
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+#include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
+#include "tensorflow/core/common_runtime/collective_rma_local.h"
+#include "tensorflow/core/common_runtime/collective_util.h"
+#include "tensorflow/core/common_runtime/device.h"
+#include "tensorflow/core/common_runtime/device_mgr.h"
+#include "tensorflow/core/common_runtime/dma_helper.h"
+#include "tensorflow/core/framework/device_base.h"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/notification.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/types.h"
+#include "tensorflow/core/profiler/lib/traceme.h"
+
+namespace tensorflow {
+
+namespace {
+// Fields of at most kMaxFieldBytes keep enough transfers in flight to
+// overlap the reduction of the fields already received, without making the
+// per-transfer overhead significant.
+constexpr int64 kMaxFieldBytes = 1024 * 1024;
+constexpr int kMaxFieldsPerRingChunk = 16;
+
+// Key to be used for BufRendezvous by HierarchicalRingReducer.
+string HierarchicalRingBufKey(const string& exec_key, const string& phase,
+                              int field_idx, int src_idx, int dst_idx) {
+  return strings::StrCat("hring(", exec_key, "):", phase, ":", field_idx, ":",
+                         src_idx, ":", dst_idx);
+}
+
+bool IsFastDataType(DataType dtype) {
+  return dtype == DT_FLOAT || dtype == DT_DOUBLE || dtype == DT_INT32 ||
+         dtype == DT_INT64;
+}
+
+template <typename T>
+void MergeInPlace(const Eigen::ThreadPoolDevice& d, const string& op,
+                  Tensor* output, const Tensor& input) {
+  auto out = output->flat<T>();
+  auto in = input.flat<T>();
+  if (op == "Add") {
+    out.device(d) = out + in;
+  } else if (op == "Mul") {
+    out.device(d) = out * in;
+  } else if (op == "Maximum") {
+    out.device(d) = out.cwiseMax(in);
+  } else {
+    DCHECK_EQ(op, "Minimum");
+    out.device(d) = out.cwiseMin(in);
+  }
+}
+
+template <typename T>
+void DivideInPlace(const Eigen::ThreadPoolDevice& d, int divisor,
+                   Tensor* chunk) {
+  auto out = chunk->flat<T>();
+  out.device(d) = out / out.constant(static_cast<T>(divisor));
+}
+}  // namespace
+
+HierarchicalRingReducer::HierarchicalRingReducer()
+    : col_ctx_(nullptr),
+      col_params_(nullptr),
+      done_(nullptr),
+      fast_merge_(false),
+      fast_finalize_(false),
+      num_tasks_(-1),
+      devices_per_task_(-1),
+      task_(-1),
+      local_rank_(-1),
+      num_fields_(-1),
+      outstanding_(0) {}
+
+Status HierarchicalRingReducer::InitializeCollectiveParams(
+    CollectiveParams* col_params) {
+  CHECK_EQ(col_params->instance.type, REDUCTION_COLLECTIVE);
+  CHECK_EQ(col_params->instance.impl_details.collective_name,
+           "HierarchicalRingReduce");
+  if (col_params->group.device_type != DeviceType(DEVICE_CPU)) {
+    return errors::InvalidArgument(
+        "HierarchicalRingReduce only supports CPU devices, got ",
+        col_params->group.device_type.type_string());
+  }
+  // Precondition: device_names must be sorted so that all devices in
+  // the same task are adjacent.
+  std::vector<int> dev_per_task;
+  const string* prior_task_name = &col_params->instance.task_names[0];
+  int dev_count = 1;
+  for (int di = 1; di < col_params->group.group_size; ++di) {
+    if (col_params->instance.task_names[di] != *prior_task_name) {
+      dev_per_task.push_back(dev_count);
+      dev_count = 1;
+      prior_task_name = &col_params->instance.task_names[di];
+    } else {
+      ++dev_count;
+    }
+  }
+  dev_per_task.push_back(dev_count);
+  for (int num_dev : dev_per_task) {
+    if (num_dev != dev_per_task[0]) {
+      return errors::InvalidArgument(
+          "HierarchicalRingReduce requires the same number of devices in "
+          "every task, got ",
+          num_dev, " and ", dev_per_task[0]);
+    }
+  }
+
+  const int num_tasks = static_cast<int>(dev_per_task.size());
+  std::vector<std::vector<int>>& perms =
+      col_params->instance.impl_details.subdiv_permutations;
+  perms.clear();
+  perms.resize(num_tasks);
+  col_params->subdiv_rank.clear();
+  int abs_di = 0;
+  for (int ti = 0; ti < num_tasks; ++ti) {
+    int subdiv_rank = -1;
+    for (int di = 0; di < dev_per_task[ti]; ++di) {
+      perms[ti].push_back(abs_di);
+      if (abs_di == col_params->default_rank) subdiv_rank = di;
+      ++abs_di;
+    }
+    col_params->subdiv_rank.push_back(subdiv_rank);
+  }
+
+  VLOG(2) << collective_util::SubdivPermDebugString(*col_params);
+  return Status::OK();
+}
+
+Status HierarchicalRingReducer::InitializeCollectiveContext(
+    std::shared_ptr<CollectiveContext> col_ctx) {
+  CHECK(col_ctx->dev_mgr);
+  col_ctx_ = col_ctx;
+  col_params_ = &col_ctx->col_params;
+  return collective_util::InitializeDeviceAndLocality(
+      col_ctx->dev_mgr, col_ctx->device_name, &col_ctx->device,
+      &col_ctx->device_locality);
+}
+
+int HierarchicalRingReducer::DeviceIndex(int task, int local_rank) const {
+  return col_params_->instance.impl_details.subdiv_permutations[task]
+                                                               [local_rank];
+}
+
+void HierarchicalRingReducer::Run(StatusCallback done) {
+  CHECK(col_ctx_);
+  CHECK(col_params_);
+  // Like RingReducer, this does not require non-overlapping collectives.
+  col_ctx_->col_exec->UnblockDependencies(*col_params_);
+  done_ = std::move(done);
+
+  const auto& perms = col_params_->instance.impl_details.subdiv_permutations;
+  num_tasks_ = static_cast<int>(perms.size());
+  CHECK_GT(num_tasks_, 0);
+  devices_per_task_ = static_cast<int>(perms[0].size());
+  for (int ti = 0; ti < num_tasks_; ++ti) {
+    if (col_params_->subdiv_rank[ti] >= 0) {
+      task_ = ti;
+      local_rank_ = col_params_->subdiv_rank[ti];
+    }
+  }
+  CHECK_GE(task_, 0);
+
+  // Start by copying input to output if they're not already the same, i.e. if
+  // we're not computing in-place on the input tensor.
+  if ((col_ctx_->input != col_ctx_->output) &&
+      (DMAHelper::base(col_ctx_->input) != DMAHelper::base(col_ctx_->output))) {
+    Notification note;
+    Status status;
+    profiler::TraceMe activity("MemCpyAsync", profiler::TraceMeLevel::kInfo);
+    CollectiveRemoteAccessLocal::MemCpyAsync(
+        col_ctx_->op_ctx->op_device_context(),
+        col_ctx_->op_ctx->op_device_context(), col_ctx_->device,
+        col_ctx_->device, col_ctx_->op_ctx->input_alloc_attr(0),
+        col_ctx_->op_ctx->output_alloc_attr(0), col_ctx_->input,
+        col_ctx_->output, 0 /*dev_to_dev_stream_index*/,
+        [&note, &status](const Status& s) {
+          status.Update(s);
+          note.Notify();
+        });
+    note.WaitForNotification();
+    if (!status.ok()) {
+      done_(status);
+      return;
+    }
+  }
+
+  // Every device must arrive at the same fields, so they only depend on the
+  // shape of the tensor.
+  const int64 ring_chunk_bytes = col_ctx_->output->TotalBytes() /
+                                 (devices_per_task_ * num_tasks_);
+  const int64 fields_per_ring_chunk = std::min<int64>(
+      kMaxFieldsPerRingChunk,
+      std::max<int64>(1, (ring_chunk_bytes + kMaxFieldBytes - 1) /
+                             kMaxFieldBytes));
+  num_fields_ = num_tasks_ * static_cast<int>(fields_per_ring_chunk);
+  AllocatorAttributes attr = col_ctx_->op_ctx->output_alloc_attr(0);
+  ca_.reset(MakeCollectiveAdapter(col_ctx_->output,
+                                  devices_per_task_ * num_fields_,
+                                  col_ctx_->device->GetAllocator(attr)));
+
+  const DataType dtype = col_params_->instance.data_type;
+  const string& merge_type = col_params_->merge_op->type_string();
+  fast_merge_ = IsFastDataType(dtype) &&
+                (merge_type == "Add" || merge_type == "Mul" ||
+                 merge_type == "Maximum" || merge_type == "Minimum");
+  if (col_params_->final_op) {
+    fast_finalize_ = IsFastDataType(dtype) &&
+                     col_params_->final_op->type_string() == "Div";
+    if (!fast_finalize_) {
+      group_size_tensor_ = ca_->Scalar(col_params_->group.group_size);
+    }
+  }
+
+  VLOG(1) << "HierarchicalRingReducer::Run for device "
+          << col_ctx_->device_name << " task " << task_ << " of "
+          << num_tasks_ << " local_rank " << local_rank_ << " of "
+          << devices_per_task_ << " num_fields " << num_fields_;
+
+  const bool ok = RunAsyncParts();
+  if (ok) {
+    // Recover the output from the adaptor.
+    ca_->ConsumeFinalValue(col_ctx_->output);
+  }
+  fields_.clear();  // Give up Refs on output tensor.
+  Status s;
+  {
+    mutex_lock l(mu_);
+    s = status_;
+  }
+  done_(s);
+}
+
+bool HierarchicalRingReducer::RunAsyncParts() {
+  fields_.clear();
+  fields_.resize(num_fields_);
+  for (int fi = 0; fi < num_fields_; ++fi) {
+    Field* field = &fields_[fi];
+    field->field_idx = fi;
+    field->segment_chunks.resize(devices_per_task_);
+    for (int si = 0; si < devices_per_task_; ++si) {
+      if (ca_->ChunkBytes(ChunkIndex(si, fi)) > 0) {
+        field->segment_chunks[si] = ca_->ChunkAlias(ChunkIndex(si, fi));
+      }
+    }
+    if (ca_->ChunkBytes(ChunkIndex(local_rank_, fi)) > 0) {
+      field->tmp_chunk = ca_->TempChunk(ChunkIndex(local_rank_, fi));
+    }
+  }
+
+  // Phase 1 sends only read the input, so they are all started right away.
+  // The fields only wait for them in phase 3, before receiving the reduced
+  // segments over them.
+  {
+    mutex_lock l(mu_);
+    for (Field& field : fields_) {
+      for (int si = 0; si < devices_per_task_; ++si) {
+        if (si != local_rank_ && field.segment_chunks[si].NumElements() > 0) {
+          ++field.scatter_sends;
+          ++outstanding_;
+        }
+      }
+    }
+  }
+  for (Field& field : fields_) {
+    Field* f = &field;
+    for (int si = 0; si < devices_per_task_; ++si) {
+      if (si == local_rank_ || f->segment_chunks[si].NumElements() == 0) {
+        continue;
+      }
+      DispatchSend("scatter", f->field_idx, DeviceIndex(task_, si),
+                   &f->segment_chunks[si], [this, f](const Status& s) {
+                     TransferDone(f, /*scatter_send=*/true, s);
+                   });
+    }
+  }
+
+  {
+    mutex_lock l(mu_);
+    for (Field& field : fields_) ready_.push_back(&field);
+  }
+  int num_done = 0;
+  {
+    profiler::TraceMe activity("Loop", profiler::TraceMeLevel::kInfo);
+    while (num_done < num_fields_) {
+      Field* field;
+      {
+        mutex_lock l(mu_);
+        while (ready_.empty() && status_.ok()) cv_.wait(l);
+        if (!status_.ok()) break;
+        field = ready_.front();
+        ready_.pop_front();
+      }
+      Advance(field);
+      if (field->action == FA_DONE) ++num_done;
+    }
+  }
+
+  // Wait for the callbacks of all transfers, which are aborted on error,
+  // before giving up the fields.
+  mutex_lock l(mu_);
+  while (outstanding_ > 0) cv_.wait(l);
+  return status_.ok();
+}
+
+void HierarchicalRingReducer::Advance(Field* field) {
+  Tensor* chunk = &field->segment_chunks[local_rank_];
+  const bool has_chunk = chunk->NumElements() > 0;
+  if (field->merge_tmp) {
+    field->merge_tmp = false;
+    Status s = Merge(chunk, &field->tmp_chunk);
+    if (!s.ok()) {
+      StartAbort(s);
+      return;
+    }
+  }
+  // Distance from the task at which the ring of this field starts.
+  const int ring_dist =
+      (task_ + num_tasks_ - (field->field_idx % num_tasks_)) % num_tasks_;
+  const int prev_idx =
+      DeviceIndex((task_ + num_tasks_ - 1) % num_tasks_, local_rank_);
+  const int next_idx = DeviceIndex((task_ + 1) % num_tasks_, local_rank_);
+  while (true) {
+    switch (field->action) {
+      case FA_SCATTER:
+        if (has_chunk && field->step < devices_per_task_ - 1) {
+          const int src = (local_rank_ + 1 + field->step) % devices_per_task_;
+          ++field->step;
+          field->merge_tmp = true;
+          DispatchRecv("scatter", field->field_idx, DeviceIndex(task_, src),
+                       &field->tmp_chunk, ExpectTransfer(field));
+          return;
+        }
+        field->action = FA_RING_REDUCE;
+        field->step = 0;
+        break;
+      case FA_RING_REDUCE:
+        if (!has_chunk) {
+          field->action = FA_GATHER;
+          break;
+        }
+        // The task at ring distance num_tasks_ - 1 holds the last partial
+        // value, and completes the reduction.
+        if (field->step == 0) {
+          field->step = 1;
+          if (ring_dist > 0) {
+            field->merge_tmp = true;
+            DispatchRecv("ring_reduce", field->field_idx, prev_idx,
+                         &field->tmp_chunk, ExpectTransfer(field));
+            return;
+          }
+        }
+        if (field->step == 1) {
+          field->step = 2;
+          if (ring_dist < num_tasks_ - 1) {
+            DispatchSend("ring_reduce", field->field_idx, next_idx, chunk,
+                         ExpectTransfer(field));
+            return;
+          }
+          Status s = Finalize(chunk);
+          if (!s.ok()) {
+            StartAbort(s);
+            return;
+          }
+        }
+        field->action = FA_RING_GATHER;
+        field->step = 0;
+        break;
+      case FA_RING_GATHER:
+        // The reduced value goes around the ring from the task that
+        // completed it, and stops before getting back to it.
+        if (num_tasks_ == 1) {
+          field->action = FA_GATHER;
+          break;
+        }
+        if (field->step == 0) {
+          field->step = 1;
+          if (ring_dist != num_tasks_ - 1) {
+            DispatchRecv("ring_gather", field->field_idx, prev_idx, chunk,
+                         ExpectTransfer(field));
+            return;
+          }
+        }
+        if (field->step == 1) {
+          field->step = 2;
+          if (ring_dist != num_tasks_ - 2) {
+            DispatchSend("ring_gather", field->field_idx, next_idx, chunk,
+                         ExpectTransfer(field));
+            return;
+          }
+        }
+        field->action = FA_GATHER;
+        field->step = 0;
+        break;
+      case FA_GATHER:
+        if (field->step == 0) {
+          field->step = 1;
+          mutex_lock l(mu_);
+          if (field->scatter_sends > 0) {
+            // TransferDone requeues the field after the last send.
+            field->waiting_for_scatter_sends = true;
+            return;
+          }
+        }
+        if (field->step == 1) {
+          field->step = 2;
+          int num_transfers = 0;
+          for (int si = 0; si < devices_per_task_; ++si) {
+            if (si == local_rank_) continue;
+            if (has_chunk) ++num_transfers;
+            if (field->segment_chunks[si].NumElements() > 0) ++num_transfers;
+          }
+          if (num_transfers > 0) {
+            {
+              mutex_lock l(mu_);
+              field->pending = num_transfers;
+              outstanding_ += num_transfers;
+            }
+            auto transfer_done = [this, field](const Status& s) {
+              TransferDone(field, /*scatter_send=*/false, s);
+            };
+            for (int si = 0; si < devices_per_task_; ++si) {
+              if (si == local_rank_) continue;
+              if (has_chunk) {
+                DispatchSend("gather", field->field_idx,
+                             DeviceIndex(task_, si), chunk, transfer_done);
+              }
+              if (field->segment_chunks[si].NumElements() > 0) {
+                DispatchRecv("gather", field->field_idx,
+                             DeviceIndex(task_, si),
+                             &field->segment_chunks[si], transfer_done);
+              }
+            }
+            return;
+          }
+        }
+        field->action = FA_DONE;
+        break;
+      case FA_DONE:
+        return;
+    }
+  }
+}
+
+Status HierarchicalRingReducer::Merge(Tensor* output, Tensor* input) {
+  if (!fast_merge_) {
+    return collective_util::ComputeBinOp(
+        col_ctx_->op_ctx, col_ctx_->op_params, col_ctx_->device,
+        col_params_->merge_op.get(), output, input);
+  }
+  const Eigen::ThreadPoolDevice& d = *col_ctx_->op_ctx->eigen_cpu_device();
+  const string& op = col_params_->merge_op->type_string();
+  switch (output->dtype()) {
+    case DT_FLOAT:
+      MergeInPlace<float>(d, op, output, *input);
+      break;
+    case DT_DOUBLE:
+      MergeInPlace<double>(d, op, output, *input);
+      break;
+    case DT_INT32:
+      MergeInPlace<int32>(d, op, output, *input);
+      break;
+    case DT_INT64:
+      MergeInPlace<int64>(d, op, output, *input);
+      break;
+    default:
+      return errors::Internal("Unexpected dtype ",
+                              DataTypeString(output->dtype()));
+  }
+  return Status::OK();
+}
+
+Status HierarchicalRingReducer::Finalize(Tensor* chunk) {
+  if (!col_params_->final_op) return Status::OK();
+  if (!fast_finalize_) {
+    return collective_util::ComputeBinOp(
+        col_ctx_->op_ctx, col_ctx_->op_params, col_ctx_->device,
+        col_params_->final_op.get(), chunk, &group_size_tensor_);
+  }
+  const Eigen::ThreadPoolDevice& d = *col_ctx_->op_ctx->eigen_cpu_device();
+  const int group_size = col_params_->group.group_size;
+  switch (chunk->dtype()) {
+    case DT_FLOAT:
+      DivideInPlace<float>(d, group_size, chunk);
+      break;
+    case DT_DOUBLE:
+      DivideInPlace<double>(d, group_size, chunk);
+      break;
+    case DT_INT32:
+      DivideInPlace<int32>(d, group_size, chunk);
+      break;
+    case DT_INT64:
+      DivideInPlace<int64>(d, group_size, chunk);
+      break;
+    default:
+      return errors::Internal("Unexpected dtype ",
+                              DataTypeString(chunk->dtype()));
+  }
+  return Status::OK();
+}
+
+StatusCallback HierarchicalRingReducer::ExpectTransfer(Field* field) {
+  {
+    mutex_lock l(mu_);
+    field->pending = 1;
+    ++outstanding_;
+  }
+  return [this, field](const Status& s) {
+    TransferDone(field, /*scatter_send=*/false, s);
+  };
+}
+
+void HierarchicalRingReducer::DispatchSend(const string& phase, int field_idx,
+                                           int dst_idx, const Tensor* src,
+                                           const StatusCallback& done) {
+  const string key =
+      HierarchicalRingBufKey(col_ctx_->exec_key, phase, field_idx,
+                             col_params_->default_rank, dst_idx);
+  VLOG(3) << "DispatchSend rank=" << col_params_->default_rank << " key "
+          << key << " chunk " << ca_->TBounds(*src);
+  col_ctx_->col_exec->PostToPeer(
+      col_params_->instance.device_names[dst_idx],
+      col_params_->instance.task_names[dst_idx], key, col_ctx_->device,
+      col_ctx_->op_ctx->op_device_context(),
+      col_ctx_->op_ctx->output_alloc_attr(0), src, col_ctx_->device_locality,
+      done);
+}
+
+void HierarchicalRingReducer::DispatchRecv(const string& phase, int field_idx,
+                                           int src_idx, Tensor* dst,
+                                           const StatusCallback& done) {
+  const string key =
+      HierarchicalRingBufKey(col_ctx_->exec_key, phase, field_idx, src_idx,
+                             col_params_->default_rank);
+  VLOG(3) << "DispatchRecv rank=" << col_params_->default_rank << " key "
+          << key << " chunk " << ca_->TBounds(*dst);
+  col_ctx_->col_exec->RecvFromPeer(
+      col_params_->instance.device_names[src_idx],
+      col_params_->instance.task_names[src_idx],
+      col_params_->task.is_local[src_idx], key, col_ctx_->device,
+      col_ctx_->op_ctx->op_device_context(),
+      col_ctx_->op_ctx->output_alloc_attr(0), dst, col_ctx_->device_locality,
+      0 /*dev_to_dev_stream_index*/, done);
+}
+
+void HierarchicalRingReducer::TransferDone(Field* field, bool scatter_send,
+                                           const Status& s) {
+  // Abort first: this object may be deleted as soon as the last transfer
+  // is accounted for.
+  if (!s.ok()) StartAbort(s);
+  mutex_lock l(mu_);
+  if (scatter_send) {
+    if (--field->scatter_sends == 0 && field->waiting_for_scatter_sends) {
+      field->waiting_for_scatter_sends = false;
+      ready_.push_back(field);
+    }
+  } else if (--field->pending == 0) {
+    ready_.push_back(field);
+  }
+  --outstanding_;
+  cv_.notify_all();
+}
+
+void HierarchicalRingReducer::StartAbort(const Status& s) {
+  bool abort_started = false;
+  {
+    mutex_lock l(mu_);
+    if (status_.ok()) {
+      LOG(ERROR) << "Aborting HierarchicalRingReduce with " << s;
+      abort_started = true;
+      status_.Update(s);
+    }
+    cv_.notify_all();
+  }
+  // Cancel the outstanding transfers of all devices.
+  if (abort_started) {
+    col_ctx_->col_exec->StartAbort(s);
+  }
+}
+
+namespace {
+REGISTER_COLLECTIVE(HierarchicalRingReduce, HierarchicalRingReducer);
+}  // namespace
+
+}  // namespace tensorflow
@@ -0,0 +1,162 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_COMMON_RUNTIME_HIERARCHICAL_RING_REDUCER_H_
+#define TENSORFLOW_CORE_COMMON_RUNTIME_HIERARCHICAL_RING_REDUCER_H_
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/common_runtime/base_collective_executor.h"
+#include "tensorflow/core/framework/collective.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+
+namespace tensorflow {
+class Device;
+
+// Two-level implementation of collective all-reduce for CPU devices.
+//
+// With L devices on each of T tasks, the tensor is split into L segments,
+// and device l of every task owns segment l. The all-reduce then runs in
+// three phases:
+//   1. Reduce-scatter within the task: every device sends each segment to
+//      its owner, which reduces the L values of its segment.
+//   2. Ring all-reduce across tasks: the T owners of a segment, one per
+//      task, reduce it over a ring, so that only 1/L of the tensor crosses
+//      task boundaries from each device.
+//   3. All-gather within the task: every owner sends its reduced segment to
+//      the other devices of its task.
+//
+// Each segment is split into fields that go through the three phases
+// independently, so that the transfers of some fields overlap the
+// reduction of others. Reductions with a standard merge_op or final_op run
+// in place on the Eigen CPU device of the op, instead of through an op
+// kernel.
+class HierarchicalRingReducer : public CollectiveImplementationInterface {
+ public:
+  HierarchicalRingReducer();
+  ~HierarchicalRingReducer() override = default;
+
+  // Establishes one subdiv per task, comprising the devices of that task.
+  // subdiv_rank[t] is the index of this device in subdiv t, or -1 if it
+  // belongs to another task. All tasks must have the same number of devices.
+  Status InitializeCollectiveParams(CollectiveParams* col_params) override;
+
+  // Initializes members of CollectiveContext not yet initialized, i.e. device
+  // and device_locality.  Also saves the CollectiveContext in this object.
+  Status InitializeCollectiveContext(
+      std::shared_ptr<CollectiveContext> col_ctx) override;
+
+  // No-op for hierarchical ring reducer.
+  Status InitializeCollectiveGroupRuntimeDetails(
+      CollGroupRuntimeDetails*) override {
+    return Status::OK();
+  }
+
+  // Begins async execution of the hierarchical ring reduce.
+  // Must be called in a blockable thread.
+  void Run(StatusCallback done) override;
+
+ private:
+  // The phase of a field.
+  enum FieldAction {
+    FA_SCATTER = 0,  // Reducing the values of the other local devices
+    FA_RING_REDUCE,  // First pass of the ring across tasks
+    FA_RING_GATHER,  // Second pass of the ring across tasks
+    FA_GATHER,       // Sending and receiving the reduced segments
+    FA_DONE,
+  };
+
+  // The state of one field of the segment owned by this device. The same
+  // field of the other segments is only transferred, in phases 1 and 3.
+  struct Field {
+    int field_idx = -1;
+    FieldAction action = FA_SCATTER;
+    // The step within the current phase.
+    int step = 0;
+    // True if tmp_chunk holds a value received for the next merge.
+    bool merge_tmp = false;
+    // Aliases of this field in every segment of the output.
+    std::vector<Tensor> segment_chunks;
+    Tensor tmp_chunk;
+    // Guarded by mu_. The transfers of the current step still in flight.
+    int pending = 0;
+    // Guarded by mu_. The phase 1 sends of the other segments still in
+    // flight, which must complete before phase 3 overwrites them.
+    int scatter_sends = 0;
+    bool waiting_for_scatter_sends = false;
+  };
+
+  // Returns the index in the CollectiveAdapter of field 'field_idx' of
+  // segment 'segment'.
+  int ChunkIndex(int segment, int field_idx) const {
+    return segment * num_fields_ + field_idx;
+  }
+
+  // Returns the index in the group of device 'local_rank' of task 'task'.
+  int DeviceIndex(int task, int local_rank) const;
+
+  // Runs all fields to completion, returning false if aborted.
+  bool RunAsyncParts();
+
+  // Advances 'field' until it waits for a transfer or is done.
+  void Advance(Field* field);
+
+  // Reduces 'input' into 'output' with the merge_op of the collective.
+  Status Merge(Tensor* output, Tensor* input);
+  // Applies the final_op of the collective to 'chunk'.
+  Status Finalize(Tensor* chunk);
+
+  // Returns the callback of the single transfer of the next step of 'field'.
+  StatusCallback ExpectTransfer(Field* field) TF_LOCKS_EXCLUDED(mu_);
+
+  void DispatchSend(const string& phase, int field_idx, int dst_idx,
+                    const Tensor* src, const StatusCallback& done);
+  void DispatchRecv(const string& phase, int field_idx, int src_idx,
+                    Tensor* dst, const StatusCallback& done);
+
+  // Called when a transfer of 'field' completes, and requeues the field if
+  // it was the last one it waited for.
+  void TransferDone(Field* field, bool scatter_send, const Status& s)
+      TF_LOCKS_EXCLUDED(mu_);
+
+  void StartAbort(const Status& s) TF_LOCKS_EXCLUDED(mu_);
+
+  std::shared_ptr<CollectiveContext> col_ctx_;
+  const CollectiveParams* col_params_;  // Not owned
+  StatusCallback done_;
+  std::unique_ptr<CollectiveAdapter> ca_;
+  bool fast_merge_;
+  bool fast_finalize_;
+  Tensor group_size_tensor_;
+
+  int num_tasks_;
+  int devices_per_task_;
+  int task_;
+  int local_rank_;
+  int num_fields_;
+  std::vector<Field> fields_;
+
+  mutex mu_;
+  condition_variable cv_;
+  std::deque<Field*> ready_ TF_GUARDED_BY(mu_);
+  int outstanding_ TF_GUARDED_BY(mu_);
+  Status status_ TF_GUARDED_BY(mu_);
+};
+
+}  // namespace tensorflow
+#endif  // TENSORFLOW_CORE_COMMON_RUNTIME_HIERARCHICAL_RING_REDUCER_H_
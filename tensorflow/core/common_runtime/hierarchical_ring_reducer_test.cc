@@ -0,0 +1,369 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/common_runtime/hierarchical_ring_reducer.h"
+
+#include <algorithm>
+#include <atomic>
+
+#include "absl/memory/memory.h"
+#include "tensorflow/core/common_runtime/base_collective_executor.h"
+#include "tensorflow/core/common_runtime/collective_rma_local.h"
+#include "tensorflow/core/common_runtime/device.h"
+#include "tensorflow/core/common_runtime/device_mgr.h"
+#include "tensorflow/core/common_runtime/device_resolver_local.h"
+#include "tensorflow/core/common_runtime/process_util.h"
+#include "tensorflow/core/common_runtime/test_collective_executor_mgr.h"
+#include "tensorflow/core/common_runtime/threadpool_device.h"
+#include "tensorflow/core/framework/collective.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def.pb.h"
+#include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/unbounded_work_queue.h"
+#include "tensorflow/core/public/session_options.h"
+#include "tensorflow/core/public/version.h"
+
+namespace tensorflow {
+namespace {
+
+// Wraps CollectiveRemoteAccessLocal with the ability to return an
+// error status to the N'th action.
+class FailTestRMA : public CollectiveRemoteAccessLocal {
+ public:
+  FailTestRMA(const DeviceMgr* dev_mgr, DeviceResolverInterface* dev_resolver,
+              std::shared_ptr<UnboundedWorkQueue> work_queue, int64 step_id,
+              int fail_after)
+      : CollectiveRemoteAccessLocal(dev_mgr, dev_resolver, work_queue, step_id),
+        fail_after_(fail_after) {}
+
+  bool MaybeFail(const StatusCallback& done) {
+    bool fail_now = false;
+    {
+      mutex_lock l(mu_);
+      if (fail_after_ > 0) {
+        fail_now = (--fail_after_ == 0);
+      }
+    }
+    if (fail_now) {
+      done(errors::Internal("Deliberate failure"));
+      return true;
+    }
+    return false;
+  }
+
+  void RecvFromPeer(const string& peer_device, const string& peer_task,
+                    bool peer_is_local, const string& key, Device* to_device,
+                    DeviceContext* to_device_ctx,
+                    const AllocatorAttributes& to_alloc_attr, Tensor* to_tensor,
+                    const DeviceLocality& client_locality,
+                    int dev_to_dev_stream_index,
+                    const StatusCallback& done) override {
+    if (MaybeFail(done)) return;
+    CollectiveRemoteAccessLocal::RecvFromPeer(
+        peer_device, peer_task, peer_is_local, key, to_device, to_device_ctx,
+        to_alloc_attr, to_tensor, client_locality, dev_to_dev_stream_index,
+        done);
+  }
+
+  void PostToPeer(const string& peer_device, const string& peer_task,
+                  const string& key, Device* from_device,
+                  DeviceContext* from_device_ctx,
+                  const AllocatorAttributes& from_alloc_attr,
+                  const Tensor* from_tensor,
+                  const DeviceLocality& client_locality,
+                  const StatusCallback& done) override {
+    if (MaybeFail(done)) return;
+    CollectiveRemoteAccessLocal::PostToPeer(
+        peer_device, peer_task, key, from_device, from_device_ctx,
+        from_alloc_attr, from_tensor, client_locality, done);
+  }
+
+  mutex mu_;
+  int fail_after_ TF_GUARDED_BY(mu_);
+};
+
+std::unique_ptr<OpKernel> GetKernel(const string& op, DataType dtype,
+                                    DeviceBase* device) {
+  NodeDef node_def;
+  TF_CHECK_OK(NodeDefBuilder(strings::StrCat(op, "_node"), op)
+                  .Attr("T", dtype)
+                  .Input(FakeInput(dtype))
+                  .Input(FakeInput(dtype))
+                  .Finalize(&node_def));
+  Status status;
+  std::unique_ptr<OpKernel> k = CreateOpKernel(
+      DEVICE_CPU, device, device->GetAllocator(AllocatorAttributes()),
+      node_def, TF_GRAPH_DEF_VERSION, &status);
+  TF_CHECK_OK(status);
+  return k;
+}
+
+static int64 kStepId = 123;
+
+class HierarchicalRingReducerTest : public ::testing::Test {
+ protected:
+  ~HierarchicalRingReducerTest() override {
+    for (auto i : instances_) delete i;
+    if (col_exec_) col_exec_->Unref();
+  }
+
+  void Init(int num_workers, int num_devices, DataType dtype, int fail_after) {
+    std::vector<std::unique_ptr<Device>> local_devices;
+    SessionOptions sess_opts;
+    sess_opts.env = Env::Default();
+    Bytes mem_limit(4 << 20);
+    DeviceLocality dev_locality;
+    for (int wi = 0; wi < num_workers; ++wi) {
+      for (int di = 0; di < num_devices; ++di) {
+        string dev_name =
+            strings::StrCat("/job:worker/replica:0/task:", wi, "/cpu:", di);
+        local_devices.push_back(absl::make_unique<ThreadPoolDevice>(
+            sess_opts, dev_name, mem_limit, dev_locality, cpu_allocator()));
+      }
+    }
+    dev_mgr_ = absl::make_unique<StaticDeviceMgr>(std::move(local_devices));
+    dev_resolver_ = absl::make_unique<DeviceResolverLocal>(dev_mgr_.get());
+    work_queue_ = std::make_shared<UnboundedWorkQueue>(Env::Default(), "test");
+    rma_ = new FailTestRMA(dev_mgr_.get(), dev_resolver_.get(), work_queue_,
+                           kStepId, fail_after);
+    col_exec_ = new BaseCollectiveExecutor(&col_exec_mgr_, rma_, kStepId,
+                                           dev_mgr_.get(), &gpu_ring_order_);
+    col_params_.name = "test_collective";
+    col_params_.group.group_key = 5;
+    col_params_.group.device_type = DEVICE_CPU;
+    col_params_.group.group_size = num_workers * num_devices;
+    col_params_.group.num_tasks = num_workers;
+    col_params_.instance.instance_key = 17;
+    col_params_.instance.type = REDUCTION_COLLECTIVE;
+    col_params_.instance.impl_details.collective_name =
+        "HierarchicalRingReduce";
+    col_params_.instance.data_type = dtype;
+    for (int wi = 0; wi < num_workers; ++wi) {
+      string task_name = strings::StrCat("/job:worker/replica:0/task:", wi);
+      col_params_.instance.num_devices_per_task[task_name] = num_devices;
+      for (int di = 0; di < num_devices; ++di) {
+        col_params_.instance.device_names.push_back(
+            strings::StrCat(task_name, "/cpu:", di));
+        col_params_.instance.task_names.push_back(task_name);
+        // This test runs in a single process so is_local is always true.
+        col_params_.task.is_local.push_back(true);
+      }
+    }
+    for (int rank = 0; rank < col_params_.group.group_size; ++rank) {
+      instances_.push_back(new DeviceInstance(rank, this));
+    }
+  }
+
+  void Reduce() {
+    std::atomic<int> done(0);
+    for (auto di : instances_) {
+      SchedClosure([di, &done] {
+        di->DoReduce();
+        ++done;
+      });
+    }
+    while (done < static_cast<int>(instances_.size())) {
+      Env::Default()->SleepForMicroseconds(1000);
+    }
+  }
+
+  template <typename T>
+  void RunTest(DataType dtype, int num_workers, int num_devices,
+               int tensor_len, const string& merge_op, int fail_after) {
+    Init(num_workers, num_devices, dtype, fail_after);
+    const int group_size = num_workers * num_devices;
+    std::vector<T> expected(tensor_len);
+    for (int di = 0; di < group_size; ++di) {
+      Tensor* t = &instances_[di]->tensor_;
+      *t = Tensor(dtype, TensorShape({tensor_len}));
+      for (int i = 0; i < tensor_len; ++i) {
+        T value = static_cast<T>((di * 7 + i) % 13);
+        t->flat<T>()(i) = value;
+        if (di == 0) {
+          expected[i] = value;
+        } else if (merge_op == "Add") {
+          expected[i] += value;
+        } else {
+          expected[i] = std::max(expected[i], value);
+        }
+      }
+    }
+    for (int i = 0; i < tensor_len; ++i) {
+      if (merge_op == "Add") expected[i] /= static_cast<T>(group_size);
+    }
+    for (auto di : instances_) di->merge_op_ = merge_op;
+    Reduce();
+    for (int di = 0; di < group_size; ++di) {
+      if (fail_after > 0) {
+        EXPECT_NE(
+            instances_[di]->status_.error_message().find("Deliberate failure"),
+            string::npos);
+        continue;
+      }
+      TF_EXPECT_OK(instances_[di]->status_);
+      auto actual = instances_[di]->tensor_.flat<T>();
+      for (int i = 0; i < tensor_len; ++i) {
+        EXPECT_EQ(expected[i], actual(i))
+            << "Mismatch at device " << di << " index " << i;
+      }
+    }
+  }
+
+  class DeviceInstance {
+   public:
+    DeviceInstance(int rank, HierarchicalRingReducerTest* parent)
+        : parent_(parent) {
+      col_params_.name = parent_->col_params_.name;
+      col_params_.group = parent_->col_params_.group;
+      col_params_.instance = parent_->col_params_.instance;
+      col_params_.task.is_local = parent_->col_params_.task.is_local;
+      col_params_.default_rank = rank;
+      TF_CHECK_OK(parent_->dev_mgr_->LookupDevice(
+          col_params_.instance.device_names[rank], &device_));
+      HierarchicalRingReducer reducer;
+      TF_CHECK_OK(reducer.InitializeCollectiveParams(&col_params_));
+    }
+
+    void DoReduce() {
+      const DataType dtype = col_params_.instance.data_type;
+      col_params_.merge_op = GetKernel(merge_op_, dtype, device_);
+      if (merge_op_ == "Add") {
+        col_params_.final_op = GetKernel("Div", dtype, device_);
+      }
+
+      // Prepare an OpKernelContext.
+      OpKernelContext::Params op_params;
+      op_params.step_id = kStepId;
+      op_params.device = device_;
+      gtl::InlinedVector<TensorValue, 4> inputs;
+      inputs.push_back(TensorValue(&tensor_));
+      op_params.inputs = &inputs;
+      gtl::InlinedVector<AllocatorAttributes, 4> input_aa(
+          {AllocatorAttributes()});
+      op_params.input_alloc_attrs = &input_aa;
+      DeviceContext* dev_ctx = new DeviceContext;
+      op_params.op_device_context = dev_ctx;
+      int forward_from = 0;
+      op_params.forward_from_array = &forward_from;
+      AllocatorAttributes generic_alloc_attr;
+      op_params.output_attr_array = &generic_alloc_attr;
+      op_params.op_kernel = col_params_.merge_op.get();
+      OpKernelContext ctx(&op_params, 1);
+
+      // We never actually execute the kernel, so we need to do the output
+      // allocation it would do, ourselves.
+      Tensor* output_tensor_ptr = nullptr;
+      TF_CHECK_OK(ctx.forward_input_or_allocate_output({0}, 0, tensor_.shape(),
+                                                       &output_tensor_ptr));
+
+      string exec_key =
+          strings::StrCat(col_params_.instance.instance_key, ":0:0");
+      HierarchicalRingReducer reducer;
+      auto col_ctx = std::make_shared<CollectiveContext>(
+          parent_->col_exec_, parent_->dev_mgr_.get(), &ctx, &op_params,
+          col_params_, exec_key, kStepId, &tensor_, output_tensor_ptr);
+      TF_CHECK_OK(reducer.InitializeCollectiveContext(col_ctx));
+      reducer.Run([this](Status s) { status_ = s; });
+      if (status_.ok()) {
+        CHECK(tensor_.CopyFrom(*ctx.mutable_output(0), tensor_.shape()));
+      }
+      dev_ctx->Unref();
+    }
+
+    HierarchicalRingReducerTest* parent_;
+    Device* device_;
+    CollectiveParams col_params_;
+    string merge_op_;
+    Tensor tensor_;
+    Status status_;
+  };
+
+  TestCollectiveExecutorMgr col_exec_mgr_;
+  CollectiveExecutor* col_exec_ = nullptr;
+  CollectiveRemoteAccessLocal* rma_;
+  std::unique_ptr<DeviceResolverLocal> dev_resolver_;
+  std::shared_ptr<UnboundedWorkQueue> work_queue_;
+  std::vector<DeviceInstance*> instances_;
+  CollectiveParams col_params_;
+  std::unique_ptr<DeviceMgr> dev_mgr_;
+  string gpu_ring_order_;
+};
+
+TEST_F(HierarchicalRingReducerTest, InitializeParams) {
+  Init(/*num_workers=*/3, /*num_devices=*/2, DT_FLOAT, /*fail_after=*/0);
+  const CollectiveParams& cp = instances_[3]->col_params_;
+  EXPECT_EQ((std::vector<std::vector<int>>{{0, 1}, {2, 3}, {4, 5}}),
+            cp.instance.impl_details.subdiv_permutations);
+  EXPECT_EQ((std::vector<int>{-1, 1, -1}), cp.subdiv_rank);
+}
+
+TEST_F(HierarchicalRingReducerTest, UnevenTasks) {
+  CollectiveParams cp;
+  cp.group.group_size = 3;
+  cp.group.device_type = DEVICE_CPU;
+  cp.instance.type = REDUCTION_COLLECTIVE;
+  cp.instance.impl_details.collective_name = "HierarchicalRingReduce";
+  cp.instance.task_names = {"/job:worker/replica:0/task:0",
+                            "/job:worker/replica:0/task:0",
+                            "/job:worker/replica:0/task:1"};
+  cp.default_rank = 0;
+  HierarchicalRingReducer reducer;
+  EXPECT_TRUE(
+      errors::IsInvalidArgument(reducer.InitializeCollectiveParams(&cp)));
+}
+
+TEST_F(HierarchicalRingReducerTest, OneTask) {
+  RunTest<float>(DT_FLOAT, 1, 4, 1001, "Add", 0);
+}
+
+TEST_F(HierarchicalRingReducerTest, OneDevicePerTask) {
+  RunTest<float>(DT_FLOAT, 4, 1, 1001, "Add", 0);
+}
+
+TEST_F(HierarchicalRingReducerTest, TwoLevels) {
+  RunTest<float>(DT_FLOAT, 2, 4, 4095, "Add", 0);
+}
+
+TEST_F(HierarchicalRingReducerTest, EmptyFields) {
+  RunTest<float>(DT_FLOAT, 3, 2, 1, "Add", 0);
+}
+
+TEST_F(HierarchicalRingReducerTest, ManyFields) {
+  // Ring chunks of 1.5 MB are split into two fields.
+  RunTest<float>(DT_FLOAT, 2, 2, 1536 * 1024, "Add", 0);
+}
+
+TEST_F(HierarchicalRingReducerTest, Double) {
+  RunTest<double>(DT_DOUBLE, 2, 3, 1001, "Add", 0);
+}
+
+TEST_F(HierarchicalRingReducerTest, Int32Maximum) {
+  RunTest<int32>(DT_INT32, 2, 3, 1001, "Maximum", 0);
+}
+
+TEST_F(HierarchicalRingReducerTest, Int64) {
+  RunTest<int64>(DT_INT64, 3, 2, 1001, "Add", 0);
+}
+
+TEST_F(HierarchicalRingReducerTest, Abort) {
+  RunTest<float>(DT_FLOAT, 2, 4, 9408, "Add", 7);
+}
+
+}  // namespace
+}  // namespace tensorflow
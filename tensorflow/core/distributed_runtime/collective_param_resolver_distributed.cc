@@ -15,10 +15,13 @@ limitations under the License.
 #include "tensorflow/core/distributed_runtime/collective_param_resolver_distributed.h"
 
 #include "absl/strings/escaping.h"
+#include "absl/strings/str_join.h"
 #include "tensorflow/core/distributed_runtime/cancellable_call.h"
 #include "tensorflow/core/distributed_runtime/device_resolver_distributed.h"
 #include "tensorflow/core/distributed_runtime/worker_cache.h"
+#include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/protobuf/config.pb.h"
+#include "tensorflow/core/util/env_var.h"
 
 namespace tensorflow {
 namespace {
@@ -46,6 +49,26 @@ class CompleteGroupCall : public CancellableCall {
   CompleteGroupResponse resp_;
 };
 
+void PopulateCompleteInstanceRequest(const CollGroupParams& group,
+                                     const CollInstanceParams& instance,
+                                     const string& node_name,
+                                     const string& device_name, bool is_source,
+                                     CompleteInstanceRequest* req) {
+  req->set_name(node_name);
+  req->set_type(instance.type);
+  req->set_data_type(instance.data_type);
+  instance.shape.AsProto(req->mutable_shape());
+  req->set_group_key(group.group_key);
+  req->set_group_size(group.group_size);
+  req->set_instance_key(instance.instance_key);
+  req->set_device_type(group.device_type.type_string());
+  for (int32 offset : instance.impl_details.subdiv_offsets) {
+    req->add_subdiv_offset(offset);
+  }
+  req->set_device(device_name);
+  req->set_is_source(is_source);
+}
+
 class CompleteInstanceCall : public CancellableCall {
  public:
   CompleteInstanceCall(const CollGroupParams& group,
@@ -54,19 +77,8 @@ class CompleteInstanceCall : public CancellableCall {
                        bool is_source, CancellationManager* cancel_mgr,
                        const string& remote_worker, WorkerCacheInterface* wc)
       : CancellableCall(cancel_mgr, remote_worker, wc) {
-    req_.set_name(node_name);
-    req_.set_type(instance.type);
-    req_.set_data_type(instance.data_type);
-    instance.shape.AsProto(req_.mutable_shape());
-    req_.set_group_key(group.group_key);
-    req_.set_group_size(group.group_size);
-    req_.set_instance_key(instance.instance_key);
-    req_.set_device_type(group.device_type.type_string());
-    for (int32 offset : instance.impl_details.subdiv_offsets) {
-      req_.add_subdiv_offset(offset);
-    }
-    req_.set_device(device_name);
-    req_.set_is_source(is_source);
+    PopulateCompleteInstanceRequest(group, instance, node_name, device_name,
+                                    is_source, &req_);
   }
 
   ~CompleteInstanceCall() override {}
@@ -90,6 +102,16 @@ CollectiveParamResolverDistributed::CollectiveParamResolverDistributed(
       group_leader_(task_name == config.experimental().collective_group_leader()
                         ? ""
                         : config.experimental().collective_group_leader()) {
+  Status status = ReadBoolFromEnvVar("TF_COLLECTIVE_CACHE_INSTANCE_SIGNATURES",
+                                     false, &cache_instance_signatures_);
+  if (!status.ok()) {
+    LOG(ERROR) << status.error_message();
+  }
+  status = ReadBoolFromEnvVar("TF_COLLECTIVE_BATCH_INSTANCE_REQUESTS", false,
+                              &batch_instance_requests_);
+  if (!status.ok()) {
+    LOG(ERROR) << status.error_message();
+  }
   VLOG(1) << "CompleteParamResolverDistributed ctor task={" << task_name
           << "} config.collective_group_leader={"
           << config.experimental().collective_group_leader() << "}"
@@ -152,19 +174,57 @@ void CollectiveParamResolverDistributed::CompleteGroupAsync(
 void CollectiveParamResolverDistributed::CompleteInstanceAsync(
     const CompleteInstanceRequest* request, CompleteInstanceResponse* response,
     CancellationManager* cancel_mgr, const StatusCallback& done) {
+  if (request->batch_size() == 0) {
+    CompleteOneInstanceAsync(*request, response, cancel_mgr, done);
+    return;
+  }
+  // Resolve the instances of the batch independently and respond once all
+  // of them are done.
+  struct BatchState {
+    mutex mu;
+    int pending TF_GUARDED_BY(mu);
+    Status status TF_GUARDED_BY(mu);
+  };
+  BatchState* state = new BatchState;
+  state->pending = request->batch_size() + 1;
+  StatusCallback instance_done = [state, done](const Status& s) {
+    Status status;
+    {
+      mutex_lock l(state->mu);
+      state->status.Update(s);
+      if (--state->pending > 0) return;
+      status = state->status;
+    }
+    delete state;
+    done(status);
+  };
+  std::vector<CompleteInstanceResponse*> batch_responses;
+  for (int i = 0; i < request->batch_size(); ++i) {
+    batch_responses.push_back(response->add_batch());
+  }
+  CompleteOneInstanceAsync(*request, response, cancel_mgr, instance_done);
+  for (int i = 0; i < request->batch_size(); ++i) {
+    CompleteOneInstanceAsync(request->batch(i), batch_responses[i], cancel_mgr,
+                             instance_done);
+  }
+}
+
+void CollectiveParamResolverDistributed::CompleteOneInstanceAsync(
+    const CompleteInstanceRequest& request, CompleteInstanceResponse* response,
+    CancellationManager* cancel_mgr, const StatusCallback& done) {
   CollectiveParams* cp = new CollectiveParams;
-  cp->name = request->name();
-  cp->group.group_key = request->group_key();
-  cp->group.group_size = request->group_size();
-  cp->group.device_type = DeviceType(request->device_type());
-  cp->instance.type = CollectiveType(request->type());
-  cp->instance.instance_key = request->instance_key();
-  cp->instance.data_type = request->data_type();
-  cp->instance.shape = TensorShape(request->shape());
-  for (int32 offset : request->subdiv_offset()) {
+  cp->name = request.name();
+  cp->group.group_key = request.group_key();
+  cp->group.group_size = request.group_size();
+  cp->group.device_type = DeviceType(request.device_type());
+  cp->instance.type = CollectiveType(request.type());
+  cp->instance.instance_key = request.instance_key();
+  cp->instance.data_type = request.data_type();
+  cp->instance.shape = TensorShape(request.shape());
+  for (int32 offset : request.subdiv_offset()) {
     cp->instance.impl_details.subdiv_offsets.push_back(offset);
   }
-  string* device = new string(request->device());
+  string* device = new string(request.device());
   VLOG(1) << "New cp " << cp << " for device " << *device << " : "
           << cp->ToString();
   StatusCallback done_and_cleanup = [cp, device, done](const Status& s) {
@@ -375,20 +435,19 @@ void CollectiveParamResolverDistributed::CompleteInstanceDistributed(
     return CompleteInstanceLocal(device, gr, cp, cp->is_source, done);
   } else if (InstanceIsCached(cp->instance.instance_key)) {
     return CompleteInstanceLocal(device, gr, cp, cp->is_source, done);
+  } else if (cp->instance.type != BROADCAST_COLLECTIVE &&
+             InstanceSignatureIsCached(gr, *cp)) {
+    return CompleteInstanceLocal(device, gr, cp, cp->is_source, done);
+  } else if (batch_instance_requests_ &&
+             cp->instance.type != BROADCAST_COLLECTIVE) {
+    EnqueueInstance(device, gr, cp, cancel_mgr, done);
   } else {
     CompleteInstanceCall* call = new CompleteInstanceCall(
         cp->group, cp->instance, cp->name, device, cp->is_source, cancel_mgr,
         group_leader_, worker_cache_);
     call->Start([this, device, gr, cp, call, done](const Status& s) {
       if (s.ok()) {
-        UpdateInstanceCache(
-            gr, cp, call->resp_, [this, device, gr, cp, done](const Status& s) {
-              if (!s.ok()) {
-                done(s);
-              } else {
-                CompleteInstanceLocal(device, gr, cp, cp->is_source, done);
-              }
-            });
+        InstanceResolved(device, gr, cp, call->resp_, done);
       } else {
         done(s);
       }
@@ -398,4 +457,152 @@ void CollectiveParamResolverDistributed::CompleteInstanceDistributed(
   }
 }
 
+void CollectiveParamResolverDistributed::InstanceResolved(
+    const string& device, const GroupRec* gr, CollectiveParams* cp,
+    const CompleteInstanceResponse& resp, const StatusCallback& done) {
+  UpdateInstanceCache(
+      gr, cp, resp, [this, device, gr, cp, done](const Status& s) {
+        if (!s.ok()) {
+          done(s);
+        } else {
+          if (cp->instance.type != BROADCAST_COLLECTIVE) {
+            CacheInstanceSignature(gr, *cp);
+          }
+          CompleteInstanceLocal(device, gr, cp, cp->is_source, done);
+        }
+      });
+}
+
+string CollectiveParamResolverDistributed::InstanceSignature(
+    const GroupRec* gr, const CollectiveParams& cp) {
+  string signature;
+  {
+    mutex_lock l(gr->mu);
+    signature = strings::StrCat(
+        absl::CEscape(gr->group.runtime_details.communicator_key), ";",
+        absl::StrJoin(gr->device_list, ","), ";");
+  }
+  strings::StrAppend(&signature, static_cast<int>(cp.instance.type), ";",
+                     static_cast<int>(cp.instance.data_type), ";",
+                     cp.instance.shape.DebugString(), ";",
+                     absl::StrJoin(cp.instance.impl_details.subdiv_offsets,
+                                   ","));
+  return signature;
+}
+
+bool CollectiveParamResolverDistributed::InstanceSignatureIsCached(
+    const GroupRec* gr, const CollectiveParams& cp) {
+  if (!cache_instance_signatures_) return false;
+  const string signature = InstanceSignature(gr, cp);
+  mutex_lock l(signature_mu_);
+  auto it = instance_signatures_.find(cp.group.group_key);
+  return it != instance_signatures_.end() && it->second.count(signature) > 0;
+}
+
+void CollectiveParamResolverDistributed::CacheInstanceSignature(
+    const GroupRec* gr, const CollectiveParams& cp) {
+  if (!cache_instance_signatures_) return;
+  const string signature = InstanceSignature(gr, cp);
+  mutex_lock l(signature_mu_);
+  instance_signatures_[cp.group.group_key].insert(signature);
+}
+
+void CollectiveParamResolverDistributed::EnqueueInstance(
+    const string& device, const GroupRec* gr, CollectiveParams* cp,
+    CancellationManager* cancel_mgr, const StatusCallback& done) {
+  PendingInstance pi{device,
+                     gr,
+                     cp,
+                     cancel_mgr,
+                     CancellationManager::kInvalidToken,
+                     std::make_shared<std::atomic<bool>>(false),
+                     done};
+  if (cancel_mgr != nullptr) {
+    pi.cancel_token = cancel_mgr->get_cancellation_token();
+    std::shared_ptr<std::atomic<bool>> finished = pi.finished;
+    const bool registered = cancel_mgr->RegisterCallback(
+        pi.cancel_token, [finished, done]() {
+          if (!finished->exchange(true)) {
+            done(errors::Cancelled("Instance resolution was cancelled"));
+          }
+        });
+    if (!registered) {
+      done(errors::Cancelled("Instance resolution was cancelled"));
+      return;
+    }
+  }
+  {
+    mutex_lock l(batch_mu_);
+    pending_instances_.push_back(std::move(pi));
+    if (batch_in_flight_) return;
+    batch_in_flight_ = true;
+  }
+  IssueInstanceBatch();
+}
+
+void CollectiveParamResolverDistributed::IssueInstanceBatch() {
+  std::vector<PendingInstance> batch;
+  {
+    mutex_lock l(batch_mu_);
+    // Instances whose step was cancelled while queued are not sent.
+    for (PendingInstance& pi : pending_instances_) {
+      if (!pi.finished->load()) batch.push_back(std::move(pi));
+    }
+    pending_instances_.clear();
+    if (batch.empty()) {
+      batch_in_flight_ = false;
+      return;
+    }
+  }
+  VLOG(1) << "IssueInstanceBatch of " << batch.size() << " instances";
+  const PendingInstance& first = batch[0];
+  CompleteInstanceCall* call = new CompleteInstanceCall(
+      first.cp->group, first.cp->instance, first.cp->name, first.device,
+      first.cp->is_source, &batch_cancel_mgr_, group_leader_, worker_cache_);
+  for (size_t i = 1; i < batch.size(); ++i) {
+    const PendingInstance& pi = batch[i];
+    PopulateCompleteInstanceRequest(pi.cp->group, pi.cp->instance, pi.cp->name,
+                                    pi.device, pi.cp->is_source,
+                                    call->req_.add_batch());
+  }
+  call->Start([this, batch, call](const Status& s) {
+    Status status = s;
+    if (status.ok() &&
+        static_cast<size_t>(call->resp_.batch_size()) + 1 != batch.size()) {
+      status = errors::Internal(
+          "CompleteInstanceResponse from group leader ", group_leader_,
+          " has ", call->resp_.batch_size() + 1, " instances, expected ",
+          batch.size(), ". Unset TF_COLLECTIVE_BATCH_INSTANCE_REQUESTS if ",
+          "the group leader does not support batched requests.");
+    }
+    for (size_t i = 0; i < batch.size(); ++i) {
+      const PendingInstance& pi = batch[i];
+      // The step of the instance was cancelled while its batch was in flight,
+      // and its cancellation manager may be gone.
+      if (pi.finished->exchange(true)) continue;
+      if (pi.cancel_mgr != nullptr) {
+        pi.cancel_mgr->TryDeregisterCallback(pi.cancel_token);
+      }
+      if (status.ok()) {
+        InstanceResolved(pi.device, pi.gr, pi.cp,
+                         i == 0 ? call->resp_ : call->resp_.batch(i - 1),
+                         pi.done);
+      } else {
+        pi.done(status);
+      }
+    }
+    delete call;
+    IssueInstanceBatch();
+  });
+}
+
+void CollectiveParamResolverDistributed::StartAbort(const Status& s) {
+  CollectiveParamResolverLocal::StartAbort(s);
+  {
+    mutex_lock l(signature_mu_);
+    instance_signatures_.clear();
+  }
+  batch_cancel_mgr_.StartCancel();
+}
+
 }  // namespace tensorflow
@@ -15,7 +15,14 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_COLLECTIVE_PARAM_RESOLVER_DISTRIBUTED_H_
 #define TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_COLLECTIVE_PARAM_RESOLVER_DISTRIBUTED_H_
 
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
 #include "tensorflow/core/common_runtime/collective_param_resolver_local.h"
+#include "tensorflow/core/framework/cancellation.h"
 
 namespace tensorflow {
 class ConfigProto;
@@ -45,6 +52,8 @@ class CollectiveParamResolverDistributed : public CollectiveParamResolverLocal {
                              CancellationManager* cancel_mgr,
                              const StatusCallback& done) override;
 
+  void StartAbort(const Status& s) override;
+
  protected:
   // Returns true iff there's an entry for this group_key in the
   // local group_table_.
@@ -82,8 +91,77 @@ class CollectiveParamResolverDistributed : public CollectiveParamResolverLocal {
                                    const StatusCallback& done)
       TF_LOCKS_EXCLUDED(instance_mu_, gr->mu, group_mu_);
 
+  // Resolves the single instance described by request.  CompleteInstanceAsync
+  // calls it once per instance of a batch.
+  void CompleteOneInstanceAsync(const CompleteInstanceRequest& request,
+                                CompleteInstanceResponse* response,
+                                CancellationManager* cancel_mgr,
+                                const StatusCallback& done);
+
+  // Finishes populating *cp once the group leader has given resp for it.
+  void InstanceResolved(const string& device, const GroupRec* gr,
+                        CollectiveParams* cp,
+                        const CompleteInstanceResponse& resp,
+                        const StatusCallback& done)
+      TF_LOCKS_EXCLUDED(instance_mu_, gr->mu, group_mu_, signature_mu_);
+
+  // The group leader gives nothing but a confirmation for instances other
+  // than broadcasts, so once it has confirmed an instance, later instances
+  // with the same group, type, data type, shape and subdivisions need not
+  // ask it again.  The signature includes the membership and communicator
+  // key of the group, so a different group record invalidates it.
+  string InstanceSignature(const GroupRec* gr, const CollectiveParams& cp)
+      TF_LOCKS_EXCLUDED(gr->mu);
+  bool InstanceSignatureIsCached(const GroupRec* gr,
+                                 const CollectiveParams& cp)
+      TF_LOCKS_EXCLUDED(signature_mu_);
+  void CacheInstanceSignature(const GroupRec* gr, const CollectiveParams& cp)
+      TF_LOCKS_EXCLUDED(signature_mu_);
+
+  // A non-broadcast instance waiting to be sent to the group leader.
+  struct PendingInstance {
+    string device;
+    const GroupRec* gr;
+    CollectiveParams* cp;
+    // The cancellation manager of the step, or nullptr.
+    CancellationManager* cancel_mgr;
+    CancellationToken cancel_token;
+    // Set once done has been called, either by the response of the group
+    // leader or by the cancellation of the step.
+    std::shared_ptr<std::atomic<bool>> finished;
+    StatusCallback done;
+  };
+
+  // Queues an instance for the group leader.  Instances queued while a batch
+  // is in flight are sent together in the next one.  Broadcasts are never
+  // batched, because the leader holds their response until every member of
+  // the group has called in.  Cancelling cancel_mgr fails the instance,
+  // without cancelling the other instances of its batch.
+  void EnqueueInstance(const string& device, const GroupRec* gr,
+                       CollectiveParams* cp, CancellationManager* cancel_mgr,
+                       const StatusCallback& done)
+      TF_LOCKS_EXCLUDED(batch_mu_);
+  void IssueInstanceBatch() TF_LOCKS_EXCLUDED(batch_mu_);
+
   WorkerCacheInterface* worker_cache_;  // Not owned
   const string group_leader_;
+
+  // Set by TF_COLLECTIVE_CACHE_INSTANCE_SIGNATURES.
+  bool cache_instance_signatures_ = false;
+  // Set by TF_COLLECTIVE_BATCH_INSTANCE_REQUESTS.  Requires a group leader
+  // that understands CompleteInstanceRequest.batch.
+  bool batch_instance_requests_ = false;
+
+  mutex signature_mu_;
+  // Maps group_key to the instance signatures confirmed for that group.
+  std::unordered_map<int32, std::unordered_set<string>> instance_signatures_
+      TF_GUARDED_BY(signature_mu_);
+
+  mutex batch_mu_;
+  bool batch_in_flight_ TF_GUARDED_BY(batch_mu_) = false;
+  std::vector<PendingInstance> pending_instances_ TF_GUARDED_BY(batch_mu_);
+  // Cancels batched requests on abort, since they serve several steps.
+  CancellationManager batch_cancel_mgr_;
 };
 
 }  // namespace tensorflow
@@ -15,6 +15,9 @@ limitations under the License.
 
 #include "tensorflow/core/distributed_runtime/collective_param_resolver_distributed.h"
 
+#include <functional>
+#include <vector>
+
 #include "tensorflow/core/common_runtime/device_mgr.h"
 #include "tensorflow/core/distributed_runtime/device_resolver_distributed.h"
 #include "tensorflow/core/distributed_runtime/test_utils.h"
@@ -22,6 +25,7 @@ limitations under the License.
 #include "tensorflow/core/lib/core/notification.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/util/device_name_utils.h"
@@ -72,10 +76,57 @@ class FakeWorker : public TestWorkerInterface {
                              const CompleteInstanceRequest* request,
                              CompleteInstanceResponse* response,
                              StatusCallback done) override {
+    {
+      mutex_lock l(mu_);
+      ++num_complete_instance_calls_;
+      num_batched_instances_ += request->batch_size();
+      if (hold_instance_calls_) {
+        held_instance_calls_.push_back([this, request, response, done]() {
+          param_resolver_->CompleteInstanceAsync(request, response, &cm_,
+                                                 done);
+        });
+        return;
+      }
+    }
     param_resolver_->CompleteInstanceAsync(request, response, &cm_, done);
   }
 
+  int num_complete_instance_calls() {
+    mutex_lock l(mu_);
+    return num_complete_instance_calls_;
+  }
+
+  // The number of instances received in the batch field of requests.
+  int num_batched_instances() {
+    mutex_lock l(mu_);
+    return num_batched_instances_;
+  }
+
+  // Instance requests received from now on are not answered until
+  // ReleaseInstanceCalls() is called.
+  void HoldInstanceCalls() {
+    mutex_lock l(mu_);
+    hold_instance_calls_ = true;
+  }
+
+  void ReleaseInstanceCalls() {
+    std::vector<std::function<void()>> calls;
+    {
+      mutex_lock l(mu_);
+      hold_instance_calls_ = false;
+      calls.swap(held_instance_calls_);
+    }
+    for (auto& call : calls) {
+      call();
+    }
+  }
+
  private:
+  mutex mu_;
+  int num_complete_instance_calls_ TF_GUARDED_BY(mu_) = 0;
+  int num_batched_instances_ TF_GUARDED_BY(mu_) = 0;
+  bool hold_instance_calls_ TF_GUARDED_BY(mu_) = false;
+  std::vector<std::function<void()>> held_instance_calls_ TF_GUARDED_BY(mu_);
   string name_;
   DeviceMgr* device_mgr_;
   CancellationManager cm_;
@@ -352,5 +403,80 @@ TEST_F(DeviceResDistTest, Workers4Devices3) {
   ValidateCollectiveParams(num_workers, num_devices);
 }
 
+TEST_F(DeviceResDistTest, BatchedInstances) {
+  setenv("TF_COLLECTIVE_BATCH_INSTANCE_REQUESTS", "1", 1);
+  const int num_workers = 2;
+  const int num_devices = 3;
+  DefineWorkers(num_workers, num_devices, "CPU", false);
+  unsetenv("TF_COLLECTIVE_BATCH_INSTANCE_REQUESTS");
+  DefineCollectiveParams(num_workers, num_devices);
+  // workers_[0] is the group leader.  Hold the first instance request of
+  // task 1 there, so that the other devices of task 1 queue behind it.
+  workers_[0]->HoldInstanceCalls();
+  IssueRequests(num_workers, num_devices);
+  while (workers_[0]->num_complete_instance_calls() < 1) {
+    Env::Default()->SleepForMicroseconds(1000);
+  }
+  Env::Default()->SleepForMicroseconds(100 * 1000);
+  workers_[0]->ReleaseInstanceCalls();
+  ValidateCollectiveParams(num_workers, num_devices);
+  EXPECT_GE(workers_[0]->num_batched_instances(), 1);
+  EXPECT_LT(workers_[0]->num_complete_instance_calls(), num_devices);
+}
+
+TEST_F(DeviceResDistTest, BatchedInstancesAreCancelledWithTheirStep) {
+  setenv("TF_COLLECTIVE_BATCH_INSTANCE_REQUESTS", "1", 1);
+  const int num_workers = 2;
+  const int num_devices = 3;
+  DefineWorkers(num_workers, num_devices, "CPU", false);
+  unsetenv("TF_COLLECTIVE_BATCH_INSTANCE_REQUESTS");
+  DefineCollectiveParams(num_workers, num_devices);
+  workers_[0]->HoldInstanceCalls();
+  IssueRequests(num_workers, num_devices);
+  while (workers_[0]->num_complete_instance_calls() < 1) {
+    Env::Default()->SleepForMicroseconds(1000);
+  }
+  // Both the instance in flight and the queued ones fail with the step.
+  cm_.StartCancel();
+  {
+    mutex_lock l(mu_);
+    while (num_done_ < num_workers * num_devices) {
+      done_.wait(l);
+    }
+  }
+  for (int idx = num_devices; idx < num_workers * num_devices; ++idx) {
+    EXPECT_TRUE(errors::IsCancelled(status_[idx])) << status_[idx];
+  }
+  // The late response to the instance in flight is dropped.
+  workers_[0]->ReleaseInstanceCalls();
+  EXPECT_EQ(workers_[0]->num_complete_instance_calls(), 1);
+}
+
+TEST_F(DeviceResDistTest, CachedInstanceSignatures) {
+  setenv("TF_COLLECTIVE_CACHE_INSTANCE_SIGNATURES", "1", 1);
+  const int num_workers = 2;
+  const int num_devices = 3;
+  DefineWorkers(num_workers, num_devices, "CPU", false);
+  unsetenv("TF_COLLECTIVE_CACHE_INSTANCE_SIGNATURES");
+  DefineCollectiveParams(num_workers, num_devices);
+  IssueRequests(num_workers, num_devices);
+  ValidateCollectiveParams(num_workers, num_devices);
+  // workers_[0] is the group leader.
+  const int num_calls = workers_[0]->num_complete_instance_calls();
+  EXPECT_GE(num_calls, 1);
+  EXPECT_EQ(workers_[0]->num_batched_instances(), 0);
+
+  // A new instance with the same signature is resolved without asking the
+  // group leader.
+  cp_.clear();
+  DefineCollectiveParams(num_workers, num_devices);
+  for (CollectiveParams& cp : cp_) {
+    cp.instance.instance_key = 4;
+  }
+  IssueRequests(num_workers, num_devices);
+  ValidateCollectiveParams(num_workers, num_devices);
+  EXPECT_EQ(workers_[0]->num_complete_instance_calls(), num_calls);
+}
+
 }  // namespace
 }  // namespace tensorflow
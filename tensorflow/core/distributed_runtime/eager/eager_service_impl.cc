@@ -521,13 +521,53 @@ Status EagerServiceImpl::Enqueue(const EnqueueRequest* request,
   TF_RETURN_IF_ERROR(GetServerContext(request->context_id(), &context));
   core::ScopedUnref context_unref(context);
 
+  if (request->batched_request_size_size() == 0) {
+    return EnqueueItems(context, request->queue(), 0, request->queue_size(),
+                        response, stream_id);
+  }
+  int64 num_items = 0;
+  for (int size : request->batched_request_size()) {
+    if (size < 0) {
+      return errors::InvalidArgument(
+          "Batched enqueue request has a request of ", size, " items");
+    }
+    num_items += size;
+  }
+  if (num_items != request->queue_size()) {
+    return errors::InvalidArgument(
+        "The sizes of the requests of a batched enqueue request do not add "
+        "up to its ",
+        request->queue_size(), " items");
+  }
+  int begin = 0;
+  for (int size : request->batched_request_size()) {
+    Status s = EnqueueItems(context, request->queue(), begin, begin + size,
+                            response, stream_id);
+    // The items skipped after an error get an empty response, so that the
+    // client can find the responses of the next request.
+    while (response->queue_response_size() < begin + size) {
+      response->add_queue_response();
+    }
+    EnqueueStatus* status = response->add_batched_request_status();
+    status->set_code(s.code());
+    status->set_error_message(s.error_message());
+    begin += size;
+  }
+  return Status::OK();
+}
+
+Status EagerServiceImpl::EnqueueItems(
+    ServerContext* context,
+    const protobuf::RepeatedPtrField<QueueItem>& queue, int begin, int end,
+    EnqueueResponse* response, uint64 stream_id) {
   EagerExecutor& executor =
       stream_id == kInvalidStreamId
           ? context->Context()->Executor()
           : context->Context()->RemoteMgr()->GetOrCreateExecutorForStream(
                 stream_id);
   Status s;
-  for (const auto& item : request->queue()) {
+  for (int i = begin; i < end; ++i) {
+    const QueueItem& item = queue.Get(i);
     auto* queue_response = response->add_queue_response();
     if (item.has_operation()) {
       s = ExecuteOp(item.operation(), context->Context(), &executor,
@@ -208,6 +208,11 @@ class EagerServiceImpl {
   };
 
  private:
+  // Runs the items [begin, end) of 'queue', and stops at the first error.
+  Status EnqueueItems(ServerContext* context,
+                      const protobuf::RepeatedPtrField<QueueItem>& queue,
+                      int begin, int end, EnqueueResponse* response,
+                      uint64 stream_id);
   Status ExecuteOp(const Operation& operation, EagerContext* eager_context,
                    EagerExecutor* eager_executor,
                    QueueResponse* queue_response);
@@ -27,6 +27,7 @@ limitations under the License.
 #include "tensorflow/core/distributed_runtime/test_utils.h"
 #include "tensorflow/core/distributed_runtime/worker_env.h"
 #include "tensorflow/core/framework/attr_value.pb.h"
+#include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/lib/random/random.h"
 #include "tensorflow/core/lib/strings/strcat.h"
@@ -455,6 +456,95 @@ TEST_F(EagerServiceImplTest, BasicTest) {
                                                &close_context_response));
 }
 
+// Test that each request of a batched enqueue request runs independently.
+TEST_F(EagerServiceImplTest, BatchedEnqueueTest) {
+  TestEagerServiceImpl eager_service_impl(&worker_env_);
+
+  uint64 context_id = random::New64();
+
+  CreateContextRequest request;
+  request.mutable_server_def()->set_job_name("localhost");
+  request.mutable_server_def()->set_task_index(0);
+  request.set_context_id(context_id);
+  CreateContextResponse response;
+
+  TF_ASSERT_OK(eager_service_impl.CreateContext(&request, &response));
+
+  std::unordered_map<string, AttrValue> const_attrs;
+  AttrValue val;
+  val.set_type(tensorflow::DataType::DT_FLOAT);
+  const_attrs.insert({"dtype", val});
+  val.Clear();
+  SetTensorProto(val.mutable_tensor());
+  const_attrs.insert({"value", val});
+
+  std::unordered_map<string, AttrValue> attrs;
+  val.Clear();
+  val.set_type(tensorflow::DataType::DT_FLOAT);
+  attrs.insert({"T", val});
+  val.Clear();
+  val.set_b(false);
+  attrs.insert({"transpose_a", val});
+  attrs.insert({"transpose_b", val});
+
+  const string device = "/job:localhost/replica:0/task:0/device:CPU:0";
+  EnqueueRequest remote_enqueue_request;
+  remote_enqueue_request.set_context_id(context_id);
+  // The second request fails since op 99 does not exist, and skips its second
+  // item.
+  AddOperationToEnqueueRequest(1, "Const", {}, const_attrs, device,
+                               &remote_enqueue_request);
+  AddOperationToEnqueueRequest(
+      2, "MatMul", {std::make_pair(99, 0), std::make_pair(99, 0)}, attrs,
+      device, &remote_enqueue_request);
+  AddOperationToEnqueueRequest(3, "Const", {}, const_attrs, device,
+                               &remote_enqueue_request);
+  AddOperationToEnqueueRequest(4, "Const", {}, const_attrs, device,
+                               &remote_enqueue_request);
+  remote_enqueue_request.add_batched_request_size(1);
+  remote_enqueue_request.add_batched_request_size(2);
+  remote_enqueue_request.add_batched_request_size(1);
+
+  EnqueueResponse remote_enqueue_response;
+  TF_ASSERT_OK(eager_service_impl.Enqueue(&remote_enqueue_request,
+                                          &remote_enqueue_response));
+  EXPECT_EQ(4, remote_enqueue_response.queue_response_size());
+  const auto& statuses = remote_enqueue_response.batched_request_status();
+  ASSERT_EQ(3, statuses.size());
+  EXPECT_EQ(error::OK, statuses.Get(0).code());
+  EXPECT_NE(error::OK, statuses.Get(1).code());
+  EXPECT_FALSE(statuses.Get(1).error_message().empty());
+  EXPECT_EQ(error::OK, statuses.Get(2).code());
+
+  tensorflow::TensorHandle* tensor_handle;
+  TF_EXPECT_OK(eager_service_impl.GetTensorHandle(
+      context_id, RemoteTensorHandleInternal(1, 0), &tensor_handle));
+  EXPECT_FALSE(eager_service_impl
+                   .GetTensorHandle(context_id,
+                                    RemoteTensorHandleInternal(3, 0),
+                                    &tensor_handle)
+                   .ok());
+  TF_EXPECT_OK(eager_service_impl.GetTensorHandle(
+      context_id, RemoteTensorHandleInternal(4, 0), &tensor_handle));
+
+  // The sizes of the requests must add up to the number of items.
+  EnqueueRequest bad_request;
+  bad_request.set_context_id(context_id);
+  AddOperationToEnqueueRequest(5, "Const", {}, const_attrs, device,
+                               &bad_request);
+  bad_request.add_batched_request_size(2);
+  EnqueueResponse bad_response;
+  EXPECT_TRUE(errors::IsInvalidArgument(
+      eager_service_impl.Enqueue(&bad_request, &bad_response)));
+
+  CloseContextRequest close_context_request;
+  close_context_request.set_context_id(context_id);
+  close_context_request.set_context_view_id(0);
+  CloseContextResponse close_context_response;
+  TF_ASSERT_OK(eager_service_impl.CloseContext(&close_context_request,
+                                               &close_context_response));
+}
+
 class EagerServiceImplFunctionTest : public EagerServiceImplTest {
  public:
   EagerServiceImplFunctionTest() : EagerServiceImplTest() {}
@@ -43,6 +43,8 @@ limitations under the License.
 #include "tensorflow/core/graph/graph_partition.h"
 #include "tensorflow/core/graph/validate.h"
 #include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/monitoring/counter.h"
+#include "tensorflow/core/lib/strings/proto_serialization.h"
 #include "tensorflow/core/lib/strings/stringprintf.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/logging.h"
@@ -56,6 +58,47 @@ limitations under the License.
 
 namespace tensorflow {
 
+namespace {
+auto* graph_registrations = monitoring::Counter<1>::New(
+    "/tensorflow/core/graph_mgr/registrations",
+    "The number of graphs registered by GraphMgr, by whether they were built "
+    "or found in the registration cache.",
+    "source");
+
+// Sets 'fingerprint' to the fingerprint of the deterministic serialization
+// of 'msg'. Returns false if it cannot be serialized.
+bool ProtoFingerprint(const protobuf::MessageLite& msg,
+                      Fprint128* fingerprint) {
+  string serialized;
+  if (!SerializeToStringDeterministic(msg, &serialized)) return false;
+  *fingerprint = Fingerprint128(serialized);
+  return true;
+}
+
+// Sets 'fingerprint' to the fingerprint of everything that GraphMgr::InitItem
+// builds an item from. Returns false if some part cannot be serialized, in
+// which case the registration must not be cached.
+bool RegistrationFingerprint(const string& session_handle,
+                             const GraphDef& gdef,
+                             const GraphOptions& graph_options,
+                             const DebugOptions& debug_options,
+                             const ConfigProto& config_proto,
+                             int64 collective_graph_key,
+                             Fprint128* fingerprint) {
+  Fprint128 parts[6] = {Fingerprint128(session_handle),
+                        {static_cast<uint64>(collective_graph_key), 0}};
+  if (!ProtoFingerprint(gdef, &parts[2]) ||
+      !ProtoFingerprint(graph_options, &parts[3]) ||
+      !ProtoFingerprint(debug_options, &parts[4]) ||
+      !ProtoFingerprint(config_proto, &parts[5])) {
+    return false;
+  }
+  *fingerprint = Fingerprint128(
+      StringPiece(reinterpret_cast<const char*>(parts), sizeof(parts)));
+  return true;
+}
+}  // namespace
+
 GraphMgr::GraphMgr(const WorkerEnv* worker_env, const DeviceMgr* device_mgr)
     : worker_env_(worker_env), device_mgr_(device_mgr), table_(5) {
   // The default value of sync_on_finish will be flipped soon and this
@@ -65,10 +108,16 @@ GraphMgr::GraphMgr(const WorkerEnv* worker_env, const DeviceMgr* device_mgr)
   if (!status.ok()) {
     LOG(ERROR) << status.error_message();
   }
+  status = ReadInt64FromEnvVar("TF_GRAPH_MGR_REGISTRATION_CACHE_SIZE", 0,
+                               &registration_cache_size_);
+  if (!status.ok()) {
+    LOG(ERROR) << status.error_message();
+  }
 }
 
 GraphMgr::~GraphMgr() {
   for (const auto& p : table_) p.second->Unref();
+  for (const auto& p : registration_list_) p.second->Unref();
 }
 
 GraphMgr::Item::~Item() {
@@ -293,17 +342,71 @@ Status GraphMgr::InitItem(
   return Status::OK();
 }
 
+GraphMgr::Item* GraphMgr::LookupRegistration(const Fprint128& fingerprint) {
+  mutex_lock l(mu_);
+  auto iter = registration_cache_.find(fingerprint);
+  if (iter == registration_cache_.end()) return nullptr;
+  registration_list_.splice(registration_list_.begin(), registration_list_,
+                            iter->second);
+  Item* item = iter->second->second;
+  item->Ref();
+  return item;
+}
+
+void GraphMgr::CacheRegistration(const Fprint128& fingerprint, Item* item) {
+  std::vector<Item*> evicted;
+  {
+    mutex_lock l(mu_);
+    // Another registration of the same graph may have been cached while this
+    // one was being built.
+    if (registration_cache_.count(fingerprint) > 0) return;
+    item->Ref();
+    registration_list_.emplace_front(fingerprint, item);
+    registration_cache_[fingerprint] = registration_list_.begin();
+    while (static_cast<int64>(registration_list_.size()) >
+           registration_cache_size_) {
+      registration_cache_.erase(registration_list_.back().first);
+      evicted.push_back(registration_list_.back().second);
+      registration_list_.pop_back();
+    }
+  }
+  for (Item* evicted_item : evicted) evicted_item->Unref();
+}
+
+void GraphMgr::ClearRegistrationCache() {
+  RegistrationList registrations;
+  {
+    mutex_lock l(mu_);
+    registrations.swap(registration_list_);
+    registration_cache_.clear();
+  }
+  for (const auto& p : registrations) p.second->Unref();
+}
+
 Status GraphMgr::Register(
     const string& handle, const GraphDef& gdef, WorkerSession* session,
     const GraphOptions& graph_options, const DebugOptions& debug_options,
     const ConfigProto& config_proto, int64 collective_graph_key,
     DistributedFunctionLibraryRuntime* cluster_flr, string* graph_handle) {
-  Item* item = new Item;
-  Status s = InitItem(handle, gdef, session, graph_options, debug_options,
-                      config_proto, collective_graph_key, cluster_flr, item);
-  if (!s.ok()) {
-    item->Unref();
-    return s;
+  Fprint128 fingerprint;
+  const bool cacheable =
+      registration_cache_size_ > 0 &&
+      RegistrationFingerprint(handle, gdef, graph_options, debug_options,
+                              config_proto, collective_graph_key,
+                              &fingerprint);
+  Item* item = cacheable ? LookupRegistration(fingerprint) : nullptr;
+  if (item != nullptr) {
+    graph_registrations->GetCell("cache")->IncrementBy(1);
+  } else {
+    item = new Item;
+    Status s = InitItem(handle, gdef, session, graph_options, debug_options,
+                        config_proto, collective_graph_key, cluster_flr, item);
+    if (!s.ok()) {
+      item->Unref();
+      return s;
+    }
+    graph_registrations->GetCell("build")->IncrementBy(1);
+    if (cacheable) CacheRegistration(fingerprint, item);
   }
 
   // Inserts one item into table_.
@@ -311,7 +414,8 @@ Status GraphMgr::Register(
     mutex_lock l(mu_);
     *graph_handle =
         strings::Printf("%016llx", static_cast<long long>(++next_id_));
-    item->handle = *graph_handle;
+    // The handle of a cached item is the one of its first registration.
+    if (item->handle.empty()) item->handle = *graph_handle;
     CHECK(table_.insert({*graph_handle, item}).second);
   }
   return Status::OK();
@@ -347,6 +451,7 @@ Status GraphMgr::DeregisterAll() {
   for (auto item : items) {
     item->Unref();
   }
+  ClearRegistrationCache();
   return Status::OK();
 }
 
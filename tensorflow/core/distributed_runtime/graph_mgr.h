@@ -16,7 +16,9 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_GRAPH_MGR_H_
 #define TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_GRAPH_MGR_H_
 
+#include <list>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "tensorflow/core/common_runtime/costmodel_manager.h"
@@ -29,6 +31,7 @@ limitations under the License.
 #include "tensorflow/core/framework/cost_graph.pb.h"
 #include "tensorflow/core/framework/function.h"
 #include "tensorflow/core/lib/core/refcount.h"
+#include "tensorflow/core/platform/fingerprint.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/macros.h"
 #include "tensorflow/core/platform/mutex.h"
@@ -57,6 +60,15 @@ class WorkerSession;
 //
 // Multiple threads can call GraphMgr methods concurrently.
 //
+// If TF_GRAPH_MGR_REGISTRATION_CACHE_SIZE is set to a positive number,
+// GraphMgr keeps up to that many built graphs, even after they are
+// deregistered, and registers identical graphs again without rebuilding
+// them. Graphs are identical if they have the same session handle, GraphDef,
+// options and collective graph key. A graph registered from the cache shares
+// its executors and kernels, including the state of stateful kernels, with
+// the earlier registrations of the same session, like the kernels of nodes
+// shared by several graphs of a session.
+//
 // E.g.,
 //   GraphMgr gmgr(worker_env);
 //   string handle;
@@ -102,9 +114,13 @@ class GraphMgr {
   // Deregisters a graph.
   Status Deregister(const string& handle);
 
-  // Deregister all graphs.
+  // Deregister all graphs, and clears the registration cache.
   Status DeregisterAll();
 
+  // Drops the graphs kept for future registrations, e.g. because the
+  // resources that their kernels refer to were cleared.
+  void ClearRegistrationCache();
+
  private:
   typedef GraphMgr ME;
 
@@ -163,6 +179,24 @@ class GraphMgr {
   // mechanism to gc these graphs.
   std::unordered_map<string, Item*> table_;
 
+  // Registration cache, mapping the fingerprint of a registration to its
+  // item, which holds one ref for the cache. The list is ordered from the
+  // most to the least recently registered.
+  typedef std::list<std::pair<Fprint128, Item*>> RegistrationList;
+  int64 registration_cache_size_ = 0;
+  RegistrationList registration_list_ TF_GUARDED_BY(mu_);
+  std::unordered_map<Fprint128, RegistrationList::iterator, Fprint128Hasher>
+      registration_cache_ TF_GUARDED_BY(mu_);
+
+  // Returns the item cached for 'fingerprint' with one more ref, or nullptr.
+  Item* LookupRegistration(const Fprint128& fingerprint)
+      TF_LOCKS_EXCLUDED(mu_);
+
+  // Adds 'item' to the registration cache, evicting the least recently
+  // registered items if it is full.
+  void CacheRegistration(const Fprint128& fingerprint, Item* item)
+      TF_LOCKS_EXCLUDED(mu_);
+
   void StartParallelExecutors(const string& handle, int64 step_id, Item* item,
                               Rendezvous* rendezvous,
                               CollectiveExecutor::Handle* ce_handle,
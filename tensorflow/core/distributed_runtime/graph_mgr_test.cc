@@ -0,0 +1,191 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/distributed_runtime/graph_mgr.h"
+
+#include <stdlib.h>
+
+#include "absl/memory/memory.h"
+#include "tensorflow/core/common_runtime/device_factory.h"
+#include "tensorflow/core/common_runtime/device_mgr.h"
+#include "tensorflow/core/distributed_runtime/worker_env.h"
+#include "tensorflow/core/framework/graph.pb.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/graph/testlib.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/monitoring/collection_registry.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace {
+
+constexpr char kDevice[] = "/job:localhost/replica:0/task:0/device:CPU:0";
+
+// Returns the number of registrations counted for 'source' ("build" or
+// "cache") so far.
+int64 GetRegistrations(const string& source) {
+  monitoring::CollectionRegistry::CollectMetricsOptions options;
+  options.collect_metric_descriptors = false;
+  auto metrics =
+      monitoring::CollectionRegistry::Default()->CollectMetrics(options);
+  auto it = metrics->point_set_map.find(
+      "/tensorflow/core/graph_mgr/registrations");
+  if (it == metrics->point_set_map.end()) return 0;
+  for (const auto& point : it->second->points) {
+    if (point->labels.size() == 1 && point->labels[0].value == source) {
+      return point->int64_value;
+    }
+  }
+  return 0;
+}
+
+// Returns a graph that outputs 'value'.
+GraphDef ConstantGraph(float value) {
+  Graph graph(OpRegistry::Global());
+  Tensor tensor(DT_FLOAT, TensorShape({}));
+  tensor.scalar<float>()() = value;
+  test::graph::Constant(&graph, tensor, "c");
+  GraphDef gdef;
+  graph.ToGraphDef(&gdef);
+  for (NodeDef& node : *gdef.mutable_node()) node.set_device(kDevice);
+  return gdef;
+}
+
+class GraphMgrTest : public ::testing::Test {
+ protected:
+  GraphMgrTest() {
+    device_mgr_ = absl::make_unique<StaticDeviceMgr>(
+        DeviceFactory::NewDevice("CPU", {}, "/job:localhost/replica:0/task:0"));
+    env_.env = Env::Default();
+    env_.local_devices = device_mgr_->ListDevices();
+    env_.device_mgr = device_mgr_.get();
+  }
+
+  // Creates the graph manager, with a registration cache of 'cache_size'
+  // graphs.
+  void CreateGraphMgr(const char* cache_size) {
+    setenv("TF_GRAPH_MGR_REGISTRATION_CACHE_SIZE", cache_size, 1);
+    graph_mgr_ = absl::make_unique<GraphMgr>(&env_, device_mgr_.get());
+    unsetenv("TF_GRAPH_MGR_REGISTRATION_CACHE_SIZE");
+  }
+
+  // Registers 'gdef' for 'session', and returns the number of graphs that
+  // were built rather than found in the cache.
+  int64 Register(const string& session, const GraphDef& gdef,
+                 string* graph_handle) {
+    const int64 builds = GetRegistrations("build");
+    const int64 hits = GetRegistrations("cache");
+    TF_CHECK_OK(graph_mgr_->Register(session, gdef, /*session=*/nullptr,
+                                     GraphOptions(), DebugOptions(),
+                                     ConfigProto(),
+                                     /*collective_graph_key=*/0,
+                                     /*cluster_flr=*/nullptr, graph_handle));
+    EXPECT_EQ(1, GetRegistrations("build") - builds +
+                     GetRegistrations("cache") - hits);
+    return GetRegistrations("build") - builds;
+  }
+
+  std::unique_ptr<DeviceMgr> device_mgr_;
+  WorkerEnv env_;
+  std::unique_ptr<GraphMgr> graph_mgr_;
+};
+
+TEST_F(GraphMgrTest, CacheIsOffByDefault) {
+  CreateGraphMgr("0");
+  string handle0, handle1;
+  EXPECT_EQ(1, Register("session", ConstantGraph(1.0f), &handle0));
+  EXPECT_EQ(1, Register("session", ConstantGraph(1.0f), &handle1));
+  EXPECT_NE(handle0, handle1);
+}
+
+TEST_F(GraphMgrTest, IdenticalGraphHitsCache) {
+  CreateGraphMgr("4");
+  string handle0, handle1;
+  EXPECT_EQ(1, Register("session", ConstantGraph(1.0f), &handle0));
+  EXPECT_EQ(0, Register("session", ConstantGraph(1.0f), &handle1));
+  EXPECT_NE(handle0, handle1);
+  TF_EXPECT_OK(graph_mgr_->Deregister(handle0));
+  TF_EXPECT_OK(graph_mgr_->Deregister(handle1));
+  EXPECT_TRUE(errors::IsAborted(graph_mgr_->Deregister(handle1)));
+}
+
+TEST_F(GraphMgrTest, DifferentGraphMissesCache) {
+  CreateGraphMgr("4");
+  string handle;
+  EXPECT_EQ(1, Register("session", ConstantGraph(1.0f), &handle));
+  EXPECT_EQ(1, Register("session", ConstantGraph(2.0f), &handle));
+}
+
+TEST_F(GraphMgrTest, OtherSessionMissesCache) {
+  CreateGraphMgr("4");
+  string handle;
+  EXPECT_EQ(1, Register("session0", ConstantGraph(1.0f), &handle));
+  // Sessions must not share the state of their stateful kernels.
+  EXPECT_EQ(1, Register("session1", ConstantGraph(1.0f), &handle));
+  EXPECT_EQ(0, Register("session0", ConstantGraph(1.0f), &handle));
+  EXPECT_EQ(0, Register("session1", ConstantGraph(1.0f), &handle));
+}
+
+TEST_F(GraphMgrTest, EvictsLeastRecentlyRegistered) {
+  CreateGraphMgr("2");
+  string handle;
+  EXPECT_EQ(1, Register("session", ConstantGraph(1.0f), &handle));
+  EXPECT_EQ(1, Register("session", ConstantGraph(2.0f), &handle));
+  // Makes 1.0 the most recently registered graph.
+  EXPECT_EQ(0, Register("session", ConstantGraph(1.0f), &handle));
+  // Evicts 2.0.
+  EXPECT_EQ(1, Register("session", ConstantGraph(3.0f), &handle));
+  EXPECT_EQ(0, Register("session", ConstantGraph(1.0f), &handle));
+  EXPECT_EQ(0, Register("session", ConstantGraph(3.0f), &handle));
+  // Evicts 1.0.
+  EXPECT_EQ(1, Register("session", ConstantGraph(2.0f), &handle));
+  EXPECT_EQ(1, Register("session", ConstantGraph(1.0f), &handle));
+}
+
+TEST_F(GraphMgrTest, KeepsDeregisteredGraphs) {
+  CreateGraphMgr("4");
+  string handle;
+  EXPECT_EQ(1, Register("session", ConstantGraph(1.0f), &handle));
+  TF_EXPECT_OK(graph_mgr_->Deregister(handle));
+  EXPECT_EQ(0, Register("session", ConstantGraph(1.0f), &handle));
+  TF_EXPECT_OK(graph_mgr_->Deregister(handle));
+}
+
+TEST_F(GraphMgrTest, DeregisterAllClearsCache) {
+  CreateGraphMgr("4");
+  string handle0, handle1;
+  EXPECT_EQ(1, Register("session", ConstantGraph(1.0f), &handle0));
+  EXPECT_EQ(1, Register("session", ConstantGraph(2.0f), &handle1));
+  TF_EXPECT_OK(graph_mgr_->DeregisterAll());
+  EXPECT_TRUE(errors::IsAborted(graph_mgr_->Deregister(handle0)));
+  EXPECT_EQ(1, Register("session", ConstantGraph(1.0f), &handle0));
+}
+
+TEST_F(GraphMgrTest, ClearRegistrationCacheKeepsRegisteredGraphs) {
+  CreateGraphMgr("4");
+  string handle;
+  EXPECT_EQ(1, Register("session", ConstantGraph(1.0f), &handle));
+  graph_mgr_->ClearRegistrationCache();
+  string other_handle;
+  EXPECT_EQ(1, Register("session", ConstantGraph(1.0f), &other_handle));
+  TF_EXPECT_OK(graph_mgr_->Deregister(handle));
+  TF_EXPECT_OK(graph_mgr_->Deregister(other_handle));
+}
+
+}  // namespace
+}  // namespace tensorflow
@@ -0,0 +1,112 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/distributed_runtime/rpc/eager/enqueue_batcher.h"
+
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+namespace eager {
+
+EnqueueBatcher::EnqueueBatcher(int64 max_ops, SendFunction send)
+    : max_ops_(max_ops), send_(std::move(send)) {}
+
+void EnqueueBatcher::Enqueue(const EnqueueRequest& request,
+                             EnqueueResponse* response, StatusCallback done) {
+  Batch* batch;
+  {
+    mutex_lock l(mu_);
+    if (pending_.empty() ||
+        pending_.back()->request.queue_size() + request.queue_size() >
+            max_ops_) {
+      pending_.emplace_back(new Batch);
+      pending_.back()->request.set_context_id(request.context_id());
+    }
+    Batch* back = pending_.back().get();
+    back->request.mutable_queue()->MergeFrom(request.queue());
+    back->request.add_batched_request_size(request.queue_size());
+    back->members.push_back({response, std::move(done), request.queue_size()});
+    if (in_flight_) return;
+    in_flight_ = true;
+    batch = pending_.front().release();
+    pending_.pop_front();
+  }
+  Send(batch);
+}
+
+void EnqueueBatcher::Send(Batch* batch) {
+  VLOG(3) << "Sending a batch of " << batch->members.size()
+          << " enqueue requests with " << batch->request.queue_size()
+          << " items";
+  Ref();
+  send_(batch->request, &batch->response,
+        [this, batch](const Status& status) { BatchDone(batch, status); });
+}
+
+void EnqueueBatcher::BatchDone(Batch* batch, const Status& status) {
+  const EnqueueResponse& response = batch->response;
+  const int num_members = batch->members.size();
+  Status batch_status = status;
+  if (batch_status.ok() && response.batched_request_status_size() != 0 &&
+      response.batched_request_status_size() != num_members) {
+    batch_status = errors::Internal(
+        "EnqueueResponse has ", response.batched_request_status_size(),
+        " request statuses, expected ", num_members);
+  }
+  int offset = 0;
+  for (int i = 0; i < num_members; ++i) {
+    Member& member = batch->members[i];
+    Status s = batch_status;
+    // An empty batched_request_status means every request succeeded.
+    if (s.ok() && response.batched_request_status_size() != 0) {
+      const EnqueueStatus& request_status = response.batched_request_status(i);
+      s = Status(request_status.code(), request_status.error_message());
+    }
+    if (s.ok() && response.queue_response_size() < offset + member.num_items) {
+      s = errors::Internal("EnqueueResponse has ",
+                           response.queue_response_size(),
+                           " queue responses, expected at least ",
+                           offset + member.num_items);
+    }
+    if (s.ok()) {
+      for (int j = 0; j < member.num_items; ++j) {
+        member.response->add_queue_response()->Swap(
+            batch->response.mutable_queue_response(offset + j));
+      }
+    }
+    offset += member.num_items;
+    member.done(s);
+  }
+  delete batch;
+
+  Batch* next = nullptr;
+  {
+    mutex_lock l(mu_);
+    if (pending_.empty()) {
+      in_flight_ = false;
+    } else {
+      next = pending_.front().release();
+      pending_.pop_front();
+    }
+  }
+  if (next != nullptr) {
+    Send(next);
+  }
+  Unref();
+}
+
+}  // namespace eager
+}  // namespace tensorflow
@@ -0,0 +1,82 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_RPC_EAGER_ENQUEUE_BATCHER_H_
+#define TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_RPC_EAGER_ENQUEUE_BATCHER_H_
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/lib/core/refcount.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/protobuf/eager_service.pb.h"
+
+namespace tensorflow {
+namespace eager {
+
+// Sends the streaming enqueue requests of one context in batches. At most one
+// batch is in flight at a time, so the order of the requests is preserved.
+//
+// A batch records the number of queue items of each of its requests in
+// EnqueueRequest.batched_request_size. The service runs every request of the
+// batch even if an earlier one fails, and returns the status of each, so a
+// request gets the same outcome as if it had been sent on its own.
+class EnqueueBatcher : public core::RefCounted {
+ public:
+  // Sends a batch, e.g. with StreamingRPCDispatcher::SendNextRequest.
+  typedef std::function<void(const EnqueueRequest&, EnqueueResponse*,
+                             StatusCallback)>
+      SendFunction;
+
+  EnqueueBatcher(int64 max_ops, SendFunction send);
+
+  // Like StreamingRPCDispatcher::SendNextRequest. `request` is copied into the
+  // next batch and can be deleted as soon as Enqueue returns.
+  void Enqueue(const EnqueueRequest& request, EnqueueResponse* response,
+               StatusCallback done);
+
+ private:
+  // A request of a batch, which owns the queue items
+  // [offset, offset + num_items) of the batch.
+  struct Member {
+    EnqueueResponse* response;
+    StatusCallback done;
+    int num_items;
+  };
+
+  struct Batch {
+    EnqueueRequest request;
+    EnqueueResponse response;
+    std::vector<Member> members;
+  };
+
+  void Send(Batch* batch);
+  void BatchDone(Batch* batch, const Status& status);
+
+  const int64 max_ops_;
+  const SendFunction send_;
+
+  mutex mu_;
+  bool in_flight_ TF_GUARDED_BY(mu_) = false;
+  std::deque<std::unique_ptr<Batch>> pending_ TF_GUARDED_BY(mu_);
+};
+
+}  // namespace eager
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_RPC_EAGER_ENQUEUE_BATCHER_H_
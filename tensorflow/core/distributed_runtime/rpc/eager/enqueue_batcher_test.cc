@@ -0,0 +1,248 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/distributed_runtime/rpc/eager/enqueue_batcher.h"
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace eager {
+namespace {
+
+// Holds the batches sent by an EnqueueBatcher until the test completes them.
+class FakeStream {
+ public:
+  struct Call {
+    EnqueueRequest request;
+    EnqueueResponse* response;
+    StatusCallback done;
+  };
+
+  EnqueueBatcher::SendFunction send_function() {
+    return [this](const EnqueueRequest& request, EnqueueResponse* response,
+                  StatusCallback done) {
+      calls_.push_back({request, response, std::move(done)});
+    };
+  }
+
+  // A deque, so that a batch sent while completing another one does not move
+  // the callback being run.
+  std::deque<Call>& calls() { return calls_; }
+
+  // Completes the 'index'-th batch like the service would: answers each of
+  // its items with a shape holding the id of its operation, and fails the
+  // requests listed in 'failed_requests'.
+  void Complete(int index, const std::vector<int>& failed_requests = {}) {
+    Call& call = calls_[index];
+    int offset = 0;
+    for (int i = 0; i < call.request.batched_request_size_size(); ++i) {
+      bool failed = std::find(failed_requests.begin(), failed_requests.end(),
+                              i) != failed_requests.end();
+      for (int j = 0; j < call.request.batched_request_size(i); ++j) {
+        QueueResponse* queue_response = call.response->add_queue_response();
+        if (!failed) {
+          queue_response->add_shape()->add_dim()->set_size(
+              call.request.queue(offset + j).operation().id());
+        }
+      }
+      offset += call.request.batched_request_size(i);
+      EnqueueStatus* status = call.response->add_batched_request_status();
+      if (failed) {
+        status->set_code(error::INVALID_ARGUMENT);
+        status->set_error_message(strings::StrCat("request ", i, " failed"));
+      }
+    }
+    call.done(Status::OK());
+  }
+
+ private:
+  std::deque<Call> calls_;
+};
+
+// A request that enqueues the operations 'first_id', ..., 'first_id' +
+// 'num_ops' - 1.
+EnqueueRequest MakeRequest(int first_id, int num_ops) {
+  EnqueueRequest request;
+  request.set_context_id(7);
+  for (int i = 0; i < num_ops; ++i) {
+    request.add_queue()->mutable_operation()->set_id(first_id + i);
+  }
+  return request;
+}
+
+// The result of one request enqueued on the batcher.
+struct Result {
+  EnqueueResponse response;
+  Status status;
+  bool done = false;
+};
+
+void Enqueue(EnqueueBatcher* batcher, const EnqueueRequest& request,
+             Result* result) {
+  batcher->Enqueue(request, &result->response, [result](const Status& s) {
+    result->status = s;
+    result->done = true;
+  });
+}
+
+// Returns the ids of the operations answered in 'response'.
+std::vector<int64> ResponseIds(const EnqueueResponse& response) {
+  std::vector<int64> ids;
+  for (const QueueResponse& queue_response : response.queue_response()) {
+    ids.push_back(queue_response.shape_size() > 0
+                      ? queue_response.shape(0).dim(0).size()
+                      : -1);
+  }
+  return ids;
+}
+
+TEST(EnqueueBatcherTest, BatchesRequestsInOrder) {
+  FakeStream stream;
+  core::RefCountPtr<EnqueueBatcher> batcher(
+      new EnqueueBatcher(/*max_ops=*/10, stream.send_function()));
+  Result r0, r1, r2, r3;
+  // Sent right away.
+  Enqueue(batcher.get(), MakeRequest(0, 1), &r0);
+  // Held while the first batch is in flight.
+  Enqueue(batcher.get(), MakeRequest(1, 2), &r1);
+  Enqueue(batcher.get(), MakeRequest(3, 1), &r2);
+  Enqueue(batcher.get(), MakeRequest(4, 3), &r3);
+  ASSERT_EQ(1, stream.calls().size());
+  EXPECT_EQ(1, stream.calls()[0].request.queue_size());
+
+  stream.Complete(0);
+  EXPECT_TRUE(r0.done);
+  TF_EXPECT_OK(r0.status);
+  EXPECT_EQ(std::vector<int64>({0}), ResponseIds(r0.response));
+  EXPECT_FALSE(r1.done);
+
+  // The held requests are sent together, in the order they were enqueued.
+  ASSERT_EQ(2, stream.calls().size());
+  const EnqueueRequest& batch = stream.calls()[1].request;
+  EXPECT_EQ(7, batch.context_id());
+  ASSERT_EQ(6, batch.queue_size());
+  for (int i = 0; i < batch.queue_size(); ++i) {
+    EXPECT_EQ(i + 1, batch.queue(i).operation().id());
+  }
+  EXPECT_EQ(std::vector<int>({2, 1, 3}),
+            std::vector<int>(batch.batched_request_size().begin(),
+                             batch.batched_request_size().end()));
+
+  // Each request gets the responses of its own items.
+  stream.Complete(1);
+  TF_EXPECT_OK(r1.status);
+  TF_EXPECT_OK(r2.status);
+  TF_EXPECT_OK(r3.status);
+  EXPECT_EQ(std::vector<int64>({1, 2}), ResponseIds(r1.response));
+  EXPECT_EQ(std::vector<int64>({3}), ResponseIds(r2.response));
+  EXPECT_EQ(std::vector<int64>({4, 5, 6}), ResponseIds(r3.response));
+  EXPECT_EQ(2, stream.calls().size());
+}
+
+TEST(EnqueueBatcherTest, SplitsBatchesAtMaxOps) {
+  FakeStream stream;
+  core::RefCountPtr<EnqueueBatcher> batcher(
+      new EnqueueBatcher(/*max_ops=*/3, stream.send_function()));
+  Result r0, r1, r2, r3;
+  Enqueue(batcher.get(), MakeRequest(0, 1), &r0);
+  Enqueue(batcher.get(), MakeRequest(1, 2), &r1);
+  Enqueue(batcher.get(), MakeRequest(3, 2), &r2);
+  Enqueue(batcher.get(), MakeRequest(5, 1), &r3);
+
+  stream.Complete(0);
+  ASSERT_EQ(2, stream.calls().size());
+  EXPECT_EQ(2, stream.calls()[1].request.queue_size());
+  stream.Complete(1);
+  ASSERT_EQ(3, stream.calls().size());
+  EXPECT_EQ(3, stream.calls()[2].request.queue_size());
+  EXPECT_EQ(2, stream.calls()[2].request.batched_request_size_size());
+  stream.Complete(2);
+  EXPECT_EQ(std::vector<int64>({1, 2}), ResponseIds(r1.response));
+  EXPECT_EQ(std::vector<int64>({3, 4}), ResponseIds(r2.response));
+  EXPECT_EQ(std::vector<int64>({5}), ResponseIds(r3.response));
+}
+
+TEST(EnqueueBatcherTest, ReportsTheStatusOfEachRequest) {
+  FakeStream stream;
+  core::RefCountPtr<EnqueueBatcher> batcher(
+      new EnqueueBatcher(/*max_ops=*/10, stream.send_function()));
+  Result r0, r1, r2, r3;
+  Enqueue(batcher.get(), MakeRequest(0, 1), &r0);
+  Enqueue(batcher.get(), MakeRequest(1, 1), &r1);
+  Enqueue(batcher.get(), MakeRequest(2, 2), &r2);
+  Enqueue(batcher.get(), MakeRequest(4, 1), &r3);
+  stream.Complete(0);
+
+  // Only the failed request reports the error; the requests before and after
+  // it ran and keep their responses.
+  stream.Complete(1, /*failed_requests=*/{1});
+  TF_EXPECT_OK(r1.status);
+  EXPECT_EQ(std::vector<int64>({1}), ResponseIds(r1.response));
+  EXPECT_TRUE(errors::IsInvalidArgument(r2.status));
+  EXPECT_EQ("request 1 failed", r2.status.error_message());
+  EXPECT_EQ(0, r2.response.queue_response_size());
+  TF_EXPECT_OK(r3.status);
+  EXPECT_EQ(std::vector<int64>({4}), ResponseIds(r3.response));
+}
+
+TEST(EnqueueBatcherTest, ReportsStreamErrorToEveryRequest) {
+  FakeStream stream;
+  core::RefCountPtr<EnqueueBatcher> batcher(
+      new EnqueueBatcher(/*max_ops=*/10, stream.send_function()));
+  Result r0, r1, r2, r3;
+  Enqueue(batcher.get(), MakeRequest(0, 1), &r0);
+  Enqueue(batcher.get(), MakeRequest(1, 1), &r1);
+  Enqueue(batcher.get(), MakeRequest(2, 1), &r2);
+  stream.calls()[0].done(errors::Unavailable("stream closed"));
+  EXPECT_TRUE(errors::IsUnavailable(r0.status));
+
+  // Requests enqueued after the failure are still sent.
+  Enqueue(batcher.get(), MakeRequest(3, 1), &r3);
+  ASSERT_EQ(2, stream.calls().size());
+  stream.calls()[1].done(errors::Unavailable("stream closed"));
+  EXPECT_TRUE(errors::IsUnavailable(r1.status));
+  EXPECT_TRUE(errors::IsUnavailable(r2.status));
+  ASSERT_EQ(3, stream.calls().size());
+  stream.Complete(2);
+  TF_EXPECT_OK(r3.status);
+}
+
+TEST(EnqueueBatcherTest, RejectsMalformedResponse) {
+  FakeStream stream;
+  core::RefCountPtr<EnqueueBatcher> batcher(
+      new EnqueueBatcher(/*max_ops=*/10, stream.send_function()));
+  Result r0, r1, r2;
+  Enqueue(batcher.get(), MakeRequest(0, 1), &r0);
+  Enqueue(batcher.get(), MakeRequest(1, 1), &r1);
+  Enqueue(batcher.get(), MakeRequest(2, 1), &r2);
+  stream.Complete(0);
+
+  // One status for a batch of two requests.
+  stream.calls()[1].response->add_batched_request_status();
+  stream.calls()[1].done(Status::OK());
+  EXPECT_TRUE(errors::IsInternal(r1.status));
+  EXPECT_TRUE(errors::IsInternal(r2.status));
+}
+
+}  // namespace
+}  // namespace eager
+}  // namespace tensorflow
@@ -15,8 +15,11 @@ limitations under the License.
 
 #include "tensorflow/core/distributed_runtime/rpc/eager/grpc_eager_client.h"
 
+#include <memory>
+
 #include "grpcpp/generic/generic_stub.h"
 #include "tensorflow/core/distributed_runtime/call_options.h"
+#include "tensorflow/core/distributed_runtime/rpc/eager/enqueue_batcher.h"
 #include "tensorflow/core/distributed_runtime/rpc/eager/grpc_eager_service.h"
 #include "tensorflow/core/distributed_runtime/rpc/grpc_client_cq_tag.h"
 #include "tensorflow/core/distributed_runtime/rpc/grpc_state.h"
@@ -63,6 +66,23 @@ bool EnableStreaming() {
   return result;
 }
 
+// Setting environment variable "TF_EAGER_CLIENT_ENQUEUE_BATCH_MAX_OPS" to a
+// positive value coalesces streaming enqueue requests: the requests of a
+// context that are issued while an earlier batch is in flight are sent
+// together, up to this many queue items per batch, as soon as it completes.
+// The service executes all the items of a request under a single lookup of the
+// context, so small ops enqueued back to back share an RPC. Has no effect when
+// streaming is disabled.
+int64 EnqueueBatchMaxOps() {
+  static const int64 max_ops = [] {
+    int64 result;
+    TF_CHECK_OK(ReadInt64FromEnvVar("TF_EAGER_CLIENT_ENQUEUE_BATCH_MAX_OPS", 0,
+                                    &result));
+    return result;
+  }();
+  return max_ops;
+}
+
 // Ref-counted thread to handle callbacks for completed requests a GRPC
 // completion queue. The thread might be shared by multiple eager clients, and
 // each one of them should hold a reference count to ensure that the thread
@@ -155,9 +175,13 @@ class GrpcEagerClient : public EagerClient {
 
     mutex_lock l(mu_);
     const auto& it = enqueue_dispatchers_.find(request->context_id());
+    const auto& batcher_it = enqueue_batchers_.find(request->context_id());
     if (it != enqueue_dispatchers_.end()) {
       it->second.CancelCall();
       enqueue_dispatchers_.erase(it);
+    } else if (batcher_it != enqueue_batchers_.end()) {
+      batcher_it->second.dispatcher->CancelCall();
+      enqueue_batchers_.erase(batcher_it);
     } else if (EnableStreaming()) {
       LOG(ERROR) << "Remote EagerContext with id " << request->context_id()
                  << " does not seem to exist.";
@@ -180,7 +204,32 @@ class GrpcEagerClient : public EagerClient {
                              EnqueueResponse* response,
                              StatusCallback done) override {
     StatusCallback done_wrapped = callback_wrapper(std::move(done));
-    if (EnableStreaming()) {
+    if (EnableStreaming() && EnqueueBatchMaxOps() > 0) {
+      EnqueueBatcher* batcher;
+      {
+        mutex_lock l(mu_);
+        BatchingDispatcher& entry = enqueue_batchers_[request->context_id()];
+        if (entry.batcher == nullptr) {
+          auto dispatcher =
+              std::make_shared<StreamingRPCDispatcher<EnqueueResponse>>(
+                  &stub_, cq_,
+                  "/tensorflow.eager.EagerService/StreamingEnqueue");
+          entry.dispatcher = dispatcher;
+          entry.batcher.reset(new EnqueueBatcher(
+              EnqueueBatchMaxOps(),
+              [dispatcher](const EnqueueRequest& batch_request,
+                           EnqueueResponse* batch_response,
+                           StatusCallback batch_done) {
+                dispatcher->SendNextRequest(batch_request, batch_response,
+                                            std::move(batch_done));
+              }));
+        }
+        batcher = entry.batcher.get();
+        batcher->Ref();
+      }
+      core::ScopedUnref batcher_unref(batcher);
+      batcher->Enqueue(*request, response, std::move(done_wrapped));
+    } else if (EnableStreaming()) {
       mutex_lock l(mu_);
       auto it = enqueue_dispatchers_.find(request->context_id());
       if (it == enqueue_dispatchers_.end()) {
@@ -216,6 +265,14 @@ class GrpcEagerClient : public EagerClient {
 
   std::unordered_map<uint64, StreamingRPCDispatcher<EnqueueResponse>>
       enqueue_dispatchers_ TF_GUARDED_BY(mu_);
+  // Used instead of enqueue_dispatchers_ when enqueue batching is enabled.
+  struct BatchingDispatcher {
+    // Also owned by the batcher, which sends its batches on it.
+    std::shared_ptr<StreamingRPCDispatcher<EnqueueResponse>> dispatcher;
+    core::RefCountPtr<EnqueueBatcher> batcher;
+  };
+  std::unordered_map<uint64, BatchingDispatcher> enqueue_batchers_
+      TF_GUARDED_BY(mu_);
 
   StatusCallback callback_wrapper(StatusCallback done) {
     Ref();
@@ -0,0 +1,147 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/distributed_runtime/rpc/grpc_chunked_tensor_store.h"
+
+#include <algorithm>
+
+#include "tensorflow/core/common_runtime/dma_helper.h"
+#include "tensorflow/core/distributed_runtime/request_id.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+
+constexpr int64 GrpcChunkedTensorStore::kDefaultExpiryMicros;
+
+GrpcChunkedTensorStore::GrpcChunkedTensorStore(Env* env, int64 expiry_micros)
+    : env_(env), expiry_micros_(expiry_micros) {}
+
+GrpcChunkedTensorStore::~GrpcChunkedTensorStore() {
+  std::unique_ptr<Thread> sweeper;
+  {
+    mutex_lock l(mu_);
+    shutting_down_ = true;
+    sweeper = std::move(sweeper_);
+  }
+  shutdown_cv_.notify_all();
+  // Joins the thread.
+  sweeper.reset();
+}
+
+int64 GrpcChunkedTensorStore::Add(int64 step_id, const Tensor& tensor) {
+  const int64 now_micros = env_->NowMicros();
+  const int64 handle = GetUniqueRequestId();
+  mutex_lock l(mu_);
+  ExpireLocked(now_micros);
+  if (sweeper_ == nullptr) {
+    sweeper_.reset(env_->StartThread(ThreadOptions(),
+                                     "tf_grpc_chunked_tensor_sweeper",
+                                     [this]() { SweepLoop(); }));
+  }
+  Entry& entry = tensors_[handle];
+  entry.tensor = tensor;
+  entry.step_id = step_id;
+  entry.remaining_bytes = tensor.TotalBytes();
+  entry.expiry_micros = now_micros + expiry_micros_;
+  expiry_index_.emplace(entry.expiry_micros, handle);
+  return handle;
+}
+
+Status GrpcChunkedTensorStore::ReadChunk(const RecvTensorChunkRequest& request,
+                                         RecvTensorChunkResponse* response) {
+  const int64 now_micros = env_->NowMicros();
+  Tensor tensor;
+  {
+    mutex_lock l(mu_);
+    ExpireLocked(now_micros);
+    auto it = tensors_.find(request.handle());
+    if (it == tensors_.end()) {
+      return errors::NotFound("No chunked tensor with handle ",
+                              request.handle(), "; it may have expired");
+    }
+    Entry& entry = it->second;
+    const int64 total_bytes = entry.tensor.TotalBytes();
+    if (request.offset() < 0 || request.num_bytes() <= 0 ||
+        request.offset() > total_bytes ||
+        request.num_bytes() > total_bytes - request.offset() ||
+        request.num_bytes() > entry.remaining_bytes) {
+      return errors::InvalidArgument("Invalid chunk of ", request.num_bytes(),
+                                     " bytes at offset ", request.offset(),
+                                     " of a tensor of ", total_bytes,
+                                     " bytes");
+    }
+    tensor = entry.tensor;
+    entry.remaining_bytes -= request.num_bytes();
+    if (entry.remaining_bytes == 0) {
+      EraseLocked(it);
+    } else {
+      // The tensor only expires once its receiver stops fetching chunks, so
+      // that a large tensor on a slow link is not dropped midway.
+      expiry_index_.erase({entry.expiry_micros, request.handle()});
+      entry.expiry_micros = now_micros + expiry_micros_;
+      expiry_index_.emplace(entry.expiry_micros, request.handle());
+    }
+  }
+  // The tensor buffer stays alive through 'tensor' after it is dropped from
+  // tensors_.
+  const char* head = reinterpret_cast<const char*>(DMAHelper::base(&tensor));
+  response->set_content(head + request.offset(), request.num_bytes());
+  return Status::OK();
+}
+
+void GrpcChunkedTensorStore::CleanEntriesForStep(int64 step_id) {
+  mutex_lock l(mu_);
+  for (auto it = tensors_.begin(); it != tensors_.end();) {
+    if (it->second.step_id == step_id) {
+      it = EraseLocked(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+size_t GrpcChunkedTensorStore::size() {
+  mutex_lock l(mu_);
+  return tensors_.size();
+}
+
+GrpcChunkedTensorStore::EntryMap::iterator GrpcChunkedTensorStore::EraseLocked(
+    EntryMap::iterator it) {
+  expiry_index_.erase({it->second.expiry_micros, it->first});
+  return tensors_.erase(it);
+}
+
+void GrpcChunkedTensorStore::ExpireLocked(int64 now_micros) {
+  while (!expiry_index_.empty() &&
+         expiry_index_.begin()->first < now_micros) {
+    auto it = tensors_.find(expiry_index_.begin()->second);
+    VLOG(1) << "Dropping chunked tensor " << it->first << " of step "
+            << it->second.step_id << ", which was not entirely fetched";
+    EraseLocked(it);
+  }
+}
+
+void GrpcChunkedTensorStore::SweepLoop() {
+  // Tensors are dropped at most half of their expiry time late.
+  const int64 period_ms = std::max<int64>(expiry_micros_ / 2000, 1);
+  mutex_lock l(mu_);
+  while (!shutting_down_) {
+    WaitForMilliseconds(&l, &shutdown_cv_, period_ms);
+    ExpireLocked(env_->NowMicros());
+  }
+}
+
+}  // namespace tensorflow
@@ -0,0 +1,101 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_RPC_GRPC_CHUNKED_TENSOR_STORE_H_
+#define TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_RPC_GRPC_CHUNKED_TENSOR_STORE_H_
+
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <utility>
+
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/protobuf/worker.pb.h"
+
+namespace tensorflow {
+
+// Holds the tensors that GrpcWorker::GrpcRecvTensorAsync returned without
+// their content, until the receiver fetches it with RecvTensorChunk requests.
+//
+// A tensor is dropped once every byte of its content has been fetched, when
+// its step is cleaned up, or once no chunk of it was fetched for a while,
+// e.g. because the receiver was cancelled. Expired tensors are dropped by
+// every call, and periodically by a background thread, so that they are freed
+// even if no other tensor is ever sent in chunks.
+class GrpcChunkedTensorStore {
+ public:
+  static constexpr int64 kDefaultExpiryMicros = 60 * 1000 * 1000;
+
+  explicit GrpcChunkedTensorStore(Env* env,
+                                  int64 expiry_micros = kDefaultExpiryMicros);
+  ~GrpcChunkedTensorStore();
+
+  // Holds 'tensor', sent in step 'step_id', and returns its handle.
+  int64 Add(int64 step_id, const Tensor& tensor);
+
+  // Sets 'response' to the range of the content of the tensor requested by
+  // 'request'. Returns NotFound if the tensor was dropped or never added.
+  Status ReadChunk(const RecvTensorChunkRequest& request,
+                   RecvTensorChunkResponse* response);
+
+  // Drops the tensors sent in step 'step_id'.
+  void CleanEntriesForStep(int64 step_id);
+
+  // Returns the number of tensors held.
+  size_t size();
+
+ private:
+  struct Entry {
+    Tensor tensor;
+    int64 step_id;
+    // The content not fetched yet.
+    int64 remaining_bytes;
+    // Pushed back by every fetched chunk.
+    int64 expiry_micros;
+  };
+  typedef std::unordered_map<int64, Entry> EntryMap;
+
+  // Drops the tensor at 'it', and returns the next one.
+  EntryMap::iterator EraseLocked(EntryMap::iterator it)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Drops the tensors that expired before 'now_micros'. Only looks at those.
+  void ExpireLocked(int64 now_micros) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Runs on sweeper_ until the store is destroyed.
+  void SweepLoop();
+
+  Env* const env_;
+  const int64 expiry_micros_;
+
+  mutex mu_;
+  // Wakes up the sweeper when the store is destroyed.
+  condition_variable shutdown_cv_;
+  bool shutting_down_ TF_GUARDED_BY(mu_) = false;
+  // Started with the first tensor.
+  std::unique_ptr<Thread> sweeper_ TF_GUARDED_BY(mu_);
+  EntryMap tensors_ TF_GUARDED_BY(mu_);
+  // The (expiry_micros, handle) of every tensor, in expiry order.
+  std::set<std::pair<int64, int64>> expiry_index_ TF_GUARDED_BY(mu_);
+
+  TF_DISALLOW_COPY_AND_ASSIGN(GrpcChunkedTensorStore);
+};
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_RPC_GRPC_CHUNKED_TENSOR_STORE_H_
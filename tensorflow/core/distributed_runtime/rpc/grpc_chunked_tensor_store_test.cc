@@ -0,0 +1,161 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/distributed_runtime/rpc/grpc_chunked_tensor_store.h"
+
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace {
+
+constexpr int64 kNumValues = 1000;
+constexpr int64 kTotalBytes = kNumValues * sizeof(float);
+
+Tensor MakeTensor() {
+  Tensor tensor(DT_FLOAT, TensorShape({kNumValues}));
+  test::FillIota<float>(&tensor, 1.0f);
+  return tensor;
+}
+
+RecvTensorChunkRequest MakeRequest(int64 handle, int64 offset,
+                                   int64 num_bytes) {
+  RecvTensorChunkRequest request;
+  request.set_handle(handle);
+  request.set_offset(offset);
+  request.set_num_bytes(num_bytes);
+  return request;
+}
+
+Status ReadChunk(GrpcChunkedTensorStore* store, int64 handle, int64 offset,
+                 int64 num_bytes, Tensor* tensor) {
+  RecvTensorChunkResponse response;
+  TF_RETURN_IF_ERROR(
+      store->ReadChunk(MakeRequest(handle, offset, num_bytes), &response));
+  EXPECT_EQ(num_bytes, static_cast<int64>(response.content().size()));
+  memcpy(const_cast<char*>(tensor->tensor_data().data()) + offset,
+         response.content().data(), response.content().size());
+  return Status::OK();
+}
+
+TEST(GrpcChunkedTensorStoreTest, ReadsChunks) {
+  GrpcChunkedTensorStore store(Env::Default());
+  const Tensor val = MakeTensor();
+  const int64 handle = store.Add(/*step_id=*/1, val);
+  EXPECT_EQ(1, store.size());
+
+  // Out of order, with a short last chunk.
+  Tensor tensor(DT_FLOAT, val.shape());
+  TF_EXPECT_OK(ReadChunk(&store, handle, 1024, 1024, &tensor));
+  TF_EXPECT_OK(ReadChunk(&store, handle, 3072, kTotalBytes - 3072, &tensor));
+  TF_EXPECT_OK(ReadChunk(&store, handle, 0, 1024, &tensor));
+  EXPECT_EQ(1, store.size());
+  TF_EXPECT_OK(ReadChunk(&store, handle, 2048, 1024, &tensor));
+  test::ExpectTensorEqual<float>(val, tensor);
+
+  // Dropped once every byte was fetched.
+  EXPECT_EQ(0, store.size());
+  EXPECT_TRUE(
+      errors::IsNotFound(ReadChunk(&store, handle, 0, 1024, &tensor)));
+}
+
+TEST(GrpcChunkedTensorStoreTest, RejectsInvalidChunks) {
+  GrpcChunkedTensorStore store(Env::Default());
+  const int64 handle = store.Add(/*step_id=*/1, MakeTensor());
+  Tensor tensor(DT_FLOAT, TensorShape({kNumValues}));
+  EXPECT_TRUE(
+      errors::IsInvalidArgument(ReadChunk(&store, handle, -1, 16, &tensor)));
+  EXPECT_TRUE(
+      errors::IsInvalidArgument(ReadChunk(&store, handle, 0, 0, &tensor)));
+  EXPECT_TRUE(
+      errors::IsInvalidArgument(ReadChunk(&store, handle, 0, -16, &tensor)));
+  EXPECT_TRUE(errors::IsInvalidArgument(
+      ReadChunk(&store, handle, kTotalBytes, 16, &tensor)));
+  EXPECT_TRUE(errors::IsInvalidArgument(
+      ReadChunk(&store, handle, kTotalBytes - 16, 32, &tensor)));
+  EXPECT_TRUE(errors::IsInvalidArgument(
+      ReadChunk(&store, handle, 0, kTotalBytes + 1, &tensor)));
+  // Offsets and lengths whose sum overflows.
+  EXPECT_TRUE(errors::IsInvalidArgument(
+      ReadChunk(&store, handle, kint64max, kint64max, &tensor)));
+
+  // Fetching more bytes than the tensor has, e.g. the same chunk twice.
+  TF_EXPECT_OK(ReadChunk(&store, handle, 0, kTotalBytes - 16, &tensor));
+  EXPECT_TRUE(
+      errors::IsInvalidArgument(ReadChunk(&store, handle, 0, 32, &tensor)));
+  TF_EXPECT_OK(ReadChunk(&store, handle, kTotalBytes - 16, 16, &tensor));
+  EXPECT_EQ(0, store.size());
+}
+
+TEST(GrpcChunkedTensorStoreTest, RejectsUnknownHandle) {
+  GrpcChunkedTensorStore store(Env::Default());
+  const int64 handle = store.Add(/*step_id=*/1, MakeTensor());
+  Tensor tensor(DT_FLOAT, TensorShape({kNumValues}));
+  EXPECT_TRUE(
+      errors::IsNotFound(ReadChunk(&store, handle + 1, 0, 16, &tensor)));
+  EXPECT_EQ(1, store.size());
+}
+
+TEST(GrpcChunkedTensorStoreTest, ExpiresOnRead) {
+  GrpcChunkedTensorStore store(Env::Default(), /*expiry_micros=*/1000);
+  const int64 handle = store.Add(/*step_id=*/1, MakeTensor());
+  Env::Default()->SleepForMicroseconds(10 * 1000);
+  Tensor tensor(DT_FLOAT, TensorShape({kNumValues}));
+  EXPECT_TRUE(errors::IsNotFound(ReadChunk(&store, handle, 0, 16, &tensor)));
+}
+
+TEST(GrpcChunkedTensorStoreTest, ReadsExtendExpiry) {
+  GrpcChunkedTensorStore store(Env::Default(), /*expiry_micros=*/500 * 1000);
+  const Tensor val = MakeTensor();
+  const int64 handle = store.Add(/*step_id=*/1, val);
+  // Fetching all the chunks takes twice the expiry time, but the tensor is
+  // never idle for that long.
+  Tensor tensor(DT_FLOAT, val.shape());
+  for (int64 offset = 0; offset < kTotalBytes; offset += 1000) {
+    Env::Default()->SleepForMicroseconds(250 * 1000);
+    TF_ASSERT_OK(ReadChunk(&store, handle, offset, 1000, &tensor));
+  }
+  test::ExpectTensorEqual<float>(val, tensor);
+}
+
+TEST(GrpcChunkedTensorStoreTest, ExpiresWithoutOtherCalls) {
+  GrpcChunkedTensorStore store(Env::Default(), /*expiry_micros=*/1000);
+  store.Add(/*step_id=*/1, MakeTensor());
+  // The sweeper drops the tensor after about 1.5ms.
+  for (int i = 0; i < 1000 && store.size() > 0; ++i) {
+    Env::Default()->SleepForMicroseconds(10 * 1000);
+  }
+  EXPECT_EQ(0, store.size());
+}
+
+TEST(GrpcChunkedTensorStoreTest, CleansEntriesForStep) {
+  GrpcChunkedTensorStore store(Env::Default());
+  const int64 handle0 = store.Add(/*step_id=*/1, MakeTensor());
+  const int64 handle1 = store.Add(/*step_id=*/1, MakeTensor());
+  const int64 handle2 = store.Add(/*step_id=*/2, MakeTensor());
+  store.CleanEntriesForStep(1);
+  EXPECT_EQ(1, store.size());
+  Tensor tensor(DT_FLOAT, TensorShape({kNumValues}));
+  EXPECT_TRUE(errors::IsNotFound(ReadChunk(&store, handle0, 0, 16, &tensor)));
+  EXPECT_TRUE(errors::IsNotFound(ReadChunk(&store, handle1, 0, 16, &tensor)));
+  TF_EXPECT_OK(ReadChunk(&store, handle2, 0, 16, &tensor));
+}
+
+}  // namespace
+}  // namespace tensorflow
@@ -19,12 +19,14 @@ limitations under the License.
 #include "grpcpp/support/slice.h"
 #include "absl/flags/flag.h"
 #include "tensorflow/core/common_runtime/dma_helper.h"
+#include "tensorflow/core/distributed_runtime/tensor_coding.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor.pb.h"
 #include "tensorflow/core/framework/tensor_reference.h"
 #include "tensorflow/core/framework/tensor_shape.pb.h"
 #include "tensorflow/core/lib/gtl/inlined_vector.h"
 #include "tensorflow/core/lib/io/proto_encode_helper.h"
+#include "tensorflow/core/lib/monitoring/counter.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/protobuf/worker.pb.h"
 
@@ -33,6 +35,22 @@ limitations under the License.
 namespace tensorflow {
 namespace grpc {
 
+namespace {
+
+auto* recv_tensor_raw_bytes = monitoring::Counter<1>::New(
+    "/tensorflow/core/grpc/recv_tensor_raw_bytes",
+    "The raw content size of the tensors sent compressed in RecvTensor "
+    "responses.",
+    "compression");
+
+auto* recv_tensor_compressed_bytes = monitoring::Counter<1>::New(
+    "/tensorflow/core/grpc/recv_tensor_compressed_bytes",
+    "The compressed content size of the tensors sent compressed in RecvTensor "
+    "responses.",
+    "compression");
+
+}  // namespace
+
 void EncodeRecvTensorResponseToByteBuffer(const RecvTensorResponse& proto,
                                           ::grpc::ByteBuffer* result) {
   ::grpc::Slice slice(proto.ByteSizeLong());
@@ -139,6 +157,13 @@ static void EncodeSkeleton(const Tensor& val, io::ProtoEncodeHelper* e) {
 
 void EncodeTensorToByteBuffer(bool is_dead, const Tensor& val, bool require_ack,
                               ::grpc::ByteBuffer* result) {
+  EncodeTensorToByteBuffer(is_dead, val, require_ack,
+                           RECV_TENSOR_COMPRESSION_NONE, result);
+}
+
+void EncodeTensorToByteBuffer(bool is_dead, const Tensor& val, bool require_ack,
+                              RecvTensorCompression compression,
+                              ::grpc::ByteBuffer* result) {
   const int kLargeTensorBytes = 1024;
   RecvTensorResponse response;
   if (is_dead) {
@@ -146,6 +171,22 @@ void EncodeTensorToByteBuffer(bool is_dead, const Tensor& val, bool require_ack,
   }
   response.set_require_ack(require_ack);
   response.set_send_start_micros(Env::Default()->NowMicros());
+  // The compressed content is owned by the byte buffer once encoded.
+  std::unique_ptr<string> compressed;
+  if (!is_dead && compression != RECV_TENSOR_COMPRESSION_NONE) {
+    compressed.reset(new string);
+    if (CompressTensorContent(val, compression, compressed.get())) {
+      // Precedes the tensor in the encoding, which lets the receiver decode
+      // the content as it parses it.
+      response.set_compression(compression);
+      const string& label = RecvTensorCompression_Name(compression);
+      recv_tensor_raw_bytes->GetCell(label)->IncrementBy(val.TotalBytes());
+      recv_tensor_compressed_bytes->GetCell(label)->IncrementBy(
+          compressed->size());
+    } else {
+      compressed.reset();
+    }
+  }
   if (!DataTypeCanUseMemcpy(val.dtype())) {
     // Straightforward but slow path for complicated kinds of tensor data
     // TODO(jeff,sanjay): If this becomes an issue, we could
@@ -161,7 +202,8 @@ void EncodeTensorToByteBuffer(bool is_dead, const Tensor& val, bool require_ack,
     io::ProtoEncodeHelper e_skeleton(skeleton.data(), skeleton.size());
     EncodeSkeleton(val, &e_skeleton);
 
-    StringPiece tdata = val.tensor_data();
+    StringPiece tdata =
+        compressed != nullptr ? StringPiece(*compressed) : val.tensor_data();
     uint32 overall_tensor_proto_bytesize =
         (e_skeleton.size() +
          VarLengthEncodingSize(TensorProto::kTensorContentFieldNumber,
@@ -223,7 +265,15 @@ void EncodeTensorToByteBuffer(bool is_dead, const Tensor& val, bool require_ack,
       num_slices += 1;
     }
 
-    if (share_tensor_slice_memory) {
+    if (share_tensor_slice_memory && compressed != nullptr) {
+      // (E) Encode compressed data, by handing over its backing store
+      string* backing = compressed.release();
+      slices[1] = ::grpc::Slice(
+          const_cast<char*>(backing->data()), backing->size(),
+          [](void* backing) { delete static_cast<string*>(backing); },
+          backing);
+      num_slices += 1;
+    } else if (share_tensor_slice_memory) {
       // (E) Encode tensor data, but by sharing backing store
       const TensorBuffer* buf = DMAHelper::buffer(&val);
       buf->Ref();
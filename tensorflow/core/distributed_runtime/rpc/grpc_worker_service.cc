@@ -39,6 +39,7 @@ limitations under the License.
 #include "tensorflow/core/distributed_runtime/rpc/grpc_tensor_coding.h"
 #include "tensorflow/core/distributed_runtime/rpc/grpc_util.h"
 #include "tensorflow/core/distributed_runtime/rpc/grpc_worker_service_impl.h"
+#include "tensorflow/core/distributed_runtime/rpc/shared_memory_transport.h"
 #include "tensorflow/core/distributed_runtime/worker.h"
 #include "tensorflow/core/distributed_runtime/worker_cache.h"
 #include "tensorflow/core/distributed_runtime/worker_session.h"
@@ -144,6 +145,7 @@ class GrpcWorkerServiceThread {
     SETUP_FOR_REQUEST(CompleteInstance, 10, true);
     SETUP_FOR_REQUEST(GetStepSequence, 10, true);
     SETUP_FOR_REQUEST(RecvBuf, 500, true);
+    SETUP_FOR_REQUEST(RecvTensorChunk, 100, true);
     SETUP_FOR_REQUEST(RunGraph, 100, true);
     SETUP_FOR_REQUEST(CleanupGraph, 100, false);
     SETUP_FOR_REQUEST(MarkRecvFinished, 10, false);
@@ -283,6 +285,25 @@ class GrpcWorkerServiceThread {
     EnqueueRecvTensorRequestRaw();
   }
 
+  void RecvTensorChunkHandler(
+      WorkerCall<RecvTensorChunkRequest, RecvTensorChunkResponse>* call) {
+    Schedule([this, call]() {
+      CallOptions* call_opts = new CallOptions;
+      call->SetCancelCallback([call_opts]() { call_opts->StartCancel(); });
+      worker_->RecvTensorChunkAsync(
+          call_opts, &call->request, &call->response,
+          [call, call_opts](const Status& s) {
+            call->ClearCancelCallback();
+            delete call_opts;
+            if (!s.ok()) {
+              VLOG(1) << "Bad response from RecvTensorChunk:" << s;
+            }
+            call->SendResponse(ToGrpcStatus(s));
+          });
+    });
+    ENQUEUE_REQUEST(RecvTensorChunk, true);
+  }
+
   void RecvBufHandler(WorkerCall<RecvBufRequest, RecvBufResponse>* call) {
     Schedule([this, call]() {
       CallOptions* call_opts = new CallOptions;
@@ -420,6 +441,7 @@ class GrpcWorkerService : public AsyncServiceInterface {
 
 GrpcWorker::GrpcWorker(WorkerEnv* worker_env, const ConfigProto& config)
     : Worker(worker_env),
+      chunked_tensors_(worker_env->env),
       recv_buf_max_chunk_(
           config.experimental().recv_buf_max_chunk() > 0
               ? config.experimental().recv_buf_max_chunk()
@@ -447,11 +469,41 @@ void GrpcWorker::GrpcRecvTensorAsync(CallOptions* opts,
 
   bool cache_enabled = (response_cache_ != nullptr && request_id != 0);
 
-  auto do_response = [response, done, cache_enabled](const Tensor& tensor,
-                                                     bool is_dead,
-                                                     const Status& status) {
+  SharedMemoryTransport* shared_memory = SharedMemoryTransport::Get();
+  auto do_response = [this, request, response, done, cache_enabled,
+                      shared_memory](const Tensor& tensor, bool is_dead,
+                                     const Status& status) {
     if (status.ok()) {
-      grpc::EncodeTensorToByteBuffer(is_dead, tensor, cache_enabled, response);
+      RecvTensorResponse shared_memory_response;
+      if (!is_dead && shared_memory != nullptr &&
+          shared_memory->WriteTensor(*request, tensor, cache_enabled,
+                                     &shared_memory_response)) {
+        // Only the metadata goes on the wire.
+        grpc::EncodeRecvTensorResponseToByteBuffer(shared_memory_response,
+                                                   response);
+      } else if (!is_dead && request->max_chunk_bytes() > 0 &&
+                 DataTypeCanUseMemcpy(tensor.dtype()) &&
+                 static_cast<int64>(tensor.TotalBytes()) >
+                     request->max_chunk_bytes()) {
+        // Only the metadata goes on the wire, and the receiver fetches the
+        // content with RecvTensorChunk requests into the tensor it allocates
+        // from it. This avoids holding a second copy of the whole content on
+        // either side.
+        RecvTensorResponse chunked_response;
+        chunked_response.set_require_ack(cache_enabled);
+        chunked_response.set_send_start_micros(env_->env->NowMicros());
+        chunked_response.mutable_tensor()->set_dtype(tensor.dtype());
+        tensor.shape().AsProto(
+            chunked_response.mutable_tensor()->mutable_tensor_shape());
+        ChunkedTensor chunked;
+        chunked.set_handle(
+            chunked_tensors_.Add(request->step_id(), tensor));
+        chunked_response.mutable_transport_options()->PackFrom(chunked);
+        grpc::EncodeRecvTensorResponseToByteBuffer(chunked_response, response);
+      } else {
+        grpc::EncodeTensorToByteBuffer(is_dead, tensor, cache_enabled,
+                                       request->compression(), response);
+      }
     }
     done(status);
   };
@@ -555,6 +607,13 @@ void GrpcWorker::GrpcRecvTensorAsync(CallOptions* opts,
       });
 }
 
+void GrpcWorker::RecvTensorChunkAsync(CallOptions* opts,
+                                      const RecvTensorChunkRequest* request,
+                                      RecvTensorChunkResponse* response,
+                                      StatusCallback done) {
+  done(chunked_tensors_.ReadChunk(*request, response));
+}
+
 namespace {
 // If RecvBufRespExtra.tensor_content is a single large string, then gRPC
 // can stall on the recv side when the string buffer needs to be enlarged,
@@ -734,6 +793,9 @@ void GrpcWorker::CleanupGraphAsync(const CleanupGraphRequest* request,
     // a worker crashes before acking a request.
     response_cache_->CleanEntriesForStep(request->step_id());
   }
+  // Drop the tensors of this step that the receivers did not fetch entirely,
+  // e.g. because they were aborted.
+  chunked_tensors_.CleanEntriesForStep(request->step_id());
   Worker::CleanupGraphAsync(request, response, done);
 }
 
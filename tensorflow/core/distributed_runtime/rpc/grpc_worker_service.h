@@ -19,6 +19,7 @@ limitations under the License.
 #include <memory>
 #include <unordered_map>
 #include "grpcpp/server_builder.h"
+#include "tensorflow/core/distributed_runtime/rpc/grpc_chunked_tensor_store.h"
 #include "tensorflow/core/distributed_runtime/rpc/grpc_response_cache.h"
 #include "tensorflow/core/distributed_runtime/rpc/grpc_worker_service_impl.h"
 #include "tensorflow/core/distributed_runtime/worker.h"
@@ -49,6 +50,14 @@ class GrpcWorker : public Worker {
   void LoggingAsync(const LoggingRequest* request, LoggingResponse* response,
                     StatusCallback done) override;
 
+  // Returns a range of the content of a tensor that GrpcRecvTensorAsync
+  // returned without content, because it is larger than the max_chunk_bytes
+  // of the request.
+  void RecvTensorChunkAsync(CallOptions* opts,
+                            const RecvTensorChunkRequest* request,
+                            RecvTensorChunkResponse* response,
+                            StatusCallback done) override;
+
   void RecvBufAsync(CallOptions* opts, const RecvBufRequest* request,
                     RecvBufResponse* response, StatusCallback done) override;
 
@@ -64,6 +73,7 @@ class GrpcWorker : public Worker {
 
  private:
   std::unique_ptr<GrpcResponseCache> response_cache_;
+  GrpcChunkedTensorStore chunked_tensors_;
   const int32 recv_buf_max_chunk_;
 };
 
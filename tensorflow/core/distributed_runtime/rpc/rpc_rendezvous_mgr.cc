@@ -15,13 +15,17 @@ limitations under the License.
 
 #include "tensorflow/core/distributed_runtime/rpc/rpc_rendezvous_mgr.h"
 
+#include <algorithm>
+#include <memory>
 #include <unordered_set>
+#include <vector>
 
 #include "tensorflow/core/common_runtime/device.h"
 #include "tensorflow/core/common_runtime/device_mgr.h"
 #include "tensorflow/core/common_runtime/dma_helper.h"
 #include "tensorflow/core/common_runtime/process_util.h"
 #include "tensorflow/core/distributed_runtime/request_id.h"
+#include "tensorflow/core/distributed_runtime/rpc/shared_memory_transport.h"
 #include "tensorflow/core/distributed_runtime/tensor_coding.h"
 #include "tensorflow/core/distributed_runtime/worker_cache.h"
 #include "tensorflow/core/distributed_runtime/worker_interface.h"
@@ -33,11 +37,76 @@ limitations under the License.
 #include "tensorflow/core/platform/macros.h"
 #include "tensorflow/core/platform/notification.h"
 #include "tensorflow/core/platform/types.h"
+#include "tensorflow/core/protobuf/transport_options.pb.h"
+#include "tensorflow/core/util/env_var.h"
 
 namespace tensorflow {
 
 namespace {
 
+// Returns the encoding that the response to a RecvTensor for 'parsed' may
+// use. It is set by TF_GRPC_RECV_TENSOR_COMPRESSION ("snappy", or the lossy
+// "bfloat16" and "half"), for the edges whose name contains one of the comma
+// separated TF_GRPC_RECV_TENSOR_COMPRESSION_EDGES, or for all edges if that
+// is not set.
+RecvTensorCompression GetRecvCompression(const Rendezvous::ParsedKey& parsed) {
+  struct Config {
+    RecvTensorCompression compression = RECV_TENSOR_COMPRESSION_NONE;
+    std::vector<string> edges;
+  };
+  static const Config* config = []() {
+    Config* config = new Config;
+    string name;
+    TF_CHECK_OK(
+        ReadStringFromEnvVar("TF_GRPC_RECV_TENSOR_COMPRESSION", "", &name));
+    name = str_util::Lowercase(name);
+    if (name == "snappy") {
+      config->compression = RECV_TENSOR_COMPRESSION_SNAPPY;
+    } else if (name == "bfloat16") {
+      config->compression = RECV_TENSOR_COMPRESSION_BFLOAT16;
+    } else if (name == "half") {
+      config->compression = RECV_TENSOR_COMPRESSION_HALF;
+    } else if (!name.empty() && name != "none") {
+      LOG(WARNING) << "Unknown TF_GRPC_RECV_TENSOR_COMPRESSION: " << name;
+    }
+    string edges;
+    TF_CHECK_OK(ReadStringFromEnvVar("TF_GRPC_RECV_TENSOR_COMPRESSION_EDGES",
+                                     "", &edges));
+    config->edges = str_util::Split(edges, ',', str_util::SkipEmpty());
+    return config;
+  }();
+  if (config->edges.empty()) return config->compression;
+  for (const string& edge : config->edges) {
+    if (str_util::StrContains(parsed.edge_name, edge)) {
+      return config->compression;
+    }
+  }
+  return RECV_TENSOR_COMPRESSION_NONE;
+}
+
+// Receiving of tensors whose content is fetched in chunks, set by
+// TF_GRPC_RECV_TENSOR_CHUNK_BYTES, the size of the chunks (zero disables it),
+// and TF_GRPC_RECV_TENSOR_CHUNKS_IN_FLIGHT, the number of chunks of a tensor
+// fetched concurrently. Together, they bound the memory of a tensor in flight
+// on both sides, in addition to the tensor itself.
+struct RecvChunkConfig {
+  int64 chunk_bytes = 0;
+  int64 chunks_in_flight = 4;
+};
+
+const RecvChunkConfig& GetRecvChunkConfig() {
+  static const RecvChunkConfig* config = []() {
+    RecvChunkConfig* config = new RecvChunkConfig;
+    TF_CHECK_OK(ReadInt64FromEnvVar("TF_GRPC_RECV_TENSOR_CHUNK_BYTES", 0,
+                                    &config->chunk_bytes));
+    TF_CHECK_OK(ReadInt64FromEnvVar("TF_GRPC_RECV_TENSOR_CHUNKS_IN_FLIGHT", 4,
+                                    &config->chunks_in_flight));
+    config->chunks_in_flight = std::max<int64>(config->chunks_in_flight, 1);
+    return config;
+  }();
+  return *config;
+}
+
 class RpcRemoteRendezvous : public BaseRemoteRendezvous {
  public:
   RpcRemoteRendezvous(const WorkerEnv* env, int64 step_id)
@@ -61,6 +130,7 @@ class RpcRecvTensorCall : public BaseRecvTensorCall {
 
   void Init(WorkerInterface* wi, int64 step_id, StringPiece key,
             AllocatorAttributes alloc_attrs, Device* dst_device,
+            RecvTensorCompression compression,
             const Rendezvous::Args& recv_args, Rendezvous::DoneCallback done) {
     wi_ = wi;
     alloc_attrs_ = alloc_attrs;
@@ -70,6 +140,18 @@ class RpcRecvTensorCall : public BaseRecvTensorCall {
     req_.set_step_id(step_id);
     req_.set_rendezvous_key(key.data(), key.size());
     req_.set_request_id(GetUniqueRequestId());
+    // Tensor content from shared memory, compressed or in chunks is copied
+    // into the tensor allocated by TensorResponse, which is only in host
+    // memory for these devices.
+    if (alloc_attrs.on_host() ||
+        dst_device->attributes().device_type() == DEVICE_CPU) {
+      shared_memory_ = SharedMemoryTransport::Get();
+      if (shared_memory_ != nullptr) {
+        shared_memory_->AddRecvOptions(&req_);
+      }
+      req_.set_compression(compression);
+      req_.set_max_chunk_bytes(GetRecvChunkConfig().chunk_bytes);
+    }
   }
 
   void Reset() {
@@ -80,6 +162,7 @@ class RpcRecvTensorCall : public BaseRecvTensorCall {
 
     alloc_attrs_ = AllocatorAttributes();
     dst_device_ = nullptr;
+    shared_memory_ = nullptr;
     // We don't clear opts_ and assume that Init will set up the state for
     // opts_ appropriately.
     req_.Clear();
@@ -87,6 +170,10 @@ class RpcRecvTensorCall : public BaseRecvTensorCall {
     {
       mutex_lock l(mu_);
       status_ = Status::OK();
+      next_chunk_offset_ = 0;
+      chunks_in_flight_ = 0;
+      chunks_done_ = nullptr;
+      chunk_calls_.clear();
     }
     done_ = nullptr;
   }
@@ -104,11 +191,16 @@ class RpcRecvTensorCall : public BaseRecvTensorCall {
   }
 
   void StartAbort(const Status& s) override {
+    std::vector<std::shared_ptr<ChunkCall>> chunk_calls;
     {
       mutex_lock l(mu_);
       status_.Update(s);
+      chunk_calls.assign(chunk_calls_.begin(), chunk_calls_.end());
     }
     opts_.StartCancel();
+    for (const auto& chunk : chunk_calls) {
+      chunk->opts.StartCancel();
+    }
   }
 
   Status status() const override {
@@ -134,6 +226,13 @@ class RpcRecvTensorCall : public BaseRecvTensorCall {
  private:
   friend class RpcRemoteRendezvous;
 
+  // A RecvTensorChunk request.
+  struct ChunkCall {
+    CallOptions opts;
+    RecvTensorChunkRequest req;
+    RecvTensorChunkResponse resp;
+  };
+
   // Start the main RecvTensor call, checking for an async abort.
   void StartRTCall(std::function<void()> recv_done) {
     resp_.InitAlloc(dst_device_, alloc_attrs_);
@@ -143,9 +242,32 @@ class RpcRecvTensorCall : public BaseRecvTensorCall {
       // Make sure the Rendezvous abort checking is finished before running the
       // callback, which might destroy the current call object.
       abort_checked->WaitForNotification();
-      if (!s.ok()) {
+      Status status = s;
+      if (status.ok() &&
+          SharedMemoryTransport::HasSharedMemoryTensor(resp_.metadata())) {
+        if (shared_memory_ == nullptr) {
+          status = errors::Internal(
+              "Received a shared memory tensor without asking for one");
+        } else {
+          // The tensor shares its buffer with resp_.tensor().
+          Tensor tensor = resp_.tensor();
+          status = shared_memory_->ReadTensor(resp_.metadata(), &tensor);
+        }
+      }
+      ChunkedTensor chunked;
+      if (status.ok() &&
+          resp_.metadata().transport_options().UnpackTo(&chunked)) {
+        if (req_.max_chunk_bytes() <= 0) {
+          status = errors::Internal(
+              "Received a chunked tensor without asking for one");
+        } else {
+          RecvChunks(chunked.handle(), recv_done);
+          return;
+        }
+      }
+      if (!status.ok()) {
         mutex_lock l(mu_);
-        status_.Update(s);
+        status_.Update(status);
       }
       recv_done();
     };
@@ -168,9 +290,100 @@ class RpcRecvTensorCall : public BaseRecvTensorCall {
     abort_checked->Notify();
   }
 
+  // Fetches the content of the chunked tensor 'handle' into resp_.tensor(),
+  // with at most chunks_in_flight RecvTensorChunk requests at a time, then
+  // calls 'recv_done'.
+  void RecvChunks(int64 handle, std::function<void()> recv_done) {
+    {
+      mutex_lock l(mu_);
+      next_chunk_offset_ = 0;
+      // Held until all the first chunks are requested.
+      chunks_in_flight_ = 1;
+      chunks_done_ = std::move(recv_done);
+    }
+    for (int64 i = 0; i < GetRecvChunkConfig().chunks_in_flight; ++i) {
+      StartNextChunk(handle);
+    }
+    ChunkDone(Status::OK());
+  }
+
+  // Requests the next chunk of the tensor content, unless it was entirely
+  // requested or the call failed. StartAbort cancels the chunk requests in
+  // flight.
+  //
+  // The caller holds a chunk in flight (see RecvChunks), so the call is alive
+  // until this returns.
+  void StartNextChunk(int64 handle) {
+    const int64 total_bytes = resp_.tensor().TotalBytes();
+    auto chunk = std::make_shared<ChunkCall>();
+    {
+      mutex_lock l(mu_);
+      if (!status_.ok() || next_chunk_offset_ >= total_bytes) return;
+      chunk->req.set_handle(handle);
+      chunk->req.set_offset(next_chunk_offset_);
+      chunk->req.set_num_bytes(std::min<int64>(
+          req_.max_chunk_bytes(), total_bytes - next_chunk_offset_));
+      next_chunk_offset_ += chunk->req.num_bytes();
+      ++chunks_in_flight_;
+      chunk_calls_.insert(chunk);
+    }
+    wi_->RecvTensorChunkAsync(
+        &chunk->opts, &chunk->req, &chunk->resp,
+        [this, handle, chunk](const Status& s) {
+          Status status = s;
+          if (status.ok()) {
+            const string& content = chunk->resp.content();
+            if (static_cast<int64>(content.size()) != chunk->req.num_bytes()) {
+              status = errors::Internal("Received a chunk of ",
+                                        content.size(), " bytes instead of ",
+                                        chunk->req.num_bytes());
+            } else {
+              // The tensor shares its buffer with resp_.tensor().
+              Tensor tensor = resp_.tensor();
+              char* head = reinterpret_cast<char*>(DMAHelper::base(&tensor));
+              memcpy(head + chunk->req.offset(), content.data(),
+                     content.size());
+            }
+          }
+          {
+            mutex_lock l(mu_);
+            chunk_calls_.erase(chunk);
+          }
+          if (status.ok()) {
+            StartNextChunk(handle);
+          }
+          ChunkDone(status);
+        });
+
+    // Like in StartRTCall, StartAbort may have run before the request set
+    // its cancellation callback.
+    Status s;
+    {
+      mutex_lock l(mu_);
+      s = status_;
+    }
+    if (!s.ok()) {
+      chunk->opts.StartCancel();
+    }
+  }
+
+  // Called when a chunk request completes, and calls the callback of
+  // RecvChunks if it was the last one.
+  void ChunkDone(const Status& s) {
+    std::function<void()> recv_done;
+    {
+      mutex_lock l(mu_);
+      status_.Update(s);
+      if (--chunks_in_flight_ > 0) return;
+      recv_done = std::move(chunks_done_);
+    }
+    recv_done();
+  }
+
   string src_worker_;
   string src_rel_device_;
   WorkerInterface* wi_;  // Not owned.
+  SharedMemoryTransport* shared_memory_ = nullptr;  // Not owned.
   AllocatorAttributes alloc_attrs_;
   Device* dst_device_;
   CallOptions opts_;
@@ -181,6 +394,13 @@ class RpcRecvTensorCall : public BaseRecvTensorCall {
 
   mutable mutex mu_;
   Status status_ TF_GUARDED_BY(mu_);
+  // The start of the tensor content not requested yet by RecvChunks.
+  int64 next_chunk_offset_ TF_GUARDED_BY(mu_) = 0;
+  int chunks_in_flight_ TF_GUARDED_BY(mu_) = 0;
+  std::function<void()> chunks_done_ TF_GUARDED_BY(mu_);
+  // The chunk requests in flight, cancelled by StartAbort.
+  std::unordered_set<std::shared_ptr<ChunkCall>> chunk_calls_
+      TF_GUARDED_BY(mu_);
 
   TF_DISALLOW_COPY_AND_ASSIGN(RpcRecvTensorCall);
 };
@@ -270,7 +490,7 @@ void RpcRemoteRendezvous::RecvFromRemoteAsync(
   }
 
   call->Init(rwi, step_id_, parsed.FullKey(), recv_args.alloc_attrs, dst_device,
-             recv_args, std::move(done));
+             GetRecvCompression(parsed), recv_args, std::move(done));
 
   // Record "call" in active_ so that it can be aborted cleanly.
   RegisterCall(call, recv_args);
@@ -15,10 +15,18 @@ limitations under the License.
 
 #include "tensorflow/core/distributed_runtime/rpc/rpc_rendezvous_mgr.h"
 
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
 #include "tensorflow/core/common_runtime/process_util.h"
 #include "tensorflow/core/distributed_runtime/test_utils.h"
+#include "tensorflow/core/framework/allocator.h"
 #include "tensorflow/core/framework/cancellation.h"
 #include "tensorflow/core/framework/control_flow.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/notification.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
@@ -27,6 +35,7 @@ limitations under the License.
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/random.h"
 #include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/protobuf/transport_options.pb.h"
 
 namespace tensorflow {
 
@@ -51,6 +60,15 @@ Rendezvous::ParsedKey MakeKey(const string& s) {
 }
 
 namespace {
+// Receives of tensors larger than 1KB fetch their content in chunks, at most
+// two at a time. The configuration is read once per process, so it applies to
+// all the tests.
+const bool kChunksConfigured = []() {
+  setenv("TF_GRPC_RECV_TENSOR_CHUNK_BYTES", "1024", 1);
+  setenv("TF_GRPC_RECV_TENSOR_CHUNKS_IN_FLIGHT", "2", 1);
+  return true;
+}();
+
 // A dummy worker interface implementation that simply triggers the callback
 // with OK status for RecvTensor request.
 class DummyWorker : public TestWorkerInterface {
@@ -68,8 +86,127 @@ class DummyWorker : public TestWorkerInterface {
   }
 };
 
+// A worker that sends a float tensor of 'num_values' values in chunks.
+class ChunkedWorker : public TestWorkerInterface {
+ public:
+  static constexpr int64 kHandle = 42;
+
+  explicit ChunkedWorker(int64 num_values)
+      : tensor_(DT_FLOAT, TensorShape({num_values})) {
+    test::FillIota<float>(&tensor_, 1.0f);
+  }
+
+  const Tensor& tensor() const { return tensor_; }
+
+  // Makes the chunk requests after the first 'num_chunks' ones fail with
+  // 'status', or if 'status' is OK, wait until they are cancelled.
+  void FailChunksAfter(int num_chunks, const Status& status) {
+    mutex_lock l(mu_);
+    num_good_chunks_ = num_chunks;
+    chunk_status_ = status;
+  }
+
+  // Waits until 'num_chunks' chunk requests wait to be cancelled.
+  void WaitForPendingChunks(int num_chunks) {
+    mutex_lock l(mu_);
+    while (num_pending_chunks_ < num_chunks) cv_.wait(l);
+  }
+
+  int64 num_bytes_sent() {
+    mutex_lock l(mu_);
+    return num_bytes_sent_;
+  }
+
+  int max_chunks_in_flight() {
+    mutex_lock l(mu_);
+    return max_chunks_in_flight_;
+  }
+
+  void RecvTensorAsync(CallOptions* opts, const RecvTensorRequest* request,
+                       TensorResponse* response, StatusCallback done) override {
+    EXPECT_EQ(1024, request->max_chunk_bytes());
+    RecvTensorResponse metadata;
+    metadata.mutable_tensor()->set_dtype(tensor_.dtype());
+    tensor_.shape().AsProto(metadata.mutable_tensor()->mutable_tensor_shape());
+    ChunkedTensor chunked;
+    chunked.set_handle(kHandle);
+    metadata.mutable_transport_options()->PackFrom(chunked);
+    Status s = response->InitFrom(&metadata);
+    SchedClosure([s, done = std::move(done)]() { done(s); });
+  }
+
+  void RecvTensorChunkAsync(CallOptions* opts,
+                            const RecvTensorChunkRequest* request,
+                            RecvTensorChunkResponse* response,
+                            StatusCallback done) override {
+    EXPECT_EQ(kHandle, request->handle());
+    const int64 total_bytes = tensor_.TotalBytes();
+    EXPECT_GE(request->offset(), 0);
+    EXPECT_LE(request->offset() + request->num_bytes(), total_bytes);
+    Status s;
+    {
+      mutex_lock l(mu_);
+      max_chunks_in_flight_ =
+          std::max(max_chunks_in_flight_, ++chunks_in_flight_);
+      if (num_good_chunks_ >= 0 && num_chunks_ >= num_good_chunks_) {
+        s = chunk_status_;
+        if (s.ok()) {
+          // Like a gRPC request, completes asynchronously once cancelled.
+          auto cancelled = std::make_shared<std::atomic<bool>>(false);
+          opts->SetCancelCallback([this, cancelled, done]() {
+            if (cancelled->exchange(true)) return;
+            SchedClosure([this, done]() {
+              {
+                mutex_lock l(mu_);
+                --chunks_in_flight_;
+              }
+              done(errors::Cancelled("RecvTensorChunk cancelled"));
+            });
+          });
+          ++num_pending_chunks_;
+          cv_.notify_all();
+          return;
+        }
+      }
+      ++num_chunks_;
+      if (s.ok()) num_bytes_sent_ += request->num_bytes();
+    }
+    if (s.ok()) {
+      const char* head = tensor_.tensor_data().data();
+      response->set_content(head + request->offset(), request->num_bytes());
+    }
+    SchedClosure([this, s, done = std::move(done)]() {
+      {
+        mutex_lock l(mu_);
+        --chunks_in_flight_;
+      }
+      done(s);
+    });
+  }
+
+ private:
+  Tensor tensor_;
+
+  mutex mu_;
+  condition_variable cv_;
+  int num_good_chunks_ TF_GUARDED_BY(mu_) = -1;
+  Status chunk_status_ TF_GUARDED_BY(mu_);
+  int num_chunks_ TF_GUARDED_BY(mu_) = 0;
+  int num_pending_chunks_ TF_GUARDED_BY(mu_) = 0;
+  int64 num_bytes_sent_ TF_GUARDED_BY(mu_) = 0;
+  int chunks_in_flight_ TF_GUARDED_BY(mu_) = 0;
+  int max_chunks_in_flight_ TF_GUARDED_BY(mu_) = 0;
+};
+
+constexpr int64 ChunkedWorker::kHandle;
+
 // Fake cache implementation for WorkerEnv.
 class DummyWorkerCache : public WorkerCacheInterface {
+ public:
+  // Returns 'worker' if not null, or a DummyWorker, for all targets.
+  explicit DummyWorkerCache(WorkerInterface* worker = nullptr)
+      : dummy_remote_worker_(worker) {}
+
   void ListWorkers(std::vector<string>* workers) const override {}
   void ListWorkersInJob(const string& job_name,
                         std::vector<string>* workers) const override {}
@@ -92,7 +229,7 @@ class DummyWorkerCache : public WorkerCacheInterface {
                               StatusCallback done) override {}
 
  private:
-  DummyWorker* dummy_remote_worker_ = nullptr;
+  WorkerInterface* dummy_remote_worker_ = nullptr;
 };
 
 static Device* CreateDevice(const char* type, const char* name) {
@@ -100,7 +237,9 @@ static Device* CreateDevice(const char* type, const char* name) {
    public:
     explicit FakeDevice(const DeviceAttributes& attr) : Device(nullptr, attr) {}
     Status Sync() override { return Status::OK(); }
-    Allocator* GetAllocator(AllocatorAttributes) override { return nullptr; }
+    Allocator* GetAllocator(AllocatorAttributes) override {
+      return cpu_allocator();
+    }
   };
   DeviceAttributes attr;
   attr.set_name(name);
@@ -344,4 +483,80 @@ TEST_F(RpcRendezvousMgrTest, RemoteRecvAsyncMany) {
   rmgr_.Cleanup(step_id);
 }
 
+class RpcRendezvousMgrChunksTest : public RpcRendezvousMgrTest {
+ protected:
+  RpcRendezvousMgrChunksTest()
+      : worker_(new ChunkedWorker(1000)),
+        chunked_session_("chunked_session", "/job:mnist/replica:1/task:2",
+                         std::unique_ptr<WorkerCacheInterface>(
+                             new DummyWorkerCache(worker_)),
+                         std::unique_ptr<DeviceMgr>(CreateDeviceMgr()),
+                         std::unique_ptr<GraphMgr>(), nullptr) {}
+
+  // Receives the tensor of worker_ with 'rendez', and returns the status.
+  Status Recv(RemoteRendezvous* rendez, Tensor* val) {
+    const Rendezvous::ParsedKey key = MakeKey(Rendezvous::CreateKey(
+        "/job:worker/replica:1/task:2/cpu:0", 7890,
+        "/job:mnist/replica:1/task:2/cpu:1", "foo", FrameAndIter(0, 0)));
+    bool val_dead = false;
+    return rendez->Recv(key, Rendezvous::Args(), val, &val_dead);
+  }
+
+  ChunkedWorker* worker_;  // Owned by chunked_session_.
+  WorkerSession chunked_session_;
+};
+
+TEST_F(RpcRendezvousMgrChunksTest, RecvChunks) {
+  const int64 step_id = 123;
+  {
+    RemoteRendezvous* rendez = rmgr_.Find(step_id);
+    TF_ASSERT_OK(rendez->Initialize(&chunked_session_));
+    core::ScopedUnref unref(rendez);
+    Tensor val;
+    TF_ASSERT_OK(Recv(rendez, &val));
+    test::ExpectTensorEqual<float>(worker_->tensor(), val);
+    // Every byte is fetched once, in chunks of at most 1KB.
+    EXPECT_EQ(worker_->tensor().TotalBytes(), worker_->num_bytes_sent());
+    EXPECT_LE(worker_->max_chunks_in_flight(), 2);
+  }
+  rmgr_.Cleanup(step_id);
+}
+
+TEST_F(RpcRendezvousMgrChunksTest, RecvChunkError) {
+  const int64 step_id = 123;
+  worker_->FailChunksAfter(1, errors::NotFound("No chunked tensor"));
+  {
+    RemoteRendezvous* rendez = rmgr_.Find(step_id);
+    TF_ASSERT_OK(rendez->Initialize(&chunked_session_));
+    core::ScopedUnref unref(rendez);
+    Tensor val;
+    EXPECT_TRUE(errors::IsNotFound(Recv(rendez, &val)));
+  }
+  rmgr_.Cleanup(step_id);
+}
+
+TEST_F(RpcRendezvousMgrChunksTest, AbortCancelsChunks) {
+  const int64 step_id = 123;
+  // The chunk requests after the first one never complete unless they are
+  // cancelled.
+  worker_->FailChunksAfter(1, Status::OK());
+  {
+    RemoteRendezvous* rendez = rmgr_.Find(step_id);
+    TF_ASSERT_OK(rendez->Initialize(&chunked_session_));
+    core::ScopedUnref unref(rendez);
+    Notification n;
+    Status status;
+    SchedClosure([this, rendez, &n, &status]() {
+      Tensor val;
+      status = Recv(rendez, &val);
+      n.Notify();
+    });
+    worker_->WaitForPendingChunks(2);
+    rendez->StartAbort(errors::Aborted("Step aborted"));
+    n.WaitForNotification();
+    EXPECT_TRUE(errors::IsAborted(status)) << status;
+  }
+  rmgr_.Cleanup(step_id);
+}
+
 }  // namespace tensorflow
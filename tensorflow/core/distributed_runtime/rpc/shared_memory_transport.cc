@@ -0,0 +1,607 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/distributed_runtime/rpc/shared_memory_transport.h"
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif  // defined(__linux__)
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#include "tensorflow/core/common_runtime/dma_helper.h"
+#include "tensorflow/core/framework/tensor.pb.h"
+#include "tensorflow/core/framework/tensor_shape.pb.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/random/random.h"
+#include "tensorflow/core/lib/strings/str_util.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/util/env_var.h"
+
+namespace tensorflow {
+
+namespace {
+
+// Tensors smaller than this are cheap enough to send in the response.
+constexpr int64 kMinTensorBytes = 16 * 1024;
+
+// Blocks that no receiver claims within this time are freed when the arena
+// is full. Their receiver gets an error if it shows up after all.
+constexpr int64 kBlockExpiryMicros = 60 * 1000 * 1000;
+
+// The receiver unmaps the arenas of senders that exited at most this often.
+constexpr int64 kArenaPruneMicros = 60 * 1000 * 1000;
+
+// The name of the memfds of probes and arenas. Other processes only open
+// memfds with this prefix.
+constexpr char kSegmentNamePrefix[] = "tf_recv_tensor_";
+
+constexpr uint64 kArenaMagic = 0x74666172656e6131;  // "tfarena1"
+
+// The arena starts with an ArenaHeader, followed by a ring of blocks, each
+// made of a BlockHeader and the tensor content.
+constexpr int64 kAlignment = 64;
+constexpr int64 kArenaHeaderSize = kAlignment;
+constexpr int64 kBlockHeaderSize = kAlignment;
+
+struct ArenaHeader {
+  uint64 magic;
+  uint64 id;
+};
+
+// The sender allocates a block in state kWriting. Once the content is
+// written, the receiver can claim it (kReading), and then releases it back
+// to the sender (kReleased). Blocks are only freed in the released state.
+enum BlockState : uint64 {
+  kWriting = 0,
+  kWritten = 1,
+  kReading = 2,
+  kReleased = 3,
+};
+
+// Each allocation gets a new generation, stored with the state in a single
+// atomic word. A receiver only claims the block of the generation in its
+// response, so a late receiver can't read the next tensor at the same
+// offset after its own block expired.
+constexpr int kBlockStateBits = 2;
+constexpr uint64 kBlockStateMask = (1 << kBlockStateBits) - 1;
+
+uint64 BlockWord(uint64 generation, BlockState state) {
+  return generation << kBlockStateBits | state;
+}
+
+struct BlockHeader {
+  // Shared by the processes that map the arena. See BlockWord().
+  std::atomic<uint64> state;
+  int64 size;  // Including the header.
+  int64 content_size;
+  int64 write_micros;
+};
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+              "Blocks are handed off between processes with lock-free "
+              "atomics.");
+static_assert(sizeof(ArenaHeader) <= kArenaHeaderSize, "");
+static_assert(sizeof(BlockHeader) <= kBlockHeaderSize, "");
+
+}  // namespace
+
+// A memfd mapped into this process, which other processes can open through
+// its /proc path while the process that created it is alive.
+class SharedMemoryTransport::Segment {
+ public:
+  // Creates a segment of 'size' bytes, initialized to zeros.
+  static Status Create(const char* name, int64 size,
+                       std::unique_ptr<Segment>* segment);
+
+  // Maps the segment at 'path', created by Create() in another process.
+  // Since 'path' comes from a peer, any other file is rejected.
+  static Status Open(const string& path, bool writable,
+                     std::unique_ptr<Segment>* segment);
+
+  ~Segment();
+
+  char* data() const { return data_; }
+  int64 size() const { return size_; }
+  const string& path() const { return path_; }
+
+  // Returns true if path() still leads to this segment, i.e. if the process
+  // that created it is alive.
+  bool IsAlive() const;
+
+ private:
+  Segment(string path, int fd, char* data, int64 size, uint64 device,
+          uint64 inode)
+      : path_(std::move(path)),
+        fd_(fd),
+        data_(data),
+        size_(size),
+        device_(device),
+        inode_(inode) {}
+
+  const string path_;
+  const int fd_;  // Only for segments created by this process, or -1.
+  char* const data_;
+  const int64 size_;
+  // Identify the file of the segment.
+  const uint64 device_;
+  const uint64 inode_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(Segment);
+};
+
+#if defined(__linux__) && defined(__NR_memfd_create)
+
+Status SharedMemoryTransport::Segment::Create(
+    const char* name, int64 size, std::unique_ptr<Segment>* segment) {
+  constexpr unsigned int kMemfdCloexec = 0x0001U;  // MFD_CLOEXEC
+  const int fd = syscall(__NR_memfd_create, name, kMemfdCloexec);
+  if (fd < 0) {
+    return errors::Unavailable("memfd_create failed: ", strerror(errno));
+  }
+  // Reserve all pages now: writing to a page that the host can't provide
+  // later would raise SIGBUS.
+  const int error = posix_fallocate(fd, 0, size);
+  if (error != 0) {
+    close(fd);
+    return errors::ResourceExhausted("Cannot reserve ", size,
+                                     " bytes of shared memory: ",
+                                     strerror(error));
+  }
+  void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    close(fd);
+    return errors::Unavailable("mmap failed: ", strerror(errno));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    munmap(data, size);
+    close(fd);
+    return errors::Unavailable("fstat failed: ", strerror(errno));
+  }
+  segment->reset(new Segment(strings::StrCat("/proc/", getpid(), "/fd/", fd),
+                             fd, static_cast<char*>(data), size, st.st_dev,
+                             st.st_ino));
+  return Status::OK();
+}
+
+Status SharedMemoryTransport::Segment::Open(const string& path,
+                                            bool writable,
+                                            std::unique_ptr<Segment>* segment) {
+  // Only paths of the form /proc/<pid>/fd/<fd>, as made by Create().
+  StringPiece rest = path;
+  uint64 pid, fd_number;
+  if (!str_util::ConsumePrefix(&rest, "/proc/") ||
+      !str_util::ConsumeLeadingDigits(&rest, &pid) ||
+      !str_util::ConsumePrefix(&rest, "/fd/") ||
+      !str_util::ConsumeLeadingDigits(&rest, &fd_number) || !rest.empty()) {
+    return errors::InvalidArgument("Not a shared memory segment: ", path);
+  }
+  // No symlink is followed on the way to the fd directory. The last component
+  // is the link of the fd to its file, which O_NOFOLLOW would refuse, so its
+  // target is checked to be a memfd of this transport instead.
+  const int dir_fd = open(strings::StrCat("/proc/", pid, "/fd").c_str(),
+                          O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if (dir_fd < 0) {
+    return errors::Unavailable("Cannot open the fd directory of ", path, ": ",
+                               strerror(errno));
+  }
+  const string fd_name = strings::StrCat(fd_number);
+  char target[128];
+  const ssize_t target_size =
+      readlinkat(dir_fd, fd_name.c_str(), target, sizeof(target));
+  if (target_size < 0 ||
+      !str_util::StartsWith(StringPiece(target, target_size),
+                        strings::StrCat("/memfd:", kSegmentNamePrefix))) {
+    close(dir_fd);
+    return errors::InvalidArgument("Not a shared memory segment: ", path);
+  }
+  // Non-blocking, in case the fd was replaced by a FIFO in the meantime.
+  const int fd =
+      openat(dir_fd, fd_name.c_str(),
+             (writable ? O_RDWR : O_RDONLY) | O_NONBLOCK | O_CLOEXEC);
+  close(dir_fd);
+  if (fd < 0) {
+    return errors::Unavailable("Cannot open ", path, ": ", strerror(errno));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+    close(fd);
+    return errors::InvalidArgument("Not a shared memory segment: ", path);
+  }
+  void* data = mmap(nullptr, st.st_size,
+                    writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED,
+                    fd, 0);
+  // The mapping keeps the file alive.
+  close(fd);
+  if (data == MAP_FAILED) {
+    return errors::Unavailable("Cannot map ", path, ": ", strerror(errno));
+  }
+  segment->reset(new Segment(path, -1, static_cast<char*>(data), st.st_size,
+                             st.st_dev, st.st_ino));
+  return Status::OK();
+}
+
+bool SharedMemoryTransport::Segment::IsAlive() const {
+  struct stat st;
+  return stat(path_.c_str(), &st) == 0 &&
+         static_cast<uint64>(st.st_dev) == device_ &&
+         static_cast<uint64>(st.st_ino) == inode_;
+}
+
+SharedMemoryTransport::Segment::~Segment() {
+  munmap(data_, size_);
+  if (fd_ >= 0) close(fd_);
+}
+
+#else
+
+Status SharedMemoryTransport::Segment::Create(
+    const char* name, int64 size, std::unique_ptr<Segment>* segment) {
+  return errors::Unimplemented("Shared memory transport requires Linux.");
+}
+
+Status SharedMemoryTransport::Segment::Open(const string& path,
+                                            bool writable,
+                                            std::unique_ptr<Segment>* segment) {
+  return errors::Unimplemented("Shared memory transport requires Linux.");
+}
+
+bool SharedMemoryTransport::Segment::IsAlive() const { return false; }
+
+SharedMemoryTransport::Segment::~Segment() {}
+
+#endif  // defined(__linux__) && defined(__NR_memfd_create)
+
+namespace {
+
+BlockHeader* GetBlockHeader(char* arena, int64 offset) {
+  return reinterpret_cast<BlockHeader*>(arena + offset);
+}
+
+}  // namespace
+
+/* static */
+SharedMemoryTransport* SharedMemoryTransport::Get() {
+  static SharedMemoryTransport* transport = []() -> SharedMemoryTransport* {
+    int64 arena_mb;
+    Status s =
+        ReadInt64FromEnvVar("TF_GRPC_SHARED_MEMORY_ARENA_MB", 0, &arena_mb);
+    if (!s.ok()) {
+      LOG(WARNING) << s;
+      return nullptr;
+    }
+    if (arena_mb <= 0) return nullptr;
+    std::unique_ptr<SharedMemoryTransport> transport;
+    s = Create(arena_mb << 20, &transport);
+    if (!s.ok()) {
+      LOG(WARNING) << "Sending tensors through gRPC only: " << s;
+      return nullptr;
+    }
+    return transport.release();
+  }();
+  return transport;
+}
+
+/* static */
+Status SharedMemoryTransport::Create(
+    int64 arena_bytes, std::unique_ptr<SharedMemoryTransport>* transport) {
+  arena_bytes = arena_bytes / kAlignment * kAlignment;
+  if (arena_bytes < kArenaHeaderSize + kBlockHeaderSize + kMinTensorBytes) {
+    return errors::InvalidArgument("Shared memory arena of ", arena_bytes,
+                                   " bytes is too small.");
+  }
+  std::unique_ptr<Segment> arena;
+  TF_RETURN_IF_ERROR(
+      Segment::Create("tf_recv_tensor_arena", arena_bytes, &arena));
+  transport->reset(new SharedMemoryTransport(std::move(arena)));
+  return Status::OK();
+}
+
+SharedMemoryTransport::SharedMemoryTransport(std::unique_ptr<Segment> arena)
+    : arena_(std::move(arena)),
+      arena_id_(random::New64()),
+      head_(kArenaHeaderSize),
+      tail_(kArenaHeaderSize) {
+  ArenaHeader* header = reinterpret_cast<ArenaHeader*>(arena_->data());
+  header->magic = kArenaMagic;
+  header->id = arena_id_;
+}
+
+SharedMemoryTransport::~SharedMemoryTransport() {}
+
+void SharedMemoryTransport::AddRecvOptions(RecvTensorRequest* request) {
+  SharedMemoryRecvOptions options;
+  {
+    mutex_lock l(mu_);
+    if (probe_ == nullptr) {
+      if (probe_failed_) return;
+      Status s = Segment::Create("tf_recv_tensor_probe", kAlignment, &probe_);
+      if (!s.ok()) {
+        LOG(WARNING) << "Receiving tensors through gRPC only: " << s;
+        probe_failed_ = true;
+        return;
+      }
+      probe_token_ = random::New64();
+      std::memcpy(probe_->data(), &probe_token_, sizeof(probe_token_));
+    }
+    options.set_probe_path(probe_->path());
+    options.set_token(probe_token_);
+  }
+  request->mutable_transport_options()->PackFrom(options);
+}
+
+bool SharedMemoryTransport::IsLocalReceiver(
+    const SharedMemoryRecvOptions& options) {
+  const string key =
+      strings::StrCat(options.probe_path(), ":", options.token());
+  {
+    mutex_lock l(mu_);
+    auto it = local_receivers_.find(key);
+    if (it != local_receivers_.end()) return it->second;
+  }
+  // Receivers on other hosts have no such file, or (e.g. in another
+  // container) not the same one.
+  std::unique_ptr<Segment> probe;
+  bool is_local = false;
+  if (Segment::Open(options.probe_path(), /*writable=*/false, &probe).ok() &&
+      probe->size() >= static_cast<int64>(sizeof(uint64))) {
+    uint64 token;
+    std::memcpy(&token, probe->data(), sizeof(token));
+    is_local = token == options.token();
+  }
+  VLOG(1) << "Receiver " << options.probe_path()
+          << (is_local ? " is" : " is not") << " on this host";
+  mutex_lock l(mu_);
+  local_receivers_.emplace(key, is_local);
+  return is_local;
+}
+
+bool SharedMemoryTransport::WriteTensor(const RecvTensorRequest& request,
+                                        const Tensor& val, bool require_ack,
+                                        RecvTensorResponse* response) {
+  if (!request.transport_options().Is<SharedMemoryRecvOptions>() ||
+      !DataTypeCanUseMemcpy(val.dtype()) ||
+      val.TotalBytes() < kMinTensorBytes) {
+    return false;
+  }
+  SharedMemoryRecvOptions options;
+  if (!request.transport_options().UnpackTo(&options) ||
+      !IsLocalReceiver(options)) {
+    return false;
+  }
+
+  const StringPiece content = val.tensor_data();
+  const int64 size = kBlockHeaderSize +
+                     (content.size() + kAlignment - 1) / kAlignment *
+                         kAlignment;
+  int64 offset;
+  {
+    mutex_lock l(mu_);
+    offset = AllocateLocked(size);
+  }
+  if (offset < 0) {
+    VLOG(1) << "Shared memory arena is full, sending " << content.size()
+            << " bytes through gRPC";
+    return false;
+  }
+  // The block is owned by this call until it is marked as written.
+  BlockHeader* header = GetBlockHeader(arena_->data(), offset);
+  std::memcpy(arena_->data() + offset + kBlockHeaderSize, content.data(),
+              content.size());
+  header->content_size = content.size();
+  header->write_micros = Env::Default()->NowMicros();
+  const uint64 generation =
+      header->state.load(std::memory_order_relaxed) >> kBlockStateBits;
+  header->state.store(BlockWord(generation, kWritten),
+                      std::memory_order_release);
+
+  response->Clear();
+  response->set_require_ack(require_ack);
+  response->set_send_start_micros(header->write_micros);
+  response->mutable_tensor()->set_dtype(val.dtype());
+  val.shape().AsProto(response->mutable_tensor()->mutable_tensor_shape());
+  SharedMemoryTensor location;
+  location.set_arena_path(arena_->path());
+  location.set_arena_id(arena_id_);
+  location.set_offset(offset);
+  location.set_generation(generation);
+  response->mutable_transport_options()->PackFrom(location);
+  return true;
+}
+
+/* static */
+bool SharedMemoryTransport::HasSharedMemoryTensor(
+    const RecvTensorResponse& response) {
+  return response.transport_options().Is<SharedMemoryTensor>();
+}
+
+Status SharedMemoryTransport::ReadTensor(const RecvTensorResponse& response,
+                                         Tensor* tensor) {
+  SharedMemoryTensor location;
+  if (!response.transport_options().UnpackTo(&location)) {
+    return errors::Internal("Cannot parse the location of a shared memory "
+                            "tensor");
+  }
+
+  std::shared_ptr<Segment> arena;
+  {
+    mutex_lock l(mu_);
+    bool opened_arena = false;
+    auto& cached = peer_arenas_[location.arena_path()];
+    // The path is reused when the sender exits and another process gets the
+    // same pid and file descriptor.
+    if (cached == nullptr || cached->size() < kArenaHeaderSize ||
+        reinterpret_cast<const ArenaHeader*>(cached->data())->id !=
+            location.arena_id()) {
+      std::unique_ptr<Segment> opened;
+      Status s =
+          Segment::Open(location.arena_path(), /*writable=*/true, &opened);
+      if (!s.ok()) {
+        peer_arenas_.erase(location.arena_path());
+        return s;
+      }
+      cached = std::move(opened);
+      opened_arena = true;
+    }
+    arena = cached;
+    // A new arena often means that another sender exited.
+    PruneArenasLocked(Env::Default()->NowMicros(), /*force=*/opened_arena);
+  }
+  const ArenaHeader* arena_header =
+      reinterpret_cast<const ArenaHeader*>(arena->data());
+  if (arena->size() < kArenaHeaderSize ||
+      arena_header->magic != kArenaMagic ||
+      arena_header->id != location.arena_id()) {
+    return errors::Unavailable("Shared memory arena ", location.arena_path(),
+                               " is gone");
+  }
+
+  const int64 offset = location.offset();
+  const StringPiece content = tensor->tensor_data();
+  if (offset < kArenaHeaderSize || offset % kAlignment != 0 ||
+      offset + kBlockHeaderSize + static_cast<int64>(content.size()) >
+          arena->size()) {
+    return errors::Internal("Invalid shared memory tensor at ", offset);
+  }
+  BlockHeader* header = GetBlockHeader(arena->data(), offset);
+  const uint64 generation = location.generation();
+  uint64 state = BlockWord(generation, kWritten);
+  if (!header->state.compare_exchange_strong(
+          state, BlockWord(generation, kReading), std::memory_order_acquire)) {
+    return errors::Aborted("Shared memory tensor at ", offset, " of ",
+                           location.arena_path(),
+                           " expired before it was received");
+  }
+  Status s;
+  if (header->content_size != static_cast<int64>(content.size())) {
+    s = errors::Internal("Shared memory tensor has ", header->content_size,
+                         " bytes, expected ", content.size());
+  } else {
+    const char* data = arena->data() + offset + kBlockHeaderSize;
+    std::memcpy(DMAHelper::base(tensor), data, content.size());
+  }
+  // The sender may have expired the block if this read took very long, and
+  // even reused it: the copy can't be trusted then.
+  state = BlockWord(generation, kReading);
+  if (!header->state.compare_exchange_strong(
+          state, BlockWord(generation, kReleased), std::memory_order_release)) {
+    return errors::Aborted("Shared memory tensor at ", offset, " of ",
+                           location.arena_path(),
+                           " expired while it was received");
+  }
+  return s;
+}
+
+size_t SharedMemoryTransport::NumPeerArenasForTesting() {
+  mutex_lock l(mu_);
+  return peer_arenas_.size();
+}
+
+void SharedMemoryTransport::PruneArenasLocked(int64 now_micros, bool force) {
+  if (!force && now_micros - last_arena_prune_micros_ < kArenaPruneMicros) {
+    return;
+  }
+  last_arena_prune_micros_ = now_micros;
+  for (auto it = peer_arenas_.begin(); it != peer_arenas_.end();) {
+    if (!it->second->IsAlive()) {
+      VLOG(1) << "Unmapping the shared memory arena of " << it->first
+              << ", whose sender exited";
+      it = peer_arenas_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+int64 SharedMemoryTransport::AllocateLocked(int64 size) {
+  ReclaimLocked(/*expire=*/false);
+  int64 offset = TryAllocateLocked(size);
+  if (offset < 0) {
+    ReclaimLocked(/*expire=*/true);
+    offset = TryAllocateLocked(size);
+  }
+  return offset;
+}
+
+int64 SharedMemoryTransport::TryAllocateLocked(int64 size) {
+  const int64 begin = kArenaHeaderSize;
+  const int64 end = arena_->size();
+  if (used_ == 0) {
+    head_ = tail_ = begin;
+  } else if (head_ == tail_) {
+    return -1;
+  }
+  if (used_ == 0 || head_ > tail_) {
+    // The free space is [head_, end) and [begin, tail_).
+    if (end - head_ < size) {
+      if (tail_ - begin < size) return -1;
+      // Skip the end of the ring with a block that is already released.
+      BlockHeader* skipped = GetBlockHeader(arena_->data(), head_);
+      skipped->size = end - head_;
+      skipped->state.store(BlockWord(0, kReleased),
+                           std::memory_order_relaxed);
+      used_ += end - head_;
+      head_ = begin;
+    }
+  }
+  if (head_ < tail_ && tail_ - head_ < size) return -1;
+  const int64 offset = head_;
+  BlockHeader* header = GetBlockHeader(arena_->data(), offset);
+  header->size = size;
+  header->state.store(BlockWord(++generation_, kWriting),
+                      std::memory_order_relaxed);
+  used_ += size;
+  head_ += size;
+  if (head_ == end) head_ = begin;
+  return offset;
+}
+
+void SharedMemoryTransport::ReclaimLocked(bool expire) {
+  const int64 now_micros = expire ? Env::Default()->NowMicros() : 0;
+  while (used_ > 0) {
+    BlockHeader* header = GetBlockHeader(arena_->data(), tail_);
+    uint64 state = header->state.load(std::memory_order_acquire);
+    const uint64 block_state = state & kBlockStateMask;
+    if (block_state != kReleased) {
+      // A block stays claimed if its receiver dies while reading it, so
+      // claimed blocks expire too.
+      if (!expire || (block_state != kWritten && block_state != kReading) ||
+          now_micros - header->write_micros < kBlockExpiryMicros ||
+          !header->state.compare_exchange_strong(
+              state, (state & ~kBlockStateMask) | kReleased,
+              std::memory_order_acquire)) {
+        break;
+      }
+      VLOG(1) << "Freeing shared memory tensor at " << tail_ << ", which was "
+              << (block_state == kWritten ? "never received"
+                                          : "not released by its receiver");
+    }
+    used_ -= header->size;
+    tail_ += header->size;
+    if (tail_ == arena_->size()) tail_ = kArenaHeaderSize;
+  }
+}
+
+}  // namespace tensorflow
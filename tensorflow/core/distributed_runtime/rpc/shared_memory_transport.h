@@ -0,0 +1,136 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_RPC_SHARED_MEMORY_TRANSPORT_H_
+#define TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_RPC_SHARED_MEMORY_TRANSPORT_H_
+
+#include <memory>
+#include <unordered_map>
+
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/platform/types.h"
+#include "tensorflow/core/protobuf/transport_options.pb.h"
+#include "tensorflow/core/protobuf/worker.pb.h"
+
+namespace tensorflow {
+
+// Moves the content of RecvTensor responses between worker processes on the
+// same host through shared memory, so that the RPC only carries the tensor
+// metadata.
+//
+// A receiver advertises a small probe file in the request. If the sender can
+// open it and read the expected token, both processes share a host (and a
+// view of its files), and the sender copies the tensor content into its
+// arena, a shared memory file of fixed size, instead of into the response.
+// The receiver maps the arena, copies the content out, and releases the
+// block by setting an atomic flag in the block header. The sender reuses the
+// space of released blocks, in allocation order, without any other message
+// from the receiver. Senders fall back to sending the content in the response
+// whenever the receiver is on another host, or the arena is full.
+//
+// Only Linux is supported: probe and arena files are memfds, which are
+// opened by other processes through /proc, and disappear with the process.
+class SharedMemoryTransport {
+ public:
+  // Returns the transport of this process, or nullptr if it is disabled.
+  //
+  // The transport is enabled by setting TF_GRPC_SHARED_MEMORY_ARENA_MB to the
+  // size of the arena holding the tensors sent by this process. Its pages
+  // are reserved up front, in the shared memory of the host.
+  static SharedMemoryTransport* Get();
+
+  // Creates a transport with an arena of 'arena_bytes'.
+  static Status Create(int64 arena_bytes,
+                       std::unique_ptr<SharedMemoryTransport>* transport);
+
+  ~SharedMemoryTransport();
+
+  // Receiver side: lets the sender of 'request' use shared memory for the
+  // response.
+  void AddRecvOptions(RecvTensorRequest* request);
+
+  // Sender side: if the receiver of 'request' accepts shared memory and runs
+  // on this host, copies the content of 'val' into the arena, sets
+  // 'response' to the rest of the RecvTensorResponse, and returns true.
+  // Otherwise returns false, and the tensor must be sent in the response.
+  bool WriteTensor(const RecvTensorRequest& request, const Tensor& val,
+                   bool require_ack, RecvTensorResponse* response);
+
+  // Returns true if the content of the tensor of 'response' is in shared
+  // memory.
+  static bool HasSharedMemoryTensor(const RecvTensorResponse& response);
+
+  // Receiver side: copies the content of the tensor of 'response' from
+  // shared memory into 'tensor', which already has the dtype and shape of
+  // the response, and releases it to the sender.
+  Status ReadTensor(const RecvTensorResponse& response, Tensor* tensor);
+
+  // Returns the number of arenas of other senders mapped by this receiver.
+  size_t NumPeerArenasForTesting() TF_LOCKS_EXCLUDED(mu_);
+
+ private:
+  class Segment;
+
+  explicit SharedMemoryTransport(std::unique_ptr<Segment> arena);
+
+  // Returns the offset of a new block of 'size' bytes in the arena, or -1 if
+  // the arena is full.
+  int64 AllocateLocked(int64 size) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  int64 TryAllocateLocked(int64 size) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Frees the released blocks at the tail of the arena. If 'expire', also
+  // frees blocks that no receiver has released for a long time, e.g. because
+  // their RPC was cancelled or their receiver died.
+  void ReclaimLocked(bool expire) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Unmaps the arenas of the senders that exited, if 'force' or if it was not
+  // done recently.
+  void PruneArenasLocked(int64 now_micros, bool force)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Returns true if the receiver that sent 'options' runs on this host.
+  bool IsLocalReceiver(const SharedMemoryRecvOptions& options)
+      TF_LOCKS_EXCLUDED(mu_);
+
+  mutex mu_;
+
+  // Sender side. The blocks in use are [tail_, head_), modulo the ring.
+  const std::unique_ptr<Segment> arena_;
+  uint64 arena_id_;
+  int64 head_ TF_GUARDED_BY(mu_);
+  int64 tail_ TF_GUARDED_BY(mu_);
+  int64 used_ TF_GUARDED_BY(mu_) = 0;
+  // The generation of the last allocated block.
+  uint64 generation_ TF_GUARDED_BY(mu_) = 0;
+  std::unordered_map<string, bool> local_receivers_ TF_GUARDED_BY(mu_);
+
+  // Receiver side.
+  std::unique_ptr<Segment> probe_ TF_GUARDED_BY(mu_);
+  uint64 probe_token_ TF_GUARDED_BY(mu_) = 0;
+  bool probe_failed_ TF_GUARDED_BY(mu_) = false;
+  std::unordered_map<string, std::shared_ptr<Segment>> peer_arenas_
+      TF_GUARDED_BY(mu_);
+  int64 last_arena_prune_micros_ TF_GUARDED_BY(mu_) = 0;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(SharedMemoryTransport);
+};
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_DISTRIBUTED_RUNTIME_RPC_SHARED_MEMORY_TRANSPORT_H_
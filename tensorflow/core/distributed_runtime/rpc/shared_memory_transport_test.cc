@@ -0,0 +1,231 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/distributed_runtime/rpc/shared_memory_transport.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.pb.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace {
+
+// Sends 'val' from 'sender' to 'receiver', both in this process, and returns
+// true if it went through shared memory.
+bool SendThroughSharedMemory(SharedMemoryTransport* sender,
+                             SharedMemoryTransport* receiver, const Tensor& val,
+                             RecvTensorResponse* response) {
+  RecvTensorRequest request;
+  receiver->AddRecvOptions(&request);
+  return sender->WriteTensor(request, val, /*require_ack=*/false, response);
+}
+
+Tensor Receive(SharedMemoryTransport* receiver,
+               const RecvTensorResponse& response) {
+  EXPECT_TRUE(SharedMemoryTransport::HasSharedMemoryTensor(response));
+  Tensor tensor(response.tensor().dtype(),
+                TensorShape(response.tensor().tensor_shape()));
+  TF_EXPECT_OK(receiver->ReadTensor(response, &tensor));
+  return tensor;
+}
+
+Tensor MakeTensor(int64 num_values) {
+  Tensor tensor(DT_FLOAT, TensorShape({num_values}));
+  test::FillIota<float>(&tensor, 1.0f);
+  return tensor;
+}
+
+class SharedMemoryTransportTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    TF_ASSERT_OK(SharedMemoryTransport::Create(1 << 20, &sender_));
+    TF_ASSERT_OK(SharedMemoryTransport::Create(1 << 20, &receiver_));
+  }
+
+  std::unique_ptr<SharedMemoryTransport> sender_;
+  std::unique_ptr<SharedMemoryTransport> receiver_;
+};
+
+TEST_F(SharedMemoryTransportTest, SendsTensor) {
+  const Tensor val = MakeTensor(64 * 1024);
+  RecvTensorResponse response;
+  ASSERT_TRUE(
+      SendThroughSharedMemory(sender_.get(), receiver_.get(), val, &response));
+  EXPECT_EQ(response.tensor().tensor_content(), "");
+  test::ExpectTensorEqual<float>(val, Receive(receiver_.get(), response));
+}
+
+TEST_F(SharedMemoryTransportTest, SmallTensorsUseResponse) {
+  RecvTensorResponse response;
+  EXPECT_FALSE(SendThroughSharedMemory(sender_.get(), receiver_.get(),
+                                       MakeTensor(16), &response));
+}
+
+TEST_F(SharedMemoryTransportTest, RequiresRecvOptions) {
+  RecvTensorRequest request;
+  RecvTensorResponse response;
+  EXPECT_FALSE(sender_->WriteTensor(request, MakeTensor(64 * 1024),
+                                    /*require_ack=*/false, &response));
+}
+
+TEST_F(SharedMemoryTransportTest, RejectsReceiverOnOtherHost) {
+  RecvTensorRequest request;
+  receiver_->AddRecvOptions(&request);
+  SharedMemoryRecvOptions options;
+  ASSERT_TRUE(request.transport_options().UnpackTo(&options));
+  // A different token means that the probe file is not the one of the
+  // receiver.
+  options.set_token(options.token() + 1);
+  request.mutable_transport_options()->PackFrom(options);
+  RecvTensorResponse response;
+  EXPECT_FALSE(sender_->WriteTensor(request, MakeTensor(64 * 1024),
+                                    /*require_ack=*/false, &response));
+}
+
+// Returns true if 'sender' accepts 'probe_path' as the probe of a receiver on
+// this host.
+bool AcceptsProbe(SharedMemoryTransport* sender,
+                  SharedMemoryTransport* receiver, const string& probe_path) {
+  RecvTensorRequest request;
+  receiver->AddRecvOptions(&request);
+  SharedMemoryRecvOptions options;
+  EXPECT_TRUE(request.transport_options().UnpackTo(&options));
+  options.set_probe_path(probe_path);
+  request.mutable_transport_options()->PackFrom(options);
+  RecvTensorResponse response;
+  return sender->WriteTensor(request, MakeTensor(64 * 1024),
+                             /*require_ack=*/false, &response);
+}
+
+TEST_F(SharedMemoryTransportTest, RejectsProbeThatIsNotASegment) {
+  // Opening a FIFO for writing would block until it has a reader.
+  const string fifo = io::JoinPath(testing::TmpDir(), "probe_fifo");
+  unlink(fifo.c_str());
+  ASSERT_EQ(0, mkfifo(fifo.c_str(), 0600));
+  EXPECT_FALSE(AcceptsProbe(sender_.get(), receiver_.get(), fifo));
+  const int fifo_fd = open(fifo.c_str(), O_RDWR | O_NONBLOCK);
+  ASSERT_GE(fifo_fd, 0);
+  EXPECT_FALSE(AcceptsProbe(sender_.get(), receiver_.get(),
+                            strings::StrCat("/proc/", getpid(), "/fd/",
+                                            fifo_fd)));
+  close(fifo_fd);
+  unlink(fifo.c_str());
+
+  EXPECT_FALSE(AcceptsProbe(sender_.get(), receiver_.get(), "/dev/zero"));
+  EXPECT_FALSE(AcceptsProbe(sender_.get(), receiver_.get(),
+                            "/proc/self/fd/0"));
+}
+
+TEST_F(SharedMemoryTransportTest, UnmapsArenasOfExitedSenders) {
+  const Tensor val = MakeTensor(64 * 1024);
+  RecvTensorResponse response;
+  ASSERT_TRUE(
+      SendThroughSharedMemory(sender_.get(), receiver_.get(), val, &response));
+  Receive(receiver_.get(), response);
+  std::unique_ptr<SharedMemoryTransport> other_sender;
+  TF_ASSERT_OK(SharedMemoryTransport::Create(1 << 20, &other_sender));
+  ASSERT_TRUE(SendThroughSharedMemory(other_sender.get(), receiver_.get(), val,
+                                      &response));
+  Receive(receiver_.get(), response);
+  EXPECT_EQ(2, receiver_->NumPeerArenasForTesting());
+
+  // Receiving from a new sender unmaps the arena of the one that is gone.
+  other_sender.reset();
+  std::unique_ptr<SharedMemoryTransport> new_sender;
+  TF_ASSERT_OK(SharedMemoryTransport::Create(1 << 20, &new_sender));
+  ASSERT_TRUE(SendThroughSharedMemory(new_sender.get(), receiver_.get(), val,
+                                      &response));
+  test::ExpectTensorEqual<float>(val, Receive(receiver_.get(), response));
+  EXPECT_EQ(2, receiver_->NumPeerArenasForTesting());
+}
+
+TEST_F(SharedMemoryTransportTest, ReusesReceivedBlocks) {
+  // Each tensor takes about a third of the arena.
+  const Tensor val = MakeTensor(80 * 1024);
+  for (int i = 0; i < 20; ++i) {
+    RecvTensorResponse response;
+    ASSERT_TRUE(SendThroughSharedMemory(sender_.get(), receiver_.get(), val,
+                                        &response));
+    test::ExpectTensorEqual<float>(val, Receive(receiver_.get(), response));
+  }
+}
+
+TEST_F(SharedMemoryTransportTest, FallsBackWhenFull) {
+  const Tensor val = MakeTensor(80 * 1024);
+  RecvTensorResponse responses[3];
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_TRUE(SendThroughSharedMemory(sender_.get(), receiver_.get(), val,
+                                        &responses[i]));
+  }
+  RecvTensorResponse response;
+  EXPECT_FALSE(
+      SendThroughSharedMemory(sender_.get(), receiver_.get(), val, &response));
+
+  // Receiving the oldest tensor frees its space.
+  test::ExpectTensorEqual<float>(val, Receive(receiver_.get(), responses[0]));
+  ASSERT_TRUE(
+      SendThroughSharedMemory(sender_.get(), receiver_.get(), val, &response));
+  test::ExpectTensorEqual<float>(val, Receive(receiver_.get(), responses[1]));
+  test::ExpectTensorEqual<float>(val, Receive(receiver_.get(), responses[2]));
+  test::ExpectTensorEqual<float>(val, Receive(receiver_.get(), response));
+}
+
+TEST_F(SharedMemoryTransportTest, ReceivesTensorOnce) {
+  const Tensor val = MakeTensor(64 * 1024);
+  RecvTensorResponse response;
+  ASSERT_TRUE(
+      SendThroughSharedMemory(sender_.get(), receiver_.get(), val, &response));
+  Receive(receiver_.get(), response);
+  Tensor tensor(DT_FLOAT, val.shape());
+  EXPECT_TRUE(errors::IsAborted(receiver_->ReadTensor(response, &tensor)));
+}
+
+TEST_F(SharedMemoryTransportTest, RejectsReusedBlock) {
+  const Tensor old_val = MakeTensor(64 * 1024);
+  RecvTensorResponse old_response;
+  ASSERT_TRUE(SendThroughSharedMemory(sender_.get(), receiver_.get(), old_val,
+                                      &old_response));
+  Receive(receiver_.get(), old_response);
+
+  // The arena is empty again, so the next tensor of the same size gets the
+  // same block.
+  Tensor val(DT_FLOAT, old_val.shape());
+  test::FillIota<float>(&val, -1.0f);
+  RecvTensorResponse response;
+  ASSERT_TRUE(
+      SendThroughSharedMemory(sender_.get(), receiver_.get(), val, &response));
+  SharedMemoryTensor old_location, location;
+  ASSERT_TRUE(old_response.transport_options().UnpackTo(&old_location));
+  ASSERT_TRUE(response.transport_options().UnpackTo(&location));
+  ASSERT_EQ(old_location.offset(), location.offset());
+  EXPECT_NE(old_location.generation(), location.generation());
+
+  // A late copy of the old response must not claim the new tensor.
+  Tensor tensor(DT_FLOAT, old_val.shape());
+  EXPECT_TRUE(errors::IsAborted(receiver_->ReadTensor(old_response, &tensor)));
+  test::ExpectTensorEqual<float>(val, Receive(receiver_.get(), response));
+}
+
+}  // namespace
+}  // namespace tensorflow
@@ -16,6 +16,7 @@ limitations under the License.
 #include "tensorflow/core/distributed_runtime/session_mgr.h"
 
 #include <utility>
+#include <vector>
 
 #include "tensorflow/core/common_runtime/device_mgr.h"
 #include "tensorflow/core/common_runtime/renamed_device.h"
@@ -322,4 +323,20 @@ void SessionMgr::ClearLogs() {
     }
   }
 }
+
+void SessionMgr::ClearRegistrationCaches() {
+  std::vector<std::shared_ptr<WorkerSession>> sessions;
+  {
+    mutex_lock l(mu_);
+    if (legacy_session_) sessions.push_back(legacy_session_);
+    for (const auto& session_kv : sessions_) {
+      if (session_kv.second) sessions.push_back(session_kv.second);
+    }
+  }
+  // Dropping the cached graphs may delete their executors, so the lock is
+  // not held.
+  for (const auto& session : sessions) {
+    session->graph_mgr()->ClearRegistrationCache();
+  }
+}
 }  // namespace tensorflow
@@ -77,6 +77,12 @@ class SessionMgr {
 
   void ClearLogs();
 
+  // Drops the graphs that the GraphMgr of every session keeps for future
+  // registrations, e.g. because the resources of the devices were cleared.
+  // Sessions that do not isolate their state share the resources of the
+  // worker's devices, so clearing only the legacy session is not enough.
+  void ClearRegistrationCaches();
+
  private:
   WorkerEnv* const worker_env_;  // Not owned.
 
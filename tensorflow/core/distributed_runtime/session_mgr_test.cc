@@ -178,6 +178,23 @@ TEST_F(SessionMgrTest, WorkerNameFromServerDef) {
   EXPECT_EQ("/job:worker/replica:0/task:3", worker_name);
 }
 
+TEST_F(SessionMgrTest, ClearRegistrationCachesOfAllSessions) {
+  ServerDef server_def;
+  server_def.set_job_name("worker");
+  server_def.set_task_index(3);
+  TF_EXPECT_OK(mgr_.CreateSession("shared", server_def, false));
+  TF_EXPECT_OK(mgr_.CreateSession("isolated", server_def, true));
+  mgr_.ClearRegistrationCaches();
+
+  // The sessions stay usable.
+  std::shared_ptr<WorkerSession> session;
+  TF_EXPECT_OK(mgr_.WorkerSessionForSession("shared", &session));
+  TF_EXPECT_OK(mgr_.WorkerSessionForSession("isolated", &session));
+  TF_EXPECT_OK(mgr_.DeleteSession("shared"));
+  TF_EXPECT_OK(mgr_.DeleteSession("isolated"));
+  mgr_.ClearRegistrationCaches();
+}
+
 TEST_F(SessionMgrTest, DeleteLegacySession) {
   TF_EXPECT_OK(mgr_.DeleteSession(""));
 }
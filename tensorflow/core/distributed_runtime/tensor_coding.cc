@@ -18,11 +18,100 @@ limitations under the License.
 #include "google/protobuf/any.pb.h"
 
 #include "tensorflow/core/common_runtime/device.h"
+#include "tensorflow/core/framework/bfloat16.h"
+#include "tensorflow/core/framework/numeric_types.h"
 #include "tensorflow/core/framework/tensor.pb.h"
 #include "tensorflow/core/framework/tensor_shape.pb.h"
+#include "tensorflow/core/platform/snappy.h"
 
 namespace tensorflow {
 
+namespace {
+
+// Smaller tensors are sent raw: the RPC costs more than their content.
+constexpr size_t kMinCompressedTensorBytes = 64 * 1024;
+
+}  // namespace
+
+bool CompressTensorContent(const Tensor& val, RecvTensorCompression compression,
+                           string* encoded) {
+  const StringPiece content = val.tensor_data();
+  if (!DataTypeCanUseMemcpy(val.dtype()) ||
+      content.size() < kMinCompressedTensorBytes) {
+    return false;
+  }
+  const int64 num_elements = val.NumElements();
+  switch (compression) {
+    case RECV_TENSOR_COMPRESSION_SNAPPY:
+      return port::Snappy_Compress(content.data(), content.size(), encoded) &&
+             encoded->size() < content.size();
+    case RECV_TENSOR_COMPRESSION_BFLOAT16:
+      if (val.dtype() != DT_FLOAT) return false;
+      encoded->resize(num_elements * sizeof(bfloat16));
+      RoundFloatToBFloat16(val.flat<float>().data(),
+                           reinterpret_cast<bfloat16*>(&(*encoded)[0]),
+                           num_elements);
+      return true;
+    case RECV_TENSOR_COMPRESSION_HALF: {
+      if (val.dtype() != DT_FLOAT) return false;
+      encoded->resize(num_elements * sizeof(Eigen::half));
+      FloatToHalf(val.flat<float>().data(),
+                  reinterpret_cast<Eigen::half*>(&(*encoded)[0]),
+                  num_elements);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+Status DecompressTensorContent(RecvTensorCompression compression,
+                               StringPiece encoded, Tensor* tensor) {
+  char* content = const_cast<char*>(tensor->tensor_data().data());
+  const size_t content_size = tensor->tensor_data().size();
+  const int64 num_elements = tensor->NumElements();
+  switch (compression) {
+    case RECV_TENSOR_COMPRESSION_NONE:
+      if (encoded.size() != content_size) break;
+      memcpy(content, encoded.data(), content_size);
+      return Status::OK();
+    case RECV_TENSOR_COMPRESSION_SNAPPY: {
+      size_t uncompressed_size;
+      if (!port::Snappy_GetUncompressedLength(encoded.data(), encoded.size(),
+                                              &uncompressed_size) ||
+          uncompressed_size != content_size ||
+          !port::Snappy_Uncompress(encoded.data(), encoded.size(), content)) {
+        break;
+      }
+      return Status::OK();
+    }
+    case RECV_TENSOR_COMPRESSION_BFLOAT16:
+      if (tensor->dtype() != DT_FLOAT ||
+          encoded.size() != num_elements * sizeof(bfloat16)) {
+        break;
+      }
+      BFloat16ToFloat(reinterpret_cast<const bfloat16*>(encoded.data()),
+                      tensor->flat<float>().data(), num_elements);
+      return Status::OK();
+    case RECV_TENSOR_COMPRESSION_HALF: {
+      if (tensor->dtype() != DT_FLOAT ||
+          encoded.size() != num_elements * sizeof(Eigen::half)) {
+        break;
+      }
+      HalfToFloat(reinterpret_cast<const Eigen::half*>(encoded.data()),
+                  tensor->flat<float>().data(), num_elements);
+      return Status::OK();
+    }
+    default:
+      return errors::Unimplemented("Unknown tensor compression ",
+                                   compression);
+  }
+  return errors::InvalidArgument(
+      "Cannot decode ", RecvTensorCompression_Name(compression), " content of ",
+      encoded.size(), " bytes into a ", DataTypeString(tensor->dtype()),
+      " tensor of shape ", tensor->shape().DebugString());
+}
+
 TensorResponse::Source::~Source() {}
 
 void TensorResponse::Clear() {
@@ -53,7 +142,9 @@ void TensorResponse::InitAlloc(DeviceBase* d, const AllocatorAttributes& aa) {
 Status TensorResponse::InitFrom(RecvTensorResponse* response) {
   Status s;
   meta_.Swap(response);
-  if (on_host_) {
+  if (meta_.compression() != RECV_TENSOR_COMPRESSION_NONE) {
+    s = InitCompressed();
+  } else if (on_host_) {
     if (!tensor_.FromProto(allocator_, meta_.tensor())) {
       s = errors::InvalidArgument("Cannot parse tensor from response");
     }
@@ -79,6 +170,23 @@ void TensorResponse::InitPartial(const RecvTensorResponse& response,
   tensor_ = std::move(t);
 }
 
+Status TensorResponse::InitCompressed() {
+  if (!on_host_) {
+    return errors::Unimplemented(
+        "Compressed tensors can only be received in host memory");
+  }
+  const TensorProto& proto = meta_.tensor();
+  if (!DataTypeCanUseMemcpy(proto.dtype()) ||
+      !TensorShape::IsValid(proto.tensor_shape())) {
+    return errors::InvalidArgument("Cannot parse tensor from response");
+  }
+  Tensor t(allocator_, proto.dtype(), TensorShape(proto.tensor_shape()));
+  TF_RETURN_IF_ERROR(
+      DecompressTensorContent(meta_.compression(), proto.tensor_content(), &t));
+  tensor_ = std::move(t);
+  return Status::OK();
+}
+
 Status TensorResponse::ParseFrom(Source* source) {
   if (!on_host_) {
     protobuf::io::CodedInputStream input(source->contents());
@@ -89,7 +197,10 @@ Status TensorResponse::ParseFrom(Source* source) {
       return errors::InvalidArgument("Cannot parse tensor from response");
     }
     Status s =
-        device_->MakeTensorFromProto(meta_.tensor(), alloc_attrs_, &tensor_);
+        meta_.compression() != RECV_TENSOR_COMPRESSION_NONE
+            ? InitCompressed()
+            : device_->MakeTensorFromProto(meta_.tensor(), alloc_attrs_,
+                                           &tensor_);
     // Reduce memory usage for big tensors.
     {
       TensorProto empty;
@@ -197,6 +308,18 @@ bool TensorResponse::ParseTensorSubmessage(
         seen_tensor_content = true;
         TensorShape shape(tensor_meta->tensor_shape());
         Tensor t(allocator_, tensor_meta->dtype(), shape);
+        if (meta_.compression() != RECV_TENSOR_COMPRESSION_NONE) {
+          // The compression precedes the tensor in responses encoded by
+          // EncodeTensorToByteBuffer. Otherwise ParseSlow decodes it.
+          string encoded;
+          if (!input->ReadString(&encoded, num_bytes) ||
+              !DecompressTensorContent(meta_.compression(), encoded, &t)
+                   .ok()) {
+            return false;
+          }
+          tensor_ = std::move(t);
+          break;
+        }
         StringPiece buf = t.tensor_data();
         if (static_cast<size_t>(num_bytes) != buf.size()) return false;
         // TODO(jeff,sanjay): Figure out a way to avoid this copy if
@@ -267,6 +390,13 @@ bool TensorResponse::ParseFast(Source* source) {
         meta_.set_require_ack(v != 0);
         break;
       }
+      case RecvTensorResponse::kCompressionFieldNumber: {
+        uint32 v;
+        if ((wt != WIRETYPE_VARINT) || !input.ReadVarint32(&v)) return false;
+        if (meta_.has_tensor()) return false;
+        meta_.set_compression(static_cast<RecvTensorCompression>(v));
+        break;
+      }
       default: {
         // Unknown tag, so don't handle we can't handle on the fast path
         return false;
@@ -282,11 +412,15 @@ bool TensorResponse::ParseSlow(Source* source) {
     return false;
   }
 
-  Tensor parsed(meta_.tensor().dtype());
-  if (!parsed.FromProto(allocator_, meta_.tensor())) {
-    return false;
+  if (meta_.compression() != RECV_TENSOR_COMPRESSION_NONE) {
+    if (!InitCompressed().ok()) return false;
+  } else {
+    Tensor parsed(meta_.tensor().dtype());
+    if (!parsed.FromProto(allocator_, meta_.tensor())) {
+      return false;
+    }
+    tensor_ = std::move(parsed);
   }
-  tensor_ = std::move(parsed);
 
   // Reduce memory usage for big tensors.
   {
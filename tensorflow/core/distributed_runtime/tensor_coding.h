@@ -29,6 +29,17 @@ class Allocator;
 class DeviceBase;
 class TensorProto;
 
+// Sets 'encoded' to the content of 'val' encoded with 'compression', and
+// returns true, if the encoding applies to 'val' and makes its content
+// smaller. Otherwise returns false, and the raw content must be sent.
+bool CompressTensorContent(const Tensor& val, RecvTensorCompression compression,
+                           string* encoded);
+
+// Decodes the content of 'tensor', which already has the dtype and shape of
+// the decoded tensor, from 'encoded', encoded with 'compression'.
+Status DecompressTensorContent(RecvTensorCompression compression,
+                               StringPiece encoded, Tensor* tensor);
+
 // TensorResponse can be used as the destination of an RPC that returns
 // a RecvTensorResponse.  It efficiently decodes the incoming data
 // into Tensor contents as well as associated metadata.
@@ -92,6 +103,9 @@ class TensorResponse {
   DeviceBase* device() const { return device_; }
 
  private:
+  // Decodes tensor_ from the compressed content of meta_.
+  Status InitCompressed();
+
   bool ParseTensorSubmessage(protobuf::io::CodedInputStream* input,
                              TensorProto* tensor_meta);
   bool ParseFast(Source* source);
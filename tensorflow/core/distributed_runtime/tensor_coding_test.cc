@@ -19,6 +19,7 @@ limitations under the License.
 #include "tensorflow/core/framework/device_base.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/lib/gtl/inlined_vector.h"
 #include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/platform/env.h"
@@ -156,6 +157,90 @@ TEST_F(TensorResponseTest, Simple) {
 
 TEST_F(TensorResponseTest, StringTensor) { DoTestForStrings(DT_STRING); }
 
+class CompressedTensorResponseTest
+    : public ::testing::TestWithParam<RecvTensorCompression> {};
+
+TEST_P(CompressedTensorResponseTest, RoundTrip) {
+  // Small integers are exact in all encodings.
+  Tensor src(DT_FLOAT, TensorShape({64, 1024}));
+  auto values = src.flat<float>();
+  for (int64 i = 0; i < values.size(); ++i) {
+    values(i) = static_cast<float>(i % 64 - 32);
+  }
+  string content;
+  ASSERT_TRUE(CompressTensorContent(src, GetParam(), &content));
+  EXPECT_LT(content.size(), src.TotalBytes());
+
+  // Responses where the compression precedes the tensor are decoded while
+  // parsing, and the others after parsing.
+  RecvTensorResponse compression;
+  compression.set_compression(GetParam());
+  RecvTensorResponse tensor;
+  tensor.set_send_start_micros(123456);
+  tensor.mutable_tensor()->set_dtype(DT_FLOAT);
+  src.shape().AsProto(tensor.mutable_tensor()->mutable_tensor_shape());
+  tensor.mutable_tensor()->set_tensor_content(content);
+  for (bool compression_first : {true, false}) {
+    // Concatenated messages parse as their merge.
+    const string encoded =
+        compression_first ? strings::StrCat(compression.SerializeAsString(),
+                                            tensor.SerializeAsString())
+                          : strings::StrCat(tensor.SerializeAsString(),
+                                            compression.SerializeAsString());
+    StringSource source(&encoded, 1024);
+    TensorResponse response;
+    DummyDevice cpu_device(Env::Default());
+    response.InitAlloc(&cpu_device, AllocatorAttributes());
+    TF_ASSERT_OK(response.ParseFrom(&source));
+    EXPECT_EQ(response.metadata().compression(), GetParam());
+    EXPECT_EQ(response.metadata().send_start_micros(), 123456);
+    test::ExpectTensorEqual<float>(src, response.tensor());
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Compressions, CompressedTensorResponseTest,
+    ::testing::Values(RECV_TENSOR_COMPRESSION_SNAPPY,
+                      RECV_TENSOR_COMPRESSION_BFLOAT16,
+                      RECV_TENSOR_COMPRESSION_HALF));
+
+TEST(CompressTensorContentTest, SkipsSmallTensors) {
+  Tensor src(DT_FLOAT, TensorShape({16}));
+  src.flat<float>().setZero();
+  string content;
+  EXPECT_FALSE(
+      CompressTensorContent(src, RECV_TENSOR_COMPRESSION_BFLOAT16, &content));
+}
+
+TEST(CompressTensorContentTest, LossyOnlyForFloats) {
+  Tensor src(DT_INT32, TensorShape({64, 1024}));
+  src.flat<int32>().setZero();
+  string content;
+  EXPECT_FALSE(
+      CompressTensorContent(src, RECV_TENSOR_COMPRESSION_BFLOAT16, &content));
+  EXPECT_FALSE(
+      CompressTensorContent(src, RECV_TENSOR_COMPRESSION_HALF, &content));
+}
+
+TEST(CompressTensorContentTest, RoundsToBFloat16) {
+  Tensor src(DT_FLOAT, TensorShape({64, 1024}));
+  src.flat<float>().setConstant(1.0f / 3);
+  string content;
+  ASSERT_TRUE(
+      CompressTensorContent(src, RECV_TENSOR_COMPRESSION_BFLOAT16, &content));
+  Tensor result(DT_FLOAT, src.shape());
+  TF_ASSERT_OK(DecompressTensorContent(RECV_TENSOR_COMPRESSION_BFLOAT16,
+                                       content, &result));
+  test::ExpectTensorNear<float>(src, result, 1e-2);
+}
+
+TEST(CompressTensorContentTest, RejectsTruncatedContent) {
+  Tensor result(DT_FLOAT, TensorShape({64, 1024}));
+  EXPECT_FALSE(DecompressTensorContent(RECV_TENSOR_COMPRESSION_HALF,
+                                       string(100, '\0'), &result)
+                   .ok());
+}
+
 string MakeFloatTensorTestCase(int num_elems) {
   std::vector<int8> v(num_elems);
   for (int i = 0; i < num_elems; i++) {
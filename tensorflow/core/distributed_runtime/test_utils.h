@@ -94,6 +94,13 @@ class TestWorkerInterface : public WorkerInterface {
     done(errors::Unimplemented("TracingAsync"));
   }
 
+  void RecvTensorChunkAsync(CallOptions* opts,
+                            const RecvTensorChunkRequest* request,
+                            RecvTensorChunkResponse* response,
+                            StatusCallback done) override {
+    done(errors::Unimplemented("RecvTensorChunkAsync"));
+  }
+
   void RecvBufAsync(CallOptions* opts, const RecvBufRequest* request,
                     RecvBufResponse* response, StatusCallback done) override {
     done(errors::Unimplemented("RecvBufAsync"));
@@ -367,6 +367,8 @@ void Worker::CleanupAllAsync(const CleanupAllRequest* request,
                              StatusCallback done) {
   std::vector<string> containers;
   for (const auto& c : request->container()) containers.push_back(c);
+  // Cached graphs hold kernels that may refer to the resources cleared below.
+  env_->session_mgr->ClearRegistrationCaches();
   env_->device_mgr->ClearContainers(containers);
   done(Status::OK());
 }
@@ -381,6 +383,16 @@ void Worker::TracingAsync(const TracingRequest* request,
   done(errors::Unimplemented("Tracing"));
 }
 
+void Worker::RecvTensorChunkAsync(CallOptions* opts,
+                                  const RecvTensorChunkRequest* request,
+                                  RecvTensorChunkResponse* response,
+                                  StatusCallback done) {
+  // The base Worker class never returns a chunked tensor from
+  // RecvTensorAsync. Use a transport-specific implementation (such as
+  // `GrpcWorker::RecvTensorChunkAsync()`) instead.
+  done(errors::Unimplemented("Worker::RecvTensorChunkAsync()"));
+}
+
 void Worker::RecvBufAsync(CallOptions* opts, const RecvBufRequest* request,
                           RecvBufResponse* response, StatusCallback done) {
   // The base Worker class does not implement RecvBufAsync because
@@ -105,6 +105,11 @@ class WorkerInterface {
                                TensorResponse* response,
                                StatusCallback done) = 0;
 
+  virtual void RecvTensorChunkAsync(CallOptions* opts,
+                                    const RecvTensorChunkRequest* request,
+                                    RecvTensorChunkResponse* response,
+                                    StatusCallback done) = 0;
+
   virtual void LoggingAsync(const LoggingRequest* request,
                             LoggingResponse* response, StatusCallback done) = 0;
 
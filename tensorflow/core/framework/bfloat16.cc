@@ -15,9 +15,222 @@ limitations under the License.
 
 #include "tensorflow/core/framework/bfloat16.h"
 
+#include "tensorflow/core/platform/cpu_info.h"
+
+// The SIMD conversions are compiled for their instruction set with function
+// attributes, and only run after checking that the CPU supports it.
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__)) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define TF_CONVERSION_USE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
 namespace tensorflow {
 
+namespace {
+
+#ifdef TF_CONVERSION_USE_X86_SIMD
+
+// Every SIMD conversion below converts the longest prefix of the arrays that
+// fills whole registers, and returns its size.
+
+__attribute__((target("avx512f"))) int64 FloatToBFloat16Avx512(
+    const float* src, bfloat16* dst, int64 size) {
+  int64 i = 0;
+  for (; i + 16 <= size; i += 16) {
+    const __m512i x = _mm512_loadu_si512(src + i);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                        _mm512_cvtepi32_epi16(_mm512_srli_epi32(x, 16)));
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) int64 FloatToBFloat16Avx2(const float* src,
+                                                           bfloat16* dst,
+                                                           int64 size) {
+  int64 i = 0;
+  for (; i + 8 <= size; i += 8) {
+    const __m256i x = _mm256_srli_epi32(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)), 16);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                     _mm_packus_epi32(_mm256_castsi256_si128(x),
+                                      _mm256_extracti128_si256(x, 1)));
+  }
+  return i;
+}
+
+// Rounds to nearest even like the bfloat16 constructor, which turns NaNs into
+// quiet NaNs with the same sign.
+__attribute__((target("avx512f"))) int64 RoundFloatToBFloat16Avx512(
+    const float* src, bfloat16* dst, int64 size) {
+  const __m512i one = _mm512_set1_epi32(1);
+  const __m512i rounding_bias = _mm512_set1_epi32(0x7fff);
+  const __m512i sign = _mm512_set1_epi32(0x8000);
+  const __m512i nan = _mm512_set1_epi32(0x7fc0);
+  int64 i = 0;
+  for (; i + 16 <= size; i += 16) {
+    const __m512 f = _mm512_loadu_ps(src + i);
+    const __m512i x = _mm512_castps_si512(f);
+    const __m512i high = _mm512_srli_epi32(x, 16);
+    const __m512i lsb = _mm512_and_si512(high, one);
+    const __m512i rounded = _mm512_srli_epi32(
+        _mm512_add_epi32(x, _mm512_add_epi32(rounding_bias, lsb)), 16);
+    const __m512i nans = _mm512_or_si512(_mm512_and_si512(high, sign), nan);
+    const __m512i y = _mm512_mask_blend_epi32(
+        _mm512_cmp_ps_mask(f, f, _CMP_UNORD_Q), rounded, nans);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                        _mm512_cvtepi32_epi16(y));
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) int64 RoundFloatToBFloat16Avx2(
+    const float* src, bfloat16* dst, int64 size) {
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i rounding_bias = _mm256_set1_epi32(0x7fff);
+  const __m256i sign = _mm256_set1_epi32(0x8000);
+  const __m256i nan = _mm256_set1_epi32(0x7fc0);
+  int64 i = 0;
+  for (; i + 8 <= size; i += 8) {
+    const __m256 f = _mm256_loadu_ps(src + i);
+    const __m256i x = _mm256_castps_si256(f);
+    const __m256i high = _mm256_srli_epi32(x, 16);
+    const __m256i lsb = _mm256_and_si256(high, one);
+    const __m256i rounded = _mm256_srli_epi32(
+        _mm256_add_epi32(x, _mm256_add_epi32(rounding_bias, lsb)), 16);
+    const __m256i nans = _mm256_or_si256(_mm256_and_si256(high, sign), nan);
+    const __m256i y = _mm256_blendv_epi8(
+        rounded, nans, _mm256_castps_si256(_mm256_cmp_ps(f, f, _CMP_UNORD_Q)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                     _mm_packus_epi32(_mm256_castsi256_si128(y),
+                                      _mm256_extracti128_si256(y, 1)));
+  }
+  return i;
+}
+
+__attribute__((target("avx512f"))) int64 BFloat16ToFloatAvx512(
+    const bfloat16* src, float* dst, int64 size) {
+  int64 i = 0;
+  for (; i + 16 <= size; i += 16) {
+    const __m256i x =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    _mm512_storeu_si512(dst + i,
+                        _mm512_slli_epi32(_mm512_cvtepu16_epi32(x), 16));
+  }
+  return i;
+}
+
+__attribute__((target("avx2"))) int64 BFloat16ToFloatAvx2(const bfloat16* src,
+                                                           float* dst,
+                                                           int64 size) {
+  int64 i = 0;
+  for (; i + 8 <= size; i += 8) {
+    const __m128i x =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                        _mm256_slli_epi32(_mm256_cvtepu16_epi32(x), 16));
+  }
+  return i;
+}
+
+// The F16C instructions keep the upper bits of the payload of NaNs, while the
+// software conversion of Eigen::half returns the same NaN for all of them.
+#ifdef EIGEN_HAS_FP16_C
+constexpr bool kCanonicalizeHalfNaNs = false;
+#else
+constexpr bool kCanonicalizeHalfNaNs = true;
+#endif
+
+inline __attribute__((target("avx2"))) __m128i CanonicalizeHalfNaNs(
+    __m128i h) {
+  if (!kCanonicalizeHalfNaNs) return h;
+  const __m128i is_nan = _mm_cmpgt_epi16(
+      _mm_and_si128(h, _mm_set1_epi16(0x7fff)), _mm_set1_epi16(0x7c00));
+  return _mm_andnot_si128(_mm_and_si128(is_nan, _mm_set1_epi16(0x01ff)), h);
+}
+
+__attribute__((target("avx512f"))) int64 FloatToHalfAvx512(const float* src,
+                                                            Eigen::half* dst,
+                                                            int64 size) {
+  int64 i = 0;
+  for (; i + 16 <= size; i += 16) {
+    const __m256i h =
+        _mm512_cvtps_ph(_mm512_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                     CanonicalizeHalfNaNs(_mm256_castsi256_si128(h)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 8),
+                     CanonicalizeHalfNaNs(_mm256_extracti128_si256(h, 1)));
+  }
+  return i;
+}
+
+__attribute__((target("avx2,f16c"))) int64 FloatToHalfF16c(const float* src,
+                                                            Eigen::half* dst,
+                                                            int64 size) {
+  int64 i = 0;
+  for (; i + 8 <= size; i += 8) {
+    const __m128i h =
+        _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                     CanonicalizeHalfNaNs(h));
+  }
+  return i;
+}
+
+__attribute__((target("avx512f"))) int64 HalfToFloatAvx512(
+    const Eigen::half* src, float* dst, int64 size) {
+  int64 i = 0;
+  for (; i + 16 <= size; i += 16) {
+    const __m256i h =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    _mm512_storeu_ps(dst + i, _mm512_cvtph_ps(h));
+  }
+  return i;
+}
+
+__attribute__((target("avx2,f16c"))) int64 HalfToFloatF16c(
+    const Eigen::half* src, float* dst, int64 size) {
+  int64 i = 0;
+  for (; i + 8 <= size; i += 8) {
+    const __m128i h =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+  }
+  return i;
+}
+
+// The instruction sets used above, which are looked up once per process.
+struct SimdSupport {
+  SimdSupport()
+      : avx512f(port::TestCPUFeature(port::CPUFeature::AVX512F)),
+        avx2(port::TestCPUFeature(port::CPUFeature::AVX2)),
+        f16c(avx2 && port::TestCPUFeature(port::CPUFeature::F16C)) {}
+
+  const bool avx512f;
+  const bool avx2;
+  const bool f16c;
+};
+
+const SimdSupport& GetSimdSupport() {
+  static const SimdSupport* simd_support = new SimdSupport;
+  return *simd_support;
+}
+
+#endif  // TF_CONVERSION_USE_X86_SIMD
+
+}  // namespace
+
 void FloatToBFloat16(const float* src, bfloat16* dst, int64 size) {
+#ifdef TF_CONVERSION_USE_X86_SIMD
+  const SimdSupport& simd = GetSimdSupport();
+  const int64 done = simd.avx512f ? FloatToBFloat16Avx512(src, dst, size)
+                     : simd.avx2  ? FloatToBFloat16Avx2(src, dst, size)
+                                  : 0;
+  src += done;
+  dst += done;
+  size -= done;
+#endif  // TF_CONVERSION_USE_X86_SIMD
   const uint16_t* p = reinterpret_cast<const uint16_t*>(src);
   uint16_t* q = reinterpret_cast<uint16_t*>(dst);
 #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
@@ -31,7 +244,29 @@ void FloatToBFloat16(const float* src, bfloat16* dst, int64 size) {
 #endif
 }
 
+void RoundFloatToBFloat16(const float* src, bfloat16* dst, int64 size) {
+  int64 i = 0;
+#ifdef TF_CONVERSION_USE_X86_SIMD
+  const SimdSupport& simd = GetSimdSupport();
+  i = simd.avx512f ? RoundFloatToBFloat16Avx512(src, dst, size)
+      : simd.avx2  ? RoundFloatToBFloat16Avx2(src, dst, size)
+                   : 0;
+#endif  // TF_CONVERSION_USE_X86_SIMD
+  for (; i < size; ++i) {
+    dst[i] = bfloat16(src[i]);
+  }
+}
+
 void BFloat16ToFloat(const bfloat16* src, float* dst, int64 size) {
+#ifdef TF_CONVERSION_USE_X86_SIMD
+  const SimdSupport& simd = GetSimdSupport();
+  const int64 done = simd.avx512f ? BFloat16ToFloatAvx512(src, dst, size)
+                     : simd.avx2  ? BFloat16ToFloatAvx2(src, dst, size)
+                                  : 0;
+  src += done;
+  dst += done;
+  size -= done;
+#endif  // TF_CONVERSION_USE_X86_SIMD
   const uint16_t* p = reinterpret_cast<const uint16_t*>(src);
   uint16_t* q = reinterpret_cast<uint16_t*>(dst);
 #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
@@ -47,4 +282,30 @@ void BFloat16ToFloat(const bfloat16* src, float* dst, int64 size) {
 #endif
 }
 
+void FloatToHalf(const float* src, Eigen::half* dst, int64 size) {
+  int64 i = 0;
+#ifdef TF_CONVERSION_USE_X86_SIMD
+  const SimdSupport& simd = GetSimdSupport();
+  i = simd.avx512f ? FloatToHalfAvx512(src, dst, size)
+      : simd.f16c  ? FloatToHalfF16c(src, dst, size)
+                   : 0;
+#endif  // TF_CONVERSION_USE_X86_SIMD
+  for (; i < size; ++i) {
+    dst[i] = Eigen::half(src[i]);
+  }
+}
+
+void HalfToFloat(const Eigen::half* src, float* dst, int64 size) {
+  int64 i = 0;
+#ifdef TF_CONVERSION_USE_X86_SIMD
+  const SimdSupport& simd = GetSimdSupport();
+  i = simd.avx512f ? HalfToFloatAvx512(src, dst, size)
+      : simd.f16c  ? HalfToFloatF16c(src, dst, size)
+                   : 0;
+#endif  // TF_CONVERSION_USE_X86_SIMD
+  for (; i < size; ++i) {
+    dst[i] = static_cast<float>(src[i]);
+  }
+}
+
 }  // end namespace tensorflow
@@ -49,10 +49,21 @@ limitations under the License.
 namespace tensorflow {
 
 // Conversion routines between an array of float and bfloat16 of
-// "size".
+// "size". FloatToBFloat16 truncates the floats, while RoundFloatToBFloat16
+// returns the same values as converting every float to bfloat16.
 void FloatToBFloat16(const float* src, bfloat16* dst, int64 size);
+void RoundFloatToBFloat16(const float* src, bfloat16* dst, int64 size);
 void BFloat16ToFloat(const bfloat16* src, float* dst, int64 size);
 
+// Conversion routines between an array of float and Eigen::half of "size",
+// which return the same values as converting every element, except that NaN
+// payloads may differ.
+void FloatToHalf(const float* src, Eigen::half* dst, int64 size);
+void HalfToFloat(const Eigen::half* src, float* dst, int64 size);
+
+// All of the routines above use SIMD instructions when the CPU supports them,
+// whatever the instruction set the binary was compiled for.
+
 }  // namespace tensorflow
 
 #endif  // TENSORFLOW_CORE_FRAMEWORK_BFLOAT16_H_
@@ -15,6 +15,9 @@ limitations under the License.
 
 #include "tensorflow/core/framework/bfloat16.h"
 
+#include <cmath>
+#include <vector>
+
 #include "absl/base/casts.h"
 #include "tensorflow/core/framework/numeric_types.h"
 #include "tensorflow/core/platform/test.h"
@@ -175,6 +178,73 @@ TEST(Bfloat16Test, Conversion) {
   }
 }
 
+// Special and boundary floats followed by random ones, in a count that does
+// not fill whole SIMD registers.
+std::vector<float> ConversionInputs() {
+  std::vector<float> inputs = {0.0f,
+                               -0.0f,
+                               1.0f,
+                               -2.5f,
+                               std::numeric_limits<float>::infinity(),
+                               -std::numeric_limits<float>::infinity(),
+                               std::numeric_limits<float>::quiet_NaN(),
+                               -std::numeric_limits<float>::quiet_NaN(),
+                               std::numeric_limits<float>::max(),
+                               std::numeric_limits<float>::min(),
+                               std::numeric_limits<float>::denorm_min(),
+                               65504.0f,
+                               65520.0f,
+                               5.96e-8f,
+                               2.98e-8f};
+  uint32_t bits = 0x12345678;
+  while (inputs.size() < 1003) {
+    bits = bits * 1664525 + 1013904223;
+    const float f = absl::bit_cast<float>(bits);
+    if (!std::isnan(f)) inputs.push_back(f);
+  }
+  return inputs;
+}
+
+TEST(Bfloat16Test, RoundFloatToBFloat16MatchesConstructor) {
+  const std::vector<float> a = ConversionInputs();
+  std::vector<bfloat16> b(a.size());
+  RoundFloatToBFloat16(a.data(), b.data(), a.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    EXPECT_EQ(b[i].value, bfloat16(a[i]).value) << a[i];
+  }
+}
+
+TEST(Bfloat16Test, TruncateAndExpand) {
+  const std::vector<float> a = ConversionInputs();
+  std::vector<bfloat16> b(a.size());
+  std::vector<float> c(a.size());
+  FloatToBFloat16(a.data(), b.data(), a.size());
+  BFloat16ToFloat(b.data(), c.data(), a.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    EXPECT_EQ(b[i].value, absl::bit_cast<uint32_t>(a[i]) >> 16) << a[i];
+    EXPECT_EQ(absl::bit_cast<uint32_t>(c[i]),
+              absl::bit_cast<uint32_t>(a[i]) & 0xffff0000)
+        << a[i];
+  }
+}
+
+TEST(Bfloat16Test, HalfConversion) {
+  const std::vector<float> a = ConversionInputs();
+  std::vector<Eigen::half> b(a.size());
+  std::vector<float> c(a.size());
+  FloatToHalf(a.data(), b.data(), a.size());
+  HalfToFloat(b.data(), c.data(), a.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    const Eigen::half expected(a[i]);
+    EXPECT_EQ(b[i].x, expected.x) << a[i];
+    if (std::isnan(a[i])) {
+      EXPECT_TRUE(std::isnan(c[i]));
+    } else {
+      EXPECT_EQ(c[i], static_cast<float>(expected)) << a[i];
+    }
+  }
+}
+
 TEST(Bfloat16Test, Epsilon) {
   EXPECT_LT(1.0f,
             static_cast<float>(Eigen::NumTraits<Eigen::bfloat16>::epsilon() +
@@ -209,12 +279,6 @@ static void BM_FloatToBFloat16(int iters) {
 }
 BENCHMARK(BM_FloatToBFloat16);
 
-void RoundFloatToBFloat16(const float* src, bfloat16* dst, int64 size) {
-  for (; size != 0; size--) {
-    dst[size] = bfloat16(src[size]);
-  }
-}
-
 static void BM_RoundFloatToBFloat16(int iters) {
   testing::StopTiming();
   static const int N = 32 << 20;
@@ -255,5 +319,43 @@ static void BM_BFloat16ToFloat(int iters) {
 }
 BENCHMARK(BM_BFloat16ToFloat);
 
+static void BM_FloatToHalf(int iters) {
+  testing::StopTiming();
+  static const int N = 32 << 20;
+  const int64 tot = static_cast<int64>(iters) * N;
+  testing::ItemsProcessed(tot);
+  testing::BytesProcessed(tot * (sizeof(float) + sizeof(Eigen::half)));
+
+  float* inp = new float[N];
+  Eigen::half* out = new Eigen::half[N];
+
+  testing::StartTiming();
+  while (iters--) {
+    FloatToHalf(inp, out, N);
+  }
+  delete[] inp;
+  delete[] out;
+}
+BENCHMARK(BM_FloatToHalf);
+
+static void BM_HalfToFloat(int iters) {
+  testing::StopTiming();
+  static const int N = 32 << 20;
+  const int64 tot = static_cast<int64>(iters) * N;
+  testing::ItemsProcessed(tot);
+  testing::BytesProcessed(tot * (sizeof(float) + sizeof(Eigen::half)));
+
+  Eigen::half* inp = new Eigen::half[N];
+  float* out = new float[N];
+
+  testing::StartTiming();
+  while (iters--) {
+    HalfToFloat(inp, out, N);
+  }
+  delete[] inp;
+  delete[] out;
+}
+BENCHMARK(BM_HalfToFloat);
+
 }  // namespace
 }  // namespace tensorflow
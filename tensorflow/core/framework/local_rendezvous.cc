@@ -97,19 +97,20 @@ void LocalRendezvous::ItemQueue::push_back(Item* item) {
 }
 
 LocalRendezvous::~LocalRendezvous() {
-  if (!table_.empty()) {
+  bool empty = true;
+  for (Bucket& bucket : buckets_) {
+    mutex_lock l(bucket.mu);
+    empty = empty && bucket.table.empty();
+  }
+  if (!empty) {
     StartAbort(errors::Cancelled("LocalRendezvous deleted"));
   }
 }
 
-namespace {
-uint64 KeyHash(const StringPiece& k) { return Hash64(k.data(), k.size()); }
-}  // namespace
-
 Status LocalRendezvous::Send(const Rendezvous::ParsedKey& key,
                              const Rendezvous::Args& send_args,
                              const Tensor& val, const bool is_dead) {
-  uint64 key_hash = KeyHash(key.FullKey());
+  uint64 key_hash = key.KeyHash();
   DVLOG(2) << "Send " << this << " " << key_hash << " " << key.FullKey();
 
   if (is_dead) {
@@ -122,15 +123,16 @@ Status LocalRendezvous::Send(const Rendezvous::ParsedKey& key,
         ->IncrementBy(1);
   }
 
-  mu_.lock();
-  if (!status_.ok()) {
+  Bucket* bucket = GetBucket(key_hash);
+  bucket->mu.lock();
+  if (!bucket->status.ok()) {
     // Rendezvous has been aborted.
-    Status s = status_;
-    mu_.unlock();
+    Status s = bucket->status;
+    bucket->mu.unlock();
     return s;
   }
 
-  ItemQueue* queue = &table_[key_hash];
+  ItemQueue* queue = &bucket->table[key_hash];
   if (queue->head == nullptr || queue->head->type == Item::kSend) {
     // There is no waiter for this message. Append the message
     // into the queue. The waiter will pick it up when arrives.
@@ -139,7 +141,7 @@ Status LocalRendezvous::Send(const Rendezvous::ParsedKey& key,
     // the lock.
     DVLOG(2) << "Enqueue Send Item (key:" << key.FullKey() << "). ";
     queue->push_back(new Item(send_args, val, is_dead));
-    mu_.unlock();
+    bucket->mu.unlock();
     return Status::OK();
   }
 
@@ -150,11 +152,11 @@ Status LocalRendezvous::Send(const Rendezvous::ParsedKey& key,
   // Delete the queue when the last element has been consumed.
   if (item->next == nullptr) {
     DVLOG(2) << "Clean up Send/Recv queue (key:" << key.FullKey() << "). ";
-    table_.erase(key_hash);
+    bucket->table.erase(key_hash);
   } else {
     queue->head = item->next;
   }
-  mu_.unlock();
+  bucket->mu.unlock();
 
   // Notify the waiter by invoking its done closure, outside the
   // lock.
@@ -167,19 +169,20 @@ Status LocalRendezvous::Send(const Rendezvous::ParsedKey& key,
 void LocalRendezvous::RecvAsync(const Rendezvous::ParsedKey& key,
                                 const Rendezvous::Args& recv_args,
                                 Rendezvous::DoneCallback done) {
-  uint64 key_hash = KeyHash(key.FullKey());
+  uint64 key_hash = key.KeyHash();
   DVLOG(2) << "Recv " << this << " " << key_hash << " " << key.FullKey();
 
-  mu_.lock();
-  if (!status_.ok()) {
+  Bucket* bucket = GetBucket(key_hash);
+  bucket->mu.lock();
+  if (!bucket->status.ok()) {
     // Rendezvous has been aborted.
-    Status s = status_;
-    mu_.unlock();
+    Status s = bucket->status;
+    bucket->mu.unlock();
     done(s, Rendezvous::Args(), recv_args, Tensor(), false);
     return;
   }
 
-  ItemQueue* queue = &table_[key_hash];
+  ItemQueue* queue = &bucket->table[key_hash];
   if (queue->head == nullptr || queue->head->type == Item::kRecv) {
     // There is no message to pick up.
     // Only recv-related fields need to be filled.
@@ -188,52 +191,53 @@ void LocalRendezvous::RecvAsync(const Rendezvous::ParsedKey& key,
     bool already_cancelled = false;
     if (cm != nullptr) {
       token = cm->get_cancellation_token();
-      already_cancelled = !cm->RegisterCallback(token, [this, token, key_hash] {
-        Item* item = nullptr;
-        {
-          mutex_lock l(mu_);
-          ItemQueue* queue = &table_[key_hash];
-          // Find an item in the queue with a cancellation token that matches
-          // `token`, and remove it.
-          if (queue->head != nullptr && queue->head->type == Item::kRecv) {
-            for (Item *prev = nullptr, *curr = queue->head; curr != nullptr;
-                 prev = curr, curr = curr->next) {
-              if (curr->recv_state.cancellation_token == token) {
-                item = curr;
-                if (queue->head->next == nullptr) {
-                  // We have a single-element queue, so we can erase it from
-                  // the table.
-                  table_.erase(key_hash);
-                } else {
-                  // Remove the current item from the queue.
-                  if (curr == queue->head) {
-                    DCHECK_EQ(prev, nullptr);
-                    queue->head = curr->next;
-                  } else {
-                    DCHECK_NE(prev, nullptr);
-                    prev->next = curr->next;
-                  }
-                  if (queue->tail == curr) {
-                    queue->tail = prev;
+      already_cancelled = !cm->RegisterCallback(
+          token, [bucket, token, key_hash] {
+            Item* item = nullptr;
+            {
+              mutex_lock l(bucket->mu);
+              ItemQueue* queue = &bucket->table[key_hash];
+              // Find an item in the queue with a cancellation token that
+              // matches `token`, and remove it.
+              if (queue->head != nullptr && queue->head->type == Item::kRecv) {
+                for (Item *prev = nullptr, *curr = queue->head; curr != nullptr;
+                     prev = curr, curr = curr->next) {
+                  if (curr->recv_state.cancellation_token == token) {
+                    item = curr;
+                    if (queue->head->next == nullptr) {
+                      // We have a single-element queue, so we can erase it from
+                      // the table.
+                      bucket->table.erase(key_hash);
+                    } else {
+                      // Remove the current item from the queue.
+                      if (curr == queue->head) {
+                        DCHECK_EQ(prev, nullptr);
+                        queue->head = curr->next;
+                      } else {
+                        DCHECK_NE(prev, nullptr);
+                        prev->next = curr->next;
+                      }
+                      if (queue->tail == curr) {
+                        queue->tail = prev;
+                      }
+                    }
+                    break;
                   }
                 }
-                break;
               }
             }
-          }
-        }
 
-        if (item != nullptr) {
-          (*item->recv_state.waiter)(
-              StatusGroup::MakeDerived(
-                  errors::Cancelled("RecvAsync is cancelled.")),
-              Rendezvous::Args(), item->args, Tensor(), /*is_dead=*/false);
-          delete item;
-        }
-      });
+            if (item != nullptr) {
+              (*item->recv_state.waiter)(
+                  StatusGroup::MakeDerived(
+                      errors::Cancelled("RecvAsync is cancelled.")),
+                  Rendezvous::Args(), item->args, Tensor(), /*is_dead=*/false);
+              delete item;
+            }
+          });
     }
     if (already_cancelled) {
-      mu_.unlock();
+      bucket->mu.unlock();
       done(StatusGroup::MakeDerived(
                errors::Cancelled("RecvAsync is cancelled.")),
            Rendezvous::Args(), recv_args, Tensor(), /*is_dead=*/false);
@@ -261,7 +265,7 @@ void LocalRendezvous::RecvAsync(const Rendezvous::ParsedKey& key,
       queue->push_back(new Item(recv_args, std::move(done), token));
     }
 
-    mu_.unlock();
+    bucket->mu.unlock();
     return;
   }
 
@@ -273,11 +277,11 @@ void LocalRendezvous::RecvAsync(const Rendezvous::ParsedKey& key,
   // Delete the queue when the last element has been consumed.
   if (item->next == nullptr) {
     DVLOG(2) << "Clean up Send/Recv queue (key:" << key.FullKey() << "). ";
-    table_.erase(key_hash);
+    bucket->table.erase(key_hash);
   } else {
     queue->head = item->next;
   }
-  mu_.unlock();
+  bucket->mu.unlock();
 
   // Invoke done() without holding the table lock.
   DCHECK_EQ(item->type, Item::kSend);
@@ -288,22 +292,24 @@ void LocalRendezvous::RecvAsync(const Rendezvous::ParsedKey& key,
 
 void LocalRendezvous::StartAbort(const Status& status) {
   CHECK(!status.ok());
-  Table table;
-  {
-    mutex_lock l(mu_);
-    status_.Update(status);
-    table_.swap(table);
-  }
-  for (auto& p : table) {
-    Item* item = p.second.head;
-    while (item != nullptr) {
-      if (item->type == Item::kRecv) {
-        (*item->recv_state.waiter)(status, Rendezvous::Args(),
-                                   Rendezvous::Args(), Tensor(), false);
+  for (Bucket& bucket : buckets_) {
+    Table table;
+    {
+      mutex_lock l(bucket.mu);
+      bucket.status.Update(status);
+      bucket.table.swap(table);
+    }
+    for (auto& p : table) {
+      Item* item = p.second.head;
+      while (item != nullptr) {
+        if (item->type == Item::kRecv) {
+          (*item->recv_state.waiter)(status, Rendezvous::Args(),
+                                     Rendezvous::Args(), Tensor(), false);
+        }
+        Item* to_delete = item;
+        item = item->next;
+        delete to_delete;
       }
-      Item* to_delete = item;
-      item = item->next;
-      delete to_delete;
     }
   }
 }
@@ -62,10 +62,23 @@ class LocalRendezvous {
 
   typedef gtl::FlatMap<uint64, ItemQueue> Table;
 
-  // TODO(zhifengc): shard table_.
-  mutex mu_;
-  Table table_ TF_GUARDED_BY(mu_);
-  Status status_ TF_GUARDED_BY(mu_);
+  // The queues are partitioned by key hash into buckets with their own lock,
+  // so that Send and Recv calls for different keys rarely contend. Each
+  // bucket also records the abort status, which StartAbort sets in every
+  // bucket while it empties it, so that no item is queued after that.
+  struct Bucket {
+    mutex mu;
+    Table table TF_GUARDED_BY(mu);
+    Status status TF_GUARDED_BY(mu);
+  };
+
+  static constexpr int kNumBuckets = 16;
+
+  Bucket* GetBucket(uint64 key_hash) {
+    return &buckets_[key_hash % kNumBuckets];
+  }
+
+  Bucket buckets_[kNumBuckets];
 
   TF_DISALLOW_COPY_AND_ASSIGN(LocalRendezvous);
 };
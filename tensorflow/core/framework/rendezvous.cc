@@ -47,6 +47,7 @@ Rendezvous::ParsedKey& Rendezvous::ParsedKey::operator=(const ParsedKey& b) {
   dst = b.dst;
   edge_name = StringPiece(buf_.data() + (b.edge_name.data() - b_base),
                           b.edge_name.size());
+  key_hash_ = b.key_hash_;
   return *this;
 }
 
@@ -109,11 +110,36 @@ Status Rendezvous::ParseKey(StringPiece key, ParsedKey* out) {
     out->src_device = StringPiece(parts[0].data(), parts[0].size());
     out->dst_device = StringPiece(parts[2].data(), parts[2].size());
     out->edge_name = StringPiece(parts[3].data(), parts[3].size());
+    out->key_hash_ = Hash64(out->buf_);
     return Status::OK();
   }
   return errors::InvalidArgument("Invalid  rendezvous key: ", key);
 }
 
+/* static */
+void Rendezvous::ReplaceFrameAndIter(const ParsedKey& key,
+                                     const FrameAndIter& frame_iter,
+                                     ParsedKey* out) {
+  DCHECK_NE(&key, out);
+  // The frame and iteration are the last part of the key, after the edge
+  // name, so the other parts keep their offsets in the new key.
+  const char* base = key.buf_.data();
+  out->buf_.assign(base, key.edge_name.data() + key.edge_name.size() - base);
+  strings::StrAppend(&out->buf_, ";", frame_iter.frame_id, ":",
+                     frame_iter.iter_id);
+  const char* out_base = out->buf_.data();
+  out->src_device = StringPiece(out_base + (key.src_device.data() - base),
+                                key.src_device.size());
+  out->src = key.src;
+  out->src_incarnation = key.src_incarnation;
+  out->dst_device = StringPiece(out_base + (key.dst_device.data() - base),
+                                key.dst_device.size());
+  out->dst = key.dst;
+  out->edge_name = StringPiece(out_base + (key.edge_name.data() - base),
+                               key.edge_name.size());
+  out->key_hash_ = Hash64(out->buf_);
+}
+
 RendezvousInterface::~RendezvousInterface() {}
 
 Status RendezvousInterface::Recv(const ParsedKey& key, const Args& recv_args,
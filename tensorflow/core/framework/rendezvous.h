@@ -70,11 +70,16 @@ class RendezvousInterface {
     ParsedKey& operator=(const ParsedKey& b);
     StringPiece FullKey() const { return buf_; }
 
+    // A fingerprint of FullKey(), computed once when the key is parsed, by
+    // which rendezvous tables look up the key.
+    uint64 KeyHash() const { return key_hash_; }
+
    private:
     friend class Rendezvous;
     friend class SendOp;
     friend class RecvOp;
     string buf_;
+    uint64 key_hash_ = 0;
   };
 
   // The caller is a tensor producer and it sends a message (a tensor
@@ -174,6 +179,13 @@ class Rendezvous : public RendezvousInterface, public core::RefCounted {
                           const FrameAndIter& frame_iter);
 
   static Status ParseKey(StringPiece key, ParsedKey* out);
+
+  // Sets "out" to "key" with its frame and iteration replaced by
+  // "frame_iter". Unlike parsing the new key, this does not parse its device
+  // names again.
+  static void ReplaceFrameAndIter(const ParsedKey& key,
+                                  const FrameAndIter& frame_iter,
+                                  ParsedKey* out);
 };
 
 // Returns a Rendezvous instance that is limited to use only by
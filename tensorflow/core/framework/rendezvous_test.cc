@@ -21,6 +21,7 @@ limitations under the License.
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/framework/tensor_types.h"
 #include "tensorflow/core/framework/types.pb.h"
+#include "tensorflow/core/lib/core/blocking_counter.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/core/notification.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
@@ -65,6 +66,39 @@ TEST(RendezvousTest, Key) {
       Rendezvous::ParseKey(strings::StrCat(key, ";", key), &parsed).ok());
 }
 
+TEST(RendezvousTest, ReplaceFrameAndIter) {
+  Rendezvous::ParsedKey parsed;
+  TF_EXPECT_OK(Rendezvous::ParseKey(
+      Rendezvous::CreateKey("/job:mnist/replica:1/task:2/CPU:0", 7890,
+                            "/job:mnist/replica:1/task:2/device:GPU:0", "var0",
+                            FrameAndIter(0, 0)),
+      &parsed));
+  Rendezvous::ParsedKey expected;
+  TF_EXPECT_OK(Rendezvous::ParseKey(
+      Rendezvous::CreateKey("/job:mnist/replica:1/task:2/CPU:0", 7890,
+                            "/job:mnist/replica:1/task:2/device:GPU:0", "var0",
+                            FrameAndIter(123, 45)),
+      &expected));
+  EXPECT_NE(parsed.KeyHash(), expected.KeyHash());
+
+  Rendezvous::ParsedKey in_loop;
+  Rendezvous::ReplaceFrameAndIter(parsed, FrameAndIter(123, 45), &in_loop);
+  EXPECT_EQ(in_loop.FullKey(), expected.FullKey());
+  EXPECT_EQ(in_loop.KeyHash(), expected.KeyHash());
+  EXPECT_EQ(in_loop.src_device, "/job:mnist/replica:1/task:2/CPU:0");
+  EXPECT_EQ(in_loop.src_incarnation, 7890);
+  EXPECT_EQ(in_loop.src.type, "CPU");
+  EXPECT_EQ(in_loop.dst_device, "/job:mnist/replica:1/task:2/device:GPU:0");
+  EXPECT_EQ(in_loop.dst.type, "GPU");
+  EXPECT_EQ(in_loop.edge_name, "var0");
+
+  // Copies keep the fingerprint and point into their own buffer.
+  Rendezvous::ParsedKey copy(in_loop);
+  EXPECT_EQ(copy.KeyHash(), expected.KeyHash());
+  EXPECT_EQ(copy.edge_name, "var0");
+  EXPECT_NE(copy.edge_name.data(), in_loop.edge_name.data());
+}
+
 class LocalRendezvousTest : public ::testing::Test {
  public:
   LocalRendezvousTest() : threads_(Env::Default(), "test", 16) {
@@ -384,6 +418,32 @@ TEST_F(LocalRendezvousTest, RecvSleepAbort) {
   EXPECT_TRUE(errors::IsAborted(status));
 }
 
+TEST_F(LocalRendezvousTest, AbortManyKeys) {
+  // Enough keys to land in every bucket of the table.
+  const int kNumKeys = 100;
+  std::vector<Rendezvous::ParsedKey> keys(kNumKeys);
+  for (int i = 0; i < kNumKeys; ++i) {
+    keys[i] = MakeKey(strings::StrCat("key", i));
+  }
+  Rendezvous::Args args;
+  BlockingCounter counter(kNumKeys);
+  for (int i = 0; i < kNumKeys; ++i) {
+    rendez_->RecvAsync(keys[i], args,
+                       [&counter](const Status& s, const Rendezvous::Args&,
+                                  const Rendezvous::Args&, const Tensor&,
+                                  bool) {
+                         EXPECT_TRUE(errors::IsAborted(s));
+                         counter.DecrementCount();
+                       });
+  }
+  rendez_->StartAbort(errors::Aborted(""));
+  counter.Wait();
+  for (int i = 0; i < kNumKeys; ++i) {
+    EXPECT_TRUE(
+        errors::IsAborted(rendez_->Send(keys[i], args, V("hello"), false)));
+  }
+}
+
 TEST_F(LocalRendezvousTest, AbortThenRecvOrSend) {
   rendez_->StartAbort(errors::Aborted(""));
   Tensor val(DT_STRING);
@@ -512,5 +572,40 @@ void BM_PingPong(int iters) {
 }
 BENCHMARK(BM_PingPong);
 
+// Each of 'num_threads' threads sends and receives 'iters' values over its own
+// key of a shared rendezvous, so that throughput only depends on how much
+// unrelated keys contend.
+void BM_ParallelSendRecv(int iters, int num_threads) {
+  testing::StopTiming();
+  Rendezvous* rendez = NewLocalRendezvous();
+  std::vector<Rendezvous::ParsedKey> keys(num_threads);
+  for (int i = 0; i < num_threads; ++i) {
+    keys[i] = MakeKey(strings::StrCat("key", i));
+  }
+  thread::ThreadPool* pool =
+      new thread::ThreadPool(Env::Default(), "test", num_threads);
+  BlockingCounter counter(num_threads);
+  testing::StartTiming();
+  for (int i = 0; i < num_threads; ++i) {
+    pool->Schedule([rendez, &keys, &counter, i, iters]() {
+      Tensor orig = V("val");
+      Tensor val(DT_STRING, TensorShape({}));
+      bool is_dead = false;
+      Rendezvous::Args args;
+      for (int j = 0; j < iters; ++j) {
+        TF_CHECK_OK(rendez->Send(keys[i], args, orig, is_dead));
+        TF_CHECK_OK(rendez->Recv(keys[i], args, &val, &is_dead));
+      }
+      counter.DecrementCount();
+    });
+  }
+  counter.Wait();
+  testing::StopTiming();
+  testing::ItemsProcessed(static_cast<int64>(iters) * num_threads);
+  delete pool;
+  rendez->Unref();
+}
+BENCHMARK(BM_ParallelSendRecv)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16);
+
 }  // namespace
 }  // namespace tensorflow
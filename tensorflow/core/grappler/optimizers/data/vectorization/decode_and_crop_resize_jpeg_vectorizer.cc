@@ -0,0 +1,85 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <initializer_list>
+
+#include "tensorflow/cc/framework/ops.h"
+#include "tensorflow/cc/framework/scope_internal.h"
+#include "tensorflow/cc/ops/array_ops.h"
+#include "tensorflow/cc/ops/const_op.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/grappler/optimizers/data/vectorization/vectorizer_registry.h"
+
+namespace tensorflow {
+namespace grappler {
+
+namespace {
+
+constexpr char kDecodeAndCropResizeJpegPrefix[] =
+    "vectorized/decode_and_crop_resize_jpeg";
+
+// BatchDecodeAndCropResizeJpeg is the vectorized version of
+// DecodeAndCropResizeJpeg. The output size must be the same for all elements,
+// but the crop window may be either shared or vary per element.
+class DecodeAndCropResizeJpegVectorizer : public Vectorizer {
+ public:
+  Status Vectorize(const Node& node, Graph* outer_scope,
+                   VectorizerInput&& inputs,
+                   VectorizerOutput* outputs) override {
+    Status status;
+    Scope parent = NewInternalScope(outer_scope, &status, /*refiner=*/nullptr);
+    Scope scope = parent.NewSubScope(kDecodeAndCropResizeJpegPrefix);
+
+    Output contents, crop_windows, size;
+    TF_RETURN_IF_ERROR(inputs.stacked(0, &contents));
+    TF_RETURN_IF_ERROR(inputs.unstacked(2, &size));
+    if (inputs.at(1).stacked) {
+      TF_RETURN_IF_ERROR(inputs.stacked(1, &crop_windows));
+    } else {
+      // Broadcast a shared crop window to every element of the batch:
+      // crop_windows = tf.broadcast_to(crop_window, [tf.size(contents), 4])
+      Output crop_window;
+      TF_RETURN_IF_ERROR(inputs.unstacked(1, &crop_window));
+      Output shape = ops::Stack(
+          scope, std::initializer_list<Output>(
+                     {ops::Size(scope, contents), ops::Const(scope, 4)}));
+      crop_windows = ops::BroadcastTo(scope, crop_window, shape);
+    }
+    TF_RETURN_IF_ERROR(status);
+
+    Node* new_node;
+    auto node_builder =
+        NodeBuilder(strings::StrCat("vectorized/", node.name()),
+                    "BatchDecodeAndCropResizeJpeg")
+            .Input(contents.node(), contents.index())
+            .Input(crop_windows.node(), crop_windows.index())
+            .Input(size.node(), size.index());
+    for (const auto& attr : node.attrs()) {
+      node_builder = node_builder.Attr(attr.first, attr.second);
+    }
+    TF_RETURN_IF_ERROR(node_builder.Finalize(outer_scope, &new_node));
+
+    // Add output mappings
+    outputs->push_back({new_node, 0, true});
+    return Status::OK();
+  }
+};
+
+REGISTER_VECTORIZER("DecodeAndCropResizeJpeg",
+                    DecodeAndCropResizeJpegVectorizer);
+
+}  // namespace
+}  // namespace grappler
+}  // namespace tensorflow
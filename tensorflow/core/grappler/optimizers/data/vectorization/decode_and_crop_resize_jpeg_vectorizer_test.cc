@@ -0,0 +1,119 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/framework/node_def_util.h"
+#include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/grappler/optimizers/data/vectorization/vectorizer_registry.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace grappler {
+namespace {
+
+class DecodeAndCropResizeJpegVectorizerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    TF_ASSERT_OK(AddPlaceholder("contents", DT_STRING, &contents_));
+    TF_ASSERT_OK(AddPlaceholder("crop_window", DT_INT32, &crop_window_));
+    TF_ASSERT_OK(AddPlaceholder("size", DT_INT32, &size_));
+    TF_ASSERT_OK(NodeBuilder("decode", "DecodeAndCropResizeJpeg")
+                     .Input(contents_)
+                     .Input(crop_window_)
+                     .Input(size_)
+                     .Attr("channels", 1)
+                     .Finalize(&graph_, &node_));
+  }
+
+  Status AddPlaceholder(const string& name, DataType dtype, Node** node) {
+    return NodeBuilder(name, "Placeholder")
+        .Attr("dtype", dtype)
+        .Finalize(&graph_, node);
+  }
+
+  // Vectorizes node_, with the crop window stacked or not.
+  Status Vectorize(bool contents_stacked, bool crop_window_stacked,
+                   VectorizerOutput* outputs) {
+    Vectorizer* vectorizer =
+        VectorizerRegistry::Global()->Get("DecodeAndCropResizeJpeg");
+    if (vectorizer == nullptr) {
+      return errors::NotFound("No vectorizer for DecodeAndCropResizeJpeg");
+    }
+    std::vector<WrappedTensor> inputs = {
+        {contents_, 0, contents_stacked},
+        {crop_window_, 0, crop_window_stacked},
+        {size_, 0, false}};
+    return vectorizer->Vectorize(*node_, &graph_, std::move(inputs), outputs);
+  }
+
+  Graph graph_{OpRegistry::Global()};
+  Node* contents_;
+  Node* crop_window_;
+  Node* size_;
+  Node* node_;
+};
+
+TEST_F(DecodeAndCropResizeJpegVectorizerTest, StackedCropWindows) {
+  VectorizerOutput outputs;
+  TF_ASSERT_OK(Vectorize(/*contents_stacked=*/true,
+                         /*crop_window_stacked=*/true, &outputs));
+  ASSERT_EQ(1, outputs.size());
+  EXPECT_TRUE(outputs[0].stacked);
+  EXPECT_EQ(0, outputs[0].output_index);
+
+  const Node* batch = outputs[0].node;
+  EXPECT_EQ("BatchDecodeAndCropResizeJpeg", batch->type_string());
+  const Node* input;
+  TF_ASSERT_OK(batch->input_node(0, &input));
+  EXPECT_EQ(contents_, input);
+  TF_ASSERT_OK(batch->input_node(1, &input));
+  EXPECT_EQ(crop_window_, input);
+  TF_ASSERT_OK(batch->input_node(2, &input));
+  EXPECT_EQ(size_, input);
+  int channels;
+  TF_ASSERT_OK(GetNodeAttr(batch->attrs(), "channels", &channels));
+  EXPECT_EQ(1, channels);
+}
+
+TEST_F(DecodeAndCropResizeJpegVectorizerTest, BroadcastsSharedCropWindow) {
+  VectorizerOutput outputs;
+  TF_ASSERT_OK(Vectorize(/*contents_stacked=*/true,
+                         /*crop_window_stacked=*/false, &outputs));
+  ASSERT_EQ(1, outputs.size());
+  EXPECT_TRUE(outputs[0].stacked);
+
+  const Node* batch = outputs[0].node;
+  EXPECT_EQ("BatchDecodeAndCropResizeJpeg", batch->type_string());
+  const Node* crop_windows;
+  TF_ASSERT_OK(batch->input_node(1, &crop_windows));
+  EXPECT_EQ("BroadcastTo", crop_windows->type_string());
+  const Node* input;
+  TF_ASSERT_OK(crop_windows->input_node(0, &input));
+  EXPECT_EQ(crop_window_, input);
+  TF_ASSERT_OK(batch->input_node(2, &input));
+  EXPECT_EQ(size_, input);
+}
+
+TEST_F(DecodeAndCropResizeJpegVectorizerTest, RequiresStackedContents) {
+  VectorizerOutput outputs;
+  EXPECT_TRUE(errors::IsInvalidArgument(
+      Vectorize(/*contents_stacked=*/false,
+                /*crop_window_stacked=*/false, &outputs)));
+}
+
+}  // namespace
+}  // namespace grappler
+}  // namespace tensorflow
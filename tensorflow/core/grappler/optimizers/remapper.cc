@@ -16,6 +16,8 @@ limitations under the License.
 #include "tensorflow/core/grappler/optimizers/remapper.h"
 
 #include "absl/container/flat_hash_set.h"
+#include "tensorflow/core/framework/attr_value_util.h"
+#include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/versions.pb.h"
 #include "tensorflow/core/grappler/costs/graph_properties.h"
 #include "tensorflow/core/grappler/graph_view.h"
@@ -27,6 +29,7 @@ limitations under the License.
 #include "tensorflow/core/grappler/utils/symbolic_shapes.h"
 #include "tensorflow/core/grappler/utils/topological_sort.h"
 #include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/util/env_var.h"
 
@@ -54,6 +57,17 @@ namespace grappler {
 //   (1) FusedBatchNorm + <Activation>
 //   (2) FusedBatchNorm + SideInput + <Activation>
 //
+// Mean + SquaredDifference + Mean -> _FusedMoments
+//   (1) Mean + [StopGradient] + SquaredDifference + Mean (tf.nn.moments)
+//
+// {Softmax,LogSoftmax} + ... -> _FusedSoftmax
+//   (1) Mul(x, scale) + Add(mask) + {Softmax,LogSoftmax}
+//   (2) Add(x, mask) + {Softmax,LogSoftmax}
+//   (3) Mul(x, scale) + {Softmax,LogSoftmax}
+//
+// Where + Squeeze + GatherV2 -> _BooleanMask
+//   (1) GatherV2(x, Squeeze(Where(mask), [1]), axis) (tf.boolean_mask)
+//
 // In all cases, the supported activation functions are Relu, Relu6, and Elu.
 //
 // Both Conv2D and MatMul implemented as Tensor contraction (on CPU), so all the
@@ -64,9 +78,15 @@ constexpr char kFusedConv2D[] = "_FusedConv2D";
 constexpr char kFusedMatMul[] = "_FusedMatMul";
 constexpr char kFusedDepthwiseConv2dNative[] = "_FusedDepthwiseConv2dNative";
 constexpr char kFusedBatchNormEx[] = "_FusedBatchNormEx";
+constexpr char kFusedMoments[] = "_FusedMoments";
+constexpr char kFusedSoftmax[] = "_FusedSoftmax";
+constexpr char kBooleanMask[] = "_BooleanMask";
 
 constexpr char kDataFormat[] = "data_format";
 constexpr char kIsTraining[] = "is_training";
+constexpr char kKeepDims[] = "keep_dims";
+// Read by the CPU MatMul kernels, see kernels/packed_matmul.h.
+constexpr char kWeightsAreConstant[] = "_grappler_weights_are_constant";
 
 constexpr int kMissingIndex = -1;
 
@@ -103,6 +123,41 @@ struct FusedBatchNormEx {
   int invalidated = kMissingIndex;
 };
 
+// Mean and variance of the same tensor computed as separate reductions:
+//   mean = Mean(x, axes), variance = Mean(SquaredDifference(x, mean), axes)
+struct FusedMoments {
+  FusedMoments() = default;
+
+  int mean = kMissingIndex;
+  int stop_gradient = kMissingIndex;
+  int squared_difference = kMissingIndex;
+  int variance = kMissingIndex;
+};
+
+// Softmax or LogSoftmax of scaled and/or masked logits:
+//   softmax = Softmax(Add(Mul(logits, scale), mask))
+struct FusedSoftmax {
+  FusedSoftmax() = default;
+
+  int softmax = kMissingIndex;
+  int add = kMissingIndex;
+  int mul = kMissingIndex;
+  int mask_port = kMissingIndex;    // Add input that reads the mask
+  int logits_port = kMissingIndex;  // Mul input that reads the logits
+  float scale = 1.0f;
+};
+
+// Selection of the slices of a tensor where a 1-D boolean mask is true:
+//   GatherV2(tensor, Squeeze(Where(mask), squeeze_dims=[1]), axis)
+struct BooleanMask {
+  BooleanMask() = default;
+
+  int gather = kMissingIndex;
+  int squeeze = kMissingIndex;
+  int where = kMissingIndex;
+  int64 axis = 0;
+};
+
 // Contraction node followed by a BiasAdd.
 struct ContractionWithBiasAdd {
   ContractionWithBiasAdd() = default;
@@ -919,6 +974,250 @@ bool FindFusedBatchNormEx(const RemapperContext& ctx, int node_index,
   return false;
 }
 
+bool FindFusedMoments(const RemapperContext& ctx, int node_index,
+                      FusedMoments* matched) {
+  // Root of the pattern must be a Mean computing the variance.
+  const auto* node_view = ctx.graph_view.GetNode(node_index);
+  const auto* node_def = node_view->node();
+  if (!IsMean(*node_def) || HasControlFaninOrFanout(*node_view)) return false;
+
+  // _FusedMoments is only implemented for floating point types on CPU.
+  const DataType dtype = GetDataTypeFromAttr(*node_def, "T");
+  if (!NodeIsOnCpu(node_def) ||
+      (dtype != DT_FLOAT && dtype != DT_DOUBLE && dtype != DT_HALF &&
+       dtype != DT_BFLOAT16))
+    return false;
+
+  if (node_view->NumRegularFanins() < 2) return false;
+  const auto& squared_difference_fanin = node_view->GetRegularFanin(0);
+  const auto* squared_difference = squared_difference_fanin.node_view();
+  const auto* squared_difference_def = squared_difference->node();
+  if (!IsSquaredDifference(*squared_difference_def) ||
+      squared_difference_fanin.index() != 0 ||
+      HasControlFaninOrFanout(*squared_difference) ||
+      !HasAtMostOneFanoutAtPort0(*squared_difference) ||
+      IsInPreserveSet(ctx, squared_difference_def) ||
+      squared_difference->NumRegularFanins() < 2)
+    return false;
+
+  // Returns true if both fanins read the same tensor, or equal constants.
+  const auto same_tensor = [](const utils::MutableFaninView& lhs,
+                              const utils::MutableFaninView& rhs) -> bool {
+    if (lhs.node_index() == rhs.node_index()) return lhs.index() == rhs.index();
+    const NodeDef* lhs_def = lhs.node_view()->node();
+    const NodeDef* rhs_def = rhs.node_view()->node();
+    return IsConstant(*lhs_def) && IsConstant(*rhs_def) &&
+           lhs.index() == 0 && rhs.index() == 0 &&
+           lhs_def->attr().count("value") > 0 &&
+           rhs_def->attr().count("value") > 0 &&
+           AreAttrValuesEqual(lhs_def->attr().at("value"),
+                              rhs_def->attr().at("value"));
+  };
+
+  bool keep_dims = false;
+  if (!TryGetNodeAttr(*node_def, kKeepDims, &keep_dims)) return false;
+
+  // One input of the SquaredDifference is the mean of the other one, possibly
+  // behind a StopGradient.
+  for (int mean_input : {0, 1}) {
+    const auto& x_fanin = squared_difference->GetRegularFanin(1 - mean_input);
+    const auto* mean =
+        squared_difference->GetRegularFanin(mean_input).node_view();
+    const auto* stop_gradient = mean;
+    if (IsStopGradient(*stop_gradient->node())) {
+      if (HasControlFaninOrFanout(*stop_gradient) ||
+          !HasAtMostOneFanoutAtPort0(*stop_gradient) ||
+          IsInPreserveSet(ctx, stop_gradient->node()) ||
+          stop_gradient->NumRegularFanins() < 1)
+        continue;
+      mean = stop_gradient->GetRegularFanin(0).node_view();
+    } else {
+      stop_gradient = nullptr;
+    }
+
+    // The mean must reduce the same tensor over the same axes, and keep the
+    // reduced dimensions so that it broadcasts against the input.
+    const auto* mean_def = mean->node();
+    bool mean_keep_dims = false;
+    if (!IsMean(*mean_def) || HasControlFaninOrFanout(*mean) ||
+        mean->NumRegularFanins() < 2 ||
+        !TryGetNodeAttr(*mean_def, kKeepDims, &mean_keep_dims) ||
+        !mean_keep_dims || mean_keep_dims != keep_dims ||
+        !HaveSameDataType(node_def, mean_def) ||
+        !HaveSameDataType(node_def, mean_def, "Tidx") ||
+        !same_tensor(mean->GetRegularFanin(0), x_fanin) ||
+        !same_tensor(mean->GetRegularFanin(1), node_view->GetRegularFanin(1)))
+      continue;
+
+    matched->mean = mean->node_index();
+    matched->stop_gradient =
+        stop_gradient ? stop_gradient->node_index() : kMissingIndex;
+    matched->squared_difference = squared_difference->node_index();
+    matched->variance = node_index;
+    return true;
+  }
+
+  return false;
+}
+
+bool FindFusedSoftmax(const RemapperContext& ctx, int node_index,
+                      FusedSoftmax* matched) {
+  // Root of the pattern must be a Softmax or LogSoftmax.
+  const auto* node_view = ctx.graph_view.GetNode(node_index);
+  const auto* node_def = node_view->node();
+  if ((!IsSoftmax(*node_def) && node_def->op() != "LogSoftmax") ||
+      HasControlFaninOrFanout(*node_view) ||
+      node_view->NumRegularFanins() < 1)
+    return false;
+
+  // _FusedSoftmax is only implemented for floating point types on CPU.
+  const DataType dtype = GetDataTypeFromAttr(*node_def, "T");
+  if (!NodeIsOnCpu(node_def) ||
+      (dtype != DT_FLOAT && dtype != DT_DOUBLE && dtype != DT_HALF &&
+       dtype != DT_BFLOAT16))
+    return false;
+
+  // Intermediate nodes are folded into the _FusedSoftmax, so they must not be
+  // observable from anywhere else.
+  const auto is_fusable = [&](const utils::MutableNodeView& node) -> bool {
+    return !HasControlFaninOrFanout(node) && HasAtMostOneFanoutAtPort0(node) &&
+           !IsInPreserveSet(ctx, node.node()) &&
+           HaveSameDataType(node_def, node.node()) &&
+           node.NumRegularFanins() == 2;
+  };
+
+  // Mul by a constant scalar, that can be folded into the `scale` attribute.
+  const auto find_scale = [&](const utils::MutableNodeView& mul) -> bool {
+    if (!IsMul(*mul.node()) || !is_fusable(mul)) return false;
+    for (int scale_port : {1, 0}) {
+      const auto& scale_fanin = mul.GetRegularFanin(scale_port);
+      const NodeDef* scale_def = scale_fanin.node_view()->node();
+      Tensor scale;
+      if (!IsConstant(*scale_def) || scale_fanin.index() != 0 ||
+          scale_def->attr().count("value") == 0 ||
+          !scale.FromProto(scale_def->attr().at("value").tensor()) ||
+          scale.dtype() != dtype || scale.NumElements() != 1 ||
+          scale.dims() > 1)
+        continue;
+
+      double value;
+      switch (dtype) {
+        case DT_FLOAT:
+          value = scale.flat<float>()(0);
+          break;
+        case DT_DOUBLE:
+          value = scale.flat<double>()(0);
+          break;
+        case DT_HALF:
+          value = static_cast<float>(scale.flat<Eigen::half>()(0));
+          break;
+        default:
+          value = static_cast<float>(scale.flat<bfloat16>()(0));
+          break;
+      }
+      // The `scale` attribute is a float, do not lose double precision.
+      if (static_cast<double>(static_cast<float>(value)) != value) continue;
+
+      matched->mul = mul.node_index();
+      matched->logits_port = 1 - scale_port;
+      matched->scale = static_cast<float>(value);
+      return true;
+    }
+    return false;
+  };
+
+  const auto* input = node_view->GetRegularFanin(0).node_view();
+  if (node_view->GetRegularFanin(0).index() != 0) return false;
+
+  if (IsAdd(*input->node()) && is_fusable(*input)) {
+    // The mask must broadcast to the shape of the logits, so that the result
+    // of the Add has the same shape as the logits.
+    const auto& props =
+        ctx.graph_properties.GetInputProperties(input->node()->name());
+    for (int mask_port : {1, 0}) {
+      if (props.size() < 2) break;
+      const auto& logits_shape = props[1 - mask_port].shape();
+      TensorShapeProto output_shape;
+      if (!ShapeAfterBroadcast(logits_shape, props[mask_port].shape(),
+                               &output_shape) ||
+          !ShapesSymbolicallyEqual(logits_shape, output_shape))
+        continue;
+
+      matched->softmax = node_index;
+      matched->add = input->node_index();
+      matched->mask_port = mask_port;
+      find_scale(*input->GetRegularFanin(1 - mask_port).node_view());
+      return true;
+    }
+    return false;
+  }
+
+  if (find_scale(*input)) {
+    matched->softmax = node_index;
+    return true;
+  }
+
+  return false;
+}
+
+bool FindBooleanMask(const RemapperContext& ctx, int node_index,
+                     BooleanMask* matched) {
+  // Root of the pattern must be a GatherV2 on CPU.
+  const auto* node_view = ctx.graph_view.GetNode(node_index);
+  const auto* node_def = node_view->node();
+  if (node_def->op() != "GatherV2" || !NodeIsOnCpu(node_def) ||
+      HasControlFaninOrFanout(*node_view) || node_view->NumRegularFanins() != 3)
+    return false;
+
+  int batch_dims = 0;
+  if (TryGetNodeAttr(*node_def, "batch_dims", &batch_dims) && batch_dims != 0)
+    return false;
+
+  // The axis must be a constant, so that it can become an attribute.
+  const auto& axis_fanin = node_view->GetRegularFanin(2);
+  const NodeDef* axis_def = axis_fanin.node_view()->node();
+  Tensor axis;
+  if (!IsConstant(*axis_def) || axis_fanin.index() != 0 ||
+      axis_def->attr().count("value") == 0 ||
+      !axis.FromProto(axis_def->attr().at("value").tensor()) ||
+      axis.NumElements() != 1 ||
+      (axis.dtype() != DT_INT32 && axis.dtype() != DT_INT64))
+    return false;
+
+  // The indices and the Where computing them are folded into the _BooleanMask,
+  // so they must not be observable from anywhere else.
+  const auto is_fusable = [&](const utils::MutableNodeView& node) -> bool {
+    return !HasControlFaninOrFanout(node) && HasAtMostOneFanoutAtPort0(node) &&
+           !IsInPreserveSet(ctx, node.node()) && NodeIsOnCpu(node.node()) &&
+           node.NumRegularFanins() == 1;
+  };
+
+  // Where(mask) returns a [num_true, 1] matrix for a 1-D mask, which must be
+  // squeezed into a vector of indices.
+  const auto& indices_fanin = node_view->GetRegularFanin(1);
+  const auto* squeeze = indices_fanin.node_view();
+  std::vector<int> squeeze_dims;
+  if (!IsSqueeze(*squeeze->node()) || indices_fanin.index() != 0 ||
+      !is_fusable(*squeeze) ||
+      !TryGetNodeAttr(*squeeze->node(), "squeeze_dims", &squeeze_dims) ||
+      squeeze_dims.size() != 1 ||
+      (squeeze_dims[0] != 1 && squeeze_dims[0] != -1))
+    return false;
+
+  const auto& where_fanin = squeeze->GetRegularFanin(0);
+  const auto* where = where_fanin.node_view();
+  if (where->node()->op() != "Where" || where_fanin.index() != 0 ||
+      !is_fusable(*where) || !HasDataType(where->node(), DT_BOOL))
+    return false;
+
+  matched->gather = node_index;
+  matched->squeeze = squeeze->node_index();
+  matched->where = where->node_index();
+  matched->axis = axis.dtype() == DT_INT32 ? axis.flat<int32>()(0)
+                                           : axis.flat<int64>()(0);
+  return true;
+}
+
 void CopyConv2DAttributes(const NodeDef& conv2d, NodeDef* fused_conv2d) {
   DCHECK(IsConv2D(conv2d)) << "Input node must be a Conv2D";
 
@@ -1370,6 +1669,139 @@ Status AddFusedBatchNormExNode(RemapperContext* ctx,
   return Status::OK();
 }
 
+Status AddFusedMomentsNode(RemapperContext* ctx, const FusedMoments& matched,
+                           std::vector<bool>* invalidated_nodes,
+                           std::vector<bool>* nodes_to_delete) {
+  const GraphDef* graph = ctx->graph_view.graph();
+  const NodeDef& mean = graph->node(matched.mean);
+  const NodeDef& variance = graph->node(matched.variance);
+
+  VLOG(2) << "Fuse Mean with SquaredDifference and Mean:"
+          << " mean=" << mean.name() << " variance=" << variance.name();
+
+  // Replace the mean with _FusedMoments, its first output is the mean.
+  NodeDef fused_op;
+  fused_op.set_op(kFusedMoments);
+  fused_op.set_name(mean.name());
+  fused_op.set_device(mean.device());
+
+  fused_op.add_input(mean.input(0));  // 0: x
+  fused_op.add_input(mean.input(1));  // 1: reduction_indices
+
+  auto* attrs = fused_op.mutable_attr();
+  (*attrs)["T"] = mean.attr().at("T");
+  (*attrs)["Tidx"] = mean.attr().at("Tidx");
+  (*attrs)[kKeepDims] = mean.attr().at(kKeepDims);
+
+  // Turn variance node into Identity node reading the second output.
+  NodeDef identity_op;
+  identity_op.set_op("Identity");
+  identity_op.set_name(variance.name());
+  identity_op.set_device(variance.device());
+  identity_op.add_input(strings::StrCat(mean.name(), ":1"));
+  (*identity_op.mutable_attr())["T"] = attrs->at("T");
+
+  utils::Mutation* mutation = ctx->graph_view.GetMutationBuilder();
+  Status status;
+  mutation->AddNode(std::move(fused_op), &status);
+  TF_RETURN_IF_ERROR(status);
+  mutation->AddNode(std::move(identity_op), &status);
+  TF_RETURN_IF_ERROR(status);
+  TF_RETURN_IF_ERROR(mutation->Apply());
+
+  (*invalidated_nodes)[matched.mean] = true;
+  (*invalidated_nodes)[matched.variance] = true;
+  (*nodes_to_delete)[matched.squared_difference] = true;
+  if (matched.stop_gradient != kMissingIndex) {
+    (*nodes_to_delete)[matched.stop_gradient] = true;
+  }
+
+  return Status::OK();
+}
+
+Status AddFusedSoftmaxNode(RemapperContext* ctx, const FusedSoftmax& matched,
+                           std::vector<bool>* invalidated_nodes,
+                           std::vector<bool>* nodes_to_delete) {
+  const GraphDef* graph = ctx->graph_view.graph();
+  const NodeDef& softmax = graph->node(matched.softmax);
+
+  VLOG(2) << "Fuse " << softmax.op() << " with Mul and/or Add:"
+          << " softmax=" << softmax.name() << " scale=" << matched.scale
+          << " add=" << (matched.add != kMissingIndex
+                             ? graph->node(matched.add).name()
+                             : "<none>");
+
+  NodeDef fused_op;
+  fused_op.set_op(kFusedSoftmax);
+  fused_op.set_name(softmax.name());
+  fused_op.set_device(softmax.device());
+
+  // 0: logits
+  if (matched.mul != kMissingIndex) {
+    fused_op.add_input(graph->node(matched.mul).input(matched.logits_port));
+  } else {
+    const NodeDef& add = graph->node(matched.add);
+    fused_op.add_input(add.input(1 - matched.mask_port));
+  }
+  // 1: mask
+  if (matched.add != kMissingIndex) {
+    fused_op.add_input(graph->node(matched.add).input(matched.mask_port));
+  }
+
+  auto* attrs = fused_op.mutable_attr();
+  (*attrs)["T"] = softmax.attr().at("T");
+  SetAttrValue(matched.add != kMissingIndex ? 1 : 0, &(*attrs)["num_masks"]);
+  SetAttrValue(matched.scale, &(*attrs)["scale"]);
+  SetAttrValue(softmax.op() == "LogSoftmax", &(*attrs)["log"]);
+
+  utils::Mutation* mutation = ctx->graph_view.GetMutationBuilder();
+  Status status;
+  mutation->AddNode(std::move(fused_op), &status);
+  TF_RETURN_IF_ERROR(status);
+  TF_RETURN_IF_ERROR(mutation->Apply());
+
+  (*invalidated_nodes)[matched.softmax] = true;
+  if (matched.add != kMissingIndex) (*nodes_to_delete)[matched.add] = true;
+  if (matched.mul != kMissingIndex) (*nodes_to_delete)[matched.mul] = true;
+
+  return Status::OK();
+}
+
+Status AddBooleanMaskNode(RemapperContext* ctx, const BooleanMask& matched,
+                          std::vector<bool>* invalidated_nodes,
+                          std::vector<bool>* nodes_to_delete) {
+  const GraphDef* graph = ctx->graph_view.graph();
+  const NodeDef& gather = graph->node(matched.gather);
+  const NodeDef& where = graph->node(matched.where);
+
+  VLOG(2) << "Fuse GatherV2 with Squeeze and Where:"
+          << " gather=" << gather.name() << " where=" << where.name();
+
+  NodeDef fused_op;
+  fused_op.set_op(kBooleanMask);
+  fused_op.set_name(gather.name());
+  fused_op.set_device(gather.device());
+
+  fused_op.add_input(gather.input(0));  // 0: tensor
+  fused_op.add_input(where.input(0));   // 1: mask
+
+  auto* attrs = fused_op.mutable_attr();
+  (*attrs)["T"] = gather.attr().at("Tparams");
+  SetAttrValue(matched.axis, &(*attrs)["axis"]);
+
+  utils::Mutation* mutation = ctx->graph_view.GetMutationBuilder();
+  Status status;
+  mutation->AddNode(std::move(fused_op), &status);
+  TF_RETURN_IF_ERROR(status);
+  TF_RETURN_IF_ERROR(mutation->Apply());
+
+  (*invalidated_nodes)[matched.gather] = true;
+  (*nodes_to_delete)[matched.squeeze] = true;
+  (*nodes_to_delete)[matched.where] = true;
+
+  return Status::OK();
+}
+
 Status AddBatchNormNodes(RemapperContext* ctx, const FusedBatchNorm& matched) {
   const GraphDef* graph = ctx->graph_view.graph();
   const NodeDef& fused_node = graph->node(matched.fused_batch_norm);
@@ -1600,6 +2032,7 @@ bool IsConv2DWithAdd(const RemapperContext& ctx, int node_index) {
 //   (2) Fusing side input and/or activation into FusedBatchNorm.
 //   (3) Fusing Conv2D biasadd and relu on GPU
 //   (4) INTEL_MKL specific: Conv2D -> Add or Conv2D -> BiasAdd -> Add.
+//   (5) Fusing a broadcasted mask into Softmax.
 bool RequiresInferredShapes(const RemapperContext& ctx, int node_index) {
   // Candidate for a FusedBatchNorm splitting.
   const auto* node_view = ctx.graph_view.GetNode(node_index);
@@ -1670,15 +2103,64 @@ bool RequiresInferredShapes(const RemapperContext& ctx, int node_index) {
     return false;
   };
 
+  // Candidate for a _FusedSoftmax with a mask.
+  const auto is_softmax_fusion_candidate = [&]() -> bool {
+    if (!IsSoftmax(*node_def) && node_def->op() != "LogSoftmax") return false;
+    if (node_view->NumRegularFanins() < 1) return false;
+    return IsAdd(*node_view->GetRegularFanin(0).node_view()->node());
+  };
+
 #ifdef INTEL_MKL
   return is_batch_norm_candidate() || is_batch_norm_fusion_candidate() ||
-         IsConv2DWithAdd(ctx, node_index);
+         is_softmax_fusion_candidate() || IsConv2DWithAdd(ctx, node_index);
 #else
   return is_relu_biasadd_conv2d_candidate() || is_batch_norm_candidate() ||
-         is_batch_norm_fusion_candidate();
+         is_batch_norm_fusion_candidate() || is_softmax_fusion_candidate();
 #endif  // INTEL_MKL
 }
 
+// Returns true if the tensor produced by 'weights' has the same value in every
+// step: it is a constant, or a read of a resource variable that the graph uses
+// for nothing but reads.
+bool HasConstantValue(const utils::MutableNodeView& weights) {
+  const NodeDef* node = weights.node();
+  if (IsConstant(*node)) return true;
+  if (!IsReadVariableOp(*node) || weights.NumRegularFanins() < 1) return false;
+
+  const auto& handle = weights.GetRegularFanin(0);
+  for (const auto& fanout :
+       handle.node_view()->GetRegularFanout(handle.index())) {
+    const string& op = fanout.node_view()->node()->op();
+    if (op != "ReadVariableOp" && op != "VarIsInitializedOp" &&
+        op != "VariableShape") {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Marks the MatMul and _FusedMatMul nodes on CPU with constant weights, whose
+// kernels can keep the weights packed for the GEMM kernel between steps.
+Status MarkMatMulsWithConstantWeights(RemapperContext* ctx) {
+  utils::Mutation* mutation = ctx->graph_view.GetMutationBuilder();
+  const int num_nodes = ctx->graph_view.NumNodes();
+  for (int i = 0; i < num_nodes; ++i) {
+    utils::MutableNodeView* node_view = ctx->graph_view.GetNode(i);
+    const NodeDef* node = node_view->node();
+    if ((!IsMatMul(*node) && node->op() != kFusedMatMul) ||
+        !NodeIsOnCpu(node) || GetDataTypeFromAttr(*node, "T") != DT_FLOAT ||
+        node_view->NumRegularFanins() < 2 ||
+        !HasConstantValue(*node_view->GetRegularFanin(1).node_view())) {
+      continue;
+    }
+    AttrValue weights_are_constant;
+    weights_are_constant.set_b(true);
+    mutation->AddOrUpdateNodeAttr(node_view, kWeightsAreConstant,
+                                  weights_are_constant);
+  }
+  return mutation->Apply();
+}
+
 }  // namespace
 
 Status Remapper::Optimize(Cluster* cluster, const GrapplerItem& item,
@@ -1827,6 +2309,33 @@ Status Remapper::Optimize(Cluster* cluster, const GrapplerItem& item,
       continue;
     }
 
+    // Remap Mean+SquaredDifference+Mean into the _FusedMoments.
+    FusedMoments fused_moments;
+    if (allow_non_differentiable_rewrites &&
+        FindFusedMoments(ctx, i, &fused_moments)) {
+      TF_RETURN_IF_ERROR(AddFusedMomentsNode(
+          &ctx, fused_moments, &invalidated_nodes, &nodes_to_delete));
+      continue;
+    }
+
+    // Remap Mul+Add+{Softmax,LogSoftmax} into the _FusedSoftmax.
+    FusedSoftmax fused_softmax;
+    if (allow_non_differentiable_rewrites &&
+        FindFusedSoftmax(ctx, i, &fused_softmax)) {
+      TF_RETURN_IF_ERROR(AddFusedSoftmaxNode(
+          &ctx, fused_softmax, &invalidated_nodes, &nodes_to_delete));
+      continue;
+    }
+
+    // Remap Where+Squeeze+GatherV2 into the _BooleanMask.
+    BooleanMask boolean_mask;
+    if (allow_non_differentiable_rewrites &&
+        FindBooleanMask(ctx, i, &boolean_mask)) {
+      TF_RETURN_IF_ERROR(AddBooleanMaskNode(
+          &ctx, boolean_mask, &invalidated_nodes, &nodes_to_delete));
+      continue;
+    }
+
     // During inference, most of the inputs to FusedBatchNorm are constant, and
     // we can therefore replace the op with a much cheaper set of primitives.
     FusedBatchNorm fused_batch_norm;
@@ -1845,6 +2354,8 @@ Status Remapper::Optimize(Cluster* cluster, const GrapplerItem& item,
   }
   TF_RETURN_IF_ERROR(mutation->Apply());
 
+  TF_RETURN_IF_ERROR(MarkMatMulsWithConstantWeights(&ctx));
+
   *optimized_graph = std::move(mutable_item.graph);
 
   return Status::OK();
@@ -449,6 +449,49 @@ TEST_F(RemapperTest, FuseMatMulWithBias) {
   test::ExpectTensorNear<float>(tensors[0], tensors_expected[0], 1e-6);
 }
 
+TEST_F(RemapperTest, MarkMatMulWithConstantWeights) {
+  using ::tensorflow::ops::Placeholder;
+
+  tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+
+  auto lhs = Placeholder(s.WithOpName("lhs"), DT_FLOAT,
+                         ops::Placeholder::Shape({4, 32}));
+  auto rhs = Placeholder(s.WithOpName("rhs"), DT_FLOAT,
+                         ops::Placeholder::Shape({32, 64}));
+  auto weights = ops::Const(s.WithOpName("weights"), 1.0f, {32, 64});
+
+  auto matmul = ops::MatMul(s.WithOpName("matmul"), lhs, rhs);
+  auto const_matmul = ops::MatMul(s.WithOpName("const_matmul"), lhs, weights);
+  auto fetch = ops::Identity(s.WithOpName("fetch"), matmul);
+  auto const_fetch = ops::Identity(s.WithOpName("const_fetch"), const_matmul);
+
+  GrapplerItem item;
+  item.fetch = {"fetch", "const_fetch"};
+  TF_ASSERT_OK(s.ToGraphDef(&item.graph));
+
+  // Place all nodes on CPU.
+  for (int i = 0; i < item.graph.node_size(); ++i) {
+    item.graph.mutable_node(i)->set_device("/device:CPU:0");
+  }
+
+  Remapper optimizer(RewriterConfig::ON);
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+
+  int found = 0;
+  for (const NodeDef& node : output.node()) {
+    if (node.name() == "matmul") {
+      EXPECT_EQ(node.attr().count("_grappler_weights_are_constant"), 0);
+      found++;
+    } else if (node.name() == "const_matmul") {
+      ASSERT_EQ(node.attr().count("_grappler_weights_are_constant"), 1);
+      EXPECT_TRUE(node.attr().at("_grappler_weights_are_constant").b());
+      found++;
+    }
+  }
+  EXPECT_EQ(2, found);
+}
+
 // TODO(b/161005848): Fix flaky test.
 TEST_F(RemapperTest, DISABLED_FuseConv2DWithBiasAndActivationOnGPU) {
 #if !(GOOGLE_CUDA)
@@ -926,5 +969,218 @@ TEST_F(RemapperTest, FuseConv2DWithSqueezeAndBias) {
 }
 #endif
 
+TEST_F(RemapperTest, FuseMoments) {
+  using ::tensorflow::ops::Placeholder;
+
+  for (bool fuse : {true, false}) {
+    tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+
+    auto input_shape = ops::Placeholder::Shape({4, 6, 8});
+    auto input = Placeholder(s.WithOpName("input"), DT_FLOAT, input_shape);
+
+    // Same graph as tf.nn.moments(input, axes=[1, 2], keepdims=True), with a
+    // separate constant for each reduction. Variance over different axes
+    // than the mean must not be fused.
+    auto mean_axes = ops::Const(s.WithOpName("mean_axes"), {1, 2}, {2});
+    auto variance_axes = ops::Const(s.WithOpName("variance_axes"),
+                                    fuse ? std::vector<int>({1, 2})
+                                         : std::vector<int>({0, 2}),
+                                    {2});
+    auto keep_dims = ops::Mean::Attrs().KeepDims(true);
+    auto mean = ops::Mean(s.WithOpName("mean"), input, mean_axes, keep_dims);
+    auto stop_gradient = ops::StopGradient(s.WithOpName("stop_gradient"), mean);
+    auto squared_difference = ops::SquaredDifference(
+        s.WithOpName("squared_difference"), input, stop_gradient);
+    auto variance = ops::Mean(s.WithOpName("variance"), squared_difference,
+                              variance_axes, keep_dims);
+    auto fetch_mean = ops::Identity(s.WithOpName("fetch_mean"), mean);
+    auto fetch_variance =
+        ops::Identity(s.WithOpName("fetch_variance"), variance);
+
+    auto input_t = GenerateRandomTensor<DT_FLOAT>({4, 6, 8});
+
+    GrapplerItem item;
+    item.fetch = {"fetch_mean", "fetch_variance"};
+    item.feed = {{"input", input_t}};
+    TF_ASSERT_OK(s.ToGraphDef(&item.graph));
+
+    // Place all nodes on CPU.
+    for (int i = 0; i < item.graph.node_size(); ++i) {
+      item.graph.mutable_node(i)->set_device("/device:CPU:0");
+    }
+
+    Remapper optimizer(RewriterConfig::ON);
+    GraphDef output;
+    TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+
+    int found = 0;
+    for (const NodeDef& node : output.node()) {
+      if (node.name() == "mean") {
+        EXPECT_EQ(node.op(), fuse ? "_FusedMoments" : "Mean");
+        ASSERT_GE(node.input_size(), 2);
+        EXPECT_EQ(node.input(0), "input");
+        EXPECT_EQ(node.input(1), "mean_axes");
+        found++;
+      } else if (node.name() == "variance") {
+        EXPECT_EQ(node.op(), fuse ? "Identity" : "Mean");
+        ASSERT_GE(node.input_size(), 1);
+        EXPECT_EQ(node.input(0), fuse ? "mean:1" : "squared_difference");
+        found++;
+      } else if (node.name() == "squared_difference" ||
+                 node.name() == "stop_gradient") {
+        EXPECT_FALSE(fuse) << node.name() << " was not removed";
+      }
+    }
+    EXPECT_EQ(found, 2);
+
+    auto tensors_expected = EvaluateNodes(item.graph, item.fetch, item.feed);
+    ASSERT_EQ(tensors_expected.size(), 2);
+    auto tensors = EvaluateNodes(output, item.fetch, item.feed);
+    ASSERT_EQ(tensors.size(), 2);
+    test::ExpectTensorNear<float>(tensors[0], tensors_expected[0], 1e-6);
+    test::ExpectTensorNear<float>(tensors[1], tensors_expected[1], 1e-6);
+  }
+}
+
+TEST_F(RemapperTest, FuseSoftmaxWithScaleAndMask) {
+  using ::tensorflow::ops::Placeholder;
+
+  for (bool fuse : {true, false}) {
+    for (bool log : {false, true}) {
+      tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+
+      // Attention scores masked with a [batch, 1, 1, seq_len] mask. A mask
+      // that changes the shape of the logits must not be fused.
+      auto logits_shape = ops::Placeholder::Shape({2, 3, 5, 8});
+      auto mask_shape = fuse ? ops::Placeholder::Shape({2, 1, 1, 8})
+                             : ops::Placeholder::Shape({4, 1, 1, 1, 8});
+
+      auto logits =
+          Placeholder(s.WithOpName("logits"), DT_FLOAT, logits_shape);
+      auto mask = Placeholder(s.WithOpName("mask"), DT_FLOAT, mask_shape);
+      auto scale = ops::Const(s.WithOpName("scale"), 0.125f, {});
+      auto mul = ops::Mul(s.WithOpName("mul"), logits, scale);
+      auto add = ops::AddV2(s.WithOpName("add"), mul, mask);
+      Output softmax = log ? ops::LogSoftmax(s.WithOpName("softmax"), add)
+                                 .logsoftmax
+                           : ops::Softmax(s.WithOpName("softmax"), add).softmax;
+      auto fetch = ops::Identity(s.WithOpName("fetch"), softmax);
+
+      auto logits_t = GenerateRandomTensor<DT_FLOAT>({2, 3, 5, 8});
+      auto mask_t = GenerateRandomTensor<DT_FLOAT>(
+          fuse ? TensorShape({2, 1, 1, 8}) : TensorShape({4, 1, 1, 1, 8}));
+
+      GrapplerItem item;
+      item.fetch = {"fetch"};
+      item.feed = {{"logits", logits_t}, {"mask", mask_t}};
+      TF_ASSERT_OK(s.ToGraphDef(&item.graph));
+
+      // Place all nodes on CPU.
+      for (int i = 0; i < item.graph.node_size(); ++i) {
+        item.graph.mutable_node(i)->set_device("/device:CPU:0");
+      }
+
+      Remapper optimizer(RewriterConfig::ON);
+      GraphDef output;
+      TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+
+      int found = 0;
+      for (const NodeDef& node : output.node()) {
+        if (node.name() == "softmax") {
+          if (fuse) {
+            EXPECT_EQ(node.op(), "_FusedSoftmax");
+            ASSERT_GE(node.input_size(), 2);
+            EXPECT_EQ(node.input(0), "logits");
+            EXPECT_EQ(node.input(1), "mask");
+            EXPECT_EQ(node.attr().at("num_masks").i(), 1);
+            EXPECT_EQ(node.attr().at("scale").f(), 0.125f);
+            EXPECT_EQ(node.attr().at("log").b(), log);
+          } else {
+            EXPECT_EQ(node.op(), log ? "LogSoftmax" : "Softmax");
+          }
+          found++;
+        } else if (node.name() == "mul" || node.name() == "add") {
+          EXPECT_FALSE(fuse) << node.name() << " was not removed";
+        }
+      }
+      EXPECT_EQ(found, 1);
+
+      auto tensors_expected = EvaluateNodes(item.graph, item.fetch, item.feed);
+      ASSERT_EQ(tensors_expected.size(), 1);
+      auto tensors = EvaluateNodes(output, item.fetch, item.feed);
+      ASSERT_EQ(tensors.size(), 1);
+      test::ExpectTensorNear<float>(tensors[0], tensors_expected[0], 1e-5);
+    }
+  }
+}
+
+TEST_F(RemapperTest, FuseBooleanMask) {
+  using ::tensorflow::ops::Placeholder;
+
+  for (bool fuse : {true, false}) {
+    for (int axis : {0, 1, -2}) {
+      tensorflow::Scope s = tensorflow::Scope::NewRootScope();
+
+      // tf.boolean_mask with a 1-D mask. Indices that are fetched as well
+      // must not be fused.
+      auto tensor = Placeholder(s.WithOpName("tensor"), DT_FLOAT,
+                                ops::Placeholder::Shape({3, 6, 2}));
+      auto mask = Placeholder(s.WithOpName("mask"), DT_BOOL,
+                              ops::Placeholder::Shape({axis == 0 ? 3 : 6}));
+      auto where = ops::Where(s.WithOpName("where"), mask);
+      auto squeeze = ops::Squeeze(s.WithOpName("squeeze"), where,
+                                  ops::Squeeze::Axis({1}));
+      auto gather = ops::GatherV2(s.WithOpName("gather"), tensor, squeeze,
+                                  ops::Const(s.WithOpName("axis"), axis));
+      auto fetch = ops::Identity(s.WithOpName("fetch"), gather);
+
+      auto tensor_t = GenerateRandomTensor<DT_FLOAT>({3, 6, 2});
+      auto mask_t = axis == 0 ? test::AsTensor<bool>({true, false, true})
+                              : test::AsTensor<bool>(
+                                    {false, true, true, false, true, true});
+
+      GrapplerItem item;
+      item.fetch = {"fetch"};
+      if (!fuse) item.fetch.push_back("squeeze");
+      item.feed = {{"tensor", tensor_t}, {"mask", mask_t}};
+      TF_ASSERT_OK(s.ToGraphDef(&item.graph));
+
+      // Place all nodes on CPU.
+      for (int i = 0; i < item.graph.node_size(); ++i) {
+        item.graph.mutable_node(i)->set_device("/device:CPU:0");
+      }
+
+      Remapper optimizer(RewriterConfig::ON);
+      GraphDef output;
+      TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+
+      int found = 0;
+      for (const NodeDef& node : output.node()) {
+        if (node.name() == "gather") {
+          if (fuse) {
+            EXPECT_EQ(node.op(), "_BooleanMask");
+            ASSERT_EQ(node.input_size(), 2);
+            EXPECT_EQ(node.input(0), "tensor");
+            EXPECT_EQ(node.input(1), "mask");
+            EXPECT_EQ(node.attr().at("axis").i(), axis);
+          } else {
+            EXPECT_EQ(node.op(), "GatherV2");
+          }
+          found++;
+        } else if (node.name() == "where" || node.name() == "squeeze") {
+          EXPECT_FALSE(fuse) << node.name() << " was not removed";
+        }
+      }
+      EXPECT_EQ(found, 1);
+
+      auto tensors_expected = EvaluateNodes(item.graph, {"fetch"}, item.feed);
+      ASSERT_EQ(tensors_expected.size(), 1);
+      auto tensors = EvaluateNodes(output, {"fetch"}, item.feed);
+      ASSERT_EQ(tensors.size(), 1);
+      test::ExpectTensorEqual<float>(tensors[0], tensors_expected[0]);
+    }
+  }
+}
+
 }  // namespace grappler
 }  // namespace tensorflow
@@ -20,6 +20,8 @@ limitations under the License.
 
 #define EIGEN_USE_THREADS
 
+#include <algorithm>
+#include <type_traits>
 #include <vector>
 
 #include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
@@ -213,6 +215,177 @@ struct SequentialMatMulKernel {
   }
 };
 
+// Batch matmul kernel for small matrices, such as the per-head products of
+// multi-head attention. For those the setup of an Eigen product (blocking,
+// packing buffers, evaluators) costs as much as the arithmetic, so this
+// computes each product directly: a microkernel keeps a tile of rows times one
+// or two packets of columns of z in registers, and for each step along the
+// reduction dimension broadcasts one element of x per row and loads one row
+// of y. x may be transposed, which only changes the strides of its elements,
+// while transposed y matrices are first copied to row major.
+template <typename Scalar, bool IsVectorizedReal =
+                               std::is_same<Scalar, float>::value ||
+                               std::is_same<Scalar, double>::value>
+struct SmallMatMulKernel {
+  typedef typename Eigen::internal::packet_traits<Scalar>::type Packet;
+  static constexpr int kPacketSize =
+      Eigen::internal::packet_traits<Scalar>::size;
+
+  // Returns true if the kernel is faster than the Eigen products for z = x * y
+  // with z of size m x n, and contraction size k.
+  static bool CanUse(int64 m, int64 n, int64 k) {
+    // NOTE: This heuristic is based on benchmarks on AVX2. Single rows are
+    // better served by the matrix-vector products of Eigen.
+    const int64 kMaxCost = 128 * 128;
+    return m >= 4 && n % kPacketSize == 0 && m * n * k <= kMaxCost;
+  }
+
+  static void Run(const Tensor& in_x, const Tensor& in_y, bool adj_x,
+                  bool adj_y, bool trans_x, bool trans_y,
+                  const MatMulBCast& bcast, Tensor* out, int start, int limit) {
+    const bool should_bcast = bcast.IsBroadcastingRequired();
+    const auto& x_batch_indices = bcast.x_batch_indices();
+    const auto& y_batch_indices = bcast.y_batch_indices();
+    const int64 m = out->dim_size(1);
+    const int64 n = out->dim_size(2);
+    const int64 k = in_x.dim_size(adj_x || trans_x ? 1 : 2);
+    // For real types the adjoint is the transpose.
+    const int64 x_row_stride = adj_x || trans_x ? 1 : k;
+    const int64 x_col_stride = adj_x || trans_x ? m : 1;
+    const bool transpose_y = adj_y || trans_y;
+
+    const Scalar* x_data = in_x.flat<Scalar>().data();
+    const Scalar* y_data = in_y.flat<Scalar>().data();
+    Scalar* z_data = out->flat<Scalar>().data();
+    std::vector<Scalar> y_buffer(transpose_y ? k * n : 0);
+    int64 y_buffer_index = -1;
+    for (int64 i = start; i < limit; ++i) {
+      const int64 x_batch_index = should_bcast ? x_batch_indices[i] : i;
+      const int64 y_batch_index = should_bcast ? y_batch_indices[i] : i;
+      const Scalar* y = y_data + y_batch_index * k * n;
+      if (transpose_y) {
+        // Broadcast y matrices are copied once for consecutive entries.
+        if (y_batch_index != y_buffer_index) {
+          for (int64 l = 0; l < k; ++l) {
+            for (int64 j = 0; j < n; ++j) {
+              y_buffer[l * n + j] = y[j * k + l];
+            }
+          }
+          y_buffer_index = y_batch_index;
+        }
+        y = y_buffer.data();
+      }
+      Product(x_data + x_batch_index * m * k, x_row_stride, x_col_stride, y, m,
+              n, k, z_data + i * m * n);
+    }
+  }
+
+ private:
+  // Multiply-adds x[r, l] * y[l, p * kPacketSize:] into acc[j], for the
+  // flattened index j = r * kPackets + p of each of the last kRemaining
+  // accumulators. The recursion unrolls the tile at compile time, so that
+  // the accumulators stay in registers.
+  template <int kRowTile, int kPackets, int kRemaining = kRowTile * kPackets>
+  struct MultiplyAdd {
+    static EIGEN_ALWAYS_INLINE void Run(const Scalar* x, int64 x_row_stride,
+                                        const Packet (&w)[kPackets],
+                                        Packet (&acc)[kRowTile * kPackets]) {
+      constexpr int j = kRowTile * kPackets - kRemaining;
+      const Packet x_r = Eigen::internal::pset1<Packet>(
+          x[(j / kPackets) * x_row_stride]);
+      acc[j] = Eigen::internal::pmadd(x_r, w[j % kPackets], acc[j]);
+      MultiplyAdd<kRowTile, kPackets, kRemaining - 1>::Run(x, x_row_stride, w,
+                                                           acc);
+    }
+  };
+
+  template <int kRowTile, int kPackets>
+  struct MultiplyAdd<kRowTile, kPackets, 0> {
+    static EIGEN_ALWAYS_INLINE void Run(const Scalar* x, int64 x_row_stride,
+                                        const Packet (&w)[kPackets],
+                                        Packet (&acc)[kRowTile * kPackets]) {}
+  };
+
+  // Computes kRowTile rows times kPackets packets of columns of z.
+  template <int kRowTile, int kPackets>
+  static void Tile(const Scalar* x, int64 x_row_stride, int64 x_col_stride,
+                   const Scalar* y, int64 n, int64 k, Scalar* z) {
+    Packet acc[kRowTile * kPackets];
+    for (int j = 0; j < kRowTile * kPackets; ++j) {
+      acc[j] = Eigen::internal::pset1<Packet>(Scalar(0));
+    }
+    for (int64 l = 0; l < k; ++l) {
+      Packet w[kPackets];
+      for (int p = 0; p < kPackets; ++p) {
+        w[p] = Eigen::internal::ploadu<Packet>(y + l * n + p * kPacketSize);
+      }
+      MultiplyAdd<kRowTile, kPackets>::Run(x + l * x_col_stride, x_row_stride,
+                                           w, acc);
+    }
+    for (int j = 0; j < kRowTile * kPackets; ++j) {
+      Eigen::internal::pstoreu(
+          z + (j / kPackets) * n + (j % kPackets) * kPacketSize, acc[j]);
+    }
+  }
+
+  // Computes kPackets packets of columns of all rows of z, kRowTile rows at
+  // a time.
+  template <int kRowTile, int kPackets>
+  static void Columns(const Scalar* x, int64 x_row_stride, int64 x_col_stride,
+                      const Scalar* y, int64 rows, int64 n, int64 k,
+                      Scalar* z) {
+    int64 i = 0;
+    for (; i + kRowTile <= rows; i += kRowTile) {
+      Tile<kRowTile, kPackets>(x + i * x_row_stride, x_row_stride,
+                               x_col_stride, y, n, k, z + i * n);
+    }
+    // The remaining rows are computed with the largest tiles that fit, since
+    // a single row is bound by the latency of its multiply-adds.
+    if (kRowTile > 4 && i + 4 <= rows) {
+      Tile<4, kPackets>(x + i * x_row_stride, x_row_stride, x_col_stride, y,
+                        n, k, z + i * n);
+      i += 4;
+    }
+    if (kRowTile > 2 && i + 2 <= rows) {
+      Tile<2, kPackets>(x + i * x_row_stride, x_row_stride, x_col_stride, y,
+                        n, k, z + i * n);
+      i += 2;
+    }
+    if (i < rows) {
+      Tile<1, kPackets>(x + i * x_row_stride, x_row_stride, x_col_stride, y,
+                        n, k, z + i * n);
+    }
+  }
+
+  // Computes the 'rows' x 'n' matrix z = x * y, where y is a 'k' x 'n' row
+  // major matrix, x[i, l] is x[i * x_row_stride + l * x_col_stride], and 'n'
+  // is a multiple of kPacketSize.
+  static void Product(const Scalar* x, int64 x_row_stride, int64 x_col_stride,
+                      const Scalar* y, int64 rows, int64 n, int64 k,
+                      Scalar* z) {
+    // Both tiles keep eight independent accumulators, which hides the
+    // latency of the multiply-adds.
+    int64 j = 0;
+    for (; j + 2 * kPacketSize <= n; j += 2 * kPacketSize) {
+      Columns<4, 2>(x, x_row_stride, x_col_stride, y + j, rows, n, k, z + j);
+    }
+    if (j < n) {
+      Columns<8, 1>(x, x_row_stride, x_col_stride, y + j, rows, n, k, z + j);
+    }
+  }
+};
+
+// The kernel is only vectorized for real floating point types.
+template <typename Scalar>
+struct SmallMatMulKernel<Scalar, false> {
+  static bool CanUse(int64 m, int64 n, int64 k) { return false; }
+
+  static void Run(const Tensor& in_x, const Tensor& in_y, bool adj_x,
+                  bool adj_y, bool trans_x, bool trans_y,
+                  const MatMulBCast& bcast, Tensor* out, int start, int limit) {
+  }
+};
+
 }  // namespace
 
 template <typename Device, typename Scalar>
@@ -229,6 +402,27 @@ struct LaunchBatchMatMul<CPUDevice, Scalar> {
 
     // Number of matrix multiplies i.e. size of the batch.
     const int64 batch_size = bcast.output_batch_size();
+
+    // If all the batch entries share the same y and x is not transposed, the
+    // batch is a single product of the stacked rows of all x matrices with y,
+    // which parallelizes better than many small products.
+    if (batch_size > 1 && bcast.y_batch_size() == 1 && !adj_x && !trans_x &&
+        std::min(in_x.dim_size(2), out->dim_size(2)) > 1) {
+      Tensor in_x_stacked;
+      CHECK(in_x_stacked.CopyFrom(
+          in_x, TensorShape({1, batch_size * in_x.dim_size(1),
+                             in_x.dim_size(2)})));
+      Tensor out_stacked;
+      CHECK(out_stacked.CopyFrom(
+          *out, TensorShape({1, batch_size * out->dim_size(1),
+                             out->dim_size(2)})));
+      MatMulBCast stacked_bcast(in_x_stacked.shape().dim_sizes(),
+                                in_y.shape().dim_sizes());
+      Launch(context, in_x_stacked, in_y, adj_x, adj_y, trans_x, trans_y,
+             stacked_bcast, &out_stacked);
+      return;
+    }
+
     const int64 cost_per_unit =
         in_x.dim_size(1) * in_x.dim_size(2) * out->dim_size(2);
     const int64 small_dim = std::min(
@@ -245,6 +439,18 @@ struct LaunchBatchMatMul<CPUDevice, Scalar> {
       ParallelMatMulKernel::Run(context, in_x, in_y, adj_x, adj_y, trans_x,
                                 trans_y, bcast, out, 0, batch_size);
       conjugate_result = adj_x;
+    } else if (SmallMatMulKernel<Scalar>::CanUse(
+                   out->dim_size(1), out->dim_size(2),
+                   in_x.dim_size(adj_x || trans_x ? 1 : 2))) {
+      // Parallelize over outer dims, with products small enough for the
+      // register blocked kernel.
+      Shard(worker_threads.num_threads, worker_threads.workers, batch_size,
+            cost_per_unit,
+            [&in_x, &in_y, adj_x, adj_y, trans_x, trans_y, &bcast, out](
+                int start, int limit) {
+              SmallMatMulKernel<Scalar>::Run(in_x, in_y, adj_x, adj_y, trans_x,
+                                             trans_y, bcast, out, start, limit);
+            });
     } else {
       // Parallelize over outer dims. For small matrices and large batches, it
       // is counter-productive to parallelize the inner matrix multiplies.
@@ -14,21 +14,158 @@ limitations under the License.
 ==============================================================================*/
 
 #include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
 #include "tensorflow/core/framework/op.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/framework/types.pb.h"
 #include "tensorflow/core/graph/graph.h"
 #include "tensorflow/core/graph/node_builder.h"
 #include "tensorflow/core/graph/testlib.h"
 #include "tensorflow/core/kernels/broadcast_to_op.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
 #include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/platform/test_benchmark.h"
 
 namespace tensorflow {
 namespace {
 
+// Compares BatchMatMulV2 with a naive product, for shapes that run on the
+// register blocked SmallMatMulKernel: more than one product, n a multiple of
+// the packet size, m >= 4, m * n * k <= 128 * 128, and either several y
+// matrices or a transposed x, so that the batch is not folded into a single
+// product.
+template <typename T>
+class SmallBatchMatMulOpTest : public OpsTestBase {
+ protected:
+  // The batch dimensions of x and y have the same rank, and each of them is
+  // either 1 or equal to the other one.
+  void RunAndCompare(const std::vector<int64>& x_batch,
+                     const std::vector<int64>& y_batch, int64 m, int64 k,
+                     int64 n, bool adj_x, bool adj_y) {
+    const DataType dtype = DataTypeToEnum<T>::v();
+    TF_ASSERT_OK(NodeDefBuilder("batch_matmul_op", "BatchMatMulV2")
+                     .Input(FakeInput(dtype))
+                     .Input(FakeInput(dtype))
+                     .Attr("adj_x", adj_x)
+                     .Attr("adj_y", adj_y)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+
+    TensorShape x_shape(x_batch);
+    x_shape.AddDim(adj_x ? k : m);
+    x_shape.AddDim(adj_x ? m : k);
+    TensorShape y_shape(y_batch);
+    y_shape.AddDim(adj_y ? n : k);
+    y_shape.AddDim(adj_y ? k : n);
+    Tensor x(dtype, x_shape);
+    x.flat<T>().setRandom();
+    Tensor y(dtype, y_shape);
+    y.flat<T>().setRandom();
+    AddInputFromArray<T>(x.shape(), x.flat<T>());
+    AddInputFromArray<T>(y.shape(), y.flat<T>());
+    TF_ASSERT_OK(RunOpKernel());
+
+    TensorShape z_shape;
+    int64 batch_size = 1;
+    for (int d = 0; d < x_batch.size(); ++d) {
+      z_shape.AddDim(std::max(x_batch[d], y_batch[d]));
+      batch_size *= z_shape.dim_size(d);
+    }
+    z_shape.AddDim(m);
+    z_shape.AddDim(n);
+    Tensor expected(dtype, z_shape);
+    const T* x_data = x.flat<T>().data();
+    const T* y_data = y.flat<T>().data();
+    T* z_data = expected.flat<T>().data();
+    for (int64 b = 0; b < batch_size; ++b) {
+      // Maps the output batch index to the ones of x and y.
+      int64 x_index = 0;
+      int64 y_index = 0;
+      int64 remaining = b;
+      int64 x_stride = 1;
+      int64 y_stride = 1;
+      for (int d = static_cast<int>(x_batch.size()) - 1; d >= 0; --d) {
+        const int64 i = remaining % z_shape.dim_size(d);
+        remaining /= z_shape.dim_size(d);
+        x_index += (x_batch[d] == 1 ? 0 : i) * x_stride;
+        y_index += (y_batch[d] == 1 ? 0 : i) * y_stride;
+        x_stride *= x_batch[d];
+        y_stride *= y_batch[d];
+      }
+      const T* x_b = x_data + x_index * m * k;
+      const T* y_b = y_data + y_index * k * n;
+      for (int64 i = 0; i < m; ++i) {
+        for (int64 j = 0; j < n; ++j) {
+          T sum = 0;
+          for (int64 l = 0; l < k; ++l) {
+            sum += (adj_x ? x_b[l * m + i] : x_b[i * k + l]) *
+                   (adj_y ? y_b[j * k + l] : y_b[l * n + j]);
+          }
+          z_data[(b * m + i) * n + j] = sum;
+        }
+      }
+    }
+    test::ExpectTensorNear<T>(expected, *GetOutput(0), 1e-4);
+  }
+};
+
+using SmallBatchMatMulTypes = ::testing::Types<float, double>;
+TYPED_TEST_SUITE(SmallBatchMatMulOpTest, SmallBatchMatMulTypes);
+
+// n = 48 is a multiple of the packet size of every instruction set, and 15
+// rows cover every row tile of both column tiles. Columns left over by the
+// two packet tile go to the single packet one, which depends on the packet
+// size: 48 covers it for 16 lanes, 24 for 8 lanes and 12 for 4 lanes.
+TYPED_TEST(SmallBatchMatMulOpTest, Simple) {
+  this->RunAndCompare({6}, {6}, 15, 7, 48, false, false);
+}
+
+TYPED_TEST(SmallBatchMatMulOpTest, AdjX) {
+  this->RunAndCompare({6}, {6}, 15, 7, 48, true, false);
+}
+
+TYPED_TEST(SmallBatchMatMulOpTest, AdjY) {
+  this->RunAndCompare({6}, {6}, 15, 7, 48, false, true);
+}
+
+TYPED_TEST(SmallBatchMatMulOpTest, AdjXAdjY) {
+  this->RunAndCompare({6}, {6}, 15, 7, 48, true, true);
+}
+
+TYPED_TEST(SmallBatchMatMulOpTest, TwentyFourColumns) {
+  this->RunAndCompare({6}, {6}, 15, 7, 24, false, false);
+}
+
+TYPED_TEST(SmallBatchMatMulOpTest, TwelveColumns) {
+  this->RunAndCompare({6}, {6}, 15, 7, 12, true, false);
+}
+
+TYPED_TEST(SmallBatchMatMulOpTest, SmallestRowsAndColumns) {
+  this->RunAndCompare({3}, {3}, 4, 5, 16, false, false);
+}
+
+TYPED_TEST(SmallBatchMatMulOpTest, BroadcastX) {
+  this->RunAndCompare({1}, {5}, 9, 13, 32, false, false);
+}
+
+// Consecutive entries share the same transposed y, which is only copied once.
+TYPED_TEST(SmallBatchMatMulOpTest, BroadcastYAdjXAdjY) {
+  this->RunAndCompare({5}, {1}, 9, 13, 32, true, true);
+}
+
+TYPED_TEST(SmallBatchMatMulOpTest, BroadcastBothBatchDims) {
+  this->RunAndCompare({2, 1}, {1, 3}, 8, 3, 16, false, true);
+}
+
+TYPED_TEST(SmallBatchMatMulOpTest, BroadcastBothBatchDimsAdjX) {
+  this->RunAndCompare({1, 3}, {2, 1}, 6, 11, 16, true, false);
+}
+
 Node* BroadcastTo(Graph* g, Node* input, Node* shape) {
   Node* ret;
   TF_CHECK_OK(NodeBuilder(g->NewName("n"), "BroadcastTo")
@@ -253,5 +390,16 @@ BM_BatchMatmul(1, 1, 200, 10000, true, true);
 BM_BatchMatmul(8, 1, 200, 10000, true, true);
 BM_BatchMatmul(32, 1, 200, 10000, true, true);
 
+// Many small matrices, e.g. the per-head products of attention.
+BM_BatchMatmul(512, 8, 64, 8, false, false);
+BM_BatchMatmul(512, 16, 64, 16, false, false);
+BM_BatchMatmul(512, 16, 64, 16, false, true);
+BM_BatchMatmul(512, 16, 16, 64, false, false);
+BM_BatchMatmul(512, 16, 16, 64, true, false);
+
+// Small matrices with a broadcast RHS.
+BM_BatchMatmulBCast(512, 1, 8, 64, 8, false);
+BM_BatchMatmulBCast(512, 1, 16, 64, 16, false);
+
 }  // namespace
 }  // namespace tensorflow
@@ -23,6 +23,7 @@ limitations under the License.
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/kernels/bincount_op.h"
 #include "tensorflow/core/kernels/fill_functor.h"
+#include "tensorflow/core/kernels/partial_histograms.h"
 #include "tensorflow/core/lib/core/threadpool.h"
 #include "tensorflow/core/platform/types.h"
 
@@ -51,32 +52,20 @@ struct BincountFunctor<CPUDevice, Tidx, T, true> {
       return errors::InvalidArgument("Input arr must be non-negative!");
     }
 
-    // Allocate partial output bin sums for each worker thread. Worker ids in
-    // ParallelForWithWorkerId range from 0 to NumThreads() inclusive.
-    ThreadPool* thread_pool =
-        context->device()->tensorflow_cpu_worker_threads()->workers;
-    const int64 num_threads = thread_pool->NumThreads() + 1;
-    Tensor partial_bins_t;
-    TF_RETURN_IF_ERROR(context->allocate_temp(
-        DT_BOOL, TensorShape({num_threads, num_bins}), &partial_bins_t));
-    auto partial_bins = partial_bins_t.matrix<bool>();
-    partial_bins.setZero();
-    thread_pool->ParallelForWithWorkerId(
-        arr.size(), 8 /* cost */,
-        [&](int64 start_ind, int64 limit_ind, int64 worker_id) {
-          for (int64 i = start_ind; i < limit_ind; i++) {
-            Tidx value = arr(i);
+    return ComputePartialHistograms(
+        context, arr.size(), num_bins, 8 /* cost */,
+        [&arr, num_bins](int64 start, int64 limit, T* bins) {
+          for (int64 i = start; i < limit; ++i) {
+            const Tidx value = arr(i);
             if (value < num_bins) {
-              partial_bins(worker_id, value) = true;
+              bins[value] = T(1);
             }
           }
-        });
-
-    // Sum the partial bins along the 0th axis.
-    Eigen::array<int, 1> reduce_dim({0});
-    output.device(context->eigen_cpu_device()) =
-        partial_bins.any(reduce_dim).cast<T>();
-    return Status::OK();
+        },
+        [](T& bin, const T& other_bin) {
+          if (other_bin != T(0)) bin = T(1);
+        },
+        output.data());
   }
 };
 
@@ -96,37 +85,27 @@ struct BincountFunctor<CPUDevice, Tidx, T, false> {
       return errors::InvalidArgument("Input arr must be non-negative!");
     }
 
-    // Allocate partial output bin sums for each worker thread. Worker ids in
-    // ParallelForWithWorkerId range from 0 to NumThreads() inclusive.
-    ThreadPool* thread_pool =
-        context->device()->tensorflow_cpu_worker_threads()->workers;
-    const int64 num_threads = thread_pool->NumThreads() + 1;
-    Tensor partial_bins_t;
-    TF_RETURN_IF_ERROR(context->allocate_temp(
-        DataTypeToEnum<T>::value, TensorShape({num_threads, num_bins}),
-        &partial_bins_t));
-    auto partial_bins = partial_bins_t.matrix<T>();
-    partial_bins.setZero();
-    thread_pool->ParallelForWithWorkerId(
-        arr.size(), 8 /* cost */,
-        [&](int64 start_ind, int64 limit_ind, int64 worker_id) {
-          for (int64 i = start_ind; i < limit_ind; i++) {
-            Tidx value = arr(i);
-            if (value < num_bins) {
-              if (weights.size()) {
-                partial_bins(worker_id, value) += weights(i);
-              } else {
-                // Complex numbers don't support "++".
-                partial_bins(worker_id, value) += T(1);
-              }
-            }
-          }
-        });
-
-    // Sum the partial bins along the 0th axis.
-    Eigen::array<int, 1> reduce_dim({0});
-    output.device(context->eigen_cpu_device()) = partial_bins.sum(reduce_dim);
-    return Status::OK();
+    auto bin = [&arr](int64 i) { return static_cast<int64>(arr(i)); };
+    auto sum = [](T& bin, const T& other_bin) { bin += other_bin; };
+    if (weights.size()) {
+      return ComputePartialHistograms(
+          context, arr.size(), num_bins, 8 /* cost */,
+          [&bin, &weights, num_bins](int64 start, int64 limit, T* bins) {
+            AccumulateBins(
+                start, limit, num_bins, bin,
+                [&weights](int64 i) { return weights(i); }, bins);
+          },
+          sum, output.data());
+    }
+    return ComputePartialHistograms(
+        context, arr.size(), num_bins, 8 /* cost */,
+        [&bin, num_bins](int64 start, int64 limit, T* bins) {
+          // Complex numbers don't support "++".
+          AccumulateBins(
+              start, limit, num_bins, bin, [](int64 i) { return T(1); },
+              bins);
+        },
+        sum, output.data());
   }
 };
 
@@ -139,29 +118,39 @@ struct BincountReduceFunctor<CPUDevice, Tidx, T, binary_output> {
                         const Tidx num_bins) {
     const int num_rows = out.dimension(0);
     const int num_cols = in.dimension(1);
-    ThreadPool* thread_pool =
-        context->device()->tensorflow_cpu_worker_threads()->workers;
-    thread_pool->ParallelForWithWorkerId(
-        num_rows, 8 /* cost */,
-        [&](int64 start_row, int64 end_row, int64 worker_id) {
-          for (int64 i = start_row; i < end_row; ++i) {
-            for (int64 j = 0; j < num_cols; ++j) {
-              Tidx value = in(i, j);
-              if (value < num_bins) {
-                if (binary_output) {
-                  out(i, value) = T(1);
-                } else {
-                  if (weights.size()) {
-                    out(i, value) += weights(i, j);
-                  } else {
-                    out(i, value) += T(1);
-                  }
-                }
-              }
-            }
+    // Counts columns [start_col, end_col) of row i into 'bins'.
+    auto fill_row = [&in, &weights, num_bins](int64 i, int64 start_col,
+                                              int64 end_col, T* bins) {
+      auto bin = [&in, i](int64 j) { return static_cast<int64>(in(i, j)); };
+      if (binary_output) {
+        for (int64 j = start_col; j < end_col; ++j) {
+          const int64 value = bin(j);
+          if (value >= 0 && value < num_bins) {
+            bins[value] = T(1);
+          }
+        }
+      } else if (weights.size()) {
+        AccumulateBins(
+            start_col, end_col, num_bins, bin,
+            [&weights, i](int64 j) { return weights(i, j); }, bins);
+      } else {
+        AccumulateBins(
+            start_col, end_col, num_bins, bin, [](int64 j) { return T(1); },
+            bins);
+      }
+    };
+    // Rows are counted in parallel, and are also split into blocks when there
+    // are too few of them to keep the threads busy.
+    return ComputeRowPartialHistograms(
+        context, num_rows, num_cols, num_bins, 8 /* cost */, fill_row,
+        [](T& bin, const T& other_bin) {
+          if (binary_output) {
+            if (other_bin != T(0)) bin = T(1);
+          } else {
+            bin += other_bin;
           }
-        });
-    return Status::OK();
+        },
+        out.data());
   }
 };
 
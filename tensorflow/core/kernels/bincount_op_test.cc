@@ -17,13 +17,184 @@ limitations under the License.
 #include "tensorflow/core/framework/fake_input.h"
 #include "tensorflow/core/framework/node_def_builder.h"
 #include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/graph/node_builder.h"
 #include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/core/threadpool.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/platform/test_benchmark.h"
 
 namespace tensorflow {
 
+// Runs the kernels on a fixed number of threads, so that inputs of a few
+// blocks of 16K items are split the same way on every machine.
+class BincountOpTest : public OpsTestBase {
+ protected:
+  static constexpr int kNumThreads = 5;
+  static constexpr int64 kBlockSize = 16 * 1024;
+
+  void SetUp() override {
+    worker_pool_.reset(
+        new thread::ThreadPool(Env::Default(), "bincount_test", kNumThreads));
+    worker_threads_.num_threads = kNumThreads;
+    worker_threads_.workers = worker_pool_.get();
+    device_->set_tensorflow_cpu_worker_threads(&worker_threads_);
+  }
+
+  // A deterministic, scattered value in [min_value, max_value].
+  static int32 Value(int64 i, int32 min_value, int32 max_value) {
+    return min_value + (i * 7919) % (max_value - min_value + 1);
+  }
+
+  // Runs DenseBincount on 'data', a vector or a matrix, and compares the
+  // result with a serial count. 'weights' is either empty or has the shape of
+  // 'data'.
+  void RunDenseBincount(const Tensor& data, int32 size, const Tensor& weights,
+                        bool binary_output) {
+    TF_ASSERT_OK(NodeDefBuilder("dense_bincount", "DenseBincount")
+                     .Input(FakeInput(DT_INT32))
+                     .Input(FakeInput(DT_INT32))
+                     .Input(FakeInput(DT_FLOAT))
+                     .Attr("binary_output", binary_output)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+    AddInputFromArray<int32>(data.shape(), data.flat<int32>());
+    AddInputFromArray<int32>(TensorShape({}), {size});
+    AddInputFromArray<float>(weights.shape(), weights.flat<float>());
+    TF_ASSERT_OK(RunOpKernel());
+
+    const int64 num_rows = data.dims() == 2 ? data.dim_size(0) : 1;
+    const int64 num_cols = data.dim_size(data.dims() - 1);
+    Tensor expected(DT_FLOAT, data.dims() == 2
+                                  ? TensorShape({num_rows, size})
+                                  : TensorShape({size}));
+    auto expected_flat = expected.flat<float>();
+    expected_flat.setZero();
+    for (int64 i = 0; i < num_rows; ++i) {
+      for (int64 j = 0; j < num_cols; ++j) {
+        const int32 value = data.flat<int32>()(i * num_cols + j);
+        if (value < 0 || value >= size) continue;
+        float& bin = expected_flat(i * size + value);
+        if (binary_output) {
+          bin = 1;
+        } else {
+          bin += weights.NumElements() ? weights.flat<float>()(i * num_cols + j)
+                                       : 1;
+        }
+      }
+    }
+    test::ExpectTensorEqual<float>(expected, *GetOutput(0));
+  }
+
+  std::unique_ptr<thread::ThreadPool> worker_pool_;
+  DeviceBase::CpuWorkerThreads worker_threads_;
+};
+
+// Five blocks, reduced in a tree with an unpaired block at every level.
+TEST_F(BincountOpTest, MultiBlock) {
+  const int64 num_items = 5 * kBlockSize + 7;
+  Tensor data(DT_INT32, TensorShape({num_items}));
+  for (int64 i = 0; i < num_items; ++i) {
+    data.flat<int32>()(i) = Value(i, 0, 60);
+  }
+  // Values of 50 and more are dropped.
+  RunDenseBincount(data, 50, Tensor(DT_FLOAT, TensorShape({0})), false);
+}
+
+// More bins than the interleaved histograms hold.
+TEST_F(BincountOpTest, MultiBlockManyBins) {
+  const int64 num_items = 5 * kBlockSize + 7;
+  Tensor data(DT_INT32, TensorShape({num_items}));
+  for (int64 i = 0; i < num_items; ++i) {
+    data.flat<int32>()(i) = Value(i, 0, 1100);
+  }
+  RunDenseBincount(data, 1000, Tensor(DT_FLOAT, TensorShape({0})), false);
+}
+
+TEST_F(BincountOpTest, MultiBlockWeighted) {
+  const int64 num_items = 3 * kBlockSize + 1;
+  Tensor data(DT_INT32, TensorShape({num_items}));
+  Tensor weights(DT_FLOAT, TensorShape({num_items}));
+  for (int64 i = 0; i < num_items; ++i) {
+    data.flat<int32>()(i) = Value(i, 0, 40);
+    weights.flat<float>()(i) = i % 3;
+  }
+  RunDenseBincount(data, 40, weights, false);
+}
+
+TEST_F(BincountOpTest, MultiBlockBinary) {
+  const int64 num_items = 4 * kBlockSize;
+  Tensor data(DT_INT32, TensorShape({num_items}));
+  for (int64 i = 0; i < num_items; ++i) {
+    // Only the last block has values in the upper half of the bins.
+    data.flat<int32>()(i) =
+        i < 3 * kBlockSize ? Value(i, 0, 9) : Value(i, 0, 19);
+  }
+  RunDenseBincount(data, 20, Tensor(DT_FLOAT, TensorShape({0})), true);
+}
+
+// Fewer rows than threads: each row is also split into two blocks.
+TEST_F(BincountOpTest, FewRowsSplit) {
+  const int64 num_rows = 3;
+  const int64 num_cols = 2 * kBlockSize + 5;
+  Tensor data(DT_INT32, TensorShape({num_rows, num_cols}));
+  for (int64 i = 0; i < num_rows * num_cols; ++i) {
+    // Negative values are skipped.
+    data.flat<int32>()(i) = Value(i, -3, 33);
+  }
+  RunDenseBincount(data, 30, Tensor(DT_FLOAT, TensorShape({0})), false);
+}
+
+TEST_F(BincountOpTest, FewRowsSplitWeighted) {
+  const int64 num_rows = 2;
+  const int64 num_cols = 3 * kBlockSize;
+  Tensor data(DT_INT32, TensorShape({num_rows, num_cols}));
+  Tensor weights(DT_FLOAT, TensorShape({num_rows, num_cols}));
+  for (int64 i = 0; i < num_rows * num_cols; ++i) {
+    data.flat<int32>()(i) = Value(i, -3, 100);
+    weights.flat<float>()(i) = i % 5;
+  }
+  RunDenseBincount(data, 100, weights, false);
+}
+
+TEST_F(BincountOpTest, FewRowsSplitBinary) {
+  const int64 num_rows = 2;
+  const int64 num_cols = 2 * kBlockSize;
+  Tensor data(DT_INT32, TensorShape({num_rows, num_cols}));
+  for (int64 i = 0; i < num_rows * num_cols; ++i) {
+    // The first row only has values in the upper bins in its second block.
+    const int64 col = i % num_cols;
+    data.flat<int32>()(i) = i < kBlockSize || col >= kBlockSize
+                                ? Value(i, -3, 15)
+                                : Value(i, -3, 7);
+  }
+  RunDenseBincount(data, 16, Tensor(DT_FLOAT, TensorShape({0})), true);
+}
+
+// Short rows are not split, and are counted in parallel.
+TEST_F(BincountOpTest, ManyShortRows) {
+  const int64 num_rows = 11;
+  const int64 num_cols = 100;
+  Tensor data(DT_INT32, TensorShape({num_rows, num_cols}));
+  Tensor weights(DT_FLOAT, TensorShape({num_rows, num_cols}));
+  for (int64 i = 0; i < num_rows * num_cols; ++i) {
+    data.flat<int32>()(i) = Value(i, -3, 12);
+    weights.flat<float>()(i) = i % 4;
+  }
+  RunDenseBincount(data, 10, weights, false);
+}
+
+TEST_F(BincountOpTest, FewShortRowsBinary) {
+  const int64 num_rows = 2;
+  const int64 num_cols = 100;
+  Tensor data(DT_INT32, TensorShape({num_rows, num_cols}));
+  for (int64 i = 0; i < num_rows * num_cols; ++i) {
+    data.flat<int32>()(i) = Value(i, -3, 12);
+  }
+  RunDenseBincount(data, 10, Tensor(DT_FLOAT, TensorShape({0})), true);
+}
+
 static Graph* Bincount(int arr_size, int nbins) {
   Graph* g = new Graph(OpRegistry::Global());
 
@@ -61,6 +232,9 @@ BM_BincountDev(64, 5000, cpu);
 BM_BincountDev(128, 1000, cpu);
 BM_BincountDev(128, 2000, cpu);
 BM_BincountDev(128, 5000, cpu);
+BM_BincountDev(1024, 8, cpu);
+BM_BincountDev(1024, 64, cpu);
+BM_BincountDev(1024, 1000, cpu);
 
 BM_BincountDev(32, 1000, gpu);
 BM_BincountDev(32, 2000, gpu);
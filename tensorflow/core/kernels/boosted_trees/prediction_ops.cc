@@ -14,6 +14,7 @@ limitations under the License.
 ==============================================================================*/
 
 #include <algorithm>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -235,6 +236,31 @@ class BoostedTreesPredictOp : public OpKernel {
       return;
     }
 
+    std::shared_ptr<const BoostedTreesFlatEnsemble> flat_ensemble;
+    {
+      tf_shared_lock l(*resource->get_mutex());
+      flat_ensemble = resource->GetFlatEnsemble();
+    }
+    if (flat_ensemble->ok() &&
+        flat_ensemble->logits_dimension() == logits_dimension_ &&
+        flat_ensemble->CanPredict(bucketized_features)) {
+      output_logits.setZero();
+      auto do_work = [&flat_ensemble, &bucketized_features, &output_logits](
+                         int64 start, int64 end) {
+        flat_ensemble->Predict(bucketized_features, start, end,
+                               &output_logits(start, 0));
+      };
+      // The same cost as walking the protos below, although the flat
+      // ensemble takes less per tree.
+      const int64 cost = resource->num_trees() * 10;
+      thread::ThreadPool* const worker_threads =
+          context->device()->tensorflow_cpu_worker_threads()->workers;
+      Shard(worker_threads->NumThreads(), worker_threads, batch_size,
+            /*cost_per_unit=*/cost, do_work);
+      return;
+    }
+
+    // Otherwise walk the protos of the trees for every example.
     const int32 last_tree = resource->num_trees() - 1;
     auto do_work = [&resource, &bucketized_features, &output_logits, last_tree,
                     this](int32 start, int32 end) {
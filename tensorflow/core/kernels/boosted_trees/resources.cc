@@ -15,6 +15,8 @@ limitations under the License.
 
 #include "tensorflow/core/kernels/boosted_trees/resources.h"
 
+#include <algorithm>
+
 #include "tensorflow/core/framework/resource_mgr.h"
 #include "tensorflow/core/kernels/boosted_trees/boosted_trees.pb.h"
 #include "tensorflow/core/kernels/boosted_trees/tree_helper.h"
@@ -23,6 +25,189 @@ limitations under the License.
 
 namespace tensorflow {
 
+BoostedTreesFlatEnsemble::BoostedTreesFlatEnsemble(
+    const boosted_trees::TreeEnsemble& tree_ensemble) {
+  const int32 num_trees = tree_ensemble.trees_size();
+  if (tree_ensemble.tree_weights_size() < num_trees) {
+    ok_ = false;
+    return;
+  }
+  tree_roots_.reserve(num_trees);
+  tree_depths_.reserve(num_trees);
+  tree_weights_.reserve(num_trees);
+  logits_dimension_ = -1;
+  for (int32 tree_id = 0; tree_id < num_trees; ++tree_id) {
+    const auto& tree = tree_ensemble.trees(tree_id);
+    const int32 num_nodes = tree.nodes_size();
+    const int32 root = feature_ids_.size();
+    if (num_nodes == 0) {
+      ok_ = false;
+      return;
+    }
+    for (int32 node_id = 0; node_id < num_nodes; ++node_id) {
+      const auto& node = tree.nodes(node_id);
+      int32 feature_id = -1;
+      int32 dimension_id = 0;
+      int32 threshold = 0;
+      bool is_categorical = false;
+      int32 left_id = node_id;
+      int32 right_id = node_id;
+      int32 leaf_value_offset = -1;
+      switch (node.node_case()) {
+        case boosted_trees::Node::kLeaf: {
+          leaf_value_offset = leaf_values_.size();
+          // Same values as node_value().
+          if (node.leaf().has_vector()) {
+            const auto& values = node.leaf().vector().value();
+            leaf_values_.insert(leaf_values_.end(), values.begin(),
+                                values.end());
+          } else {
+            leaf_values_.push_back(node.leaf().scalar());
+          }
+          const int32 dimension = leaf_values_.size() - leaf_value_offset;
+          if (logits_dimension_ == -1) logits_dimension_ = dimension;
+          if (dimension != logits_dimension_) {
+            ok_ = false;
+            return;
+          }
+          break;
+        }
+        case boosted_trees::Node::kBucketizedSplit: {
+          const auto& split = node.bucketized_split();
+          feature_id = split.feature_id();
+          dimension_id = split.dimension_id();
+          threshold = split.threshold();
+          left_id = split.left_id();
+          right_id = split.right_id();
+          break;
+        }
+        case boosted_trees::Node::kCategoricalSplit: {
+          const auto& split = node.categorical_split();
+          feature_id = split.feature_id();
+          dimension_id = split.dimension_id();
+          threshold = split.value();
+          is_categorical = true;
+          left_id = split.left_id();
+          right_id = split.right_id();
+          break;
+        }
+        default:
+          ok_ = false;
+          return;
+      }
+      if (left_id < 0 || left_id >= num_nodes || right_id < 0 ||
+          right_id >= num_nodes || dimension_id < 0) {
+        ok_ = false;
+        return;
+      }
+      if (feature_id >= 0) {
+        if (feature_id >= static_cast<int32>(max_dimension_ids_.size())) {
+          max_dimension_ids_.resize(feature_id + 1, -1);
+        }
+        max_dimension_ids_[feature_id] =
+            std::max(max_dimension_ids_[feature_id], dimension_id);
+      } else if (leaf_value_offset == -1) {
+        ok_ = false;
+        return;
+      }
+      feature_ids_.push_back(feature_id + 1);
+      dimension_ids_.push_back(dimension_id);
+      thresholds_.push_back(threshold);
+      is_categorical_.push_back(is_categorical);
+      left_ids_.push_back(root + left_id);
+      right_ids_.push_back(root + right_id);
+      leaf_value_offsets_.push_back(leaf_value_offset);
+    }
+
+    // Count the levels of splits, giving up on cycles.
+    int32 depth = 0;
+    int32 num_visited = 1;
+    std::vector<int32> level = {root};
+    std::vector<int32> next_level;
+    while (true) {
+      next_level.clear();
+      for (const int32 node : level) {
+        if (leaf_value_offsets_[node] == -1) {
+          next_level.push_back(left_ids_[node]);
+          next_level.push_back(right_ids_[node]);
+        }
+      }
+      if (next_level.empty()) break;
+      num_visited += next_level.size();
+      if (num_visited > num_nodes) {
+        ok_ = false;
+        return;
+      }
+      ++depth;
+      level.swap(next_level);
+    }
+    tree_roots_.push_back(root);
+    tree_depths_.push_back(depth);
+    tree_weights_.push_back(tree_ensemble.tree_weights(tree_id));
+  }
+}
+
+bool BoostedTreesFlatEnsemble::CanPredict(
+    const std::vector<TTypes<int32>::ConstMatrix>& bucketized_features) const {
+  if (max_dimension_ids_.size() > bucketized_features.size()) return false;
+  for (size_t feature_id = 0; feature_id < max_dimension_ids_.size();
+       ++feature_id) {
+    if (max_dimension_ids_[feature_id] >=
+        bucketized_features[feature_id].dimension(1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void BoostedTreesFlatEnsemble::Predict(
+    const std::vector<TTypes<int32>::ConstMatrix>& bucketized_features,
+    int64 start, int64 end, float* logits) const {
+  // The features and their row sizes, after the zero feature of the leaves.
+  static const int32 kZeroFeature = 0;
+  std::vector<const int32*> features = {&kZeroFeature};
+  std::vector<int64> row_sizes = {0};
+  for (const auto& feature : bucketized_features) {
+    features.push_back(feature.data());
+    row_sizes.push_back(feature.dimension(1));
+  }
+
+  // Walks blocks of examples through every tree, level by level, so that a
+  // tree stays in cache for the whole block.
+  constexpr int64 kBlockSize = 64;
+  int32 node_ids[kBlockSize];
+  for (int64 block_start = start; block_start < end;
+       block_start += kBlockSize) {
+    const int64 block_size = std::min(kBlockSize, end - block_start);
+    float* block_logits = logits + (block_start - start) * logits_dimension_;
+    for (size_t tree_id = 0; tree_id < tree_roots_.size(); ++tree_id) {
+      std::fill(node_ids, node_ids + block_size, tree_roots_[tree_id]);
+      for (int32 level = 0; level < tree_depths_[tree_id]; ++level) {
+        for (int64 i = 0; i < block_size; ++i) {
+          const int32 node = node_ids[i];
+          const int32 feature_id = feature_ids_[node];
+          const int32 value =
+              features[feature_id][(block_start + i) * row_sizes[feature_id] +
+                                   dimension_ids_[node]];
+          const bool go_left = is_categorical_[node]
+                                   ? value == thresholds_[node]
+                                   : value <= thresholds_[node];
+          node_ids[i] = go_left ? left_ids_[node] : right_ids_[node];
+        }
+      }
+      const float tree_weight = tree_weights_[tree_id];
+      for (int64 i = 0; i < block_size; ++i) {
+        const float* leaf_values =
+            leaf_values_.data() + leaf_value_offsets_[node_ids[i]];
+        float* example_logits = block_logits + i * logits_dimension_;
+        for (int32 j = 0; j < logits_dimension_; ++j) {
+          example_logits[j] += tree_weight * leaf_values[j];
+        }
+      }
+    }
+  }
+}
+
 // Constructor.
 BoostedTreesEnsembleResource::BoostedTreesEnsembleResource()
     : tree_ensemble_(
@@ -37,6 +222,7 @@ string BoostedTreesEnsembleResource::DebugString() const {
 bool BoostedTreesEnsembleResource::InitFromSerialized(const string& serialized,
                                                       const int64 stamp_token) {
   CHECK_EQ(stamp(), -1) << "Must Reset before Init.";
+  InvalidateFlatEnsemble();
   if (ParseProtoUnlimited(tree_ensemble_, serialized)) {
     set_stamp(stamp_token);
     return true;
@@ -126,6 +312,7 @@ void BoostedTreesEnsembleResource::set_node_value(const int32 tree_id,
   auto* node = tree_ensemble_->mutable_trees(tree_id)->mutable_nodes(node_id);
   DCHECK(node->node_case() == boosted_trees::Node::kLeaf);
   node->mutable_leaf()->set_scalar(logits);
+  InvalidateFlatEnsemble();
 }
 
 int32 BoostedTreesEnsembleResource::GetNumLayersGrown(
@@ -235,6 +422,7 @@ void BoostedTreesEnsembleResource::SetTreeWeight(const int32 tree_id,
   DCHECK_GE(tree_id, 0);
   DCHECK_LT(tree_id, num_trees());
   tree_ensemble_->set_tree_weights(tree_id, weight);
+  InvalidateFlatEnsemble();
 }
 
 void BoostedTreesEnsembleResource::UpdateGrowingMetadata() const {
@@ -273,6 +461,7 @@ int32 BoostedTreesEnsembleResource::AddNewTreeWithLogits(
   }
   tree_ensemble_->add_tree_weights(weight);
   tree_ensemble_->add_tree_metadata();
+  InvalidateFlatEnsemble();
 
   return new_tree_id;
 }
@@ -321,6 +510,7 @@ boosted_trees::Node* BoostedTreesEnsembleResource::AddLeafNodes(
     const int32 tree_id,
     const std::pair<int32, boosted_trees::SplitCandidate>& split_entry,
     const int32 logits_dimension, int32* left_node_id, int32* right_node_id) {
+  InvalidateFlatEnsemble();
   auto* tree = tree_ensemble_->mutable_trees(tree_id);
   const auto node_id = split_entry.first;
   const auto candidate = split_entry.second;
@@ -375,6 +565,7 @@ void BoostedTreesEnsembleResource::Reset() {
   CHECK_EQ(0, arena_.SpaceAllocated());
   tree_ensemble_ =
       protobuf::Arena::CreateMessage<boosted_trees::TreeEnsemble>(&arena_);
+  InvalidateFlatEnsemble();
 }
 
 void BoostedTreesEnsembleResource::PostPruneTree(const int32 current_tree,
@@ -385,6 +576,7 @@ void BoostedTreesEnsembleResource::PostPruneTree(const int32 current_tree,
   if (num_nodes == 0) {
     return;
   }
+  InvalidateFlatEnsemble();
 
   std::vector<int32> nodes_to_delete;
   // If a node was pruned, we need to save the change of the prediction from
@@ -581,4 +773,19 @@ void BoostedTreesEnsembleResource::RecursivelyDoPostPrunePreparation(
   }
 }
 
+std::shared_ptr<const BoostedTreesFlatEnsemble>
+BoostedTreesEnsembleResource::GetFlatEnsemble() const {
+  mutex_lock l(flat_ensemble_mu_);
+  if (flat_ensemble_ == nullptr) {
+    flat_ensemble_ =
+        std::make_shared<const BoostedTreesFlatEnsemble>(*tree_ensemble_);
+  }
+  return flat_ensemble_;
+}
+
+void BoostedTreesEnsembleResource::InvalidateFlatEnsemble() {
+  mutex_lock l(flat_ensemble_mu_);
+  flat_ensemble_.reset();
+}
+
 }  // namespace tensorflow
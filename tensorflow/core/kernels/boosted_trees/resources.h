@@ -16,7 +16,11 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_KERNELS_BOOSTED_TREES_RESOURCES_H_
 #define TENSORFLOW_CORE_KERNELS_BOOSTED_TREES_RESOURCES_H_
 
+#include <memory>
+#include <vector>
+
 #include "tensorflow/core/framework/resource_mgr.h"
+#include "tensorflow/core/framework/tensor_types.h"
 #include "tensorflow/core/kernels/boosted_trees/tree_helper.h"
 #include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/platform/protobuf.h"
@@ -45,6 +49,63 @@ class StampedResource : public ResourceBase {
   int64 stamp_;
 };
 
+// The trees of an ensemble compiled into flat arrays, so that prediction
+// walks a block of examples through a tree at a time without touching the
+// protos. The nodes of all trees are concatenated, and the per-node arrays are
+// indexed by the position of the node in the concatenation.
+class BoostedTreesFlatEnsemble {
+ public:
+  explicit BoostedTreesFlatEnsemble(
+      const boosted_trees::TreeEnsemble& tree_ensemble);
+
+  // Whether the ensemble could be compiled. It can't if it has nodes of other
+  // types than leaves and bucketized or categorical splits, children out of
+  // range, cycles, or leaves with different numbers of logits.
+  bool ok() const { return ok_; }
+
+  int32 logits_dimension() const { return logits_dimension_; }
+
+  // Whether every split reads a feature and dimension within
+  // `bucketized_features`.
+  bool CanPredict(const std::vector<TTypes<int32>::ConstMatrix>&
+                      bucketized_features) const;
+
+  // Computes the logits of the examples in [start, end) into `logits`, which
+  // holds logits_dimension() zero-initialized values per example.
+  void Predict(
+      const std::vector<TTypes<int32>::ConstMatrix>& bucketized_features,
+      int64 start, int64 end, float* logits) const;
+
+ private:
+  bool ok_ = true;
+  int32 logits_dimension_ = 0;
+
+  // Per tree: the position of the root node, the number of splits on the
+  // longest path from the root and the weight.
+  std::vector<int32> tree_roots_;
+  std::vector<int32> tree_depths_;
+  std::vector<float> tree_weights_;
+
+  // Per node. Splits send an example to the left child if the feature is at
+  // most (bucketized) or equal to (categorical) the threshold. Leaves read
+  // the zero feature 0 and point back to themselves, so that examples stay
+  // there until the longest path of the tree has been walked. Split features
+  // are shifted by one to make room for it.
+  std::vector<int32> feature_ids_;
+  std::vector<int32> dimension_ids_;
+  std::vector<int32> thresholds_;
+  std::vector<uint8> is_categorical_;
+  std::vector<int32> left_ids_;
+  std::vector<int32> right_ids_;
+  std::vector<int32> leaf_value_offsets_;
+
+  // The logits of every leaf, one after the other.
+  std::vector<float> leaf_values_;
+
+  // The largest dimension read from every (unshifted) feature, or -1.
+  std::vector<int32> max_dimension_ids_;
+};
+
 // Keep a tree ensemble in memory for efficient evaluation and mutation.
 class BoostedTreesEnsembleResource : public StampedResource {
  public:
@@ -150,6 +211,12 @@ class BoostedTreesEnsembleResource : public StampedResource {
   void GetPostPruneCorrection(const int32 tree_id, const int32 initial_node_id,
                               int32* current_node_id,
                               std::vector<float>* logit_updates) const;
+
+  // Returns the ensemble compiled for prediction, which is compiled again
+  // after every change to the trees. Caller needs to hold the mutex lock, at
+  // least shared, while calling this.
+  std::shared_ptr<const BoostedTreesFlatEnsemble> GetFlatEnsemble() const;
+
   mutex* get_mutex() { return &mu_; }
 
  private:
@@ -171,6 +238,13 @@ class BoostedTreesEnsembleResource : public StampedResource {
       std::vector<int32>* nodes_to_delete,
       std::vector<std::pair<int32, std::vector<float>>>* nodes_meta);
 
+  // Drops the compiled ensemble after a change to the trees or weights.
+  void InvalidateFlatEnsemble();
+
+  mutable mutex flat_ensemble_mu_;
+  mutable std::shared_ptr<const BoostedTreesFlatEnsemble> flat_ensemble_
+      TF_GUARDED_BY(flat_ensemble_mu_);
+
  protected:
   protobuf::Arena arena_;
   mutex mu_;
@@ -18,8 +18,10 @@ limitations under the License.
 
 #define EIGEN_USE_THREADS
 
+#include "tensorflow/core/framework/bfloat16.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/kernels/cast_op.h"
+#include "tensorflow/core/util/work_sharder.h"
 
 namespace tensorflow {
 
@@ -66,6 +68,27 @@ CAST_FUNCTORS(Eigen::SyclDevice);
     };                                                                    \
   }
 
+// Casts from IN to OUT on CPU with `Convert`, which converts arrays with SIMD
+// instructions. Truncating casts still go through the CastFunctor.
+template <typename IN, typename OUT, void (*Convert)(const IN*, OUT*, int64)>
+void CpuCastWithConversion(OpKernelContext* ctx, const Tensor& inp, Tensor* out,
+                           bool truncate) {
+  if (truncate) {
+    functor::CastFunctor<Eigen::ThreadPoolDevice, OUT, IN> func;
+    func(ctx->eigen_device<Eigen::ThreadPoolDevice>(), out->flat<OUT>(),
+         inp.flat<IN>(), truncate);
+    return;
+  }
+  const IN* src = inp.flat<IN>().data();
+  OUT* dst = out->flat<OUT>().data();
+  const DeviceBase::CpuWorkerThreads& worker_threads =
+      *ctx->device()->tensorflow_cpu_worker_threads();
+  Shard(worker_threads.num_threads, worker_threads.workers, inp.NumElements(),
+        sizeof(IN) + sizeof(OUT), [src, dst](int64 start, int64 limit) {
+          Convert(src + start, dst + start, limit - start);
+        });
+}
+
 // The functions below are implemented in the cast_op_impl_*.cc files.
 CastFunctorType GetCpuCastFromBool(DataType dst_dtype);
 
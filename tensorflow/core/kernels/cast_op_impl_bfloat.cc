@@ -23,6 +23,9 @@ typedef Eigen::ThreadPoolDevice CPUDevice;
 typedef Eigen::GpuDevice GPUDevice;
 
 CastFunctorType GetCpuCastFromBfloat(DataType dst_dtype) {
+  if (dst_dtype == DT_FLOAT) {
+    return CpuCastWithConversion<bfloat16, float, BFloat16ToFloat>;
+  }
   CURRY_TYPES3(CAST_CASE, CPUDevice, bfloat16);
   return nullptr;
 }
@@ -23,6 +23,12 @@ typedef Eigen::ThreadPoolDevice CPUDevice;
 typedef Eigen::GpuDevice GPUDevice;
 
 CastFunctorType GetCpuCastFromFloat(DataType dst_dtype) {
+  if (dst_dtype == DT_BFLOAT16) {
+    return CpuCastWithConversion<float, bfloat16, RoundFloatToBFloat16>;
+  }
+  if (dst_dtype == DT_HALF) {
+    return CpuCastWithConversion<float, Eigen::half, FloatToHalf>;
+  }
   CURRY_TYPES3(CAST_CASE, CPUDevice, float);
   return nullptr;
 }
@@ -21,6 +21,9 @@ typedef Eigen::ThreadPoolDevice CPUDevice;
 typedef Eigen::GpuDevice GPUDevice;
 
 CastFunctorType GetCpuCastFromHalf(DataType dst_dtype) {
+  if (dst_dtype == DT_FLOAT) {
+    return CpuCastWithConversion<Eigen::half, float, HalfToFloat>;
+  }
   CURRY_TYPES3(CAST_CASE, CPUDevice, Eigen::half);
   return nullptr;
 }
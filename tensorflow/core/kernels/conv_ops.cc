@@ -42,6 +42,7 @@ limitations under the License.
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/kernels/conv_2d.h"
 #include "tensorflow/core/kernels/deep_conv2d.h"
+#include "tensorflow/core/kernels/direct_conv2d.h"
 #include "tensorflow/core/kernels/ops_util.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/gtl/array_slice.h"
@@ -271,6 +272,54 @@ class LaunchDeepConvOp<CPUDevice, float> {
   }
 };
 
+template <typename Device, typename T>
+class LaunchDirectConvOp {
+ public:
+  static bool Run(OpKernelContext* ctx, const Tensor& input,
+                  const Tensor& filter, const Conv2DDimensions& dimensions,
+                  Tensor* output, TensorFormat data_format) {
+    return false;
+  }
+};
+
+// Conditionally launches DirectConv operation based on convolution parameters.
+template <>
+class LaunchDirectConvOp<CPUDevice, float> {
+ public:
+  static bool Run(OpKernelContext* ctx, const Tensor& input,
+                  const Tensor& filter, const Conv2DDimensions& dimensions,
+                  Tensor* output, TensorFormat data_format) {
+    if (data_format != FORMAT_NHWC ||
+        dimensions.in_depth != dimensions.patch_depth) {
+      return false;
+    }
+
+    DirectConv2DArgs args;
+    args.batch = dimensions.batch;
+    args.in_rows = dimensions.input_rows;
+    args.in_cols = dimensions.input_cols;
+    args.in_depth = dimensions.in_depth;
+    args.filter_rows = dimensions.filter_rows;
+    args.filter_cols = dimensions.filter_cols;
+    args.stride_rows = dimensions.stride_rows;
+    args.stride_cols = dimensions.stride_cols;
+    args.dilation_rows = dimensions.dilation_rows;
+    args.dilation_cols = dimensions.dilation_cols;
+    args.pad_rows = dimensions.pad_rows_before;
+    args.pad_cols = dimensions.pad_cols_before;
+    args.out_rows = dimensions.out_rows;
+    args.out_cols = dimensions.out_cols;
+    args.out_depth = dimensions.out_depth;
+    if (!CanUseDirectConv2D(args)) return false;
+
+    functor::DirectConv2D<CPUDevice, float>()(
+        ctx, args, input.flat<float>().data(), filter.flat<float>().data(),
+        /*bias=*/nullptr, DirectConv2DActivation::kNone,
+        output->flat<float>().data());
+    return true;
+  }
+};
+
 #ifdef TENSORFLOW_USE_LIBXSMM_CONVOLUTIONS
 template <typename Device, typename T>
 class LaunchXsmmConvOp {
@@ -581,6 +630,11 @@ class Conv2DOp : public BinaryOp<T> {
       return;
     }
 
+    if (LaunchDirectConvOp<Device, T>::Run(context, input, filter, dimensions,
+                                           output, params_.data_format)) {
+      return;
+    }
+
     launcher_(context, use_cudnn_, cudnn_use_autotune_, input, filter,
               dimensions.dilation_rows, dimensions.dilation_cols,
               dimensions.stride_rows, dimensions.stride_cols, params_.padding,
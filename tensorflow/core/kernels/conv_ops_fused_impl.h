@@ -51,6 +51,7 @@ limitations under the License.
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/kernels/conv_2d.h"
 #include "tensorflow/core/kernels/conv_ops.h"
+#include "tensorflow/core/kernels/direct_conv2d.h"
 #include "tensorflow/core/kernels/fused_eigen_output_kernels.h"
 #include "tensorflow/core/kernels/ops_util.h"
 #include "tensorflow/core/util/tensor_format.h"
@@ -168,6 +169,69 @@ class LaunchFusedConv2DWithOutputKernel {
   const std::vector<int64>& explicit_paddings_;
 };
 
+// Conditionally launches DirectConv2D for the Conv2D + BiasAdd + <Activation>
+// fusions, based on convolution parameters. Returns false if the fused
+// convolution must be computed with an Eigen output kernel instead.
+template <typename T>
+struct LaunchFusedDirectConv2D {
+  static bool Run(OpKernelContext* ctx, const Tensor& input,
+                  const Tensor& filter, FusedComputationType fusion,
+                  const BiasAddArgs<T>& bias_add_args,
+                  const Conv2DDimensions& dimensions, Tensor* output) {
+    return false;
+  }
+};
+
+template <>
+struct LaunchFusedDirectConv2D<float> {
+  static bool Run(OpKernelContext* ctx, const Tensor& input,
+                  const Tensor& filter, FusedComputationType fusion,
+                  const BiasAddArgs<float>& bias_add_args,
+                  const Conv2DDimensions& dimensions, Tensor* output) {
+    DirectConv2DActivation activation;
+    switch (fusion) {
+      case FusedComputationType::kBiasAdd:
+        activation = DirectConv2DActivation::kNone;
+        break;
+      case FusedComputationType::kBiasAddWithRelu:
+        activation = DirectConv2DActivation::kRelu;
+        break;
+      case FusedComputationType::kBiasAddWithRelu6:
+        activation = DirectConv2DActivation::kRelu6;
+        break;
+      case FusedComputationType::kBiasAddWithElu:
+        activation = DirectConv2DActivation::kElu;
+        break;
+      default:
+        return false;
+    }
+    if (ctx->input(2).NumElements() != dimensions.out_depth) return false;
+
+    DirectConv2DArgs args;
+    args.batch = dimensions.batch;
+    args.in_rows = dimensions.input_rows;
+    args.in_cols = dimensions.input_cols;
+    args.in_depth = dimensions.in_depth;
+    args.filter_rows = dimensions.filter_rows;
+    args.filter_cols = dimensions.filter_cols;
+    args.stride_rows = dimensions.stride_rows;
+    args.stride_cols = dimensions.stride_cols;
+    args.dilation_rows = dimensions.dilation_rows;
+    args.dilation_cols = dimensions.dilation_cols;
+    args.pad_rows = dimensions.pad_rows_before;
+    args.pad_cols = dimensions.pad_cols_before;
+    args.out_rows = dimensions.out_rows;
+    args.out_cols = dimensions.out_cols;
+    args.out_depth = dimensions.out_depth;
+    if (!CanUseDirectConv2D(args)) return false;
+
+    functor::DirectConv2D<CPUDevice, float>()(
+        ctx, args, input.flat<float>().data(), filter.flat<float>().data(),
+        bias_add_args.bias_add_data, activation, output->flat<float>().data());
+    return true;
+  }
+};
+
 template <typename T>
 struct LaunchFusedConv2DOp<CPUDevice, T> {
   void operator()(OpKernelContext* context, bool use_cudnn,
@@ -186,6 +250,10 @@ struct LaunchFusedConv2DOp<CPUDevice, T> {
     BiasAddArgs<T> bias_add_args;
     if (BiasAddArgs<T>::IsSupported(fusion)) {
       OP_REQUIRES_OK(context, InitBiasAddArgs(context, &bias_add_args));
+      if (LaunchFusedDirectConv2D<T>::Run(context, input, filter, fusion,
+                                          bias_add_args, dimensions, output)) {
+        return;
+      }
     }
 
     FusedBatchNormArgs<T> fused_batch_norm_args;
@@ -522,12 +522,104 @@ class ConvOpTest : public OpsTestBase {
     const Tensor& output = *GetOutput(0);
     test::ExpectTensorNear<float>(expected, output, 1e-5);
   }
+
+  // Runs a convolution over an image that is large compared to its depth,
+  // with an output depth that is not a multiple of the SIMD width, and
+  // compares it with a naive implementation.
+  void LargeImageConv(int stride, int dilation,
+                      const std::vector<int>& explicit_paddings) {
+    TF_EXPECT_OK(NodeDefBuilder("conv_op", "Conv2D")
+                     .Input(FakeInput(DT_FLOAT))
+                     .Input(FakeInput(DT_FLOAT))
+                     .Attr("T", DT_FLOAT)
+                     .Attr("strides", {1, stride, stride, 1})
+                     .Attr("dilations", {1, dilation, dilation, 1})
+                     .Attr("padding", "EXPLICIT")
+                     .Attr("explicit_paddings", explicit_paddings)
+                     .Finalize(node_def()));
+    TF_EXPECT_OK(InitOp());
+    const int batch = 2;
+    const int in_rows = 12;
+    const int in_cols = 11;
+    const int in_depth = 3;
+    const int filter_size = 3;
+    const int out_depth = 20;
+    const int pad_top = explicit_paddings[2];
+    const int pad_left = explicit_paddings[4];
+    const int effective_filter_size = (filter_size - 1) * dilation + 1;
+    const int out_rows =
+        (in_rows + pad_top + explicit_paddings[3] - effective_filter_size) /
+            stride +
+        1;
+    const int out_cols =
+        (in_cols + pad_left + explicit_paddings[5] - effective_filter_size) /
+            stride +
+        1;
+
+    Tensor image(DT_FLOAT, {batch, in_rows, in_cols, in_depth});
+    auto image_data = image.flat<float>();
+    for (int i = 0; i < image_data.size(); ++i) {
+      image_data(i) = static_cast<float>(i % 7) - 3.0f;
+    }
+    Tensor filter(DT_FLOAT, {filter_size, filter_size, in_depth, out_depth});
+    auto filter_data = filter.flat<float>();
+    for (int i = 0; i < filter_data.size(); ++i) {
+      filter_data(i) = static_cast<float>(i % 5) * 0.5f - 1.0f;
+    }
+
+    Tensor expected(DT_FLOAT, {batch, out_rows, out_cols, out_depth});
+    auto image_tensor = image.tensor<float, 4>();
+    auto filter_tensor = filter.tensor<float, 4>();
+    auto expected_tensor = expected.tensor<float, 4>();
+    for (int b = 0; b < batch; ++b) {
+      for (int r = 0; r < out_rows; ++r) {
+        for (int c = 0; c < out_cols; ++c) {
+          for (int o = 0; o < out_depth; ++o) {
+            float sum = 0.0f;
+            for (int fr = 0; fr < filter_size; ++fr) {
+              for (int fc = 0; fc < filter_size; ++fc) {
+                const int in_r = r * stride - pad_top + fr * dilation;
+                const int in_c = c * stride - pad_left + fc * dilation;
+                if (in_r < 0 || in_r >= in_rows || in_c < 0 ||
+                    in_c >= in_cols) {
+                  continue;
+                }
+                for (int i = 0; i < in_depth; ++i) {
+                  sum += image_tensor(b, in_r, in_c, i) *
+                         filter_tensor(fr, fc, i, o);
+                }
+              }
+            }
+            expected_tensor(b, r, c, o) = sum;
+          }
+        }
+      }
+    }
+
+    AddInputFromArray<float>(image.shape(), image.flat<float>());
+    AddInputFromArray<float>(filter.shape(), filter.flat<float>());
+    TF_ASSERT_OK(RunOpKernel());
+    const Tensor& output = *GetOutput(0);
+    test::ExpectTensorNear<float>(expected, output, 1e-4);
+  }
 };
 
 TEST_F(ConvOpTest, HandwrittenConv) { HandwrittenConv(); }
 
 TEST_F(ConvOpTest, AnisotropicStride) { AnisotropicStrides(); }
 
+#ifndef INTEL_MKL
+TEST_F(ConvOpTest, LargeImageStrided) {
+  LargeImageConv(/*stride=*/2, /*dilation=*/1,
+                 /*explicit_paddings=*/{0, 0, 1, 2, 2, 0, 0, 0});
+}
+
+TEST_F(ConvOpTest, LargeImageDilated) {
+  LargeImageConv(/*stride=*/1, /*dilation=*/2,
+                 /*explicit_paddings=*/{0, 0, 2, 2, 1, 3, 0, 0});
+}
+#endif
+
 template <typename T>
 class FusedConv2DOpTest : public OpsTestBase {
  protected:
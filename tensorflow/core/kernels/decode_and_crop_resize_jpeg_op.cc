@@ -0,0 +1,322 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// See docs in ../ops/image_ops.cc
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/lib/jpeg/jpeg_mem.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+namespace tensorflow {
+namespace {
+
+// Rough number of cycles spent per output byte.  Dominated by the entropy
+// decoding and IDCT of the (possibly downscaled) crop window, which is at most
+// a small multiple of the output size once a DCT scaling ratio is picked.
+constexpr int64 kCostPerOutputByte = 200;
+
+// Returns the largest libjpeg DCT scaling denominator such that the scaled
+// crop window still covers at least `target_height` x `target_width` pixels,
+// so that the final resize never has to upsample more than the caller asked.
+int ChooseScaleRatio(int crop_height, int crop_width, int target_height,
+                     int target_width) {
+  for (int ratio : {8, 4, 2}) {
+    if (crop_height / ratio >= target_height &&
+        crop_width / ratio >= target_width) {
+      return ratio;
+    }
+  }
+  return 1;
+}
+
+// Bilinear resize with half-pixel centers from the decoded window `src`
+// (`src_height` x `src_width`) into `dst`.  (`in_y`, `in_x`, `in_height`,
+// `in_width`) is the sub-rectangle of `src`, in fractional source pixels, that
+// maps onto the whole of `dst`.
+void ResizeBilinear(const uint8* src, int src_height, int src_width,
+                    float in_y, float in_x, float in_height, float in_width,
+                    int channels, int dst_height, int dst_width, uint8* dst) {
+  struct Interpolation {
+    int64 lower;
+    int64 upper;
+    float lerp;
+  };
+  auto compute = [](int out_size, int in_size, float in_start, float in_extent,
+                    int64 stride, std::vector<Interpolation>* out) {
+    out->resize(out_size);
+    const float scale = in_extent / out_size;
+    for (int i = 0; i < out_size; ++i) {
+      const float in = in_start + (i + 0.5f) * scale - 0.5f;
+      const float in_floor = std::floor(in);
+      const int64 lower =
+          std::min<int64>(std::max<int64>(in_floor, 0), in_size - 1);
+      const int64 upper =
+          std::min<int64>(std::max<int64>(in_floor + 1, 0), in_size - 1);
+      (*out)[i] = {lower * stride, upper * stride,
+                   std::min(std::max(in - in_floor, 0.0f), 1.0f)};
+    }
+  };
+
+  std::vector<Interpolation> ys;
+  std::vector<Interpolation> xs;
+  const int64 src_row_size = static_cast<int64>(src_width) * channels;
+  compute(dst_height, src_height, in_y, in_height, src_row_size, &ys);
+  compute(dst_width, src_width, in_x, in_width, channels, &xs);
+
+  for (int y = 0; y < dst_height; ++y) {
+    const uint8* top = src + ys[y].lower;
+    const uint8* bottom = src + ys[y].upper;
+    const float y_lerp = ys[y].lerp;
+    for (int x = 0; x < dst_width; ++x) {
+      const Interpolation& xi = xs[x];
+      for (int c = 0; c < channels; ++c) {
+        const float top_left = top[xi.lower + c];
+        const float top_right = top[xi.upper + c];
+        const float bottom_left = bottom[xi.lower + c];
+        const float bottom_right = bottom[xi.upper + c];
+        const float t = top_left + (top_right - top_left) * xi.lerp;
+        const float b = bottom_left + (bottom_right - bottom_left) * xi.lerp;
+        *dst++ = static_cast<uint8>(
+            std::min(std::max(t + (b - t) * y_lerp + 0.5f, 0.0f), 255.0f));
+      }
+    }
+  }
+}
+
+// Decodes JPEG images, crops them and resizes them to a fixed size in a single
+// step.  The crop window is given in coordinates of the full resolution image.
+// Whenever the crop is at least twice as large as the requested output, the
+// image is downscaled in the DCT domain by libjpeg first, which skips most of
+// the IDCT work, and only the scanlines covered by the crop are decoded.
+//
+// `BatchDecodeAndCropResizeJpeg` decodes a vector of images in parallel on the
+// intra-op thread pool, directly into slices of a preallocated batch tensor.
+class DecodeAndCropResizeJpegOp : public OpKernel {
+ public:
+  explicit DecodeAndCropResizeJpegOp(OpKernelConstruction* context)
+      : OpKernel(context) {
+    batched_ = type_string() == "BatchDecodeAndCropResizeJpeg";
+
+    OP_REQUIRES_OK(context, context->GetAttr("channels", &flags_.components));
+    OP_REQUIRES(context, flags_.components == 1 || flags_.components == 3,
+                errors::InvalidArgument("channels must be 1 or 3, got ",
+                                        flags_.components));
+    OP_REQUIRES_OK(context, context->GetAttr("fancy_upscaling",
+                                             &flags_.fancy_upscaling));
+    OP_REQUIRES_OK(context,
+                   context->GetAttr("try_recover_truncated",
+                                    &flags_.try_recover_truncated_jpeg));
+    OP_REQUIRES_OK(context, context->GetAttr("acceptable_fraction",
+                                             &flags_.min_acceptable_fraction));
+
+    // The TensorFlow-chosen default for jpeg decoding is IFAST, sacrificing
+    // image quality for speed.
+    flags_.dct_method = JDCT_IFAST;
+    string dct_method;
+    OP_REQUIRES_OK(context, context->GetAttr("dct_method", &dct_method));
+    OP_REQUIRES(
+        context,
+        (dct_method.empty() || dct_method == "INTEGER_FAST" ||
+         dct_method == "INTEGER_ACCURATE"),
+        errors::InvalidArgument("dct_method must be one of "
+                                "{'', 'INTEGER_FAST', 'INTEGER_ACCURATE'}"));
+    if (dct_method == "INTEGER_ACCURATE") {
+      flags_.dct_method = JDCT_ISLOW;
+    }
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& contents = context->input(0);
+    const Tensor& crop_windows = context->input(1);
+    const Tensor& size = context->input(2);
+
+    if (batched_) {
+      OP_REQUIRES(context, TensorShapeUtils::IsVector(contents.shape()),
+                  errors::InvalidArgument("contents must be 1-D, got shape ",
+                                          contents.shape().DebugString()));
+      OP_REQUIRES(
+          context,
+          crop_windows.dims() == 2 &&
+              crop_windows.dim_size(0) == contents.dim_size(0) &&
+              crop_windows.dim_size(1) == 4,
+          errors::InvalidArgument("crop_windows must have shape [",
+                                  contents.dim_size(0), ", 4], got ",
+                                  crop_windows.shape().DebugString()));
+    } else {
+      OP_REQUIRES(context, TensorShapeUtils::IsScalar(contents.shape()),
+                  errors::InvalidArgument("contents must be scalar, got shape ",
+                                          contents.shape().DebugString()));
+      OP_REQUIRES(context,
+                  crop_windows.dims() == 1 && crop_windows.dim_size(0) == 4,
+                  errors::InvalidArgument(
+                      "crop_window must have four elements, got shape ",
+                      crop_windows.shape().DebugString()));
+    }
+    OP_REQUIRES(context,
+                TensorShapeUtils::IsVector(size.shape()) && size.dim_size(0) == 2,
+                errors::InvalidArgument("size must be 1-D with two elements, ",
+                                        "got shape ",
+                                        size.shape().DebugString()));
+    const int target_height = size.vec<int32>()(0);
+    const int target_width = size.vec<int32>()(1);
+    OP_REQUIRES(context, target_height > 0 && target_width > 0,
+                errors::InvalidArgument("size must be positive, got ",
+                                        target_height, "x", target_width));
+
+    const int64 batch_size = contents.NumElements();
+    const int channels = flags_.components;
+    TensorShape output_shape({target_height, target_width, channels});
+    if (batched_) output_shape.InsertDim(0, batch_size);
+    Tensor* output = nullptr;
+    OP_REQUIRES_OK(context, context->allocate_output(0, output_shape, &output));
+    if (batch_size == 0) return;
+
+    const auto contents_flat = contents.flat<tstring>();
+    const int32* windows = crop_windows.flat<int32>().data();
+    uint8* output_data = output->flat<uint8>().data();
+    const int64 image_size =
+        static_cast<int64>(target_height) * target_width * channels;
+
+    std::vector<Status> statuses(batch_size);
+    auto decode_range = [&](int64 start, int64 limit) {
+      for (int64 i = start; i < limit; ++i) {
+        statuses[i] = DecodeOne(contents_flat(i), windows + 4 * i,
+                                target_height, target_width,
+                                output_data + i * image_size);
+      }
+    };
+    auto worker_threads = context->device()->tensorflow_cpu_worker_threads();
+    Shard(worker_threads->num_threads, worker_threads->workers, batch_size,
+          image_size * kCostPerOutputByte, decode_range);
+
+    for (int64 i = 0; i < batch_size; ++i) {
+      OP_REQUIRES_OK(context, statuses[i]);
+    }
+  }
+
+ private:
+  // Decodes `input`, crops it to `window` ([y, x, height, width] in full
+  // resolution pixels, or the whole image if height or width is 0) and
+  // resizes the crop into `output`.
+  Status DecodeOne(StringPiece input, const int32* window, int target_height,
+                   int target_width, uint8* output) const {
+    if (input.size() > std::numeric_limits<int>::max()) {
+      return errors::InvalidArgument("JPEG contents are too large for int: ",
+                                     input.size());
+    }
+    int image_width;
+    int image_height;
+    if (!jpeg::GetImageInfo(input.data(), input.size(), &image_width,
+                            &image_height, nullptr)) {
+      return errors::InvalidArgument("Invalid JPEG data, size ", input.size());
+    }
+
+    int crop_y = window[0];
+    int crop_x = window[1];
+    int crop_height = window[2];
+    int crop_width = window[3];
+    if (crop_height == 0 || crop_width == 0) {
+      crop_y = 0;
+      crop_x = 0;
+      crop_height = image_height;
+      crop_width = image_width;
+    }
+    if (crop_y < 0 || crop_x < 0 || crop_height < 0 || crop_width < 0 ||
+        static_cast<int64>(crop_y) + crop_height > image_height ||
+        static_cast<int64>(crop_x) + crop_width > image_width) {
+      return errors::InvalidArgument(
+          "Invalid crop window: y=", crop_y, ", x=", crop_x, ", h=",
+          crop_height, ", w=", crop_width, " for image of size ", image_height,
+          "x", image_width);
+    }
+
+    // libjpeg scales an image of size n to ceil(n / ratio).  Decode the
+    // smallest whole-pixel window of the scaled image that covers the crop.
+    const int ratio =
+        ChooseScaleRatio(crop_height, crop_width, target_height, target_width);
+    const int scaled_height = (image_height + ratio - 1) / ratio;
+    const int scaled_width = (image_width + ratio - 1) / ratio;
+    jpeg::UncompressFlags flags = flags_;
+    flags.ratio = ratio;
+    flags.crop = true;
+    flags.crop_y = crop_y / ratio;
+    flags.crop_x = crop_x / ratio;
+    flags.crop_height =
+        std::min(scaled_height, (crop_y + crop_height + ratio - 1) / ratio) -
+        flags.crop_y;
+    flags.crop_width =
+        std::min(scaled_width, (crop_x + crop_width + ratio - 1) / ratio) -
+        flags.crop_x;
+
+    const bool direct = ratio == 1 && crop_height == target_height &&
+                        crop_width == target_width;
+    std::unique_ptr<uint8[]> buffer;
+    int decoded_height = 0;
+    int decoded_width = 0;
+    uint8* decoded = jpeg::Uncompress(
+        input.data(), input.size(), flags, nullptr /* nwarn */,
+        [&](int width, int height, int components) -> uint8* {
+          if (components != flags_.components) return nullptr;
+          decoded_height = height;
+          decoded_width = width;
+          // When no resize is needed, decode straight into the output.
+          if (direct && height == target_height && width == target_width) {
+            return output;
+          }
+          buffer.reset(new uint8[static_cast<int64>(height) * width *
+                                 components]);
+          return buffer.get();
+        });
+    if (decoded == nullptr || decoded_height != flags.crop_height ||
+        decoded_width != flags.crop_width) {
+      return errors::InvalidArgument(
+          "Invalid JPEG data or crop window, data size ", input.size());
+    }
+    if (decoded == output) return Status::OK();
+
+    ResizeBilinear(decoded, decoded_height, decoded_width,
+                   static_cast<float>(crop_y) / ratio - flags.crop_y,
+                   static_cast<float>(crop_x) / ratio - flags.crop_x,
+                   static_cast<float>(crop_height) / ratio,
+                   static_cast<float>(crop_width) / ratio, flags_.components,
+                   target_height, target_width, output);
+    return Status::OK();
+  }
+
+  bool batched_;
+  jpeg::UncompressFlags flags_;
+};
+
+REGISTER_KERNEL_BUILDER(Name("DecodeAndCropResizeJpeg").Device(DEVICE_CPU),
+                        DecodeAndCropResizeJpegOp);
+REGISTER_KERNEL_BUILDER(
+    Name("BatchDecodeAndCropResizeJpeg").Device(DEVICE_CPU),
+    DecodeAndCropResizeJpegOp);
+
+}  // namespace
+}  // namespace tensorflow
@@ -0,0 +1,275 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <vector>
+
+#include "absl/strings/match.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/jpeg/jpeg_mem.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace {
+
+// Encodes a `height` x `width` RGB image filled with a horizontal gradient, or
+// with a single color if `uniform` is true.
+tstring MakeJpeg(int height, int width, bool uniform) {
+  std::vector<uint8> pixels(height * width * 3);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      uint8* p = &pixels[(y * width + x) * 3];
+      p[0] = uniform ? 200 : static_cast<uint8>(x * 255 / width);
+      p[1] = uniform ? 100 : static_cast<uint8>(y * 255 / height);
+      p[2] = 50;
+    }
+  }
+  jpeg::CompressFlags flags;
+  flags.format = jpeg::FORMAT_RGB;
+  flags.quality = 100;
+  return jpeg::Compress(pixels.data(), width, height, flags);
+}
+
+class DecodeAndCropResizeJpegOpTest : public OpsTestBase {
+ protected:
+  void MakeOp(const string& op, int channels) {
+    TF_ASSERT_OK(NodeDefBuilder("decode_op", op)
+                     .Input(FakeInput(DT_STRING))
+                     .Input(FakeInput(DT_INT32))
+                     .Input(FakeInput(DT_INT32))
+                     .Attr("channels", channels)
+                     .Attr("dct_method", "INTEGER_ACCURATE")
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+  }
+
+  // Decodes `jpeg` with DecodeJpeg and resizes it with CropAndResize, with
+  // boxes chosen so that CropAndResize samples the same half-pixel centers as
+  // DecodeAndCropResizeJpeg does for `window` ([y, x, height, width]).
+  Tensor DecodeThenCropAndResize(const tstring& jpeg,
+                                 const std::vector<int32>& window,
+                                 int out_height, int out_width) {
+    inputs_.clear();
+    TF_CHECK_OK(NodeDefBuilder("decode_jpeg", "DecodeJpeg")
+                    .Input(FakeInput(DT_STRING))
+                    .Attr("channels", 3)
+                    .Attr("dct_method", "INTEGER_ACCURATE")
+                    .Finalize(node_def()));
+    TF_CHECK_OK(InitOp());
+    AddInputFromArray<tstring>(TensorShape({}), {jpeg});
+    TF_CHECK_OK(RunOpKernel());
+    const Tensor decoded = *GetOutput(0);
+    const int height = decoded.dim_size(0);
+    const int width = decoded.dim_size(1);
+
+    inputs_.clear();
+    TF_CHECK_OK(NodeDefBuilder("crop_and_resize", "CropAndResize")
+                    .Input(FakeInput(DT_UINT8))
+                    .Input(FakeInput(DT_FLOAT))
+                    .Input(FakeInput(DT_INT32))
+                    .Input(FakeInput(DT_INT32))
+                    .Finalize(node_def()));
+    TF_CHECK_OK(InitOp());
+    const auto decoded_flat = decoded.flat<uint8>();
+    AddInputFromArray<uint8>(
+        TensorShape({1, height, width, 3}),
+        std::vector<uint8>(decoded_flat.data(),
+                           decoded_flat.data() + decoded_flat.size()));
+    const float scale_y = static_cast<float>(window[2]) / out_height;
+    const float scale_x = static_cast<float>(window[3]) / out_width;
+    AddInputFromArray<float>(
+        TensorShape({1, 4}),
+        {(window[0] + 0.5f * scale_y - 0.5f) / (height - 1),
+         (window[1] + 0.5f * scale_x - 0.5f) / (width - 1),
+         (window[0] + (out_height - 0.5f) * scale_y - 0.5f) / (height - 1),
+         (window[1] + (out_width - 0.5f) * scale_x - 0.5f) / (width - 1)});
+    AddInputFromArray<int32>(TensorShape({1}), {0});
+    AddInputFromArray<int32>(TensorShape({2}), {out_height, out_width});
+    TF_CHECK_OK(RunOpKernel());
+    return *GetOutput(0);
+  }
+
+  // Expects `actual` (uint8) to be within `tolerance` of `expected` (float,
+  // with a leading batch dimension of 1).
+  void ExpectNear(const Tensor& expected, const Tensor& actual,
+                  float tolerance) {
+    const auto expected_flat = expected.flat<float>();
+    const auto actual_flat = actual.flat<uint8>();
+    ASSERT_EQ(expected_flat.size(), actual_flat.size());
+    for (int i = 0; i < actual_flat.size(); ++i) {
+      EXPECT_NEAR(expected_flat(i), actual_flat(i), tolerance) << "at " << i;
+    }
+  }
+};
+
+// Encodes a `size` x `size` RGB image with a ramp of about one level per pixel
+// along x in the red channel and along y in the green channel, so that an
+// error of a few pixels in the crop or resize geometry changes the output by
+// more than the tolerance of the tests below.
+tstring MakeRampJpeg(int size) {
+  std::vector<uint8> pixels(size * size * 3);
+  for (int y = 0; y < size; ++y) {
+    for (int x = 0; x < size; ++x) {
+      uint8* p = &pixels[(y * size + x) * 3];
+      p[0] = static_cast<uint8>(x * 255 / (size - 1));
+      p[1] = static_cast<uint8>(y * 255 / (size - 1));
+      p[2] = 128;
+    }
+  }
+  jpeg::CompressFlags flags;
+  flags.format = jpeg::FORMAT_RGB;
+  flags.quality = 100;
+  flags.chroma_downsampling = false;
+  return jpeg::Compress(pixels.data(), size, size, flags);
+}
+
+TEST_F(DecodeAndCropResizeJpegOpTest, FullImageAtNativeSizeMatchesDecode) {
+  const tstring jpeg = MakeJpeg(48, 64, /*uniform=*/false);
+  MakeOp("DecodeAndCropResizeJpeg", 3);
+  AddInputFromArray<tstring>(TensorShape({}), {jpeg});
+  AddInputFromArray<int32>(TensorShape({4}), {0, 0, 0, 0});
+  AddInputFromArray<int32>(TensorShape({2}), {48, 64});
+  TF_ASSERT_OK(RunOpKernel());
+
+  jpeg::UncompressFlags flags;
+  flags.components = 3;
+  flags.dct_method = JDCT_ISLOW;
+  Tensor expected(DT_UINT8, TensorShape({48, 64, 3}));
+  ASSERT_NE(jpeg::Uncompress(jpeg.data(), jpeg.size(), flags, nullptr,
+                             [&](int width, int height, int components) {
+                               return expected.flat<uint8>().data();
+                             }),
+            nullptr);
+  test::ExpectTensorEqual<uint8>(expected, *GetOutput(0));
+}
+
+TEST_F(DecodeAndCropResizeJpegOpTest, BatchMatchesSingleImage) {
+  const std::vector<tstring> jpegs = {MakeJpeg(48, 64, false),
+                                      MakeJpeg(128, 96, false),
+                                      MakeJpeg(256, 256, false)};
+  const std::vector<int32> windows = {4, 8, 32, 40,     //
+                                      0, 0, 0, 0,       //
+                                      16, 32, 200, 160};
+
+  std::vector<Tensor> singles;
+  for (int i = 0; i < jpegs.size(); ++i) {
+    inputs_.clear();
+    MakeOp("DecodeAndCropResizeJpeg", 1);
+    AddInputFromArray<tstring>(TensorShape({}), {jpegs[i]});
+    AddInputFromArray<int32>(
+        TensorShape({4}),
+        {windows[4 * i], windows[4 * i + 1], windows[4 * i + 2],
+         windows[4 * i + 3]});
+    AddInputFromArray<int32>(TensorShape({2}), {24, 20});
+    TF_ASSERT_OK(RunOpKernel());
+    singles.push_back(*GetOutput(0));
+  }
+
+  inputs_.clear();
+  MakeOp("BatchDecodeAndCropResizeJpeg", 1);
+  AddInputFromArray<tstring>(TensorShape({3}), jpegs);
+  AddInputFromArray<int32>(TensorShape({3, 4}), windows);
+  AddInputFromArray<int32>(TensorShape({2}), {24, 20});
+  TF_ASSERT_OK(RunOpKernel());
+  const Tensor& batch = *GetOutput(0);
+  ASSERT_EQ(batch.shape(), TensorShape({3, 24, 20, 1}));
+  for (int i = 0; i < jpegs.size(); ++i) {
+    test::ExpectTensorEqual<uint8>(singles[i], batch.SubSlice(i));
+  }
+}
+
+TEST_F(DecodeAndCropResizeJpegOpTest, DownscalesInDctDomain) {
+  // A 1/8 DCT downscale of a uniform image must keep its color.
+  MakeOp("BatchDecodeAndCropResizeJpeg", 3);
+  AddInputFromArray<tstring>(TensorShape({1}), {MakeJpeg(512, 512, true)});
+  AddInputFromArray<int32>(TensorShape({1, 4}), {64, 64, 384, 384});
+  AddInputFromArray<int32>(TensorShape({2}), {32, 32});
+  TF_ASSERT_OK(RunOpKernel());
+  const auto output = GetOutput(0)->flat<uint8>();
+  ASSERT_EQ(output.size(), 32 * 32 * 3);
+  for (int i = 0; i < output.size(); i += 3) {
+    EXPECT_NEAR(output(i), 200, 2);
+    EXPECT_NEAR(output(i + 1), 100, 2);
+    EXPECT_NEAR(output(i + 2), 50, 2);
+  }
+}
+
+TEST_F(DecodeAndCropResizeJpegOpTest, ResizeMatchesCropAndResize) {
+  // A crop of less than twice the output size is decoded at full resolution
+  // and resized bilinearly.
+  const tstring jpeg = MakeRampJpeg(256);
+  const std::vector<int32> window = {40, 24, 120, 150};
+  const Tensor expected = DecodeThenCropAndResize(jpeg, window, 70, 90);
+
+  inputs_.clear();
+  MakeOp("DecodeAndCropResizeJpeg", 3);
+  AddInputFromArray<tstring>(TensorShape({}), {jpeg});
+  AddInputFromArray<int32>(TensorShape({4}), window);
+  AddInputFromArray<int32>(TensorShape({2}), {70, 90});
+  TF_ASSERT_OK(RunOpKernel());
+  ExpectNear(expected, *GetOutput(0), 1.0f);
+}
+
+TEST_F(DecodeAndCropResizeJpegOpTest, DctDownscaleMatchesCropAndResize) {
+  // A crop of 192x160 into 24x16 is decoded at 1/8 scale.  One pixel of the
+  // scaled image is eight levels of the ramp, so an offset error in the
+  // scaled window cannot hide within the tolerance.
+  const tstring jpeg = MakeRampJpeg(256);
+  const std::vector<int32> window = {32, 48, 192, 160};
+  const Tensor expected = DecodeThenCropAndResize(jpeg, window, 24, 16);
+
+  inputs_.clear();
+  MakeOp("BatchDecodeAndCropResizeJpeg", 3);
+  AddInputFromArray<tstring>(TensorShape({2}), {jpeg, jpeg});
+  AddInputFromArray<int32>(TensorShape({2, 4}),
+                           {window[0], window[1], window[2], window[3],
+                            window[0], window[1], window[2], window[3]});
+  AddInputFromArray<int32>(TensorShape({2}), {24, 16});
+  TF_ASSERT_OK(RunOpKernel());
+  const Tensor& batch = *GetOutput(0);
+  ASSERT_EQ(batch.shape(), TensorShape({2, 24, 16, 3}));
+  for (int i = 0; i < 2; ++i) {
+    ExpectNear(expected, batch.SubSlice(i), 3.0f);
+  }
+}
+
+TEST_F(DecodeAndCropResizeJpegOpTest, InvalidCropWindow) {
+  MakeOp("BatchDecodeAndCropResizeJpeg", 3);
+  AddInputFromArray<tstring>(TensorShape({2}),
+                             {MakeJpeg(32, 32, true), MakeJpeg(32, 32, true)});
+  AddInputFromArray<int32>(TensorShape({2, 4}), {0, 0, 0, 0, 8, 8, 32, 32});
+  AddInputFromArray<int32>(TensorShape({2}), {16, 16});
+  Status status = RunOpKernel();
+  EXPECT_TRUE(errors::IsInvalidArgument(status));
+  EXPECT_TRUE(absl::StrContains(status.error_message(), "Invalid crop window"))
+      << status;
+}
+
+TEST_F(DecodeAndCropResizeJpegOpTest, InvalidJpeg) {
+  MakeOp("BatchDecodeAndCropResizeJpeg", 3);
+  AddInputFromArray<tstring>(TensorShape({1}), {"not a jpeg"});
+  AddInputFromArray<int32>(TensorShape({1, 4}), {0, 0, 0, 0});
+  AddInputFromArray<int32>(TensorShape({2}), {16, 16});
+  EXPECT_TRUE(errors::IsInvalidArgument(RunOpKernel()));
+}
+
+}  // namespace
+}  // namespace tensorflow
@@ -0,0 +1,355 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#define USE_EIGEN_TENSOR
+#define EIGEN_USE_THREADS
+
+#include "tensorflow/core/kernels/direct_conv2d.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <type_traits>
+
+#include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/util/env_var.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+namespace tensorflow {
+
+// DirectConv2D computes the convolution as a sum of outer products between
+// input pixels and filter taps, reading both straight from memory:
+//
+//   output[b, r, c, :] = sum(input[b, r', c', i] * filter[fr, fc, i, :])
+//
+// where r' and c' are the input coordinates of filter tap (fr, fc), and the
+// sum goes over all taps and input channels i.
+//
+// The output channels are processed in blocks of kBlockSize (a small multiple
+// of the SIMD packet size), and the filter is repacked once per call into
+//
+//   [out_depth / kBlockSize, filter_rows, filter_cols, in_depth, kBlockSize]
+//
+// so that the kBlockSize output channels of one tap and input channel are a
+// contiguous run of aligned packets. A microkernel keeps the accumulators for
+// kTileCols adjacent output pixels times one block of output channels in
+// registers, broadcasts one input value per pixel and multiply-adds it with
+// the filter packets. NHWC already keeps the channels of a pixel contiguous,
+// so the input and output are used in place and no layout conversion is
+// needed around or between convolutions. The bias and the activation are
+// applied to the accumulators before they are stored.
+//
+// The microkernel is written with Eigen packet primitives, so the same code is
+// compiled to AVX2/FMA, AVX-512 or NEON depending on the target.
+
+namespace {
+
+typedef Eigen::internal::packet_traits<float>::type Packet;
+static constexpr int kPacketSize = Eigen::internal::packet_traits<float>::size;
+
+// Number of packets of output channels computed by one microkernel call.
+static constexpr int kBlockPackets = 2;
+static constexpr int kBlockSize = kBlockPackets * kPacketSize;
+
+// Maximum number of adjacent output pixels computed by one microkernel call.
+// kMaxTileCols * kBlockPackets accumulators plus kBlockPackets filter packets
+// and a broadcast input value fit into the 16 vector registers of AVX2.
+static constexpr int kMaxTileCols = 6;
+
+// Multiply-adds input channel 'i' of the pixels 'in' with the filter packets
+// 'w', into the accumulators of pixels [t, kTileCols). The recursion unrolls
+// the pixels at compile time, so that the accumulators stay in registers.
+template <int kTileCols, int t = 0>
+struct MultiplyAdd {
+  static EIGEN_ALWAYS_INLINE void Run(const float* const* in, int i,
+                                      const Packet (&w)[kBlockPackets],
+                                      Packet (&acc)[kTileCols][kBlockPackets]) {
+    static_assert(kBlockPackets == 2, "Update the unrolled products.");
+    const Packet x = Eigen::internal::pset1<Packet>(in[t][i]);
+    acc[t][0] = Eigen::internal::pmadd(x, w[0], acc[t][0]);
+    acc[t][1] = Eigen::internal::pmadd(x, w[1], acc[t][1]);
+    MultiplyAdd<kTileCols, t + 1>::Run(in, i, w, acc);
+  }
+};
+
+template <int kTileCols>
+struct MultiplyAdd<kTileCols, kTileCols> {
+  static EIGEN_ALWAYS_INLINE void Run(const float* const* in, int i,
+                                      const Packet (&w)[kBlockPackets],
+                                      Packet (&acc)[kTileCols][kBlockPackets]) {
+  }
+};
+
+Packet ApplyActivation(DirectConv2DActivation activation, Packet value) {
+  switch (activation) {
+    case DirectConv2DActivation::kNone:
+      return value;
+    case DirectConv2DActivation::kRelu:
+      return Eigen::internal::pmax(value, Eigen::internal::pset1<Packet>(0.0f));
+    case DirectConv2DActivation::kRelu6:
+      return Eigen::internal::pmin(
+          Eigen::internal::pmax(value, Eigen::internal::pset1<Packet>(0.0f)),
+          Eigen::internal::pset1<Packet>(6.0f));
+    case DirectConv2DActivation::kElu: {
+      // elu(x) = x if x >= 0 else exp(x) - 1
+      const Packet negative = Eigen::internal::psub(
+          Eigen::internal::pexp(value), Eigen::internal::pset1<Packet>(1.0f));
+      return Eigen::internal::pselect(
+          Eigen::internal::pcmp_lt(value,
+                                   Eigen::internal::pset1<Packet>(0.0f)),
+          negative, value);
+    }
+  }
+  return value;
+}
+
+// Computes output[out_row, out_col + t, 0:depth] for t in [0, kTileCols) of a
+// single image, for one block of output channels. 'filter' and 'bias' point
+// to the packed data of the block, and 'depth' is the number of valid output
+// channels in the block. 'zeros' holds 'in_depth' zeros and stands in for
+// input pixels in the padding area.
+template <int kTileCols>
+void ComputeTile(const DirectConv2DArgs& args, const float* input,
+                 const float* filter, const float* bias, const float* zeros,
+                 DirectConv2DActivation activation, int out_row, int out_col,
+                 int depth, float* output) {
+  Packet acc[kTileCols][kBlockPackets];
+  for (int t = 0; t < kTileCols; ++t) {
+    for (int p = 0; p < kBlockPackets; ++p) {
+      acc[t][p] = Eigen::internal::pset1<Packet>(0.0f);
+    }
+  }
+
+  const int64 tap_size = static_cast<int64>(args.in_depth) * kBlockSize;
+  for (int fr = 0; fr < args.filter_rows; ++fr) {
+    const int in_row =
+        out_row * args.stride_rows - args.pad_rows + fr * args.dilation_rows;
+    if (in_row < 0 || in_row >= args.in_rows) continue;
+    const float* input_row =
+        input + static_cast<int64>(in_row) * args.in_cols * args.in_depth;
+    for (int fc = 0; fc < args.filter_cols; ++fc) {
+      const float* in[kTileCols];
+      for (int t = 0; t < kTileCols; ++t) {
+        const int in_col = (out_col + t) * args.stride_cols - args.pad_cols +
+                           fc * args.dilation_cols;
+        in[t] = (in_col < 0 || in_col >= args.in_cols)
+                    ? zeros
+                    : input_row + static_cast<int64>(in_col) * args.in_depth;
+      }
+      const float* w = filter + (fr * args.filter_cols + fc) * tap_size;
+      for (int i = 0; i < args.in_depth; ++i) {
+        const Packet w_p[kBlockPackets] = {
+            Eigen::internal::pload<Packet>(w),
+            Eigen::internal::pload<Packet>(w + kPacketSize)};
+        MultiplyAdd<kTileCols>::Run(in, i, w_p, acc);
+        w += kBlockSize;
+      }
+    }
+  }
+
+  for (int t = 0; t < kTileCols; ++t) {
+    float* out = output + static_cast<int64>(t) * args.out_depth;
+    if (depth == kBlockSize) {
+      for (int p = 0; p < kBlockPackets; ++p) {
+        const Packet value = Eigen::internal::padd(
+            acc[t][p], Eigen::internal::pload<Packet>(bias + p * kPacketSize));
+        Eigen::internal::pstoreu(out + p * kPacketSize,
+                                 ApplyActivation(activation, value));
+      }
+    } else {
+      EIGEN_ALIGN_MAX float buf[kBlockSize];
+      for (int p = 0; p < kBlockPackets; ++p) {
+        const Packet value = Eigen::internal::padd(
+            acc[t][p], Eigen::internal::pload<Packet>(bias + p * kPacketSize));
+        Eigen::internal::pstore(buf + p * kPacketSize,
+                                ApplyActivation(activation, value));
+      }
+      memcpy(out, buf, depth * sizeof(float));
+    }
+  }
+}
+
+// Computes one output row of a single image for one block of output channels.
+void ComputeRow(const DirectConv2DArgs& args, const float* input,
+                const float* filter, const float* bias, const float* zeros,
+                DirectConv2DActivation activation, int out_row, int depth,
+                float* output) {
+  int out_col = 0;
+  for (; out_col + kMaxTileCols <= args.out_cols; out_col += kMaxTileCols) {
+    ComputeTile<kMaxTileCols>(args, input, filter, bias, zeros, activation,
+                              out_row, out_col, depth,
+                              output + out_col * args.out_depth);
+  }
+  float* out = output + out_col * args.out_depth;
+  switch (args.out_cols - out_col) {
+    case 0:
+      break;
+    case 1:
+      ComputeTile<1>(args, input, filter, bias, zeros, activation, out_row,
+                     out_col, depth, out);
+      break;
+    case 2:
+      ComputeTile<2>(args, input, filter, bias, zeros, activation, out_row,
+                     out_col, depth, out);
+      break;
+    case 3:
+      ComputeTile<3>(args, input, filter, bias, zeros, activation, out_row,
+                     out_col, depth, out);
+      break;
+    case 4:
+      ComputeTile<4>(args, input, filter, bias, zeros, activation, out_row,
+                     out_col, depth, out);
+      break;
+    default:
+      static_assert(kMaxTileCols == 6, "Update the remainder tiles.");
+      ComputeTile<5>(args, input, filter, bias, zeros, activation, out_row,
+                     out_col, depth, out);
+      break;
+  }
+}
+
+// Copies 'filter' [filter_rows, filter_cols, in_depth, out_depth] into the
+// blocked layout described above, padding the last block with zeros. Also
+// copies 'bias' (or zeros if it is null) into a padded buffer.
+void PackFilterAndBias(const DirectConv2DArgs& args, const float* filter,
+                       const float* bias, int num_blocks, float* packed_filter,
+                       float* packed_bias) {
+  const int64 taps = static_cast<int64>(args.filter_rows) * args.filter_cols *
+                     args.in_depth;
+  for (int b = 0; b < num_blocks; ++b) {
+    const int depth_start = b * kBlockSize;
+    const int depth = std::min(kBlockSize, args.out_depth - depth_start);
+    float* dst = packed_filter + b * taps * kBlockSize;
+    const float* src = filter + depth_start;
+    for (int64 j = 0; j < taps; ++j) {
+      memcpy(dst, src, depth * sizeof(float));
+      memset(dst + depth, 0, (kBlockSize - depth) * sizeof(float));
+      dst += kBlockSize;
+      src += args.out_depth;
+    }
+  }
+  const int padded_depth = num_blocks * kBlockSize;
+  if (bias != nullptr) {
+    memcpy(packed_bias, bias, args.out_depth * sizeof(float));
+  } else {
+    memset(packed_bias, 0, args.out_depth * sizeof(float));
+  }
+  memset(packed_bias + args.out_depth, 0,
+         (padded_depth - args.out_depth) * sizeof(float));
+}
+
+}  // namespace
+
+bool CanUseDirectConv2D(const DirectConv2DArgs& args) {
+  // 1x1 filters, and filters covering the whole (unpadded) input, are already
+  // computed as a single matrix multiplication without any patch extraction.
+  if (args.filter_rows * args.filter_cols == 1) return false;
+  if (args.filter_rows == args.in_rows && args.filter_cols == args.in_cols &&
+      args.pad_rows == 0 && args.pad_cols == 0) {
+    return false;
+  }
+  if (args.in_depth == 0 || args.out_depth == 0) return false;
+
+  // The contraction based implementation packs blocks of patches and reuses
+  // each of them over many output channels, which wins on small and deep
+  // feature maps. DirectConv2D wins when the feature maps are large compared
+  // to their depth, e.g. the first layers of image models.
+  if (static_cast<int64>(args.out_rows) * args.out_cols <
+      8 * static_cast<int64>(args.in_depth)) {
+    return false;
+  }
+
+  // Check if direct convolution is disabled by environment variable.
+  static bool enabled = [] {
+    bool value;
+    TF_CHECK_OK(ReadBoolFromEnvVar("TF_USE_DIRECT_CONV2D", true, &value));
+    return value;
+  }();
+  return enabled;
+}
+
+namespace functor {
+
+template <typename T>
+struct DirectConv2D<Eigen::ThreadPoolDevice, T> {
+  void operator()(OpKernelContext* ctx, const DirectConv2DArgs& args,
+                  const T* input, const T* filter, const T* bias,
+                  DirectConv2DActivation activation, T* output) {
+    static_assert(std::is_same<T, float>::value,
+                  "DirectConv2D is only implemented for float.");
+    const int num_blocks = (args.out_depth + kBlockSize - 1) / kBlockSize;
+    const int64 taps = static_cast<int64>(args.filter_rows) * args.filter_cols *
+                       args.in_depth;
+    const int64 packed_filter_size = num_blocks * taps * kBlockSize;
+    const int64 padded_depth = num_blocks * kBlockSize;
+
+    // A single buffer for the packed filter, the padded bias and the zeros
+    // that stand in for the padding area of the input.
+    Tensor buffer;
+    OP_REQUIRES_OK(
+        ctx, ctx->allocate_temp(
+                 DataTypeToEnum<T>::value,
+                 TensorShape({packed_filter_size + padded_depth +
+                              args.in_depth}),
+                 &buffer));
+    T* packed_filter = buffer.template flat<T>().data();
+    T* packed_bias = packed_filter + packed_filter_size;
+    T* zeros = packed_bias + padded_depth;
+    PackFilterAndBias(args, filter, bias, num_blocks, packed_filter,
+                      packed_bias);
+    memset(zeros, 0, args.in_depth * sizeof(T));
+
+    const int64 input_image_size =
+        static_cast<int64>(args.in_rows) * args.in_cols * args.in_depth;
+    const int64 output_image_size =
+        static_cast<int64>(args.out_rows) * args.out_cols * args.out_depth;
+
+    // Each unit of work is one output row of one image, for one block of
+    // output channels. Consecutive units share the same input rows.
+    auto shard = [&](int64 start, int64 limit) {
+      for (int64 unit = start; unit < limit; ++unit) {
+        const int block = unit % num_blocks;
+        const int64 row = unit / num_blocks;
+        const int out_row = row % args.out_rows;
+        const int64 image = row / args.out_rows;
+        const int depth_start = block * kBlockSize;
+        ComputeRow(args, input + image * input_image_size,
+                   packed_filter + block * taps * kBlockSize,
+                   packed_bias + depth_start, zeros, activation, out_row,
+                   std::min(kBlockSize, args.out_depth - depth_start),
+                   output + image * output_image_size +
+                       static_cast<int64>(out_row) * args.out_cols *
+                           args.out_depth +
+                       depth_start);
+      }
+    };
+
+    const int64 num_units =
+        static_cast<int64>(args.batch) * args.out_rows * num_blocks;
+    const int64 cost_per_unit =
+        static_cast<int64>(args.out_cols) * taps * kBlockSize;
+    const DeviceBase::CpuWorkerThreads& worker_threads =
+        *(ctx->device()->tensorflow_cpu_worker_threads());
+    Shard(worker_threads.num_threads, worker_threads.workers, num_units,
+          cost_per_unit, shard);
+  }
+};
+
+template struct DirectConv2D<Eigen::ThreadPoolDevice, float>;
+
+}  // namespace functor
+
+}  // namespace tensorflow
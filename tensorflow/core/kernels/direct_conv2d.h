@@ -0,0 +1,93 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_KERNELS_DIRECT_CONV2D_H_
+#define TENSORFLOW_CORE_KERNELS_DIRECT_CONV2D_H_
+
+#include "tensorflow/core/framework/types.h"
+
+namespace tensorflow {
+
+class OpKernelContext;
+
+// DirectConv2D is a Conv2D implementation that computes the output directly
+// from the NHWC input, without extracting image patches into an intermediate
+// buffer (see direct_conv2d.cc for details). It is meant for spatial filters
+// over large feature maps, where the patch buffer of the contraction based
+// implementation grows to filter_rows * filter_cols times the input size.
+
+// Activation applied to the output of DirectConv2D, after the bias.
+enum class DirectConv2DActivation { kNone, kRelu, kRelu6, kElu };
+
+// Conv2D arguments used by DirectConv2D implementation.
+struct DirectConv2DArgs {
+  // Input layer dimensions
+  int batch;
+  int in_rows;
+  int in_cols;
+  int in_depth;
+  int filter_rows;
+  int filter_cols;
+  int stride_rows;
+  int stride_cols;
+  int dilation_rows;
+  int dilation_cols;
+  int pad_rows;
+  int pad_cols;
+
+  // Output layer dimensions
+  int out_rows;
+  int out_cols;
+  int out_depth;
+
+  DirectConv2DArgs()
+      : batch(0),
+        in_rows(0),
+        in_cols(0),
+        in_depth(0),
+        filter_rows(0),
+        filter_cols(0),
+        stride_rows(1),
+        stride_cols(1),
+        dilation_rows(1),
+        dilation_cols(1),
+        pad_rows(0),
+        pad_cols(0),
+        out_rows(0),
+        out_cols(0),
+        out_depth(0) {}
+};
+
+// Returns true if convolution operation specified by 'args' can use
+// DirectConv2D implementation, and false otherwise.
+// May return false based on parameters, or whether feature is disabled.
+bool CanUseDirectConv2D(const DirectConv2DArgs& args);
+
+namespace functor {
+
+// Calls DirectConv2D implementation (see direct_conv2d.cc for details).
+// 'bias' is optional, and if not null must hold 'out_depth' values.
+template <typename Device, typename T>
+struct DirectConv2D {
+  void operator()(OpKernelContext* ctx, const DirectConv2DArgs& args,
+                  const T* input, const T* filter, const T* bias,
+                  DirectConv2DActivation activation, T* output);
+};
+
+}  // namespace functor
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_KERNELS_DIRECT_CONV2D_H_
@@ -18,9 +18,13 @@ limitations under the License.
 #define EIGEN_USE_THREADS
 
 #include "tensorflow/core/kernels/histogram_op.h"
+
+#include <algorithm>
+
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/register_types.h"
 #include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/kernels/partial_histograms.h"
 #include "tensorflow/core/lib/core/threadpool.h"
 #include "tensorflow/core/platform/types.h"
 
@@ -37,16 +41,8 @@ struct HistogramFixedWidthFunctor<CPUDevice, T, Tout> {
                         const typename TTypes<T, 1>::ConstTensor& values,
                         const typename TTypes<T, 1>::ConstTensor& value_range,
                         int32 nbins, typename TTypes<Tout, 1>::Tensor& out) {
-    const CPUDevice& d = context->eigen_device<CPUDevice>();
-
-    Tensor index_to_bin_tensor;
-
-    TF_RETURN_IF_ERROR(context->forward_input_or_allocate_temp(
-        {0}, DataTypeToEnum<int32>::value, TensorShape({values.size()}),
-        &index_to_bin_tensor));
-    auto index_to_bin = index_to_bin_tensor.flat<int32>();
-
-    const double step = static_cast<double>(value_range(1) - value_range(0)) /
+    const T lower = value_range(0);
+    const double step = static_cast<double>(value_range(1) - lower) /
                         static_cast<double>(nbins);
     const double nbins_minus_1 = static_cast<double>(nbins - 1);
 
@@ -55,21 +51,23 @@ struct HistogramFixedWidthFunctor<CPUDevice, T, Tout> {
     //   step = (b - a) / nbins
     //   (x - a) / step
     // , then the entries are mapped to output.
-
-    // Bug fix: Switch the order of cwiseMin and int32-casting to avoid
-    // producing a negative index when casting an big int64 number to int32
-    index_to_bin.device(d) =
-        ((values.cwiseMax(value_range(0)) - values.constant(value_range(0)))
-             .template cast<double>() /
-         step)
-            .cwiseMin(nbins_minus_1)
-            .template cast<int32>();
-
-    out.setZero();
-    for (int32 i = 0; i < index_to_bin.size(); i++) {
-      out(index_to_bin(i)) += Tout(1);
-    }
-    return Status::OK();
+    //
+    // The slot is clamped to the last bin before casting to int32, to avoid
+    // producing a negative index when casting a big int64 number to int32.
+    // NaN values fail the comparison and also end up in the last bin.
+    auto bin = [&values, lower, step, nbins_minus_1](int64 i) {
+      const double slot =
+          static_cast<double>(std::max(values(i), lower) - lower) / step;
+      return static_cast<int64>(slot < nbins_minus_1 ? slot : nbins_minus_1);
+    };
+    return ComputePartialHistograms(
+        context, values.size(), nbins, 16 /* cost */,
+        [&bin, nbins](int64 start, int64 limit, Tout* bins) {
+          AccumulateBins(
+              start, limit, nbins, bin, [](int64 i) { return Tout(1); }, bins);
+        },
+        [](Tout& bin, const Tout& other_bin) { bin += other_bin; },
+        out.data());
   }
 };
 
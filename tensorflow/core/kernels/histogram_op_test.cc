@@ -0,0 +1,109 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <cmath>
+#include <limits>
+#include <memory>
+
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace {
+
+// Runs the kernel on a fixed number of threads, so that inputs of a few
+// blocks of 16K items are split the same way on every machine.
+class HistogramFixedWidthOpTest : public OpsTestBase {
+ protected:
+  static constexpr int kNumThreads = 5;
+  static constexpr int64 kBlockSize = 16 * 1024;
+
+  void SetUp() override {
+    worker_pool_.reset(
+        new thread::ThreadPool(Env::Default(), "histogram_test", kNumThreads));
+    worker_threads_.num_threads = kNumThreads;
+    worker_threads_.workers = worker_pool_.get();
+    device_->set_tensorflow_cpu_worker_threads(&worker_threads_);
+  }
+
+  void MakeOp() {
+    TF_ASSERT_OK(NodeDefBuilder("histogram_op", "HistogramFixedWidth")
+                     .Input(FakeInput(DT_FLOAT))
+                     .Input(FakeInput(DT_FLOAT))
+                     .Input(FakeInput(DT_INT32))
+                     .Attr("dtype", DT_INT32)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+  }
+
+  std::unique_ptr<thread::ThreadPool> worker_pool_;
+  DeviceBase::CpuWorkerThreads worker_threads_;
+};
+
+TEST_F(HistogramFixedWidthOpTest, Small) {
+  MakeOp();
+  // Values out of the range are counted in the first or last bin.
+  AddInputFromArray<float>(TensorShape({7}),
+                           {-1.0f, 0.0f, 1.5f, 2.0f, 3.9f, 5.0f, 15.0f});
+  AddInputFromArray<float>(TensorShape({2}), {0.0f, 5.0f});
+  AddInputFromArray<int32>(TensorShape({}), {5});
+  TF_ASSERT_OK(RunOpKernel());
+  Tensor expected(DT_INT32, TensorShape({5}));
+  test::FillValues<int32>(&expected, {2, 1, 1, 1, 2});
+  test::ExpectTensorEqual<int32>(expected, *GetOutput(0));
+}
+
+TEST_F(HistogramFixedWidthOpTest, NaNGoesToLastBin) {
+  MakeOp();
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  AddInputFromArray<float>(TensorShape({5}), {nan, 0.5f, nan, 4.5f, -nan});
+  AddInputFromArray<float>(TensorShape({2}), {0.0f, 5.0f});
+  AddInputFromArray<int32>(TensorShape({}), {5});
+  TF_ASSERT_OK(RunOpKernel());
+  Tensor expected(DT_INT32, TensorShape({5}));
+  test::FillValues<int32>(&expected, {1, 0, 0, 0, 4});
+  test::ExpectTensorEqual<int32>(expected, *GetOutput(0));
+}
+
+// Five blocks, reduced in a tree with an unpaired block at every level.
+TEST_F(HistogramFixedWidthOpTest, MultiBlock) {
+  MakeOp();
+  const int64 num_items = 5 * kBlockSize + 3;
+  const int32 nbins = 100;
+  Tensor values(DT_FLOAT, TensorShape({num_items}));
+  Tensor expected(DT_INT32, TensorShape({nbins}));
+  expected.flat<int32>().setZero();
+  for (int64 i = 0; i < num_items; ++i) {
+    // Half-integer values in [-10.5, 109.5] never fall on a bin edge.
+    const int64 bin = (i * 7919) % 121 - 11;
+    values.flat<float>()(i) = bin + 0.5f;
+    expected.flat<int32>()(std::min<int64>(std::max<int64>(bin, 0),
+                                           nbins - 1)) += 1;
+  }
+  AddInputFromArray<float>(values.shape(), values.flat<float>());
+  AddInputFromArray<float>(TensorShape({2}), {0.0f, 100.0f});
+  AddInputFromArray<int32>(TensorShape({}), {nbins});
+  TF_ASSERT_OK(RunOpKernel());
+  test::ExpectTensorEqual<int32>(expected, *GetOutput(0));
+}
+
+}  // namespace
+}  // namespace tensorflow
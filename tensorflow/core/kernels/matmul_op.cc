@@ -23,6 +23,7 @@ limitations under the License.
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/register_types.h"
 #include "tensorflow/core/kernels/fill_functor.h"
+#include "tensorflow/core/kernels/packed_matmul.h"
 #include "tensorflow/core/util/matmul_autotune.h"
 #if GOOGLE_CUDA
 #include "third_party/gpus/cuda/include/cuda.h"
@@ -148,6 +149,42 @@ struct LaunchMatMulCPU : LaunchMatMulBase<CPUDevice, T> {};
 template <typename T, bool USE_CUBLAS>
 struct LaunchMatMul<CPUDevice, T, USE_CUBLAS> : public LaunchMatMulCPU<T> {};
 
+// Computes out = a * b with the weights b packed in 'cache', for products
+// that benefit from it. Returns true if the product was computed or failed
+// (with the error set in 'ctx'), and false if the caller has to compute it.
+template <typename Device, typename T>
+struct LaunchPackedMatMul {
+  static bool Run(OpKernelContext* ctx, PackedWeightsCache* cache,
+                  const Tensor& a, const Tensor& b, bool transpose_a,
+                  bool transpose_b, Tensor* out) {
+    return false;
+  }
+};
+
+template <>
+struct LaunchPackedMatMul<CPUDevice, float> {
+  static bool Run(OpKernelContext* ctx, PackedWeightsCache* cache,
+                  const Tensor& a, const Tensor& b, bool transpose_a,
+                  bool transpose_b, Tensor* out) {
+    const int64 m = out->dim_size(0);
+    const int64 n = out->dim_size(1);
+    const int64 k = a.dim_size(transpose_a ? 0 : 1);
+    if (!packed_matmul::CanUse(m, k, n)) return false;
+
+    Tensor packed;
+    Status status = cache->Get(ctx, b, transpose_b, &packed);
+    if (!status.ok()) {
+      ctx->SetStatus(status);
+      return true;
+    }
+    if (!packed.IsInitialized()) return false;
+    PackedMatMul(ctx, a.flat<float>().data(), transpose_a, m, k, n,
+                 packed.flat<float>().data(), Eigen::NoOpOutputKernel(),
+                 out->flat<float>().data());
+    return true;
+  }
+};
+
 #ifdef TENSORFLOW_USE_SYCL
 template <typename T>
 struct LaunchMatMulSYCL : LaunchMatMulBase<SYCLDevice, T> {};
@@ -449,6 +486,9 @@ class MatMulOp : public OpKernel {
     LaunchMatMul<Device, T, USE_CUBLAS>::GetBlasGemmAlgorithm(
         ctx, &algorithms_, &algorithms_set_already_);
     use_autotune_ = MatmulAutotuneEnable();
+    if (!ctx->GetAttr(kWeightsAreConstantAttr, &weights_are_constant_).ok()) {
+      weights_are_constant_ = false;
+    }
   }
 
   void Compute(OpKernelContext* ctx) override {
@@ -495,6 +535,12 @@ class MatMulOp : public OpKernel {
       return;
     }
 
+    if (weights_are_constant_ &&
+        LaunchPackedMatMul<Device, T>::Run(ctx, &packed_weights_, a, b,
+                                           transpose_a_, transpose_b_, out)) {
+      return;
+    }
+
     if (std::is_same<T, bfloat16>::value) {
       bool is_cpu = std::is_same<Device, CPUDevice>::value;
       OP_REQUIRES(ctx, is_cpu,
@@ -528,6 +574,9 @@ class MatMulOp : public OpKernel {
   bool use_autotune_;
   bool transpose_a_;
   bool transpose_b_;
+  // Weights (In[1]) do not change between steps, and can be cached packed.
+  bool weights_are_constant_;
+  PackedWeightsCache packed_weights_;
 };
 
 namespace functor {
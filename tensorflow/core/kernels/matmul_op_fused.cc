@@ -38,6 +38,7 @@ limitations under the License.
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/kernels/fill_functor.h"
 #include "tensorflow/core/kernels/fused_eigen_output_kernels.h"
+#include "tensorflow/core/kernels/packed_matmul.h"
 #include "tensorflow/core/util/tensor_format.h"
 
 #if defined(TENSORFLOW_USE_CUSTOM_CONTRACTION_KERNEL)
@@ -102,6 +103,71 @@ struct LaunchFusedMatMulOp<CPUDevice, T> {
   }
 };
 
+// Computes the fused MatMul with the weights b packed in 'cache', for products
+// that benefit from it. Returns true if the product was computed or failed
+// (with the error set in 'context'), and false if the caller has to compute
+// it.
+template <typename Device, typename T>
+struct LaunchPackedFusedMatMulOp {
+  bool operator()(OpKernelContext* context, PackedWeightsCache* cache,
+                  const Tensor& a, const Tensor& b, bool transpose_a,
+                  bool transpose_b, FusedComputationType fusion,
+                  Tensor* output) {
+    return false;
+  }
+};
+
+template <>
+struct LaunchPackedFusedMatMulOp<CPUDevice, float> {
+  bool operator()(OpKernelContext* context, PackedWeightsCache* cache,
+                  const Tensor& a, const Tensor& b, bool transpose_a,
+                  bool transpose_b, FusedComputationType fusion,
+                  Tensor* output) {
+    const int64 m = output->dim_size(0);
+    const int64 n = output->dim_size(1);
+    const int64 k = a.dim_size(transpose_a ? 0 : 1);
+    if (!BiasAddArgs<float>::IsSupported(fusion) ||
+        !packed_matmul::CanUse(m, k, n)) {
+      return false;
+    }
+
+    BiasAddArgs<float> bias_add_args;
+    Status status = InitBiasAddArgs(context, &bias_add_args);
+    Tensor packed_t;
+    if (status.ok()) status = cache->Get(context, b, transpose_b, &packed_t);
+    if (!status.ok()) {
+      context->SetStatus(status);
+      return true;
+    }
+    if (!packed_t.IsInitialized()) return false;
+
+    const float* lhs = a.flat<float>().data();
+    const float* packed = packed_t.flat<float>().data();
+    float* out = output->flat<float>().data();
+    switch (fusion) {
+      case FusedComputationType::kBiasAdd:
+        PackedMatMul(context, lhs, transpose_a, m, k, n, packed,
+                     WithBiasAdd<float>(bias_add_args), out);
+        break;
+      case FusedComputationType::kBiasAddWithRelu:
+        PackedMatMul(context, lhs, transpose_a, m, k, n, packed,
+                     WithBiasAddAndRelu<float>(bias_add_args), out);
+        break;
+      case FusedComputationType::kBiasAddWithRelu6:
+        PackedMatMul(context, lhs, transpose_a, m, k, n, packed,
+                     WithBiasAddAndRelu6<float>(bias_add_args), out);
+        break;
+      case FusedComputationType::kBiasAddWithElu:
+        PackedMatMul(context, lhs, transpose_a, m, k, n, packed,
+                     WithBiasAddAndElu<float>(bias_add_args), out);
+        break;
+      default:
+        return false;
+    }
+    return true;
+  }
+};
+
 template <typename Device, typename T>
 class FusedMatMulOp : public OpKernel {
  public:
@@ -122,6 +188,11 @@ class FusedMatMulOp : public OpKernel {
     OP_REQUIRES_OK(context, InitializeFusedComputation(
                                 context, "MatMul", patterns,
                                 &fused_computation_, &fused_computation_args_));
+
+    if (!context->GetAttr(kWeightsAreConstantAttr, &weights_are_constant_)
+             .ok()) {
+      weights_are_constant_ = false;
+    }
   }
 
   void Compute(OpKernelContext* ctx) override {
@@ -168,6 +239,13 @@ class FusedMatMulOp : public OpKernel {
       return;
     }
 
+    if (weights_are_constant_ &&
+        LaunchPackedFusedMatMulOp<Device, T>()(ctx, &packed_weights_, a, b,
+                                               transpose_a_, transpose_b_,
+                                               fused_computation_, out)) {
+      return;
+    }
+
     auto launch = LaunchFusedMatMulOp<Device, T>();
     launch(ctx, a, b, dim_pair, fused_computation_, fused_computation_args_,
            out);
@@ -180,6 +258,10 @@ class FusedMatMulOp : public OpKernel {
   FusedComputationType fused_computation_ = FusedComputationType::kUndefined;
   FusedComputationArgs fused_computation_args_;
 
+  // Weights (In[1]) do not change between steps, and can be cached packed.
+  bool weights_are_constant_;
+  PackedWeightsCache packed_weights_;
+
   TF_DISALLOW_COPY_AND_ASSIGN(FusedMatMulOp);
 };
 
@@ -16,9 +16,11 @@ limitations under the License.
 #include "absl/algorithm/container.h"
 #include "tensorflow/cc/ops/standard_ops.h"
 #include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/kernels/ops_testutil.h"
 #include "tensorflow/core/kernels/ops_util.h"
+#include "tensorflow/core/kernels/packed_matmul.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/platform/test_benchmark.h"
@@ -147,7 +149,8 @@ class FusedMatMulOpTest : public OpsTestBase {
                         const std::vector<Tensor>& args_data,
                         const std::vector<string>& fused_ops, bool transpose_a,
                         bool transpose_b, Tensor* output,
-                        bool allow_gpu_device = false) {
+                        bool allow_gpu_device = false,
+                        bool weights_are_constant = false) {
     Scope root = tensorflow::Scope::NewRootScope();
 
     DataType dtype = DataTypeToEnum<T>::v();
@@ -175,12 +178,40 @@ class FusedMatMulOpTest : public OpsTestBase {
                      .Attr("fused_ops", fused_ops)
                      .Attr("transpose_a", transpose_a)
                      .Attr("transpose_b", transpose_b)
+                     .Attr(kWeightsAreConstantAttr, weights_are_constant)
                      .Finalize(&fused_matmul));
 
     RunAndFetch(root, fused_matmul.name(), output, allow_gpu_device,
                 &fused_matmul);
   }
 
+  // Runs a MatMul node, which uses the packed weights of its kernel if
+  // 'weights_are_constant'.
+  void RunMatMulOp(const Tensor& lhs_data, const Tensor& rhs_data,
+                   bool transpose_a, bool transpose_b,
+                   bool weights_are_constant, Tensor* output) {
+    Scope root = tensorflow::Scope::NewRootScope();
+
+    DataType dtype = DataTypeToEnum<T>::v();
+    Output lhs =
+        ops::Const(root.WithOpName("lhs"), Input::Initializer(lhs_data));
+    Output rhs =
+        ops::Const(root.WithOpName("rhs"), Input::Initializer(rhs_data));
+
+    NodeDef matmul;
+    TF_EXPECT_OK(NodeDefBuilder("matmul", "MatMul")
+                     .Input({lhs.name(), 0, dtype})
+                     .Input({rhs.name(), 0, dtype})
+                     .Attr("T", dtype)
+                     .Attr("transpose_a", transpose_a)
+                     .Attr("transpose_b", transpose_b)
+                     .Attr(kWeightsAreConstantAttr, weights_are_constant)
+                     .Finalize(&matmul));
+
+    RunAndFetch(root, matmul.name(), output, /*allow_gpu_device=*/false,
+                &matmul);
+  }
+
   void VerifyBiasAddTensorsNear(int m, int k, int n,
                                 const BiasAddGraphRunner& run_default,
                                 const BiasAddGraphRunner& run_fused) {
@@ -338,6 +369,127 @@ using FusedBiasAddDataTypes = ::testing::Types<float>;
 INSTANTIATE_TYPED_TEST_SUITE_P(Test, FusedMatMulWithBiasOpTest,
                                FusedBiasAddDataTypes);
 
+// -------------------------------------------------------------------------- //
+// MatMul and _FusedMatMul with packed constant weights                       //
+// -------------------------------------------------------------------------- //
+
+// Compares the kernels with packed weights (2 to 32 rows) to the Eigen
+// contraction they replace.
+class PackedMatMulOpTest : public FusedMatMulOpTest<float> {
+ protected:
+  void MakeInputs(int m, int k, int n, bool transpose_a, bool transpose_b,
+                  Tensor* lhs, Tensor* rhs, Tensor* bias) {
+    *lhs = Tensor(DT_FLOAT, transpose_a ? TensorShape({k, m})
+                                        : TensorShape({m, k}));
+    lhs->flat<float>().setRandom();
+    lhs->flat<float>() -= lhs->flat<float>().constant(0.5f);
+    *rhs = Tensor(DT_FLOAT, transpose_b ? TensorShape({n, k})
+                                        : TensorShape({k, n}));
+    rhs->flat<float>().setRandom();
+    rhs->flat<float>() -= rhs->flat<float>().constant(0.5f);
+    *bias = Tensor(DT_FLOAT, TensorShape({n}));
+    bias->flat<float>().setRandom();
+    bias->flat<float>() -= bias->flat<float>().constant(0.5f);
+  }
+
+  void VerifyMatMul(int m, int k, int n, bool transpose_a, bool transpose_b) {
+    Tensor lhs, rhs, bias;
+    MakeInputs(m, k, n, transpose_a, transpose_b, &lhs, &rhs, &bias);
+    Tensor expected, packed;
+    RunMatMulOp(lhs, rhs, transpose_a, transpose_b, false, &expected);
+    RunMatMulOp(lhs, rhs, transpose_a, transpose_b, true, &packed);
+    ASSERT_EQ(expected.shape(), packed.shape());
+    test::ExpectClose(expected, packed, /*atol=*/1e-5);
+  }
+
+  void VerifyFusedMatMul(int m, int k, int n, bool transpose_a,
+                         bool transpose_b,
+                         const std::vector<string>& fused_ops) {
+    Tensor lhs, rhs, bias;
+    MakeInputs(m, k, n, transpose_a, transpose_b, &lhs, &rhs, &bias);
+    Tensor expected, packed;
+    RunFusedMatMulOp(lhs, rhs, {bias}, fused_ops, transpose_a, transpose_b,
+                     &expected);
+    RunFusedMatMulOp(lhs, rhs, {bias}, fused_ops, transpose_a, transpose_b,
+                     &packed, /*allow_gpu_device=*/false,
+                     /*weights_are_constant=*/true);
+    ASSERT_EQ(expected.shape(), packed.shape());
+    test::ExpectClose(expected, packed, /*atol=*/1e-5);
+  }
+};
+
+// 37 columns are never a whole number of panels, so the last panel is
+// always zero padded. 7 rows use the tiles of 4, 2 and 1 rows.
+TEST_F(PackedMatMulOpTest, MatMul) {
+  VerifyMatMul(7, 19, 37, false, false);
+  VerifyMatMul(7, 19, 37, true, false);
+  VerifyMatMul(7, 19, 37, false, true);
+  VerifyMatMul(7, 19, 37, true, true);
+}
+
+TEST_F(PackedMatMulOpTest, MatMulRowLimits) {
+  VerifyMatMul(2, 64, 96, false, false);
+  VerifyMatMul(32, 64, 100, false, true);
+}
+
+// Many panels, which are sharded over the threads.
+TEST_F(PackedMatMulOpTest, MatMulManyPanels) {
+  VerifyMatMul(4, 256, 1000, false, false);
+}
+
+TEST_F(PackedMatMulOpTest, FusedMatMul) {
+  for (const std::vector<string>& fused_ops :
+       std::vector<std::vector<string>>{{"BiasAdd"},
+                                        {"BiasAdd", "Relu"},
+                                        {"BiasAdd", "Relu6"},
+                                        {"BiasAdd", "Elu"}}) {
+    VerifyFusedMatMul(5, 33, 37, false, false, fused_ops);
+    VerifyFusedMatMul(5, 33, 37, true, false, fused_ops);
+    VerifyFusedMatMul(5, 33, 37, false, true, fused_ops);
+    VerifyFusedMatMul(5, 33, 37, true, true, fused_ops);
+  }
+}
+
+// The kernel packs weights that come in new buffers again, and gives up
+// packing when they keep changing. Every result has to match the reference.
+TEST_F(PackedMatMulOpTest, WeightsInNewBuffers) {
+  const int m = 4, k = 9, n = 13;
+  TF_ASSERT_OK(NodeDefBuilder("matmul", "MatMul")
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Attr(kWeightsAreConstantAttr, true)
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  Tensor lhs, rhs, bias;
+  MakeInputs(m, k, n, false, false, &lhs, &rhs, &bias);
+  AddInputFromArray<float>(lhs.shape(), lhs.flat<float>());
+  AddInputFromArray<float>(rhs.shape(), rhs.flat<float>());
+
+  std::vector<Tensor> weights;
+  for (int step = 0; step < 6; ++step) {
+    // The first steps reuse the weights, and the later ones replace them.
+    if (step >= 2) {
+      weights.emplace_back(DT_FLOAT, TensorShape({k, n}));
+      weights.back().flat<float>().setRandom();
+    }
+    const Tensor& b = weights.empty() ? rhs : weights.back();
+    inputs_[1] = TensorValue(const_cast<Tensor*>(&b));
+    TF_ASSERT_OK(RunOpKernel());
+
+    Tensor expected(DT_FLOAT, TensorShape({m, n}));
+    for (int i = 0; i < m; ++i) {
+      for (int j = 0; j < n; ++j) {
+        float sum = 0.0f;
+        for (int l = 0; l < k; ++l) {
+          sum += lhs.matrix<float>()(i, l) * b.matrix<float>()(l, j);
+        }
+        expected.matrix<float>()(i, j) = sum;
+      }
+    }
+    test::ExpectClose(expected, *GetOutput(0), /*atol=*/1e-5);
+  }
+}
+
 //----------------------------------------------------------------------------//
 // Performance benchmarks are below.                                          //
 //----------------------------------------------------------------------------//
@@ -1384,12 +1384,25 @@ BM_ImageNetSoftmaxFwd(8192, 1024, 1, true, "softmax32");
 BM_ImageNetSoftmaxFwd(8192, 32768, 1, true, "softmax128");
 
 static void BM_TopK(int iters, int rows, int cols, int k, int num_threads,
-                    bool use_gpu, const string& label) {
+                    bool use_gpu, const string& label,
+                    DataType dtype = DT_FLOAT) {
   testing::StopTiming();
   auto root = Scope::NewRootScope().ExitOnError();
 
-  Tensor input(DT_FLOAT, TensorShape({rows, cols}));
-  input.flat<float>().setRandom();
+  Tensor input(dtype, TensorShape({rows, cols}));
+  switch (dtype) {
+    case DT_FLOAT:
+      input.flat<float>().setRandom();
+      break;
+    case DT_HALF:
+      input.flat<Eigen::half>().setRandom();
+      break;
+    case DT_INT32:
+      input.flat<int32>().setRandom();
+      break;
+    default:
+      LOG(FATAL) << "Unsupported dtype " << DataTypeString(dtype);
+  }
 
   Tensor input_k(DT_INT32, TensorShape({}));
   input_k.scalar<int32>()() = k;
@@ -1430,6 +1443,14 @@ static void BM_TopK(int iters, int rows, int cols, int k, int num_threads,
   }                                                              \
   BENCHMARK(BM_TopK_CPU_##IR##_##IC##_##IK##_##TH)
 
+#define BM_TopKCPUType(IR, IC, IK, TH, TYPE)                              \
+  static void BM_TopK_CPU_##TYPE##_##IR##_##IC##_##IK##_##TH(int iters) { \
+    BM_TopK(iters, IR, IC, IK, TH, false,                                 \
+            "topk_" #TYPE "_r_" #IR "_c_" #IC "_k_" #IK "_th_" #TH,       \
+            DT_##TYPE);                                                   \
+  }                                                                       \
+  BENCHMARK(BM_TopK_CPU_##TYPE##_##IR##_##IC##_##IK##_##TH)
+
 // clang-format on
 
 BM_TopKCPU(1, 100, 1, 16, "topk_r_1_c_100_k_1_th_16");
@@ -1476,4 +1497,30 @@ BM_TopKCPU(128, 70000, 70000, 16, "topk_nmt_r_128_c_70000_k_70000_th_16");
 BM_TopKCPU(128, 175000, 175000, 16, "topk_nmt_r_128_c_175000_k_175000_th_16");
 BM_TopKCPU(128, 350000, 350000, 16, "topk_nmt_r_128_c_350000_k_350000_th_16");
 
+// Beam search and retrieval over long rows, by k, row length and dtype. A
+// single row is split across threads, many rows are processed in parallel.
+BM_TopKCPUType(1, 100000, 10, 16, FLOAT);
+BM_TopKCPUType(1, 100000, 100, 16, FLOAT);
+BM_TopKCPUType(1, 100000, 1000, 16, FLOAT);
+BM_TopKCPUType(1, 100000, 10000, 16, FLOAT);
+BM_TopKCPUType(1, 100000, 50000, 16, FLOAT);
+BM_TopKCPUType(1, 1000000, 10, 16, FLOAT);
+BM_TopKCPUType(1, 1000000, 100, 16, FLOAT);
+BM_TopKCPUType(1, 1000000, 1000, 16, FLOAT);
+BM_TopKCPUType(1, 1000000, 100000, 16, FLOAT);
+BM_TopKCPUType(16, 100000, 10, 16, FLOAT);
+BM_TopKCPUType(16, 100000, 100, 16, FLOAT);
+BM_TopKCPUType(16, 100000, 1000, 16, FLOAT);
+BM_TopKCPUType(16, 100000, 10000, 16, FLOAT);
+BM_TopKCPUType(128, 10000, 10, 16, FLOAT);
+BM_TopKCPUType(128, 10000, 1000, 16, FLOAT);
+BM_TopKCPUType(1, 100000, 10, 16, HALF);
+BM_TopKCPUType(1, 100000, 1000, 16, HALF);
+BM_TopKCPUType(16, 100000, 100, 16, HALF);
+BM_TopKCPUType(16, 100000, 10000, 16, HALF);
+BM_TopKCPUType(1, 100000, 10, 16, INT32);
+BM_TopKCPUType(1, 100000, 1000, 16, INT32);
+BM_TopKCPUType(16, 100000, 100, 16, INT32);
+BM_TopKCPUType(16, 100000, 10000, 16, INT32);
+
 }  // namespace tensorflow
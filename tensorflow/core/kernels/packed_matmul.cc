@@ -0,0 +1,204 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#define EIGEN_USE_THREADS
+
+#include "tensorflow/core/kernels/packed_matmul.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+
+const char* const kWeightsAreConstantAttr = "_grappler_weights_are_constant";
+
+namespace packed_matmul {
+
+namespace {
+
+typedef Eigen::internal::packet_traits<float>::type Packet;
+constexpr int kPacketSize = Eigen::internal::packet_traits<float>::size;
+constexpr int kPanelPackets = kPanelCols / kPacketSize;
+
+// Products with more rows amortize the packing in the Eigen GEMM kernel.
+constexpr int64 kMaxRows = 32;
+
+// Multiply-adds a[r, l] * b[l, p * kPacketSize:] into acc[j], for the
+// flattened index j = r * kPanelPackets + p of each of the last kRemaining
+// accumulators. The recursion unrolls the tile at compile time, so that the
+// accumulators stay in registers.
+template <int kRows, int kRemaining = kRows * kPanelPackets>
+struct MultiplyAdd {
+  static EIGEN_ALWAYS_INLINE void Run(const float* a, int64 a_row_stride,
+                                      const Packet (&b)[kPanelPackets],
+                                      Packet (&acc)[kRows * kPanelPackets]) {
+    constexpr int j = kRows * kPanelPackets - kRemaining;
+    const Packet a_r =
+        Eigen::internal::pset1<Packet>(a[(j / kPanelPackets) * a_row_stride]);
+    acc[j] = Eigen::internal::pmadd(a_r, b[j % kPanelPackets], acc[j]);
+    MultiplyAdd<kRows, kRemaining - 1>::Run(a, a_row_stride, b, acc);
+  }
+};
+
+template <int kRows>
+struct MultiplyAdd<kRows, 0> {
+  static EIGEN_ALWAYS_INLINE void Run(const float* a, int64 a_row_stride,
+                                      const Packet (&b)[kPanelPackets],
+                                      Packet (&acc)[kRows * kPanelPackets]) {}
+};
+
+// Computes kRows rows of one panel of the product into 'out', whose rows are
+// 'out_stride' apart.
+template <int kRows>
+void Tile(const float* a, int64 a_row_stride, int64 a_col_stride, int64 k,
+          const float* panel, float* out, int64 out_stride) {
+  Packet acc[kRows * kPanelPackets];
+  for (int j = 0; j < kRows * kPanelPackets; ++j) {
+    acc[j] = Eigen::internal::pset1<Packet>(0.0f);
+  }
+  for (int64 l = 0; l < k; ++l) {
+    Packet b[kPanelPackets];
+    for (int p = 0; p < kPanelPackets; ++p) {
+      b[p] = Eigen::internal::pload<Packet>(panel + l * kPanelCols +
+                                            p * kPacketSize);
+    }
+    MultiplyAdd<kRows>::Run(a + l * a_col_stride, a_row_stride, b, acc);
+  }
+  for (int j = 0; j < kRows * kPanelPackets; ++j) {
+    Eigen::internal::pstoreu(out + (j / kPanelPackets) * out_stride +
+                                 (j % kPanelPackets) * kPacketSize,
+                             acc[j]);
+  }
+}
+
+// Computes all rows of one panel of the product, four rows at a time.
+void Panel(const float* a, int64 a_row_stride, int64 a_col_stride, int64 m,
+           int64 k, const float* panel, float* out, int64 out_stride) {
+  int64 i = 0;
+  for (; i + 4 <= m; i += 4) {
+    Tile<4>(a + i * a_row_stride, a_row_stride, a_col_stride, k, panel,
+            out + i * out_stride, out_stride);
+  }
+  if (i + 2 <= m) {
+    Tile<2>(a + i * a_row_stride, a_row_stride, a_col_stride, k, panel,
+            out + i * out_stride, out_stride);
+    i += 2;
+  }
+  if (i < m) {
+    Tile<1>(a + i * a_row_stride, a_row_stride, a_col_stride, k, panel,
+            out + i * out_stride, out_stride);
+  }
+}
+
+}  // namespace
+
+bool CanUse(int64 m, int64 k, int64 n) {
+  // NOTE: This heuristic is based on benchmarks on AVX2. Single rows are
+  // multiplied by the matrix-vector product of Eigen, which does not pack.
+  return m >= 2 && m <= kMaxRows && k > 0 && n > 0;
+}
+
+int64 PackedSize(int64 k, int64 n) {
+  return Eigen::divup<int64>(n, kPanelCols) * k * kPanelCols;
+}
+
+void PackWeights(const float* b, bool transpose_b, int64 k, int64 n,
+                 float* packed) {
+  const int64 num_panels = Eigen::divup<int64>(n, kPanelCols);
+  for (int64 p = 0; p < num_panels; ++p) {
+    const int64 start_col = p * kPanelCols;
+    const int64 num_cols = std::min<int64>(kPanelCols, n - start_col);
+    float* panel = packed + p * k * kPanelCols;
+    for (int64 l = 0; l < k; ++l) {
+      float* panel_row = panel + l * kPanelCols;
+      if (transpose_b) {
+        for (int64 c = 0; c < num_cols; ++c) {
+          panel_row[c] = b[(start_col + c) * k + l];
+        }
+      } else {
+        std::memcpy(panel_row, b + l * n + start_col, num_cols * sizeof(float));
+      }
+      std::fill(panel_row + num_cols, panel_row + kPanelCols, 0.0f);
+    }
+  }
+}
+
+void MultiplyPanels(const float* a, int64 a_row_stride, int64 a_col_stride,
+                    int64 m, int64 k, int64 n, const float* packed,
+                    int64 start_panel, int64 limit_panel, float* out) {
+  DCHECK_LE(m, kMaxRows);
+  for (int64 p = start_panel; p < limit_panel; ++p) {
+    const float* panel = packed + p * k * kPanelCols;
+    const int64 start_col = p * kPanelCols;
+    if (start_col + kPanelCols <= n) {
+      Panel(a, a_row_stride, a_col_stride, m, k, panel, out + start_col, n);
+      continue;
+    }
+    // The last panel is zero padded: compute it into a buffer, and only copy
+    // the columns that exist.
+    EIGEN_ALIGN_MAX float buffer[kMaxRows * kPanelCols];
+    Panel(a, a_row_stride, a_col_stride, m, k, panel, buffer, kPanelCols);
+    for (int64 i = 0; i < m; ++i) {
+      std::memcpy(out + i * n + start_col, buffer + i * kPanelCols,
+                  (n - start_col) * sizeof(float));
+    }
+  }
+}
+
+}  // namespace packed_matmul
+
+constexpr int PackedWeightsCache::kMaxRepacks;
+
+Status PackedWeightsCache::Get(OpKernelContext* ctx, const Tensor& weights,
+                               bool transpose, Tensor* packed) {
+  mutex_lock lock(mu_);
+  if (num_repacks_ >= kMaxRepacks) return Status::OK();
+  // The cached weights are still referenced, so their buffer can't have been
+  // reused for other data.
+  const bool is_cached =
+      packed_.IsInitialized() &&
+      weights_.tensor_data().data() == weights.tensor_data().data() &&
+      weights_.shape() == weights.shape() && transpose_ == transpose;
+  if (is_cached) {
+    num_repacks_ = 0;
+  } else {
+    if (++num_repacks_ >= kMaxRepacks) {
+      VLOG(1) << "Weights of " << ctx->op_kernel().name()
+              << " change on every call, no longer packing them.";
+      packed_ = PersistentTensor();
+      weights_ = Tensor();
+      return Status::OK();
+    }
+    const int64 k = weights.dim_size(transpose ? 1 : 0);
+    const int64 n = weights.dim_size(transpose ? 0 : 1);
+    Tensor* packed_weights = nullptr;
+    TF_RETURN_IF_ERROR(ctx->allocate_persistent(
+        DT_FLOAT, TensorShape({packed_matmul::PackedSize(k, n)}), &packed_,
+        &packed_weights));
+    packed_matmul::PackWeights(weights.flat<float>().data(), transpose, k, n,
+                               packed_weights->flat<float>().data());
+    weights_ = weights;
+    transpose_ = transpose;
+  }
+  // Callers keep their own reference, in case the weights are packed again
+  // by a concurrent step.
+  *packed = *packed_.AccessTensor(ctx);
+  return Status::OK();
+}
+
+}  // namespace tensorflow
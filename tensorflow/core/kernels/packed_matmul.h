@@ -0,0 +1,141 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_KERNELS_PACKED_MATMUL_H_
+#define TENSORFLOW_CORE_KERNELS_PACKED_MATMUL_H_
+
+#include <algorithm>
+
+#include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/platform/types.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+namespace tensorflow {
+
+// MatMul kernels repack their weights (the right hand side) into the panel
+// format of the GEMM kernel on every call. When the product has only a few
+// rows, as in inference with small batches, the packing costs about as much
+// as the multiplication itself. Kernels whose weights are known not to change
+// (see kWeightsAreConstantAttr) keep their weights packed in a
+// PackedWeightsCache, and multiply them with PackedMatMul.
+//
+// The packed k x n weights are ceil(n / kPanelCols) panels of kPanelCols
+// columns, each one row major and zero padded to kPanelCols columns.
+
+// Set by Grappler on CPU MatMul and _FusedMatMul nodes whose weights are a
+// constant or a variable that the graph never updates.
+extern const char* const kWeightsAreConstantAttr;
+
+namespace packed_matmul {
+
+constexpr int kPanelCols = 2 * Eigen::internal::packet_traits<float>::size;
+
+// Returns true if the product of an 'm' x 'k' lhs with 'k' x 'n' weights
+// should use the packed weights, and false otherwise.
+bool CanUse(int64 m, int64 k, int64 n);
+
+// Returns the number of values of 'k' x 'n' packed weights.
+int64 PackedSize(int64 k, int64 n);
+
+// Packs the 'k' x 'n' row major weights 'b', or 'n' x 'k' if 'transpose_b'.
+void PackWeights(const float* b, bool transpose_b, int64 k, int64 n,
+                 float* packed);
+
+// Computes the columns of panels [start_panel, limit_panel) of the row major
+// 'm' x 'n' product out = a * b, with b packed by PackWeights. The element
+// a[i, l] is a[i * a_row_stride + l * a_col_stride].
+void MultiplyPanels(const float* a, int64 a_row_stride, int64 a_col_stride,
+                    int64 m, int64 k, int64 n, const float* packed,
+                    int64 start_panel, int64 limit_panel, float* out);
+
+}  // namespace packed_matmul
+
+// Computes out = a * b with b packed by PackWeights, sharded over the
+// panels of b. The Eigen contraction output kernel is applied to each block
+// of computed columns, so that the fused MatMul kernels can use the same
+// BiasAdd and activation kernels as for the contraction.
+template <typename OutputKernel>
+void PackedMatMul(OpKernelContext* ctx, const float* a, bool transpose_a,
+                  int64 m, int64 k, int64 n, const float* packed,
+                  const OutputKernel& output_kernel, float* out) {
+  using packed_matmul::kPanelCols;
+  const int64 num_panels = Eigen::divup<int64>(n, kPanelCols);
+  const int64 a_row_stride = transpose_a ? 1 : k;
+  const int64 a_col_stride = transpose_a ? m : 1;
+  auto work = [&](int64 start_panel, int64 limit_panel) {
+    packed_matmul::MultiplyPanels(a, a_row_stride, a_col_stride, m, k, n,
+                                  packed, start_panel, limit_panel, out);
+    // Output kernels see the swapped (column major) product, like they do
+    // for the contraction of row major tensors.
+    const int64 start_col = start_panel * kPanelCols;
+    const int64 num_cols = std::min(n, limit_panel * kPanelCols) - start_col;
+    const Eigen::internal::blas_data_mapper<float, Eigen::Index,
+                                            Eigen::ColMajor>
+        output_mapper(out + start_col, n);
+    output_kernel(output_mapper,
+                  Eigen::TensorContractionParams(/*swapped_arguments=*/true),
+                  static_cast<Eigen::Index>(start_col), Eigen::Index(0),
+                  static_cast<Eigen::Index>(num_cols),
+                  static_cast<Eigen::Index>(m));
+  };
+  const DeviceBase::CpuWorkerThreads& worker_threads =
+      *(ctx->device()->tensorflow_cpu_worker_threads());
+  Shard(worker_threads.num_threads, worker_threads.workers, num_panels,
+        m * k * kPanelCols, work);
+}
+
+// Keeps the weights of a MatMul kernel packed across steps.
+//
+// The cache holds a reference to the weights it was packed from, and packs
+// them again when they come in a different buffer or shape. Holding the
+// reference is what makes the cache safe for resource variables: a variable
+// update never modifies a buffer that is still referenced elsewhere, but
+// copies it to a new one. The packed weights are allocated as a persistent
+// tensor, so that they are accounted in the memory stats of the kernel.
+//
+// Weights that keep coming in new buffers, such as the reads of a variable in
+// copy-on-read mode (used by sparse ops) or of one that another graph updates
+// every step, would be packed again on every call. Once kMaxRepacks calls in a
+// row find new weights, the cache gives up and releases the packed weights.
+class PackedWeightsCache {
+ public:
+  PackedWeightsCache() {}
+
+  // Sets 'packed' to the packed 'weights', transposed if 'transpose'. Leaves
+  // 'packed' uninitialized if the cache gave up, in which case the caller has
+  // to multiply the weights as they are.
+  Status Get(OpKernelContext* ctx, const Tensor& weights, bool transpose,
+             Tensor* packed) TF_LOCKS_EXCLUDED(mu_);
+
+ private:
+  static constexpr int kMaxRepacks = 3;
+
+  mutex mu_;
+  Tensor weights_ TF_GUARDED_BY(mu_);
+  bool transpose_ TF_GUARDED_BY(mu_) = false;
+  PersistentTensor packed_ TF_GUARDED_BY(mu_);
+  // Number of consecutive calls that had to pack the weights.
+  int num_repacks_ TF_GUARDED_BY(mu_) = 0;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(PackedWeightsCache);
+};
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_KERNELS_PACKED_MATMUL_H_
@@ -0,0 +1,189 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_KERNELS_PARTIAL_HISTOGRAMS_H_
+#define TENSORFLOW_CORE_KERNELS_PARTIAL_HISTOGRAMS_H_
+
+#include <algorithm>
+
+#include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+
+// Helpers for the CPU histogram kernels (Bincount, DenseBincount,
+// HistogramFixedWidth). Items are split into contiguous blocks, each block is
+// counted into a private histogram by one thread, and the partial histograms
+// are then reduced pairwise, so that no two threads ever update the same bin.
+
+// Adds weight(i) to bins[bin(i)] for all items i in [start, limit). Items
+// with a bin outside of [0, num_bins) are ignored.
+//
+// Runs of items falling into the same bin make every update depend on the
+// previous one through memory. For small histograms the items are therefore
+// spread over kNumInterleaved copies of the bins, which are summed at the end.
+template <typename T, typename BinFn, typename WeightFn>
+void AccumulateBins(int64 start, int64 limit, int64 num_bins, const BinFn& bin,
+                    const WeightFn& weight, T* bins) {
+  static constexpr int kNumInterleaved = 4;
+  static constexpr int kMaxInterleavedBins = 64;
+  const uint64 num_bins_unsigned = static_cast<uint64>(num_bins);
+  if (num_bins > kMaxInterleavedBins) {
+    for (int64 i = start; i < limit; ++i) {
+      const int64 b = bin(i);
+      if (static_cast<uint64>(b) < num_bins_unsigned) {
+        bins[b] += weight(i);
+      }
+    }
+    return;
+  }
+
+  T interleaved[kNumInterleaved][kMaxInterleavedBins];
+  for (int k = 0; k < kNumInterleaved; ++k) {
+    std::fill(interleaved[k], interleaved[k] + num_bins, T(0));
+  }
+  int64 i = start;
+  for (; i + kNumInterleaved <= limit; i += kNumInterleaved) {
+    for (int k = 0; k < kNumInterleaved; ++k) {
+      const int64 b = bin(i + k);
+      if (static_cast<uint64>(b) < num_bins_unsigned) {
+        interleaved[k][b] += weight(i + k);
+      }
+    }
+  }
+  for (; i < limit; ++i) {
+    const int64 b = bin(i);
+    if (static_cast<uint64>(b) < num_bins_unsigned) {
+      interleaved[0][b] += weight(i);
+    }
+  }
+  for (int64 b = 0; b < num_bins; ++b) {
+    bins[b] += (interleaved[0][b] + interleaved[1][b]) +
+               (interleaved[2][b] + interleaved[3][b]);
+  }
+}
+
+// Computes 'num_rows' histograms of 'num_items' items each into 'output',
+// which holds 'num_bins' values per row, on the intra-op thread pool of
+// 'context'. Rows are counted in parallel, and each row is split into blocks
+// when there are fewer rows than threads.
+//
+// fill(row, start, limit, bins) adds items [start, limit) of 'row' to the zero
+// initialized 'bins', and is expected to cost about 'cost_per_item' cycles per
+// item. combine(a, b) merges bin value b of one partial histogram into the
+// value a of the same bin of another one.
+template <typename T, typename FillFn, typename CombineFn>
+Status ComputeRowPartialHistograms(OpKernelContext* context, int64 num_rows,
+                                   int64 num_items, int64 num_bins,
+                                   int64 cost_per_item, const FillFn& fill,
+                                   const CombineFn& combine, T* output) {
+  // Every block pays for clearing and reducing its own histogram, so blocks
+  // are never smaller than the histogram.
+  static constexpr int64 kMinBlockSize = 16 * 1024;
+  if (num_rows == 0) return Status::OK();
+  thread::ThreadPool* thread_pool =
+      context->device()->tensorflow_cpu_worker_threads()->workers;
+  int64 num_blocks = std::min<int64>(
+      Eigen::divup(static_cast<int64>(thread_pool->NumThreads()), num_rows),
+      num_items / std::max<int64>(kMinBlockSize, num_bins));
+  if (num_blocks <= 1) {
+    thread_pool->ParallelFor(
+        num_rows, num_items * cost_per_item, [&](int64 start, int64 limit) {
+          for (int64 row = start; row < limit; ++row) {
+            T* bins = output + row * num_bins;
+            std::fill(bins, bins + num_bins, T(0));
+            fill(row, 0, num_items, bins);
+          }
+        });
+    return Status::OK();
+  }
+  const int64 block_size = Eigen::divup(num_items, num_blocks);
+  num_blocks = Eigen::divup(num_items, block_size);
+
+  // The first block of every row is counted directly into the output.
+  Tensor partial_bins_t;
+  TF_RETURN_IF_ERROR(context->allocate_temp(
+      DataTypeToEnum<T>::value,
+      TensorShape({num_rows, num_blocks - 1, num_bins}), &partial_bins_t));
+  T* partial_bins = partial_bins_t.flat<T>().data();
+  auto block_bins = [output, partial_bins, num_blocks, num_bins](int64 row,
+                                                                 int64 block) {
+    return block == 0
+               ? output + row * num_bins
+               : partial_bins + (row * (num_blocks - 1) + block - 1) * num_bins;
+  };
+
+  thread_pool->ParallelFor(
+      num_rows * num_blocks, block_size * cost_per_item,
+      [&](int64 start, int64 limit) {
+        for (int64 i = start; i < limit; ++i) {
+          const int64 row = i / num_blocks;
+          const int64 block = i % num_blocks;
+          T* bins = block_bins(row, block);
+          std::fill(bins, bins + num_bins, T(0));
+          fill(row, block * block_size,
+               std::min(num_items, (block + 1) * block_size), bins);
+        }
+      });
+
+  // Reduce the histograms of every row pairwise, each level over all bins of
+  // all rows in parallel.
+  for (int64 stride = 1; stride < num_blocks; stride *= 2) {
+    const int64 num_pairs = (num_blocks - 1) / (2 * stride) + 1;
+    thread_pool->ParallelFor(
+        num_rows * num_bins, num_pairs, [&](int64 start, int64 limit) {
+          for (int64 i = start; i < limit;) {
+            const int64 row = i / num_bins;
+            const int64 start_bin = i % num_bins;
+            const int64 limit_bin =
+                std::min(num_bins, start_bin + (limit - i));
+            for (int64 block = 0; block + stride < num_blocks;
+                 block += 2 * stride) {
+              T* bins = block_bins(row, block);
+              const T* other_bins = block_bins(row, block + stride);
+              for (int64 b = start_bin; b < limit_bin; ++b) {
+                combine(bins[b], other_bins[b]);
+              }
+            }
+            i += limit_bin - start_bin;
+          }
+        });
+  }
+  return Status::OK();
+}
+
+// Computes a histogram of 'num_items' items into 'output', which holds
+// 'num_bins' values. This is ComputeRowPartialHistograms for a single row,
+// with fill(start, limit, bins).
+template <typename T, typename FillFn, typename CombineFn>
+Status ComputePartialHistograms(OpKernelContext* context, int64 num_items,
+                                int64 num_bins, int64 cost_per_item,
+                                const FillFn& fill, const CombineFn& combine,
+                                T* output) {
+  return ComputeRowPartialHistograms(
+      context, /*num_rows=*/1, num_items, num_bins, cost_per_item,
+      [&fill](int64 row, int64 start, int64 limit, T* bins) {
+        fill(start, limit, bins);
+      },
+      combine, output);
+}
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_KERNELS_PARTIAL_HISTOGRAMS_H_
@@ -30,6 +30,7 @@ limitations under the License.
 #include <arm_neon.h>
 #endif
 
+#include <algorithm>
 #include <array>
 
 #include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
@@ -136,6 +137,14 @@ void QuantizationRangeForMultiplication(float min_a, float max_a, float min_b,
   *max_c = c_float_for_one_quant_level * c_highest;
 }
 
+// qint8 weights of the quint8 x qint8 kernels are quantized symmetrically, the
+// same way the MKL kernels do it: zero is always 0, and one quantized level is
+// max(|range_min|, |range_max|) / 127, leaving -128 unused.
+inline float SymmetricFloatForOneQuantizedLevel(float range_min,
+                                                float range_max) {
+  return std::max(std::abs(range_min), std::abs(range_max)) / 127.0f;
+}
+
 // input_array is an eigen Tensor.  q2f is a QuantizedToFloatStruct.
 // This evaluates to an eigen tensor expression, to be used like:
 // auto tensor = DEQUANTIZE_WITH_EIGEN(input_tensor, q2f);
@@ -29,6 +29,7 @@ limitations under the License.
 #include "tensorflow/core/kernels/meta_support.h"
 #include "tensorflow/core/kernels/quantization_utils.h"
 #include "tensorflow/core/kernels/reference_gemm.h"
+#include "tensorflow/core/kernels/ruy_support.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/util/padding.h"
 
@@ -183,6 +184,114 @@ class ReferenceConvFunctor {
   }
 };
 
+// Multiplies a chunk of im2col patches (m x k) with the filter weights (k x n)
+// into the matching rows of the output, using the fastest implementation that
+// supports the types and output parameters.
+template <class T1, class T2, class T3>
+void QuantizedConvGemm(OpKernelContext* context, int m, int n, int k,
+                       const T1* im2col_buffer, int input_offset,
+                       const T2* filter_data, int filter_offset,
+                       T3* chunk_output_data, int output_shift,
+                       int output_offset, int output_mult) {
+  const bool transpose_a = false;
+  const bool transpose_b = false;
+  const bool transpose_c = false;
+  const int lda = k;
+  const int ldb = n;
+  const int ldc = n;
+
+  if (ruy_support::IsSupportedAndEnabled() && std::is_same<T1, quint8>() &&
+      std::is_same<T2, quint8>() && std::is_same<T3, qint32>() &&
+      (output_offset == 0) && (output_mult == 1) && (output_shift == 0) &&
+      (transpose_c == false) &&
+      ruy_support::CanUseZeroPoints<T1, T2>(input_offset, filter_offset)) {
+    ruy_support::QuantizedGemm(context, transpose_a, transpose_b,
+                               im2col_buffer, filter_data, chunk_output_data,
+                               m, n, k, input_offset, filter_offset, lda, ldb,
+                               ldc);
+  } else if (meta::IsSupportedAndEnabled() && std::is_same<T1, quint8>() &&
+             std::is_same<T2, quint8>() && std::is_same<T3, qint32>() &&
+             (output_offset == 0) && (output_mult == 1) &&
+             (output_shift == 0) && (transpose_c == false) && (k <= 2048)) {
+    meta::QuantizedGemm(context, transpose_a, transpose_b, im2col_buffer,
+                        filter_data, chunk_output_data, m, n, k,
+                        -input_offset, -filter_offset, lda, ldb, ldc);
+  } else if (std::is_same<T1, quint8>() && std::is_same<T2, quint8>() &&
+             std::is_same<T3, qint32>() && (output_offset == 0) &&
+             (output_mult == 1) && (output_shift == 0)) {
+    // The gemmlowp optimized library only works for a particular set of
+    // data types, so check if we meet those requirements and fall back to a
+    // slower reference implementation if not.
+    const uint8* im2col_data_as_uint8 = &(im2col_buffer->value);
+    const uint8* filter_data_as_uint8 = &(filter_data->value);
+    int32* output_data_as_int32 = &(chunk_output_data->value);
+    // All of the transpose_* variables are currently compile-time consts,
+    // so we could just hard-code these values too, but that would break if
+    // anybody changed those values in the future (e.g. to match the ability
+    // of MatMul to specify them as attributes). We're using a verbose
+    // approach of deriving the order values from the transpose variables to
+    // be able to catch any changes like that.
+    static const gemmlowp::MapOrder ResultOrder =
+        !transpose_c ? gemmlowp::MapOrder::RowMajor
+                     : gemmlowp::MapOrder::ColMajor;
+    static const gemmlowp::MapOrder LhsOrder =
+        !transpose_a ? gemmlowp::MapOrder::RowMajor
+                     : gemmlowp::MapOrder::ColMajor;
+    static const gemmlowp::MapOrder RhsOrder =
+        !transpose_b ? gemmlowp::MapOrder::RowMajor
+                     : gemmlowp::MapOrder::ColMajor;
+    gemmlowp::MatrixMap<const std::uint8_t, LhsOrder> lhs(
+        im2col_data_as_uint8, m, k, lda);
+    gemmlowp::MatrixMap<const std::uint8_t, RhsOrder> rhs(
+        filter_data_as_uint8, k, n, ldb);
+    gemmlowp::MatrixMap<std::int32_t, ResultOrder> result(
+        output_data_as_int32, m, n, ldc);
+    const std::tuple<> empty_pipeline = {};
+
+    auto& worker_threads =
+        *(context->device()->tensorflow_cpu_worker_threads());
+    TensorflowGemmContext context(worker_threads.num_threads,
+                                  worker_threads.workers);
+    gemmlowp::GemmWithOutputPipeline<std::uint8_t, std::int32_t,
+                                     gemmlowp::DefaultL8R8BitDepthParams>(
+        &context, lhs, rhs, &result, -input_offset, -filter_offset,
+        empty_pipeline);
+    // Since gemmlowp uses assembly to write to the output, msan won't
+    // detect the output buffer as written to, so we mark it manually.
+    TF_ANNOTATE_MEMORY_IS_INITIALIZED(output_data_as_int32,
+                                      m * n * sizeof(int32));
+  } else {
+    ReferenceGemm<T1, T2, T3>(
+        transpose_a, transpose_b, transpose_c, m, n, k, im2col_buffer,
+        input_offset, lda, filter_data, filter_offset, ldb,
+        chunk_output_data, output_shift, output_offset, output_mult, ldc);
+  }
+}
+
+// Filters quantized to signed eight bit values, as QuantizedConv2DPerChannel
+// uses, are only handled by ruy and the reference implementation.
+template <>
+void QuantizedConvGemm<quint8, qint8, qint32>(
+    OpKernelContext* context, int m, int n, int k, const quint8* im2col_buffer,
+    int input_offset, const qint8* filter_data, int filter_offset,
+    qint32* chunk_output_data, int output_shift, int output_offset,
+    int output_mult) {
+  if (ruy_support::IsSupportedAndEnabled() && (output_offset == 0) &&
+      (output_mult == 1) && (output_shift == 0) &&
+      ruy_support::CanUseZeroPoints<quint8, qint8>(input_offset,
+                                                   filter_offset)) {
+    ruy_support::QuantizedGemm(context, /*transpose_a=*/false,
+                               /*transpose_b=*/false, im2col_buffer,
+                               filter_data, chunk_output_data, m, n, k,
+                               input_offset, filter_offset, k, n, n);
+  } else {
+    ReferenceGemm<quint8, qint8, qint32>(
+        /*transpose_a=*/false, /*transpose_b=*/false, /*transpose_c=*/false, m,
+        n, k, im2col_buffer, input_offset, k, filter_data, filter_offset, n,
+        chunk_output_data, output_shift, output_offset, output_mult, n);
+  }
+}
+
 // We don't want to allocate a buffer to hold all the patches if the size is
 // going to be extremely large, so break it into chunks if it's bigger than
 // a limit. Each chunk will be processed serially, so we can refill the
@@ -373,74 +482,11 @@ class Im2ColConvFunctor {
       // GEMM matrix multiply of the patches as rows, times the filter
       // weights in columns, to get partial results in the output matrix.
       const int how_many_patches = patch_index_end - patch_index_start;
-      const bool transpose_a = false;
-      const bool transpose_b = false;
-      const bool transpose_c = false;
-      const int m = how_many_patches;
-      const int n = filter_count;
-      const int k = filter_value_count;
-      const int lda = filter_value_count;
-      const int ldb = filter_count;
-      const int ldc = filter_count;
       T3* chunk_output_data = output_data + (patch_index_start * filter_count);
-
-      if (meta::IsSupportedAndEnabled() && std::is_same<T1, quint8>() &&
-          std::is_same<T2, quint8>() && std::is_same<T3, qint32>() &&
-          (output_offset == 0) && (output_mult == 1) && (output_shift == 0) &&
-          (transpose_c == false) && (k <= 2048)) {
-        meta::QuantizedGemm(context, transpose_a, transpose_b, im2col_buffer,
-                            filter_data, chunk_output_data, m, n, k,
-                            -input_offset, -filter_offset, lda, ldb, ldc);
-      } else if (std::is_same<T1, quint8>() && std::is_same<T2, quint8>() &&
-                 std::is_same<T3, qint32>() && (output_offset == 0) &&
-                 (output_mult == 1) && (output_shift == 0)) {
-        // The gemmlowp optimized library only works for a particular set of
-        // data types, so check if we meet those requirements and fall back to a
-        // slower reference implementation if not.
-        const uint8* im2col_data_as_uint8 = &(im2col_buffer->value);
-        const uint8* filter_data_as_uint8 = &(filter_data->value);
-        int32* output_data_as_int32 = &(chunk_output_data->value);
-        // All of the transpose_* variables are currently compile-time consts,
-        // so we could just hard-code these values too, but that would break if
-        // anybody changed those values in the future (e.g. to match the ability
-        // of MatMul to specify them as attributes). We're using a verbose
-        // approach of deriving the order values from the transpose variables to
-        // be able to catch any changes like that.
-        static const gemmlowp::MapOrder ResultOrder =
-            !transpose_c ? gemmlowp::MapOrder::RowMajor
-                         : gemmlowp::MapOrder::ColMajor;
-        static const gemmlowp::MapOrder LhsOrder =
-            !transpose_a ? gemmlowp::MapOrder::RowMajor
-                         : gemmlowp::MapOrder::ColMajor;
-        static const gemmlowp::MapOrder RhsOrder =
-            !transpose_b ? gemmlowp::MapOrder::RowMajor
-                         : gemmlowp::MapOrder::ColMajor;
-        gemmlowp::MatrixMap<const std::uint8_t, LhsOrder> lhs(
-            im2col_data_as_uint8, m, k, lda);
-        gemmlowp::MatrixMap<const std::uint8_t, RhsOrder> rhs(
-            filter_data_as_uint8, k, n, ldb);
-        gemmlowp::MatrixMap<std::int32_t, ResultOrder> result(
-            output_data_as_int32, m, n, ldc);
-        const std::tuple<> empty_pipeline = {};
-
-        auto& worker_threads =
-            *(context->device()->tensorflow_cpu_worker_threads());
-        TensorflowGemmContext context(worker_threads.num_threads,
-                                      worker_threads.workers);
-        gemmlowp::GemmWithOutputPipeline<std::uint8_t, std::int32_t,
-                                         gemmlowp::DefaultL8R8BitDepthParams>(
-            &context, lhs, rhs, &result, -input_offset, -filter_offset,
-            empty_pipeline);
-        // Since gemmlowp uses assembly to write to the output, msan won't
-        // detect the output buffer as written to, so we mark it manually.
-        TF_ANNOTATE_MEMORY_IS_INITIALIZED(output_data_as_int32,
-                                          m * n * sizeof(int32));
-      } else {
-        ReferenceGemm<T1, T2, T3>(
-            transpose_a, transpose_b, transpose_c, m, n, k, im2col_buffer,
-            input_offset, lda, filter_data, filter_offset, ldb,
-            chunk_output_data, output_shift, output_offset, output_mult, ldc);
-      }
+      QuantizedConvGemm(context, how_many_patches, filter_count,
+                        filter_value_count, im2col_buffer, input_offset,
+                        filter_data, filter_offset, chunk_output_data,
+                        output_shift, output_offset, output_mult);
     }
   }
 };
@@ -477,6 +523,7 @@ class QuantizedConv2DOp : public OpKernel {
                     "Current implementation does not yet support "
                     "dilations in the batch and depth dimensions."));
     OP_REQUIRES_OK(context, context->GetAttr("padding", &padding_));
+    per_channel_ = (type_string() == "QuantizedConv2DPerChannel");
   }
 
   void Compute(OpKernelContext* context) override {
@@ -498,12 +545,10 @@ class QuantizedConv2DOp : public OpKernel {
 
     const float min_input = context->input(2).flat<float>()(0);
     const float max_input = context->input(3).flat<float>()(0);
-    const float min_filter = context->input(4).flat<float>()(0);
-    const float max_filter = context->input(5).flat<float>()(0);
+    const Tensor& min_filter = context->input(4);
+    const Tensor& max_filter = context->input(5);
     const int32 offset_input =
         FloatToQuantizedUnclamped<T1>(0.0f, min_input, max_input);
-    const int32 offset_filter =
-        FloatToQuantizedUnclamped<T2>(0.0f, min_filter, max_filter);
     const int32 offset_output = 0;
     const int32 mult_output = 1;
     const int32 shift_output = 0;
@@ -519,6 +564,25 @@ class QuantizedConv2DOp : public OpKernel {
     // The last dimension for filter is out_depth.
     const int64 out_depth = filter.dim_size(3);
 
+    // The per-channel variant has a filter range for every output channel.
+    // Its qint8 filter is quantized symmetrically, so every channel has zero
+    // at 0 and only the scale differs between them.
+    const bool symmetric_filter = std::is_same<T2, qint8>::value;
+    const int64 filter_range_count = per_channel_ ? out_depth : 1;
+    OP_REQUIRES(context,
+                min_filter.NumElements() == filter_range_count &&
+                    max_filter.NumElements() == filter_range_count,
+                errors::InvalidArgument(
+                    "min_filter and max_filter must have ", filter_range_count,
+                    " elements: ", min_filter.shape().DebugString(), " and ",
+                    max_filter.shape().DebugString()));
+    const auto min_filter_flat = min_filter.flat<float>();
+    const auto max_filter_flat = max_filter.flat<float>();
+    const int32 offset_filter =
+        symmetric_filter ? 0
+                         : FloatToQuantizedUnclamped<T2>(
+                               0.0f, min_filter_flat(0), max_filter_flat(0));
+
     // The second dimension for input is rows/height.
     // The first dimension for filter is rows/height.
     const int64 input_rows = input.dim_size(1);
@@ -564,24 +628,36 @@ class QuantizedConv2DOp : public OpKernel {
                  padding_, output->flat<T3>().data(), out_rows, out_cols,
                  shift_output, offset_output, mult_output);
 
-    float min_output_value;
-    float max_output_value;
-    QuantizationRangeForMultiplication<T1, T2, T3>(
-        min_input, max_input, min_filter, max_filter, &min_output_value,
-        &max_output_value);
-
+    const TensorShape range_shape =
+        per_channel_ ? min_filter.shape() : TensorShape({});
     Tensor* output_min = nullptr;
-    OP_REQUIRES_OK(context, context->allocate_output(1, {}, &output_min));
-    output_min->flat<float>()(0) = min_output_value;
-
+    OP_REQUIRES_OK(context,
+                   context->allocate_output(1, range_shape, &output_min));
     Tensor* output_max = nullptr;
-    OP_REQUIRES_OK(context, context->allocate_output(2, {}, &output_max));
-    output_max->flat<float>()(0) = max_output_value;
+    OP_REQUIRES_OK(context,
+                   context->allocate_output(2, range_shape, &output_max));
+    for (int64 i = 0; i < filter_range_count; ++i) {
+      if (symmetric_filter) {
+        const float output_level =
+            FloatForOneQuantizedLevel<T1>(min_input, max_input) *
+            SymmetricFloatForOneQuantizedLevel(min_filter_flat(i),
+                                               max_filter_flat(i));
+        output_min->flat<float>()(i) =
+            output_level * static_cast<int64>(Eigen::NumTraits<T3>::lowest());
+        output_max->flat<float>()(i) =
+            output_level * static_cast<int64>(Eigen::NumTraits<T3>::highest());
+      } else {
+        QuantizationRangeForMultiplication<T1, T2, T3>(
+            min_input, max_input, min_filter_flat(i), max_filter_flat(i),
+            &output_min->flat<float>()(i), &output_max->flat<float>()(i));
+      }
+    }
   }
 
  private:
   std::vector<int32> strides_;
   Padding padding_;
+  bool per_channel_;
 };
 
 // Right now we only support taking two eight bit inputs, and returning the
@@ -594,4 +670,15 @@ REGISTER_KERNEL_BUILDER(
         .TypeConstraint<qint32>("out_type"),
     QuantizedConv2DOp<quint8, quint8, qint32, Im2ColConvFunctor>);
 
+// Builds with MKL register their own kernel for the per-channel variant.
+#ifndef INTEL_MKL
+REGISTER_KERNEL_BUILDER(
+    Name("QuantizedConv2DPerChannel")
+        .Device(DEVICE_CPU)
+        .TypeConstraint<quint8>("Tinput")
+        .TypeConstraint<qint8>("Tfilter")
+        .TypeConstraint<qint32>("out_type"),
+    QuantizedConv2DOp<quint8, qint8, qint32, Im2ColConvFunctor>);
+#endif  // INTEL_MKL
+
 }  // namespace tensorflow
@@ -15,6 +15,7 @@ limitations under the License.
 
 #define EIGEN_USE_THREADS
 
+#include <cmath>
 #include <functional>
 #include <memory>
 #include <vector>
@@ -322,4 +323,149 @@ TEST_F(QuantizedConv2DTest, SmallWithNoZero) {
   test::ExpectTensorNear<float>(expected_float, output_float, 1.0);
 }
 
+// Builds with MKL replace the per-channel kernel, and have their own tests.
+#ifndef INTEL_MKL
+TEST_F(QuantizedConv2DTest, PerChannel) {
+  const int stride = 1;
+  TF_ASSERT_OK(NodeDefBuilder("quantized_conv_op", "QuantizedConv2DPerChannel")
+                   .Input(FakeInput(DT_QUINT8))
+                   .Input(FakeInput(DT_QINT8))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Attr("out_type", DataTypeToEnum<qint32>::v())
+                   .Attr("strides", {1, stride, stride, 1})
+                   .Attr("padding", "SAME")
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  const int depth = 1;
+  const int image_width = 4;
+  const int image_height = 3;
+  const int image_batch_count = 1;
+  const float image_min = 0.0f;
+  const float image_max = 255.0f;
+  Tensor image_float(DT_FLOAT,
+                     {image_batch_count, image_height, image_width, depth});
+  test::FillValues<float>(&image_float,
+                          {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12});
+  Tensor image_quantized =
+      FloatTensorToQuantized<quint8>(image_float, image_min, image_max);
+  // Both filters hold the same quantized values:
+  // | 1 | 4 | 7 |
+  // | 2 | 5 | 8 |
+  // | 3 | 6 | 9 |
+  // but the second one has twice the range of the first, so its float values
+  // are twice as large. One level of the first filter is exactly 1.0.
+  const int filter_size = 3;
+  const int filter_count = 2;
+  AddInputFromArray<quint8>(image_quantized.shape(),
+                            image_quantized.flat<quint8>());
+  AddInputFromArray<qint8>(
+      TensorShape({filter_size, filter_size, depth, filter_count}),
+      {1, 1, 4, 4, 7, 7, 2, 2, 5, 5, 8, 8, 3, 3, 6, 6, 9, 9});
+  AddInputFromArray<float>(TensorShape({1}), {image_min});
+  AddInputFromArray<float>(TensorShape({1}), {image_max});
+  AddInputFromArray<float>(TensorShape({filter_count}), {-127.0f, -254.0f});
+  AddInputFromArray<float>(TensorShape({filter_count}), {127.0f, 254.0f});
+  TF_ASSERT_OK(RunOpKernel());
+
+  const Tensor& output_min = *GetOutput(1);
+  const Tensor& output_max = *GetOutput(2);
+  ASSERT_EQ(filter_count, output_min.NumElements());
+  ASSERT_EQ(filter_count, output_max.NumElements());
+  // The per-channel ranges only differ by the filter scale.
+  EXPECT_NEAR(2.0f * output_min.flat<float>()(0), output_min.flat<float>()(1),
+              1e-3f * std::abs(output_min.flat<float>()(1)));
+  EXPECT_NEAR(2.0f * output_max.flat<float>()(0), output_max.flat<float>()(1),
+              1e-3f * std::abs(output_max.flat<float>()(1)));
+
+  // See the Small test for how these values are calculated.
+  const std::vector<float> expected = {105, 150, 183, 95,  235, 312,
+                                       357, 178, 187, 234, 261, 121};
+  const Tensor& output = *GetOutput(0);
+  ASSERT_EQ(expected.size() * filter_count, output.NumElements());
+  for (int i = 0; i < output.NumElements(); ++i) {
+    const int channel = i % filter_count;
+    const float value = QuantizedToFloat<qint32>(
+        output.flat<qint32>()(i), output_min.flat<float>()(channel),
+        output_max.flat<float>()(channel));
+    EXPECT_NEAR(expected[i / filter_count] * (channel + 1), value, 1.0)
+        << "at " << i;
+  }
+}
+
+// Filter ranges like [-0.3, 0.3] and [-1.7, 1.7] would not quantize zero to
+// the same value in the asymmetric quint8-style mapping. The qint8 filter is
+// symmetric, so they only differ in scale.
+TEST_F(QuantizedConv2DTest, PerChannelFractionalRanges) {
+  const int stride = 1;
+  TF_ASSERT_OK(NodeDefBuilder("quantized_conv_op", "QuantizedConv2DPerChannel")
+                   .Input(FakeInput(DT_QUINT8))
+                   .Input(FakeInput(DT_QINT8))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Attr("out_type", DataTypeToEnum<qint32>::v())
+                   .Attr("strides", {1, stride, stride, 1})
+                   .Attr("padding", "SAME")
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  const int depth = 1;
+  const int image_width = 4;
+  const int image_height = 3;
+  const int image_batch_count = 1;
+  const float image_min = 0.0f;
+  const float image_max = 255.0f;
+  Tensor image_float(DT_FLOAT,
+                     {image_batch_count, image_height, image_width, depth});
+  test::FillValues<float>(&image_float,
+                          {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12});
+  Tensor image_quantized =
+      FloatTensorToQuantized<quint8>(image_float, image_min, image_max);
+  // The same quantized filter values as in PerChannel, with a negative one.
+  const int filter_size = 3;
+  const int filter_count = 2;
+  AddInputFromArray<quint8>(image_quantized.shape(),
+                            image_quantized.flat<quint8>());
+  AddInputFromArray<qint8>(
+      TensorShape({filter_size, filter_size, depth, filter_count}),
+      {1, 1, 4, 4, 7, 7, 2, 2, 5, 5, 8, 8, 3, 3, 6, 6, -9, -9});
+  AddInputFromArray<float>(TensorShape({1}), {image_min});
+  AddInputFromArray<float>(TensorShape({1}), {image_max});
+  AddInputFromArray<float>(TensorShape({filter_count}), {-0.3f, -1.7f});
+  AddInputFromArray<float>(TensorShape({filter_count}), {0.3f, 1.7f});
+  TF_ASSERT_OK(RunOpKernel());
+
+  const float filter_levels[filter_count] = {0.3f / 127.0f, 1.7f / 127.0f};
+  const Tensor& output_min = *GetOutput(1);
+  const Tensor& output_max = *GetOutput(2);
+  ASSERT_EQ(filter_count, output_max.NumElements());
+  float output_levels[filter_count];
+  for (int channel = 0; channel < filter_count; ++channel) {
+    output_levels[channel] = output_max.flat<float>()(channel) / kint32max;
+    EXPECT_NEAR(filter_levels[channel], output_levels[channel],
+                1e-6f * filter_levels[channel]);
+    EXPECT_NEAR(-output_max.flat<float>()(channel),
+                output_min.flat<float>()(channel),
+                1e-6f * output_max.flat<float>()(channel));
+  }
+
+  // The convolution of the image with the quantized filter values, computed
+  // as in the Small test.
+  const std::vector<float> expected = {-3,  24,  39,  95,  55,  114,
+                                       141, 178, 187, 234, 261, 121};
+  const Tensor& output = *GetOutput(0);
+  ASSERT_EQ(expected.size() * filter_count, output.NumElements());
+  for (int i = 0; i < output.NumElements(); ++i) {
+    const int channel = i % filter_count;
+    EXPECT_NEAR(expected[i / filter_count] * filter_levels[channel],
+                output.flat<qint32>()(i).value * output_levels[channel],
+                1e-4f)
+        << "at " << i;
+  }
+}
+#endif  // INTEL_MKL
+
 }  // namespace tensorflow
@@ -17,6 +17,9 @@ limitations under the License.
 
 #define EIGEN_USE_THREADS
 
+#include <algorithm>
+#include <cmath>
+
 #define GEMMLOWP_ALLOW_SLOW_SCALAR_FALLBACK
 #include "public/gemmlowp.h"
 #include "tensorflow/core/framework/op_kernel.h"
@@ -24,6 +27,7 @@ limitations under the License.
 #include "tensorflow/core/kernels/meta_support.h"
 #include "tensorflow/core/kernels/quantization_utils.h"
 #include "tensorflow/core/kernels/reference_gemm.h"
+#include "tensorflow/core/kernels/ruy_support.h"
 #include "tensorflow/core/lib/core/errors.h"
 
 namespace tensorflow {
@@ -132,7 +136,16 @@ class QuantizedMatMulOp : public OpKernel {
     const size_t ldb = b.dim_size(1);
     const size_t ldc = n;
 
-    if (meta::IsSupportedAndEnabled() && std::is_same<T1, quint8>() &&
+    if (ruy_support::IsSupportedAndEnabled() && std::is_same<T1, quint8>() &&
+        std::is_same<T2, quint8>() && std::is_same<Toutput, qint32>() &&
+        (offset_c == 0) && (mult_c == 1) && (shift_c == 0) &&
+        (transpose_c == false) &&
+        ruy_support::CanUseZeroPoints<T1, T2>(offset_a, offset_b)) {
+      // Ruy has optimized 8bit to 32bit gemm kernels for both x86 and Arm.
+      ruy_support::QuantizedGemm(context, transpose_a_, transpose_b_, a_data,
+                                 b_data, c_data, m, n, k, offset_a, offset_b,
+                                 lda, ldb, ldc);
+    } else if (meta::IsSupportedAndEnabled() && std::is_same<T1, quint8>() &&
         std::is_same<T2, quint8>() && std::is_same<Toutput, qint32>() &&
         (offset_c == 0) && (mult_c == 1) && (shift_c == 0) &&
         (transpose_c == false) && (k <= 2048)) {
@@ -198,4 +211,225 @@ REGISTER_KERNEL_BUILDER(Name("QuantizedMatMul")
                             .TypeConstraint<qint32>("Toutput"),
                         QuantizedMatMulOp<quint8, quint8, qint32>);
 
+// Builds with MKL register their own kernels for the fused ops below.
+#ifndef INTEL_MKL
+
+namespace {
+
+// Applies the output stage to int32 accumulators computed by ReferenceGemm,
+// matching what ruy_support::QuantizedGemm does in its own kernels.
+void ApplyOutputStage(const ruy_support::OutputStage& output_stage,
+                      const qint32* accumulators, int m, int n,
+                      qint32* output) {
+  for (int i = 0; i < m; ++i) {
+    for (int j = 0; j < n; ++j) {
+      output[i * n + j] = accumulators[i * n + j].value + output_stage.bias[j];
+    }
+  }
+}
+
+void ApplyOutputStage(const ruy_support::OutputStage& output_stage,
+                      const qint32* accumulators, int m, int n,
+                      quint8* output) {
+  for (int i = 0; i < m; ++i) {
+    for (int j = 0; j < n; ++j) {
+      const int32 value =
+          ruy_support::MultiplyByQuantizedMultiplier(
+              accumulators[i * n + j].value + output_stage.bias[j],
+              output_stage.multiplier_fixedpoint,
+              output_stage.multiplier_exponent) +
+          output_stage.output_offset;
+      output[i * n + j] = static_cast<uint8>(std::min(
+          std::max(value, output_stage.clamp_min), output_stage.clamp_max));
+    }
+  }
+}
+
+}  // namespace
+
+// Implements QuantizedMatMulWithBias and its requantizing variants: a quint8
+// times qint8 matrix multiplication, with the bias added to the int32
+// accumulators and, for quint8 outputs, the result requantized to the frozen
+// output range, all in the output stage of a single gemm.
+// A float bias is scaled to the accumulator range here. A qint32 bias is
+// expected to be in that range already.
+template <class Tbias, class Toutput, bool relu>
+class QuantizedMatMulWithBiasOp : public OpKernel {
+ public:
+  explicit QuantizedMatMulWithBiasOp(OpKernelConstruction* context)
+      : OpKernel(context) {
+    OP_REQUIRES_OK(context, context->GetAttr("transpose_a", &transpose_a_));
+    OP_REQUIRES_OK(context, context->GetAttr("transpose_b", &transpose_b_));
+    string mode_string;
+    OP_REQUIRES_OK(context, context->GetAttr("input_quant_mode", &mode_string));
+    OP_REQUIRES(context, mode_string == "MIN_FIRST" || mode_string == "SCALED",
+                errors::InvalidArgument("Quantization mode must be either "
+                                        "MIN_FIRST or SCALED, but received ",
+                                        mode_string));
+    scaled_input_ = (mode_string == "SCALED");
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& a = context->input(0);
+    const Tensor& b = context->input(1);
+    const Tensor& bias = context->input(2);
+    float min_a = context->input(3).flat<float>()(0);
+    float max_a = context->input(4).flat<float>()(0);
+    const float min_b = context->input(5).flat<float>()(0);
+    const float max_b = context->input(6).flat<float>()(0);
+
+    OP_REQUIRES(context, (max_a > min_a),
+                errors::InvalidArgument("max_a must be larger than min_a."));
+    OP_REQUIRES(context, (max_b > min_b),
+                errors::InvalidArgument("max_b must be larger than min_b."));
+    // SCALED mode quantizes a symmetrically, so zero is always at zero.
+    if (scaled_input_) {
+      max_a = std::max(std::abs(min_a), std::abs(max_a));
+      min_a = 0.0f;
+    }
+    const int32 offset_a =
+        FloatToQuantizedUnclamped<quint8>(0.0f, min_a, max_a);
+    // The qint8 weights are symmetric, with zero at 0.
+    const int32 offset_b = 0;
+
+    OP_REQUIRES(context, TensorShapeUtils::IsMatrix(a.shape()),
+                errors::InvalidArgument("In[0] is not a matrix"));
+    OP_REQUIRES(context, TensorShapeUtils::IsMatrix(b.shape()),
+                errors::InvalidArgument("In[1] is not a matrix"));
+    const int a_dim_inner = transpose_a_ ? 0 : 1;
+    const int b_dim_inner = transpose_b_ ? 1 : 0;
+    OP_REQUIRES(context, a.dim_size(a_dim_inner) == b.dim_size(b_dim_inner),
+                errors::InvalidArgument("Matrix size-incompatible: In[0]: ",
+                                        a.shape().DebugString(),
+                                        ", In[1]: ", b.shape().DebugString()));
+    const int m = a.dim_size(1 - a_dim_inner);
+    const int n = b.dim_size(1 - b_dim_inner);
+    const int k = a.dim_size(a_dim_inner);
+    OP_REQUIRES(context,
+                TensorShapeUtils::IsVector(bias.shape()) &&
+                    bias.NumElements() == n,
+                errors::InvalidArgument("bias must be a vector of size ", n,
+                                        ": ", bias.shape().DebugString()));
+
+    // The float value of one unit of the int32 accumulators.
+    const double accumulator_scale =
+        static_cast<double>(FloatForOneQuantizedLevel<quint8>(min_a, max_a)) *
+        SymmetricFloatForOneQuantizedLevel(min_b, max_b);
+
+    Tensor scaled_bias;
+    OP_REQUIRES_OK(context, context->allocate_temp(DT_INT32, TensorShape({n}),
+                                                   &scaled_bias));
+    int32* scaled_bias_data = scaled_bias.flat<int32>().data();
+    const Tbias* bias_data = bias.flat<Tbias>().data();
+    for (int j = 0; j < n; ++j) {
+      scaled_bias_data[j] = ScaleBias(bias_data[j], accumulator_scale);
+    }
+
+    ruy_support::OutputStage output_stage;
+    output_stage.bias = scaled_bias_data;
+    float min_output_value;
+    float max_output_value;
+    if (std::is_same<Toutput, quint8>::value) {
+      // "min_freezed_output" and "max_freezed_output" are the requested range
+      // for the output.
+      min_output_value = context->input(7).flat<float>()(0);
+      max_output_value = context->input(8).flat<float>()(0);
+      OP_REQUIRES(context, (max_output_value > min_output_value),
+                  errors::InvalidArgument(
+                      "max_freezed_output must be larger than "
+                      "min_freezed_output."));
+      ruy_support::QuantizeMultiplier(
+          accumulator_scale / FloatForOneQuantizedLevel<quint8>(
+                                  min_output_value, max_output_value),
+          &output_stage.multiplier_fixedpoint,
+          &output_stage.multiplier_exponent);
+      output_stage.output_offset = FloatToQuantizedUnclamped<quint8>(
+          0.0f, min_output_value, max_output_value);
+      output_stage.clamp_min =
+          relu ? std::max(output_stage.output_offset, 0) : 0;
+      output_stage.clamp_max = 255;
+    } else {
+      min_output_value = accumulator_scale * kint32min;
+      max_output_value = accumulator_scale * kint32max;
+    }
+
+    Tensor* c = nullptr;
+    OP_REQUIRES_OK(context,
+                   context->allocate_output(0, TensorShape({m, n}), &c));
+    const quint8* a_data = a.flat<quint8>().data();
+    const qint8* b_data = b.flat<qint8>().data();
+    Toutput* c_data = c->flat<Toutput>().data();
+    const int lda = a.dim_size(1);
+    const int ldb = b.dim_size(1);
+    if (ruy_support::IsSupportedAndEnabled() &&
+        ruy_support::CanUseZeroPoints<quint8, qint8>(offset_a, offset_b) &&
+        output_stage.output_offset >= 0 && output_stage.output_offset <= 255) {
+      ruy_support::QuantizedGemm(context, transpose_a_, transpose_b_, a_data,
+                                 b_data, c_data, m, n, k, offset_a, offset_b,
+                                 lda, ldb, n, output_stage);
+    } else {
+      Tensor accumulators;
+      OP_REQUIRES_OK(context, context->allocate_temp(
+                                  DT_QINT32, TensorShape({m, n}),
+                                  &accumulators));
+      qint32* accumulator_data = accumulators.flat<qint32>().data();
+      ReferenceGemm<quint8, qint8, qint32>(
+          transpose_a_, transpose_b_, false, m, n, k, a_data, offset_a, lda,
+          b_data, offset_b, ldb, accumulator_data, 0, 0, 1, n);
+      ApplyOutputStage(output_stage, accumulator_data, m, n, c_data);
+    }
+
+    Tensor* c_min = nullptr;
+    OP_REQUIRES_OK(context, context->allocate_output(1, {}, &c_min));
+    c_min->flat<float>()(0) = min_output_value;
+    Tensor* c_max = nullptr;
+    OP_REQUIRES_OK(context, context->allocate_output(2, {}, &c_max));
+    c_max->flat<float>()(0) = max_output_value;
+  }
+
+ private:
+  static int32 ScaleBias(float bias, double accumulator_scale) {
+    const double scaled = std::round(bias / accumulator_scale);
+    return static_cast<int32>(
+        std::min<double>(std::max<double>(scaled, kint32min), kint32max));
+  }
+
+  static int32 ScaleBias(qint32 bias, double accumulator_scale) {
+    return bias.value;
+  }
+
+  bool transpose_a_;
+  bool transpose_b_;
+  bool scaled_input_;
+};
+
+#define REGISTER_QUANTIZED_MATMUL_WITH_BIAS(Tbias)                            \
+  REGISTER_KERNEL_BUILDER(Name("QuantizedMatMulWithBias")                     \
+                              .Device(DEVICE_CPU)                             \
+                              .TypeConstraint<quint8>("T1")                   \
+                              .TypeConstraint<qint8>("T2")                    \
+                              .TypeConstraint<Tbias>("Tbias")                 \
+                              .TypeConstraint<qint32>("Toutput"),             \
+                          QuantizedMatMulWithBiasOp<Tbias, qint32, false>);   \
+  REGISTER_KERNEL_BUILDER(Name("QuantizedMatMulWithBiasAndRequantize")        \
+                              .Device(DEVICE_CPU)                             \
+                              .TypeConstraint<quint8>("T1")                   \
+                              .TypeConstraint<qint8>("T2")                    \
+                              .TypeConstraint<Tbias>("Tbias")                 \
+                              .TypeConstraint<quint8>("Toutput"),             \
+                          QuantizedMatMulWithBiasOp<Tbias, quint8, false>);   \
+  REGISTER_KERNEL_BUILDER(Name("QuantizedMatMulWithBiasAndReluAndRequantize") \
+                              .Device(DEVICE_CPU)                             \
+                              .TypeConstraint<quint8>("T1")                   \
+                              .TypeConstraint<qint8>("T2")                    \
+                              .TypeConstraint<Tbias>("Tbias")                 \
+                              .TypeConstraint<quint8>("Toutput"),             \
+                          QuantizedMatMulWithBiasOp<Tbias, quint8, true>);
+
+REGISTER_QUANTIZED_MATMUL_WITH_BIAS(float);
+REGISTER_QUANTIZED_MATMUL_WITH_BIAS(qint32);
+#undef REGISTER_QUANTIZED_MATMUL_WITH_BIAS
+
+#endif  // INTEL_MKL
+
 }  // namespace tensorflow
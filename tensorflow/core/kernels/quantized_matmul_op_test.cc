@@ -355,4 +355,159 @@ TEST_F(QuantizedMatMulTest, Medium_WithParams) {
   test::ExpectTensorNear<float>(expected_float, output_float, 15.0);
 }
 
+// Builds with MKL replace the fused kernels, and have their own tests.
+#ifndef INTEL_MKL
+// Multiplies a quint8 matrix by a qint8 one, adding a float bias.
+TEST_F(QuantizedMatMulTest, WithBias) {
+  TF_ASSERT_OK(NodeDefBuilder("quantized_mat_mul_op", "QuantizedMatMulWithBias")
+                   .Input(FakeInput(DT_QUINT8))
+                   .Input(FakeInput(DT_QINT8))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Attr("Toutput", DataTypeToEnum<qint32>::v())
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  // The ranges are picked so that one quantized level is exactly 1.0 for both
+  // inputs, with zero at zero. A matrix is:
+  // |  1 |  2 |  3 |
+  // |  4 |  5 |  6 |
+  AddInputFromArray<quint8>(TensorShape({2, 3}), {1, 2, 3, 4, 5, 6});
+  // B matrix is:
+  // |  7 |  8 |  9 | 10 |
+  // | 11 | 12 | 13 | 14 |
+  // | 15 | 16 | 17 | 18 |
+  AddInputFromArray<qint8>(TensorShape({3, 4}),
+                           {7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18});
+  AddInputFromArray<float>(TensorShape({4}), {1.0f, -2.0f, 3.0f, -4.0f});
+  AddInputFromArray<float>(TensorShape({1}), {0});
+  AddInputFromArray<float>(TensorShape({1}), {255.0f});
+  AddInputFromArray<float>(TensorShape({1}), {-127.0f});
+  AddInputFromArray<float>(TensorShape({1}), {127.0f});
+  TF_ASSERT_OK(RunOpKernel());
+  // See Small_NoParams for the products, the bias is added to each row.
+  Tensor expected(allocator(), DT_QINT32, TensorShape({2, 4}));
+  test::FillValues<qint32>(&expected, {75, 78, 89, 88, 174, 186, 206, 214});
+  test::ExpectTensorEqual<qint32>(expected, *GetOutput(0));
+  EXPECT_NEAR(1.0f, GetOutput(2)->flat<float>()(0) / kint32max, 1e-6f);
+}
+
+// Same as above, with the result requantized to eight bits in [0, 510].
+TEST_F(QuantizedMatMulTest, WithBiasAndRequantize) {
+  TF_ASSERT_OK(NodeDefBuilder("quantized_mat_mul_op",
+                              "QuantizedMatMulWithBiasAndRequantize")
+                   .Input(FakeInput(DT_QUINT8))
+                   .Input(FakeInput(DT_QINT8))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Attr("Toutput", DataTypeToEnum<quint8>::v())
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  AddInputFromArray<quint8>(TensorShape({2, 3}), {1, 2, 3, 4, 5, 6});
+  AddInputFromArray<qint8>(TensorShape({3, 4}),
+                           {7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18});
+  AddInputFromArray<float>(TensorShape({4}), {1.0f, -2.0f, 3.0f, -4.0f});
+  AddInputFromArray<float>(TensorShape({1}), {0});
+  AddInputFromArray<float>(TensorShape({1}), {255.0f});
+  AddInputFromArray<float>(TensorShape({1}), {-127.0f});
+  AddInputFromArray<float>(TensorShape({1}), {127.0f});
+  AddInputFromArray<float>(TensorShape({1}), {0});
+  AddInputFromArray<float>(TensorShape({1}), {510.0f});
+  TF_ASSERT_OK(RunOpKernel());
+  EXPECT_EQ(0.0f, GetOutput(1)->flat<float>()(0));
+  EXPECT_EQ(510.0f, GetOutput(2)->flat<float>()(0));
+  // One output level is 2.0, and ties round up.
+  Tensor expected(allocator(), DT_QUINT8, TensorShape({2, 4}));
+  test::FillValues<quint8>(&expected, {38, 39, 45, 44, 87, 93, 103, 107});
+  test::ExpectTensorEqual<quint8>(expected, *GetOutput(0));
+}
+
+// The qint8 weights are symmetric, so zero is at 0 whatever their range is,
+// even for ranges like [-0.3, 0.3] where the asymmetric quint8-style mapping
+// would put it at -1.
+TEST_F(QuantizedMatMulTest, WithBiasSmallWeightRange) {
+  TF_ASSERT_OK(NodeDefBuilder("quantized_mat_mul_op", "QuantizedMatMulWithBias")
+                   .Input(FakeInput(DT_QUINT8))
+                   .Input(FakeInput(DT_QINT8))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Attr("Toutput", DataTypeToEnum<qint32>::v())
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  const float weight_level = 0.3f / 127.0f;
+  AddInputFromArray<quint8>(TensorShape({2, 3}), {1, 2, 3, 4, 5, 6});
+  AddInputFromArray<qint8>(TensorShape({3, 4}),
+                           {7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18});
+  AddInputFromArray<float>(TensorShape({4}), {1.0f, -2.0f, 3.0f, -4.0f});
+  AddInputFromArray<float>(TensorShape({1}), {0});
+  AddInputFromArray<float>(TensorShape({1}), {255.0f});
+  AddInputFromArray<float>(TensorShape({1}), {-0.3f});
+  AddInputFromArray<float>(TensorShape({1}), {0.3f});
+  TF_ASSERT_OK(RunOpKernel());
+  const float output_level = GetOutput(2)->flat<float>()(0) / kint32max;
+  EXPECT_NEAR(weight_level, output_level, 1e-6f * weight_level);
+  EXPECT_NEAR(-weight_level, GetOutput(1)->flat<float>()(0) / kint32max,
+              1e-6f * weight_level);
+  // The products in quantized levels, see Small_NoParams.
+  const std::vector<float> products = {74, 80, 86, 92, 173, 188, 203, 218};
+  const std::vector<float> bias = {1.0f, -2.0f, 3.0f, -4.0f};
+  const Tensor& output = *GetOutput(0);
+  for (int i = 0; i < output.NumElements(); ++i) {
+    // The bias is rounded to the nearest accumulator level.
+    EXPECT_NEAR(products[i] * weight_level + bias[i % 4],
+                output.flat<qint32>()(i).value * output_level, weight_level)
+        << "at " << i;
+  }
+}
+
+// Same with a [-1.7, 1.7] weight range, requantized to eight bits in [-8, 8].
+TEST_F(QuantizedMatMulTest, WithBiasAndRequantizeLargeWeightRange) {
+  TF_ASSERT_OK(NodeDefBuilder("quantized_mat_mul_op",
+                              "QuantizedMatMulWithBiasAndRequantize")
+                   .Input(FakeInput(DT_QUINT8))
+                   .Input(FakeInput(DT_QINT8))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_FLOAT))
+                   .Attr("Toutput", DataTypeToEnum<quint8>::v())
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  const float weight_level = 1.7f / 127.0f;
+  AddInputFromArray<quint8>(TensorShape({2, 3}), {1, 2, 3, 4, 5, 6});
+  AddInputFromArray<qint8>(TensorShape({3, 4}),
+                           {7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18});
+  AddInputFromArray<float>(TensorShape({4}), {1.0f, -2.0f, 3.0f, -4.0f});
+  AddInputFromArray<float>(TensorShape({1}), {0});
+  AddInputFromArray<float>(TensorShape({1}), {255.0f});
+  AddInputFromArray<float>(TensorShape({1}), {-1.7f});
+  AddInputFromArray<float>(TensorShape({1}), {1.7f});
+  AddInputFromArray<float>(TensorShape({1}), {-8.0f});
+  AddInputFromArray<float>(TensorShape({1}), {8.0f});
+  TF_ASSERT_OK(RunOpKernel());
+  const std::vector<float> products = {74, 80, 86, 92, 173, 188, 203, 218};
+  const std::vector<float> bias = {1.0f, -2.0f, 3.0f, -4.0f};
+  const Tensor& output = *GetOutput(0);
+  for (int i = 0; i < output.NumElements(); ++i) {
+    EXPECT_NEAR(products[i] * weight_level + bias[i % 4],
+                QuantizedToFloat<quint8>(output.flat<quint8>()(i), -8.0f, 8.0f),
+                16.0f / 255.0f)
+        << "at " << i;
+  }
+}
+#endif  // INTEL_MKL
+
 }  // namespace tensorflow
@@ -56,6 +56,142 @@ namespace functor {
 using random::PhiloxRandom;
 using random::SingleSampleAdapter;
 
+// Operations on packets of 32-bit unsigned integers that run the rounds of
+// Philox for several counters at once. With narrower packets, transposing the
+// counters and samples costs more than the rounds save.
+#if defined(EIGEN_VECTORIZE_AVX512)
+struct PhiloxPacket {
+  using Type = __m512i;
+  static constexpr int kSize = 16;
+  static Type Set1(uint32 x) { return _mm512_set1_epi32(x); }
+  static Type Load(const uint32* p) { return _mm512_load_si512(p); }
+  static void Store(uint32* p, Type x) { _mm512_store_si512(p, x); }
+  static Type Xor(Type a, Type b) { return _mm512_xor_si512(a, b); }
+  // Computes the low and high 32 bits of the 64-bit products of every element
+  // of `a` with `m`, whose elements must be all equal.
+  static void MultiplyHighLow(Type a, Type m, Type* lo, Type* hi) {
+    const Type low_mask = _mm512_set1_epi64(0xFFFFFFFF);
+    const Type even = _mm512_mul_epu32(a, m);
+    const Type odd = _mm512_mul_epu32(_mm512_srli_epi64(a, 32), m);
+    *lo = _mm512_or_si512(_mm512_and_si512(even, low_mask),
+                          _mm512_slli_epi64(odd, 32));
+    *hi = _mm512_or_si512(_mm512_srli_epi64(even, 32),
+                          _mm512_andnot_si512(low_mask, odd));
+  }
+};
+#elif defined(EIGEN_VECTORIZE_AVX2)
+struct PhiloxPacket {
+  using Type = __m256i;
+  static constexpr int kSize = 8;
+  static Type Set1(uint32 x) { return _mm256_set1_epi32(x); }
+  static Type Load(const uint32* p) {
+    return _mm256_load_si256(reinterpret_cast<const Type*>(p));
+  }
+  static void Store(uint32* p, Type x) {
+    _mm256_store_si256(reinterpret_cast<Type*>(p), x);
+  }
+  static Type Xor(Type a, Type b) { return _mm256_xor_si256(a, b); }
+  static void MultiplyHighLow(Type a, Type m, Type* lo, Type* hi) {
+    const Type low_mask = _mm256_set1_epi64x(0xFFFFFFFF);
+    const Type even = _mm256_mul_epu32(a, m);
+    const Type odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+    *lo = _mm256_or_si256(_mm256_and_si256(even, low_mask),
+                          _mm256_slli_epi64(odd, 32));
+    *hi = _mm256_or_si256(_mm256_srli_epi64(even, 32),
+                          _mm256_andnot_si256(low_mask, odd));
+  }
+};
+#endif
+
+// Whether GeneratePhiloxSamples runs packets of counters together. Without
+// packets, generating the samples in batches only adds a copy.
+#if defined(EIGEN_VECTORIZE_AVX512) || defined(EIGEN_VECTORIZE_AVX2)
+constexpr bool kHasPhiloxPackets = true;
+#else
+constexpr bool kHasPhiloxPackets = false;
+#endif
+
+// Generates the next `n` samples of `gen` into `samples`, and advances `gen`
+// past them. The samples are bit-identical to those returned by calling
+// `gen` `n` times, but packets of counters are run through the rounds of
+// Philox together when SIMD instructions are available.
+inline void GeneratePhiloxSamples(PhiloxRandom* gen,
+                                  PhiloxRandom::ResultType* samples, int n) {
+  int i = 0;
+#if defined(EIGEN_VECTORIZE_AVX512) || defined(EIGEN_VECTORIZE_AVX2)
+  using Packet = PhiloxPacket;
+  constexpr int kSize = Packet::kSize;
+  const Packet::Type multiplier_a = Packet::Set1(PhiloxRandom::kPhiloxM4x32A);
+  const Packet::Type multiplier_b = Packet::Set1(PhiloxRandom::kPhiloxM4x32B);
+  for (; i + kSize <= n; i += kSize) {
+    // Transpose the counters so that every packet holds one of their words.
+    EIGEN_ALIGN_MAX uint32 words[4][kSize];
+    for (int j = 0; j < kSize; ++j) {
+      for (int w = 0; w < 4; ++w) words[w][j] = gen->counter()[w];
+      gen->Skip(1);
+    }
+    Packet::Type c0 = Packet::Load(words[0]);
+    Packet::Type c1 = Packet::Load(words[1]);
+    Packet::Type c2 = Packet::Load(words[2]);
+    Packet::Type c3 = Packet::Load(words[3]);
+
+    PhiloxRandom::Key key = gen->key();
+    for (int round = 0; round < 10; ++round) {
+      Packet::Type lo0, hi0, lo1, hi1;
+      Packet::MultiplyHighLow(c0, multiplier_a, &lo0, &hi0);
+      Packet::MultiplyHighLow(c2, multiplier_b, &lo1, &hi1);
+      c0 = Packet::Xor(Packet::Xor(hi1, c1), Packet::Set1(key[0]));
+      c1 = lo1;
+      c2 = Packet::Xor(Packet::Xor(hi0, c3), Packet::Set1(key[1]));
+      c3 = lo0;
+      key[0] += PhiloxRandom::kPhiloxW32A;
+      key[1] += PhiloxRandom::kPhiloxW32B;
+    }
+
+    Packet::Store(words[0], c0);
+    Packet::Store(words[1], c1);
+    Packet::Store(words[2], c2);
+    Packet::Store(words[3], c3);
+    for (int j = 0; j < kSize; ++j) {
+      for (int w = 0; w < 4; ++w) samples[i + j][w] = words[w][j];
+    }
+  }
+#endif
+  for (; i < n; ++i) samples[i] = (*gen)();
+}
+
+// A generator that returns the same samples as the PhiloxRandom it is created
+// from, but generates them in batches with GeneratePhiloxSamples.
+class BatchedPhiloxRandom {
+ public:
+  using ResultType = PhiloxRandom::ResultType;
+  using ResultElementType = PhiloxRandom::ResultElementType;
+  static constexpr int kResultElementCount = PhiloxRandom::kResultElementCount;
+
+  // At most `num_samples` samples are generated ahead of their use.
+  BatchedPhiloxRandom(PhiloxRandom gen, int64 num_samples)
+      : gen_(gen), num_samples_(num_samples) {}
+
+  ResultType operator()() {
+    if (next_ == batch_size_) {
+      batch_size_ = std::max<int64>(1, std::min(kBatchSize, num_samples_));
+      num_samples_ -= batch_size_;
+      GeneratePhiloxSamples(&gen_, batch_, batch_size_);
+      next_ = 0;
+    }
+    return batch_[next_++];
+  }
+
+ private:
+  static constexpr int64 kBatchSize = 64;
+
+  PhiloxRandom gen_;
+  int64 num_samples_;
+  int next_ = 0;
+  int batch_size_ = 0;
+  ResultType batch_[kBatchSize];
+};
+
 // The default implementation of the functor, which should never be invoked
 // But we still need to provide implementation for now for the linker to work,
 // since we do not support all the distributions yet.
@@ -84,15 +220,29 @@ struct FillPhiloxRandomTask<Distribution, false> {
   typedef typename Distribution::ResultElementType T;
   static void Run(random::PhiloxRandom gen, T* data, int64 size,
                   int64 start_group, int64 limit_group, Distribution dist) {
-    const int kGroupSize = Distribution::kResultElementCount;
-
     gen.Skip(start_group);
+    if (kHasPhiloxPackets) {
+      // Every group takes exactly one sample of Philox, so that the samples
+      // of all groups can be generated in batches.
+      BatchedPhiloxRandom batched_gen(gen, limit_group - start_group);
+      FillGroups(&batched_gen, data, size, start_group, limit_group, dist);
+    } else {
+      FillGroups(&gen, data, size, start_group, limit_group, dist);
+    }
+  }
+
+ private:
+  template <class Generator>
+  static void FillGroups(Generator* gen, T* data, int64 size,
+                         int64 start_group, int64 limit_group,
+                         Distribution dist) {
+    const int kGroupSize = Distribution::kResultElementCount;
     int64 offset = start_group * kGroupSize;
 
     // First fill all the full-size groups
     int64 limit_group_full = std::min(limit_group, size / kGroupSize);
     for (int64 index = start_group; index < limit_group_full; ++index) {
-      auto samples = dist(&gen);
+      auto samples = dist(gen);
       std::copy(&samples[0], &samples[0] + kGroupSize, data + offset);
       offset += kGroupSize;
     }
@@ -100,7 +250,7 @@ struct FillPhiloxRandomTask<Distribution, false> {
     // If there are any remaining elements that need to be filled, process them
     if (limit_group_full < limit_group) {
       int64 remaining_size = size - limit_group_full * kGroupSize;
-      auto samples = dist(&gen);
+      auto samples = dist(gen);
       std::copy(&samples[0], &samples[0] + remaining_size, data + offset);
     }
   }
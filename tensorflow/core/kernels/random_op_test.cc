@@ -17,6 +17,7 @@ limitations under the License.
 
 #include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
 #include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/kernels/random_op_cpu.h"
 #include "tensorflow/core/lib/math/math_util.h"
 #include "tensorflow/core/lib/random/philox_random.h"
 #include "tensorflow/core/platform/test.h"
@@ -117,6 +118,44 @@ void BM_PhiloxRandom(int iters) {
 }
 BENCHMARK(BM_PhiloxRandom);
 
+TEST(BatchedPhiloxRandomTest, MatchesPhiloxRandom) {
+  for (int64 num_samples : {1, 7, 16, 63, 64, 65, 1000}) {
+    random::PhiloxRandom gen(0x12345, 0x6789);
+    // Start close to a carry into the upper words of the counter.
+    gen.Skip(0xFFFFFFFFull - 10);
+    functor::BatchedPhiloxRandom batched_gen(gen, num_samples);
+    for (int64 i = 0; i < num_samples; ++i) {
+      const auto expected = gen();
+      const auto actual = batched_gen();
+      for (int j = 0; j < random::PhiloxRandom::kResultElementCount; ++j) {
+        ASSERT_EQ(expected[j], actual[j]) << num_samples << " " << i;
+      }
+    }
+  }
+}
+
+void BM_BatchedPhiloxRandom(int iters) {
+  // Fill 2M random numbers
+  int count = 2 << 20;
+
+  testing::ItemsProcessed(static_cast<int64>(iters) * count);
+
+  random::PhiloxRandom gen(0x12345);
+
+  int val = 1;
+  for (int i = 0; i < iters; ++i) {
+    functor::BatchedPhiloxRandom batched_gen(gen, count / 4);
+    for (int j = 0; j < count; j += 4) {
+      auto samples = batched_gen();
+      val ^= samples[0] ^ samples[1] ^ samples[2] ^ samples[3];
+    }
+    gen.Skip(count / 4);
+  }
+
+  CHECK(val) << val;
+}
+BENCHMARK(BM_BatchedPhiloxRandom);
+
 void BM_StdMTRandom(int iters) {
   // Fill 2M random numbers
   int count = 2 << 20;
@@ -0,0 +1,360 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Single pass mean and variance over arbitrary reduction axes. The Grappler
+// remapper replaces Mean + SquaredDifference + Mean chains (tf.nn.moments,
+// layer and batch normalization) with a _FusedMoments node.
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "tensorflow/core/kernels/reduction_ops_common.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+namespace tensorflow {
+
+namespace {
+
+// Type used to accumulate moments of T.
+template <typename T>
+struct MomentsAccumulator {
+  typedef float type;
+};
+
+template <>
+struct MomentsAccumulator<double> {
+  typedef double type;
+};
+
+// Number of contiguous elements summarized at once. A block stays in L1 cache
+// between the two passes that compute its mean and its sum of squared
+// deviations, so every input element is read from memory exactly once.
+constexpr int64 kMomentsBlockSize = 2048;
+
+// Tile of a reduction along the leading (non-contiguous) axis.
+constexpr int64 kMomentsTileRows = 32;
+constexpr int64 kMomentsTileCols = 256;
+
+// Minimum number of input elements reduced by a single shard.
+constexpr int64 kMomentsMinShardSize = 16 * 1024;
+
+// Number of elements, their mean and the sum of squared deviations from the
+// mean. Partial results are combined with the pairwise update of Chan et al.,
+// which unlike E[x^2] - E[x]^2 does not lose precision to cancellation.
+template <typename Acc>
+struct Moments {
+  int64 count = 0;
+  Acc mean = Acc(0);
+  Acc m2 = Acc(0);
+
+  void Merge(int64 other_count, Acc other_mean, Acc other_m2) {
+    if (other_count == 0) return;
+    const int64 total = count + other_count;
+    const Acc weight = static_cast<Acc>(other_count) / total;
+    const Acc delta = other_mean - mean;
+    mean += delta * weight;
+    m2 += other_m2 + delta * delta * (count * weight);
+    count = total;
+  }
+
+  void Merge(const Moments& other) { Merge(other.count, other.mean, other.m2); }
+};
+
+template <typename Acc>
+using AccVec = Eigen::Array<Acc, Eigen::Dynamic, 1>;
+
+// Returns a pointer to `n` elements of `x` as the accumulation type, converting
+// them into `buffer` if necessary.
+template <typename Acc>
+const Acc* LoadBlock(const Acc* x, int64 n, Acc* buffer) {
+  return x;
+}
+
+template <typename T, typename Acc>
+const Acc* LoadBlock(const T* x, int64 n, Acc* buffer) {
+  Eigen::Map<AccVec<Acc>>(buffer, n) =
+      Eigen::Map<const Eigen::Array<T, Eigen::Dynamic, 1>>(x, n)
+          .template cast<Acc>();
+  return buffer;
+}
+
+// Accumulates the moments of `n` contiguous elements into `moments`.
+template <typename T, typename Acc>
+void AccumulateContiguous(const T* x, int64 n, Acc* buffer,
+                          Moments<Acc>* moments) {
+  for (int64 i = 0; i < n; i += kMomentsBlockSize) {
+    const int64 size = std::min(kMomentsBlockSize, n - i);
+    Eigen::Map<const AccVec<Acc>> block(LoadBlock(x + i, size, buffer), size);
+    const Acc mean = block.sum() / size;
+    const Acc m2 = (block - mean).square().sum();
+    moments->Merge(size, mean, m2);
+  }
+}
+
+// Accumulates the per-column moments of a `rows` x `cols` tile with row stride
+// `stride` into `mean` and `m2`, which hold the moments of `*count` rows.
+template <typename T, typename Acc>
+void AccumulateColumns(const T* x, int64 rows, int64 cols, int64 stride,
+                       Acc* buffer, int64* count, Acc* mean, Acc* m2) {
+  Eigen::Map<AccVec<Acc>> running_mean(mean, cols);
+  Eigen::Map<AccVec<Acc>> running_m2(m2, cols);
+  AccVec<Acc> block_mean(cols);
+  AccVec<Acc> block_m2(cols);
+  const Acc* row_data[kMomentsTileRows];
+
+  for (int64 r0 = 0; r0 < rows; r0 += kMomentsTileRows) {
+    const int64 num_rows = std::min(kMomentsTileRows, rows - r0);
+    for (int64 r = 0; r < num_rows; ++r) {
+      row_data[r] =
+          LoadBlock(x + (r0 + r) * stride, cols, buffer + r * kMomentsTileCols);
+    }
+
+    block_mean.setZero();
+    for (int64 r = 0; r < num_rows; ++r) {
+      block_mean += Eigen::Map<const AccVec<Acc>>(row_data[r], cols);
+    }
+    block_mean /= static_cast<Acc>(num_rows);
+
+    block_m2.setZero();
+    for (int64 r = 0; r < num_rows; ++r) {
+      block_m2 +=
+          (Eigen::Map<const AccVec<Acc>>(row_data[r], cols) - block_mean)
+              .square();
+    }
+
+    const int64 total = *count + num_rows;
+    const Acc weight = static_cast<Acc>(num_rows) / total;
+    const AccVec<Acc> delta = block_mean - running_mean;
+    running_mean += delta * weight;
+    running_m2 += block_m2 + delta.square() * (*count * weight);
+    *count = total;
+  }
+}
+
+// Splits the reduction of each output into chunks so that there is enough
+// work to keep all threads busy when the number of outputs is small.
+int64 NumChunksPerOutput(int64 num_outputs, int64 reduced_size,
+                         int num_threads) {
+  const int64 max_chunks = Eigen::divup(reduced_size, kMomentsMinShardSize);
+  const int64 wanted_chunks =
+      Eigen::divup(static_cast<int64>(4 * num_threads), num_outputs);
+  return std::max<int64>(1, std::min(max_chunks, wanted_chunks));
+}
+
+}  // namespace
+
+// Computes the mean and the (biased) variance of `x` over `reduction_indices`
+// in a single pass over the input.
+template <typename T>
+class FusedMomentsOp : public OpKernel {
+ public:
+  typedef typename MomentsAccumulator<T>::type Acc;
+
+  explicit FusedMomentsOp(OpKernelConstruction* context) : OpKernel(context) {
+    OP_REQUIRES_OK(context, context->GetAttr("keep_dims", &keep_dims_));
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& data = context->input(0);
+    const Tensor& axes = context->input(1);
+
+    ReductionHelper helper;
+    OP_REQUIRES_OK(context, helper.Simplify(data, axes, keep_dims_));
+
+    Tensor* mean = nullptr;
+    Tensor* variance = nullptr;
+    OP_REQUIRES_OK(context,
+                   context->allocate_output(0, helper.out_shape(), &mean));
+    OP_REQUIRES_OK(context,
+                   context->allocate_output(1, helper.out_shape(), &variance));
+    if (mean->NumElements() == 0) return;
+
+    auto mean_flat = mean->flat<T>();
+    auto variance_flat = variance->flat<T>();
+
+    if (data.NumElements() == 0) {
+      // Mean of an empty set, same as Mean and SquaredDifference would give.
+      const T nan(std::numeric_limits<Acc>::quiet_NaN());
+      mean_flat.setConstant(nan);
+      variance_flat.setConstant(nan);
+      return;
+    }
+
+    const int ndims = helper.ndims();
+    if (ndims == 0 || (ndims == 1 && !helper.reduce_first_axis())) {
+      // Every output is the moments of a single element.
+      mean_flat = data.flat<T>();
+      variance_flat.setZero();
+      return;
+    }
+
+    const auto shape = helper.data_reshape();
+    const T* x = data.flat<T>().data();
+    if (ndims == 1) {
+      ReduceContiguous(context, x, 1, 1, shape.dim_size(0), mean, variance);
+    } else if (ndims == 2 && helper.reduce_first_axis()) {
+      ReduceColumns(context, x, 1, shape.dim_size(0), shape.dim_size(1), mean,
+                    variance);
+    } else if (ndims == 2) {
+      ReduceContiguous(context, x, 1, shape.dim_size(0), shape.dim_size(1),
+                       mean, variance);
+    } else if (ndims == 3 && helper.reduce_first_axis()) {
+      ReduceContiguous(context, x, shape.dim_size(0), shape.dim_size(1),
+                       shape.dim_size(2), mean, variance);
+    } else if (ndims == 3) {
+      ReduceColumns(context, x, shape.dim_size(0), shape.dim_size(1),
+                    shape.dim_size(2), mean, variance);
+    } else {
+      // Transpose the data so that all reduced dimensions are last.
+      Tensor data_reshaped;
+      OP_REQUIRES(context, data_reshaped.CopyFrom(data, shape),
+                  errors::Internal("Error during reduction copy."));
+      Tensor shuffled;
+      OP_REQUIRES_OK(context, context->allocate_temp(DataTypeToEnum<T>::value,
+                                                     helper.shuffled_shape(),
+                                                     &shuffled));
+      OP_REQUIRES_OK(context, DoTranspose(context->eigen_device<CPUDevice>(),
+                                          data_reshaped, helper.permutation(),
+                                          &shuffled));
+      const int64 unreduced = mean->NumElements();
+      ReduceContiguous(context, shuffled.flat<T>().data(), 1, unreduced,
+                       shuffled.NumElements() / unreduced, mean, variance);
+    }
+  }
+
+ private:
+  // Reduces `x` viewed as [outer, num_outputs, inner] over the outer and inner
+  // dimensions. The inner dimension is contiguous in memory.
+  void ReduceContiguous(OpKernelContext* context, const T* x, int64 outer,
+                        int64 num_outputs, int64 inner, Tensor* mean,
+                        Tensor* variance) {
+    auto worker_threads =
+        *(context->device()->tensorflow_cpu_worker_threads());
+    const int64 reduced_size = outer * inner;
+    const int64 num_chunks = NumChunksPerOutput(num_outputs, reduced_size,
+                                                worker_threads.num_threads);
+
+    std::vector<Moments<Acc>> partials(num_outputs * num_chunks);
+    auto reduce_chunks = [&](int64 begin, int64 end) {
+      Acc buffer[kMomentsBlockSize];
+      for (int64 unit = begin; unit < end; ++unit) {
+        const int64 output = unit / num_chunks;
+        const int64 chunk = unit % num_chunks;
+        const int64 start = reduced_size * chunk / num_chunks;
+        const int64 limit = reduced_size * (chunk + 1) / num_chunks;
+        Moments<Acc>* moments = &partials[unit];
+        for (int64 i = start; i < limit;) {
+          const int64 o = i / inner;
+          const int64 j = i % inner;
+          const int64 size = std::min(limit - i, inner - j);
+          AccumulateContiguous(x + (o * num_outputs + output) * inner + j,
+                               size, buffer, moments);
+          i += size;
+        }
+      }
+    };
+    const int64 cost_per_unit = 4 * reduced_size / num_chunks;
+    Shard(worker_threads.num_threads, worker_threads.workers,
+          num_outputs * num_chunks, cost_per_unit, reduce_chunks);
+
+    auto mean_flat = mean->flat<T>();
+    auto variance_flat = variance->flat<T>();
+    for (int64 output = 0; output < num_outputs; ++output) {
+      Moments<Acc> moments = partials[output * num_chunks];
+      for (int64 chunk = 1; chunk < num_chunks; ++chunk) {
+        moments.Merge(partials[output * num_chunks + chunk]);
+      }
+      mean_flat(output) = static_cast<T>(moments.mean);
+      variance_flat(output) = static_cast<T>(moments.m2 / moments.count);
+    }
+  }
+
+  // Reduces `x` viewed as [outer, rows, cols] over the rows dimension. Each
+  // shard accumulates a tile of columns at once, so the inner loops run over
+  // contiguous memory.
+  void ReduceColumns(OpKernelContext* context, const T* x, int64 outer,
+                     int64 rows, int64 cols, Tensor* mean, Tensor* variance) {
+    auto worker_threads =
+        *(context->device()->tensorflow_cpu_worker_threads());
+    const int64 num_tiles = Eigen::divup(cols, kMomentsTileCols);
+    const int64 num_chunks = NumChunksPerOutput(
+        outer * num_tiles, rows * std::min(cols, kMomentsTileCols),
+        worker_threads.num_threads);
+
+    // Partial moments, indexed by [outer, chunk, cols].
+    std::vector<Acc> partial_mean(outer * num_chunks * cols, Acc(0));
+    std::vector<Acc> partial_m2(outer * num_chunks * cols, Acc(0));
+    auto reduce_tiles = [&](int64 begin, int64 end) {
+      std::vector<Acc> buffer(kMomentsTileRows * kMomentsTileCols);
+      for (int64 unit = begin; unit < end; ++unit) {
+        const int64 tile = unit % num_tiles;
+        const int64 chunk = (unit / num_tiles) % num_chunks;
+        const int64 o = unit / (num_tiles * num_chunks);
+        const int64 start = rows * chunk / num_chunks;
+        const int64 limit = rows * (chunk + 1) / num_chunks;
+        const int64 c0 = tile * kMomentsTileCols;
+        const int64 offset = (o * num_chunks + chunk) * cols + c0;
+        int64 count = 0;
+        AccumulateColumns(x + (o * rows + start) * cols + c0, limit - start,
+                          std::min(kMomentsTileCols, cols - c0), cols,
+                          buffer.data(), &count, &partial_mean[offset],
+                          &partial_m2[offset]);
+      }
+    };
+    const int64 cost_per_unit =
+        4 * kMomentsTileCols * Eigen::divup(rows, num_chunks);
+    Shard(worker_threads.num_threads, worker_threads.workers,
+          outer * num_chunks * num_tiles, cost_per_unit, reduce_tiles);
+
+    auto mean_flat = mean->flat<T>();
+    auto variance_flat = variance->flat<T>();
+    for (int64 o = 0; o < outer; ++o) {
+      for (int64 c = 0; c < cols; ++c) {
+        Moments<Acc> moments;
+        for (int64 chunk = 0; chunk < num_chunks; ++chunk) {
+          const int64 index = (o * num_chunks + chunk) * cols + c;
+          const int64 chunk_rows =
+              rows * (chunk + 1) / num_chunks - rows * chunk / num_chunks;
+          moments.Merge(chunk_rows, partial_mean[index], partial_m2[index]);
+        }
+        mean_flat(o * cols + c) = static_cast<T>(moments.mean);
+        variance_flat(o * cols + c) =
+            static_cast<T>(moments.m2 / moments.count);
+      }
+    }
+  }
+
+  bool keep_dims_;
+};
+
+#define REGISTER_CPU_KERNELS(type)                              \
+  REGISTER_KERNEL_BUILDER(Name("_FusedMoments")                \
+                              .Device(DEVICE_CPU)              \
+                              .TypeConstraint<type>("T")       \
+                              .TypeConstraint<int32>("Tidx"),  \
+                          FusedMomentsOp<type>);               \
+  REGISTER_KERNEL_BUILDER(Name("_FusedMoments")                \
+                              .Device(DEVICE_CPU)              \
+                              .TypeConstraint<type>("T")       \
+                              .TypeConstraint<int64>("Tidx"),  \
+                          FusedMomentsOp<type>);
+TF_CALL_half(REGISTER_CPU_KERNELS);
+TF_CALL_bfloat16(REGISTER_CPU_KERNELS);
+TF_CALL_float(REGISTER_CPU_KERNELS);
+TF_CALL_double(REGISTER_CPU_KERNELS);
+#undef REGISTER_CPU_KERNELS
+
+}  // namespace tensorflow
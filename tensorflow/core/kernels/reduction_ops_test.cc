@@ -13,9 +13,19 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include <cmath>
+#include <vector>
+
 #include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
 #include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/kernels/ops_util.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/platform/test_benchmark.h"
 
@@ -189,4 +199,206 @@ static void BM_Bool2DToScalarGPU(int iters, int num_x, int num_y) {
 }
 BENCHMARK(BM_Bool2DToScalarGPU)->RangePair(2048, 8192, 2048, 8192);
 
+class FusedMomentsOpTest : public OpsTestBase {
+ protected:
+  // Runs _FusedMoments on `x` and compares the result with the mean and
+  // variance computed in double precision.
+  void RunAndCheck(const Tensor& x, const std::vector<int32>& axes,
+                   bool keep_dims, float tolerance) {
+    TF_ASSERT_OK(NodeDefBuilder("moments", "_FusedMoments")
+                     .Input(FakeInput(DT_FLOAT))
+                     .Input(FakeInput(DT_INT32))
+                     .Attr("keep_dims", keep_dims)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+    AddInputFromArray<float>(
+        x.shape(), gtl::ArraySlice<float>(x.flat<float>().data(),
+                                          x.NumElements()));
+    AddInputFromArray<int32>(TensorShape({static_cast<int64>(axes.size())}),
+                             axes);
+    TF_ASSERT_OK(RunOpKernel());
+
+    // Output shape and the input stride of each output dimension.
+    std::vector<bool> reduced(x.dims(), false);
+    for (int32 axis : axes) reduced[(axis + x.dims()) % x.dims()] = true;
+    TensorShape out_shape;
+    TensorShape kept_shape;
+    for (int d = 0; d < x.dims(); ++d) {
+      if (!reduced[d]) {
+        out_shape.AddDim(x.dim_size(d));
+        kept_shape.AddDim(x.dim_size(d));
+      } else if (keep_dims) {
+        out_shape.AddDim(1);
+      }
+    }
+    const auto strides = ComputeStride<int64>(x.shape());
+    const int64 num_outputs = kept_shape.num_elements();
+    std::vector<double> sum(num_outputs, 0.0);
+    std::vector<double> sum_sq(num_outputs, 0.0);
+    std::vector<int64> count(num_outputs, 0);
+    std::vector<int64> output_index(x.NumElements());
+    const auto x_flat = x.flat<float>();
+    for (int64 i = 0; i < x.NumElements(); ++i) {
+      int64 o = 0;
+      for (int d = 0; d < x.dims(); ++d) {
+        if (reduced[d]) continue;
+        o = o * x.dim_size(d) + (i / strides[d]) % x.dim_size(d);
+      }
+      output_index[i] = o;
+      sum[o] += x_flat(i);
+      count[o] += 1;
+    }
+    for (int64 i = 0; i < x.NumElements(); ++i) {
+      const int64 o = output_index[i];
+      const double delta = x_flat(i) - sum[o] / count[o];
+      sum_sq[o] += delta * delta;
+    }
+
+    Tensor expected_mean(DT_FLOAT, out_shape);
+    Tensor expected_variance(DT_FLOAT, out_shape);
+    for (int64 o = 0; o < num_outputs; ++o) {
+      expected_mean.flat<float>()(o) = sum[o] / count[o];
+      expected_variance.flat<float>()(o) = sum_sq[o] / count[o];
+    }
+    test::ExpectTensorNear<float>(expected_mean, *GetOutput(0), tolerance);
+    test::ExpectTensorNear<float>(expected_variance, *GetOutput(1), tolerance);
+  }
+
+  static Tensor RandomTensor(const TensorShape& shape, float offset) {
+    Tensor x(DT_FLOAT, shape);
+    x.flat<float>().setRandom();
+    x.flat<float>() += x.flat<float>().constant(offset);
+    return x;
+  }
+};
+
+TEST_F(FusedMomentsOpTest, InnerAxis) {
+  RunAndCheck(RandomTensor(TensorShape({16, 768}), 0.0f), {1},
+              /*keep_dims=*/true, 1e-5);
+}
+
+TEST_F(FusedMomentsOpTest, LeadingAxes) {
+  // Batch normalization statistics in NHWC.
+  RunAndCheck(RandomTensor(TensorShape({4, 7, 9, 300}), 0.0f), {0, 1, 2},
+              /*keep_dims=*/false, 1e-5);
+}
+
+TEST_F(FusedMomentsOpTest, OuterAndInnerAxes) {
+  // Batch normalization statistics in NCHW.
+  RunAndCheck(RandomTensor(TensorShape({4, 6, 9, 11}), 0.0f), {0, 2, 3},
+              /*keep_dims=*/true, 1e-5);
+}
+
+TEST_F(FusedMomentsOpTest, MiddleAxis) {
+  RunAndCheck(RandomTensor(TensorShape({3, 500, 20}), 0.0f), {1},
+              /*keep_dims=*/false, 1e-5);
+}
+
+TEST_F(FusedMomentsOpTest, InterleavedAxes) {
+  RunAndCheck(RandomTensor(TensorShape({3, 4, 5, 6, 7}), 0.0f), {0, 2, -1},
+              /*keep_dims=*/false, 1e-5);
+}
+
+TEST_F(FusedMomentsOpTest, AllAxes) {
+  RunAndCheck(RandomTensor(TensorShape({300, 1000}), 0.0f), {0, 1},
+              /*keep_dims=*/false, 1e-5);
+}
+
+TEST_F(FusedMomentsOpTest, NoAxes) {
+  RunAndCheck(RandomTensor(TensorShape({5, 3}), 0.0f), {},
+              /*keep_dims=*/false, 1e-6);
+}
+
+TEST_F(FusedMomentsOpTest, LargeMean) {
+  // E[x^2] - E[x]^2 would lose all precision here.
+  RunAndCheck(RandomTensor(TensorShape({8, 100000}), 1e4f), {1},
+              /*keep_dims=*/false, 1e-2);
+  inputs_.clear();
+  RunAndCheck(RandomTensor(TensorShape({100000, 8}), 1e4f), {0},
+              /*keep_dims=*/false, 1e-2);
+}
+
+TEST_F(FusedMomentsOpTest, EmptyReduction) {
+  TF_ASSERT_OK(NodeDefBuilder("moments", "_FusedMoments")
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_INT32))
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  AddInputFromArray<float>(TensorShape({0, 2}), {});
+  AddInputFromArray<int32>(TensorShape({1}), {0});
+  TF_ASSERT_OK(RunOpKernel());
+  ASSERT_EQ(GetOutput(0)->shape(), TensorShape({2}));
+  EXPECT_TRUE(std::isnan(GetOutput(0)->flat<float>()(0)));
+  EXPECT_TRUE(std::isnan(GetOutput(1)->flat<float>()(1)));
+}
+
+TEST_F(FusedMomentsOpTest, InvalidAxis) {
+  TF_ASSERT_OK(NodeDefBuilder("moments", "_FusedMoments")
+                   .Input(FakeInput(DT_FLOAT))
+                   .Input(FakeInput(DT_INT32))
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  AddInputFromArray<float>(TensorShape({2, 2}), {1, 2, 3, 4});
+  AddInputFromArray<int32>(TensorShape({1}), {2});
+  EXPECT_TRUE(errors::IsInvalidArgument(RunOpKernel()));
+}
+
+// Mean and variance of a [num_x, num_y] matrix along `axis`, either with a
+// _FusedMoments node or with the Mean + SquaredDifference + Mean graph that
+// tf.nn.moments builds.
+static Graph* Moments(bool fused, int num_x, int num_y, int axis) {
+  auto* g = new Graph(OpRegistry::Global());
+  Tensor data(DT_FLOAT, TensorShape({num_x, num_y}));
+  data.flat<float>().setRandom();
+  Tensor axes(DT_INT32, TensorShape({1}));
+  axes.flat<int32>()(0) = axis;
+  Node* x = test::graph::Constant(g, data);
+  Node* reduction_indices = test::graph::Constant(g, axes);
+  if (fused) {
+    Node* ret;
+    TF_CHECK_OK(NodeBuilder(g->NewName("n"), "_FusedMoments")
+                    .Input(x)
+                    .Input(reduction_indices)
+                    .Attr("keep_dims", true)
+                    .Finalize(g, &ret));
+  } else {
+    Node* mean = test::graph::Reduce(g, "Mean", x, reduction_indices,
+                                     /*keep_dims=*/true);
+    Node* sq_diff = test::graph::Binary(g, "SquaredDifference", x, mean);
+    test::graph::Reduce(g, "Mean", sq_diff, reduction_indices,
+                        /*keep_dims=*/true);
+  }
+  return g;
+}
+
+static void DoMoments(int iters, bool fused, int num_x, int num_y, int axis) {
+  testing::ItemsProcessed(static_cast<int64>(iters) * num_x * num_y);
+  testing::BytesProcessed(static_cast<int64>(iters) * num_x * num_y *
+                          sizeof(float));
+  testing::UseRealTime();
+  test::Benchmark("cpu", Moments(fused, num_x, num_y, axis)).Run(iters);
+}
+
+static void BM_MomentsRowReduceCPU(int iters, int num_x, int num_y) {
+  DoMoments(iters, /*fused=*/false, num_x, num_y, 1);
+}
+BENCHMARK(BM_MomentsRowReduceCPU)->ArgPair(4096, 768)->ArgPair(64, 65536);
+
+static void BM_FusedMomentsRowReduceCPU(int iters, int num_x, int num_y) {
+  DoMoments(iters, /*fused=*/true, num_x, num_y, 1);
+}
+BENCHMARK(BM_FusedMomentsRowReduceCPU)->ArgPair(4096, 768)->ArgPair(64, 65536);
+
+static void BM_MomentsColumnReduceCPU(int iters, int num_x, int num_y) {
+  DoMoments(iters, /*fused=*/false, num_x, num_y, 0);
+}
+BENCHMARK(BM_MomentsColumnReduceCPU)->ArgPair(25088, 64)->ArgPair(784, 512);
+
+static void BM_FusedMomentsColumnReduceCPU(int iters, int num_x, int num_y) {
+  DoMoments(iters, /*fused=*/true, num_x, num_y, 0);
+}
+BENCHMARK(BM_FusedMomentsColumnReduceCPU)
+    ->ArgPair(25088, 64)
+    ->ArgPair(784, 512);
+
 }  // end namespace tensorflow
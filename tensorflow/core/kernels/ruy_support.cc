@@ -0,0 +1,221 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#define EIGEN_USE_THREADS
+
+#include "tensorflow/core/kernels/ruy_support.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/util/work_sharder.h"
+
+#if !defined(IS_MOBILE_PLATFORM) && !defined(TENSORFLOW_DISABLE_RUY)
+#define TENSORFLOW_USE_RUY (1)
+#endif
+
+#ifdef TENSORFLOW_USE_RUY
+#include "ruy/context.h"  // from @ruy
+#include "ruy/matrix.h"  // from @ruy
+#include "ruy/mul_params.h"  // from @ruy
+#include "ruy/ruy.h"  // from @ruy
+#endif
+
+namespace tensorflow {
+namespace ruy_support {
+
+namespace {
+
+bool g_enabled = true;
+
+#ifdef TENSORFLOW_USE_RUY
+
+// A ruy::Context is not thread safe, and it holds the packing buffers that
+// are reused from one multiplication to the next, so every thread keeps its
+// own. The work is sharded over the intra-op thread pool by the caller, which
+// leaves each context with ruy's default of a single thread.
+ruy::Context* GetThreadLocalContext() {
+  static thread_local ruy::Context context;
+  return &context;
+}
+
+void SetOutputStage(const OutputStage& output_stage,
+                    ruy::MulParams<std::int32_t, std::int32_t>* mul_params) {
+  mul_params->set_bias(output_stage.bias);
+}
+
+template <typename DstScalar>
+void SetOutputStage(const OutputStage& output_stage,
+                    ruy::MulParams<std::int32_t, DstScalar>* mul_params) {
+  mul_params->set_bias(output_stage.bias);
+  if (output_stage.multiplier_fixedpoint_perchannel != nullptr) {
+    mul_params->set_multiplier_fixedpoint_perchannel(
+        output_stage.multiplier_fixedpoint_perchannel);
+    mul_params->set_multiplier_exponent_perchannel(
+        output_stage.multiplier_exponent_perchannel);
+  } else {
+    mul_params->set_multiplier_fixedpoint(output_stage.multiplier_fixedpoint);
+    mul_params->set_multiplier_exponent(output_stage.multiplier_exponent);
+  }
+  const int32 lowest = std::numeric_limits<DstScalar>::lowest();
+  const int32 highest = std::numeric_limits<DstScalar>::max();
+  mul_params->set_clamp_min(static_cast<DstScalar>(
+      std::min(std::max(output_stage.clamp_min, lowest), highest)));
+  mul_params->set_clamp_max(static_cast<DstScalar>(
+      std::min(std::max(output_stage.clamp_max, lowest), highest)));
+}
+
+template <typename Scalar, typename DataPointer>
+void MakeMatrix(int rows, int cols, bool row_major, int stride,
+                DataPointer data, int zero_point, ruy::Matrix<Scalar>* matrix) {
+  ruy::MakeSimpleLayout(
+      rows, cols, row_major ? ruy::Order::kRowMajor : ruy::Order::kColMajor,
+      matrix->mutable_layout());
+  matrix->mutable_layout()->set_stride(stride);
+  matrix->set_data(data);
+  matrix->set_zero_point(static_cast<Scalar>(zero_point));
+}
+
+template <typename LhsScalar, typename RhsScalar, typename DstScalar>
+void QuantizedGemmImpl(OpKernelContext* context, bool transpose_a,
+                       bool transpose_b, const LhsScalar* a_data,
+                       const RhsScalar* b_data, DstScalar* c_data, int m, int n,
+                       int k, int offset_a, int offset_b, int lda, int ldb,
+                       int ldc, const OutputStage& output_stage) {
+  DCHECK((CanUseZeroPoints<LhsScalar, RhsScalar>(offset_a, offset_b)));
+  // Ruy applies the bias and the per-channel multipliers along the rows of its
+  // destination, while ours go along the columns of c. So this computes the
+  // transposed product c' = b' * a', which is only a matter of describing the
+  // same buffers differently: a row major matrix is a column major view of its
+  // transpose.
+  ruy::Matrix<RhsScalar> lhs;
+  MakeMatrix(n, k, transpose_b, ldb, b_data, offset_b, &lhs);
+  ruy::MulParams<std::int32_t, DstScalar> mul_params;
+  SetOutputStage(output_stage, &mul_params);
+  const int dst_offset =
+      std::is_same<DstScalar, std::int32_t>::value ? 0
+                                                   : output_stage.output_offset;
+
+  // Each shard multiplies a block of rows of a, which is a block of columns
+  // of the transposed operands.
+  auto work = [&](int64 start, int64 limit) {
+    const int rows = static_cast<int>(limit - start);
+    ruy::Matrix<LhsScalar> rhs;
+    MakeMatrix(k, rows, transpose_a, lda,
+               transpose_a ? a_data + start : a_data + start * lda, offset_a,
+               &rhs);
+    ruy::Matrix<DstScalar> dst;
+    MakeMatrix(n, rows, /*row_major=*/false, ldc, c_data + start * ldc,
+               dst_offset, &dst);
+    ruy::Mul(lhs, rhs, mul_params, GetThreadLocalContext(), &dst);
+  };
+  const DeviceBase::CpuWorkerThreads& worker_threads =
+      *(context->device()->tensorflow_cpu_worker_threads());
+  Shard(worker_threads.num_threads, worker_threads.workers, m,
+        static_cast<int64>(n) * k, work);
+}
+
+#endif  // TENSORFLOW_USE_RUY
+
+}  // namespace
+
+bool IsSupported() {
+#if defined(TENSORFLOW_USE_RUY)
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool IsEnabled() { return g_enabled; }
+
+void SetEnabled(bool enabled) { g_enabled = enabled; }
+
+bool IsSupportedAndEnabled() { return IsSupported() && IsEnabled(); }
+
+void QuantizeMultiplier(double multiplier, int32* fixedpoint, int* exponent) {
+  DCHECK_GE(multiplier, 0.0);
+  if (multiplier == 0.0) {
+    *fixedpoint = 0;
+    *exponent = 0;
+    return;
+  }
+  const double q = std::frexp(multiplier, exponent);
+  int64 q_fixed = static_cast<int64>(std::round(q * (1LL << 31)));
+  DCHECK_LE(q_fixed, (1LL << 31));
+  if (q_fixed == (1LL << 31)) {
+    q_fixed /= 2;
+    ++*exponent;
+  }
+  // Multipliers this small flush every accumulator to zero anyway.
+  if (*exponent < -31) {
+    *exponent = 0;
+    q_fixed = 0;
+  }
+  *fixedpoint = static_cast<int32>(q_fixed);
+}
+
+void QuantizedGemm(OpKernelContext* context, bool transpose_a, bool transpose_b,
+                   const quint8* a_data, const quint8* b_data, qint32* c_data,
+                   int m, int n, int k, int offset_a, int offset_b, int lda,
+                   int ldb, int ldc, const OutputStage& output_stage) {
+#ifdef TENSORFLOW_USE_RUY
+  QuantizedGemmImpl(context, transpose_a, transpose_b,
+                    reinterpret_cast<const std::uint8_t*>(&(a_data->value)),
+                    reinterpret_cast<const std::uint8_t*>(&(b_data->value)),
+                    reinterpret_cast<std::int32_t*>(&(c_data->value)), m, n, k,
+                    offset_a, offset_b, lda, ldb, ldc, output_stage);
+#else
+  LOG(FATAL) << "QuantizedGemm: Ruy fastpath not supported.";
+#endif
+}
+
+void QuantizedGemm(OpKernelContext* context, bool transpose_a, bool transpose_b,
+                   const quint8* a_data, const qint8* b_data, qint32* c_data,
+                   int m, int n, int k, int offset_a, int offset_b, int lda,
+                   int ldb, int ldc, const OutputStage& output_stage) {
+#ifdef TENSORFLOW_USE_RUY
+  QuantizedGemmImpl(context, transpose_a, transpose_b,
+                    reinterpret_cast<const std::uint8_t*>(&(a_data->value)),
+                    reinterpret_cast<const std::int8_t*>(&(b_data->value)),
+                    reinterpret_cast<std::int32_t*>(&(c_data->value)), m, n, k,
+                    offset_a, offset_b, lda, ldb, ldc, output_stage);
+#else
+  LOG(FATAL) << "QuantizedGemm: Ruy fastpath not supported.";
+#endif
+}
+
+void QuantizedGemm(OpKernelContext* context, bool transpose_a, bool transpose_b,
+                   const quint8* a_data, const qint8* b_data, quint8* c_data,
+                   int m, int n, int k, int offset_a, int offset_b, int lda,
+                   int ldb, int ldc, const OutputStage& output_stage) {
+#ifdef TENSORFLOW_USE_RUY
+  QuantizedGemmImpl(context, transpose_a, transpose_b,
+                    reinterpret_cast<const std::uint8_t*>(&(a_data->value)),
+                    reinterpret_cast<const std::int8_t*>(&(b_data->value)),
+                    reinterpret_cast<std::uint8_t*>(&(c_data->value)), m, n, k,
+                    offset_a, offset_b, lda, ldb, ldc, output_stage);
+#else
+  LOG(FATAL) << "QuantizedGemm: Ruy fastpath not supported.";
+#endif
+}
+
+}  // namespace ruy_support
+}  // namespace tensorflow
@@ -0,0 +1,142 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_CORE_KERNELS_RUY_SUPPORT_H_
+#define TENSORFLOW_CORE_KERNELS_RUY_SUPPORT_H_
+
+#include <algorithm>
+#include <limits>
+
+#include "fixedpoint/fixedpoint.h"
+#include "tensorflow/core/framework/numeric_types.h"
+
+namespace tensorflow {
+
+class OpKernelContext;
+
+namespace ruy_support {
+
+// Ruy is the matrix multiplication library used by the TensorFlow Lite CPU
+// backend. It has optimized eight-bit kernels for x86 (AVX2, AVX-512) and Arm
+// (NEON, dot-product), so the quantized kernels here use it to share the same
+// int8 GEMM instead of the generic gemmlowp paths. It is not built into mobile
+// (portable) builds, which keep using gemmlowp and gemmlowp/meta.
+
+// Toggles the codepath. Enabled by default (true) on supported platforms.
+void SetEnabled(bool enabled);
+
+// Returns true if the codepath is supported and is enabled. Use this call
+// before calling QuantizedGemm(). If the codepath is not supported and
+// QuantizedGemm() is called anyway, the library will log a FATAL error.
+bool IsSupportedAndEnabled();
+
+// Returns true if operands of types T1 and T2 quantized with the given zero
+// points can be multiplied by ruy. Zero points must be representable in the
+// operand types, and ruy rejects the case where both of them are the lowest
+// representable value.
+template <typename T1, typename T2>
+bool CanUseZeroPoints(int64 offset_a, int64 offset_b) {
+  const int64 lowest_a = Eigen::NumTraits<T1>::lowest();
+  const int64 highest_a = Eigen::NumTraits<T1>::highest();
+  const int64 lowest_b = Eigen::NumTraits<T2>::lowest();
+  const int64 highest_b = Eigen::NumTraits<T2>::highest();
+  if (offset_a < lowest_a || offset_a > highest_a || offset_b < lowest_b ||
+      offset_b > highest_b) {
+    return false;
+  }
+  return !(offset_a == lowest_a && offset_b == lowest_b);
+}
+
+// The stage applied to the int32 accumulators of each output column j before
+// they are stored:
+//
+//   c[i, j] := acc[i, j] + bias[j]
+//
+// and, for eight-bit outputs only,
+//
+//   c[i, j] := clamp(MultiplyByQuantizedMultiplier(c[i, j], multiplier[j])
+//                    + output_offset, clamp_min, clamp_max)
+//
+// The bias and per-channel arrays must hold n values and stay alive for the
+// duration of the QuantizedGemm() call.
+struct OutputStage {
+  const int32* bias = nullptr;
+  // Uniform multiplier, as produced by QuantizeMultiplier().
+  int32 multiplier_fixedpoint = 0;
+  int multiplier_exponent = 0;
+  // Per output column multipliers. If set they take precedence over the
+  // uniform one.
+  const int32* multiplier_fixedpoint_perchannel = nullptr;
+  const int* multiplier_exponent_perchannel = nullptr;
+  int32 output_offset = 0;
+  int32 clamp_min = std::numeric_limits<int32>::lowest();
+  int32 clamp_max = std::numeric_limits<int32>::max();
+};
+
+// Splits a positive real multiplier into a Q0.31 fixed point value in
+// [2^30, 2^31) and a power of two exponent, such that
+// multiplier ~= fixedpoint * 2^(exponent - 31).
+void QuantizeMultiplier(double multiplier, int32* fixedpoint, int* exponent);
+
+// Rescales an accumulator by a multiplier produced by QuantizeMultiplier(),
+// rounding the same way the ruy kernels do. This is what reference fallbacks
+// should use so that their results match the optimized path bit for bit.
+// The left shift of a positive exponent saturates, like the SQSHL of the Arm
+// kernels, instead of overflowing.
+inline int32 MultiplyByQuantizedMultiplier(int32 x, int32 fixedpoint,
+                                           int exponent) {
+  // Shifting further than 31 saturates every nonzero x anyway.
+  const int left_shift = std::min(std::max(exponent, 0), 31);
+  const int right_shift = exponent > 0 ? 0 : -exponent;
+  const int64 shifted = static_cast<int64>(x) * (int64{1} << left_shift);
+  const int32 saturated = static_cast<int32>(std::min<int64>(
+      std::max<int64>(shifted, std::numeric_limits<int32>::min()),
+      std::numeric_limits<int32>::max()));
+  return gemmlowp::RoundingDivideByPOT(
+      gemmlowp::SaturatingRoundingDoublingHighMul(saturated, fixedpoint),
+      right_shift);
+}
+
+// Calculates the quantized matrix multiplication:
+//
+// for (i, j) in [0, m) x [0, n) do
+//   acc[i, j] :=
+//     sum((a_data[i, l] - offset_a) * (b_data[l, j] - offset_b)) : l in [0, k)
+//
+// followed by the output stage. If transpose_a is false the lhs operand has
+// row major layout, otherwise column major. Similarly transpose_b describes
+// the layout of the rhs operand. The result is always row major. lda, ldb, and
+// ldc are the strides of the lhs operand, rhs operand and the result arrays.
+// The zero points must pass CanUseZeroPoints(). The work is split over the
+// intra-op thread pool of the context.
+void QuantizedGemm(OpKernelContext* context, bool transpose_a, bool transpose_b,
+                   const quint8* a_data, const quint8* b_data, qint32* c_data,
+                   int m, int n, int k, int offset_a, int offset_b, int lda,
+                   int ldb, int ldc,
+                   const OutputStage& output_stage = OutputStage());
+void QuantizedGemm(OpKernelContext* context, bool transpose_a, bool transpose_b,
+                   const quint8* a_data, const qint8* b_data, qint32* c_data,
+                   int m, int n, int k, int offset_a, int offset_b, int lda,
+                   int ldb, int ldc,
+                   const OutputStage& output_stage = OutputStage());
+void QuantizedGemm(OpKernelContext* context, bool transpose_a, bool transpose_b,
+                   const quint8* a_data, const qint8* b_data, quint8* c_data,
+                   int m, int n, int k, int offset_a, int offset_b, int lda,
+                   int ldb, int ldc, const OutputStage& output_stage);
+
+}  // namespace ruy_support
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_KERNELS_RUY_SUPPORT_H_
@@ -29,7 +29,6 @@ class SendOp : public OpKernel {
   string TraceString(OpKernelContext* ctx, bool verbose) override;
 
  private:
-  string key_prefix_;
   Rendezvous::ParsedKey parsed_key_;
   bool hostmem_sendrecv_;
 
@@ -44,7 +43,6 @@ class RecvOp : public AsyncOpKernel {
   string TraceString(OpKernelContext* ctx, bool verbose) override;
 
  private:
-  string key_prefix_;
   Rendezvous::ParsedKey parsed_key_;
   bool hostmem_sendrecv_;
 
@@ -18,12 +18,16 @@ limitations under the License.
 #include "tensorflow/core/lib/strings/str_util.h"
 #define EIGEN_USE_THREADS
 
+#include <type_traits>
+#include <vector>
+
 #include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/register_types.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
 #include "tensorflow/core/kernels/softmax_op_functor.h"
+#include "tensorflow/core/lib/gtl/inlined_vector.h"
 
 namespace tensorflow {
 
@@ -33,8 +37,234 @@ typedef Eigen::GpuDevice GPUDevice;
 typedef Eigen::SyclDevice SYCLDevice;
 #endif  // TENSORFLOW_USE_SYCL
 
-// Partial specialization for a CPUDevice, that uses the Eigen implementation
-// from SoftmaxEigenImpl.
+namespace {
+
+// Type used to compute the softmax of T.
+template <typename T>
+struct SoftmaxAccumulator {
+  typedef T type;
+};
+
+template <>
+struct SoftmaxAccumulator<Eigen::half> {
+  typedef float type;
+};
+
+template <>
+struct SoftmaxAccumulator<bfloat16> {
+  typedef float type;
+};
+
+template <typename T>
+using RowArray = Eigen::Array<T, 1, Eigen::Dynamic>;
+
+template <typename T>
+using HasPacketExp =
+    std::integral_constant<bool,
+                           Eigen::internal::packet_traits<T>::Vectorizable &&
+                               Eigen::internal::packet_traits<T>::HasExp>;
+
+// Returns sum(exp(z - max)) over `n` elements, storing exp(z - max) into `out`
+// if it is not null. `out` may alias `z`.
+template <typename T>
+T ExpAndSum(const T* z, T max, int64 n, T* out, std::true_type) {
+  typedef typename Eigen::internal::packet_traits<T>::type Packet;
+  const int64 kPacketSize = Eigen::internal::unpacket_traits<Packet>::size;
+  const Packet max_packet = Eigen::internal::pset1<Packet>(max);
+  Packet sum_packet = Eigen::internal::pset1<Packet>(T(0));
+  int64 i = 0;
+  for (; i + kPacketSize <= n; i += kPacketSize) {
+    const Packet e = Eigen::internal::pexp(Eigen::internal::psub(
+        Eigen::internal::ploadu<Packet>(z + i), max_packet));
+    if (out != nullptr) Eigen::internal::pstoreu(out + i, e);
+    sum_packet = Eigen::internal::padd(sum_packet, e);
+  }
+  T sum = Eigen::internal::predux(sum_packet);
+  for (; i < n; ++i) {
+    const T e = Eigen::numext::exp(z[i] - max);
+    if (out != nullptr) out[i] = e;
+    sum += e;
+  }
+  return sum;
+}
+
+template <typename T>
+T ExpAndSum(const T* z, T max, int64 n, T* out, std::false_type) {
+  Eigen::Map<const RowArray<T>> z_row(z, n);
+  if (out == nullptr) return (z_row - max).exp().sum();
+  Eigen::Map<RowArray<T>> out_row(out, n);
+  out_row = (z_row - max).exp();
+  return out_row.sum();
+}
+
+// Computes the softmax, or log softmax, of z = logits * scale + mask for a row
+// of `n` logits. `mask` is either null, a row of `n` values, or a single value
+// added to every logit if `mask_size` is 1.
+//
+// The logits are read at most twice: once to find the maximum, and once to
+// compute exp(z - max) and its sum. The final normalization only touches the
+// output row, which is still in cache.
+template <typename T>
+void SoftmaxRow(const T* logits, const T* mask, int64 mask_size, T scale,
+                bool log, int64 n, T* out) {
+  Eigen::Map<RowArray<T>> out_row(out, n);
+  const T* z = logits;
+  if (mask != nullptr || scale != T(1)) {
+    Eigen::Map<const RowArray<T>> logits_row(logits, n);
+    if (mask == nullptr) {
+      out_row = logits_row * scale;
+    } else if (mask_size == 1) {
+      out_row = logits_row * scale + *mask;
+    } else {
+      out_row = logits_row * scale + Eigen::Map<const RowArray<T>>(mask, n);
+    }
+    z = out;
+  }
+
+  const T max = Eigen::Map<const RowArray<T>>(z, n).maxCoeff();
+  if (log) {
+    const T sum = ExpAndSum<T>(z, max, n, nullptr, HasPacketExp<T>());
+    const T log_sum = max + Eigen::numext::log(sum);
+    out_row = Eigen::Map<const RowArray<T>>(z, n) - log_sum;
+  } else {
+    const T sum = ExpAndSum<T>(z, max, n, out, HasPacketExp<T>());
+    out_row *= T(1) / sum;
+  }
+}
+
+// Returns a pointer to `n` elements of `x` as type Acc, converting them into
+// `buffer` if necessary.
+template <typename Acc>
+const Acc* LoadRow(const Acc* x, int64 n, Acc* buffer) {
+  return x;
+}
+
+template <typename T, typename Acc>
+const Acc* LoadRow(const T* x, int64 n, Acc* buffer) {
+  Eigen::Map<RowArray<Acc>>(buffer, n) =
+      Eigen::Map<const RowArray<T>>(x, n).template cast<Acc>();
+  return buffer;
+}
+
+// Computes SoftmaxRow in the accumulation type of T, using `buffer` as scratch
+// space for the conversion if T is a 16-bit float.
+template <typename T>
+void SoftmaxRowWithConversion(const T* logits, const T* mask, int64 mask_size,
+                              float scale, bool log, int64 n, T* out,
+                              std::vector<T>* buffer, std::true_type) {
+  SoftmaxRow<T>(logits, mask, mask_size, static_cast<T>(scale), log, n, out);
+}
+
+template <typename T, typename Acc>
+void SoftmaxRowWithConversion(const T* logits, const T* mask, int64 mask_size,
+                              float scale, bool log, int64 n, T* out,
+                              std::vector<Acc>* buffer, std::false_type) {
+  buffer->resize(2 * n + mask_size);
+  Acc* out_buffer = buffer->data() + n;
+  const Acc* mask_acc =
+      mask == nullptr ? nullptr
+                      : LoadRow(mask, mask_size, buffer->data() + 2 * n);
+  SoftmaxRow<Acc>(LoadRow(logits, n, buffer->data()), mask_acc, mask_size,
+                  static_cast<Acc>(scale), log, n, out_buffer);
+  Eigen::Map<RowArray<T>>(out, n) =
+      Eigen::Map<const RowArray<Acc>>(out_buffer, n).template cast<T>();
+}
+
+}  // namespace
+
+// Maps a row of logits, i.e. all dimensions but the last, to the offset of the
+// row of a mask that broadcasts against the logits.
+class SoftmaxMaskBroadcast {
+ public:
+  // Validates that `mask` broadcasts to `logits` without changing the shape of
+  // the logits.
+  Status Init(const TensorShape& logits, const TensorShape& mask) {
+    const int rank = logits.dims();
+    if (mask.dims() > rank) {
+      return errors::InvalidArgument(
+          "mask must not have a higher rank than logits, got logits shape ",
+          logits.DebugString(), " and mask shape ", mask.DebugString());
+    }
+    int64 stride = 1;
+    dims_.resize(rank - 1);
+    strides_.resize(rank - 1);
+    for (int i = rank - 1; i >= 0; --i) {
+      const int mask_dim = i - (rank - mask.dims());
+      const int64 size = mask_dim >= 0 ? mask.dim_size(mask_dim) : 1;
+      if (size != 1 && size != logits.dim_size(i)) {
+        return errors::InvalidArgument(
+            "mask must broadcast to the shape of logits, got logits shape ",
+            logits.DebugString(), " and mask shape ", mask.DebugString());
+      }
+      if (i == rank - 1) {
+        row_size_ = size;
+      } else {
+        dims_[i] = logits.dim_size(i);
+        strides_[i] = size == 1 ? 0 : stride;
+      }
+      stride *= size;
+    }
+    return Status::OK();
+  }
+
+  // Number of mask values per row of logits, either 1 or the number of classes.
+  int64 row_size() const { return row_size_; }
+
+  int64 RowOffset(int64 row) const {
+    int64 offset = 0;
+    for (int i = dims_.size() - 1; i >= 0; --i) {
+      offset += (row % dims_[i]) * strides_[i];
+      row /= dims_[i];
+    }
+    return offset;
+  }
+
+ private:
+  int64 row_size_ = 1;
+  gtl::InlinedVector<int64, 4> dims_;
+  gtl::InlinedVector<int64, 4> strides_;
+};
+
+// Computes the row-wise softmax of `logits` * `scale` + `mask` on CPU. `mask`
+// may be null, otherwise `mask_broadcast` maps logits rows to mask rows.
+template <typename T>
+void SoftmaxRowsCpu(const CPUDevice& d, typename TTypes<T>::ConstMatrix logits,
+                    const T* mask, const SoftmaxMaskBroadcast* mask_broadcast,
+                    float scale, bool log, typename TTypes<T>::Matrix softmax) {
+  const int64 batch_size = logits.dimension(0);
+  const int64 num_classes = logits.dimension(1);
+  const T* logits_data = logits.data();
+  T* softmax_data = softmax.data();
+
+  auto compute_rows = [&](int64 begin, int64 end) {
+    std::vector<typename SoftmaxAccumulator<T>::type> buffer;
+    for (int64 row = begin; row < end; ++row) {
+      const T* row_mask = nullptr;
+      int64 mask_size = 0;
+      if (mask != nullptr) {
+        row_mask = mask + mask_broadcast->RowOffset(row);
+        mask_size = mask_broadcast->row_size();
+      }
+      SoftmaxRowWithConversion(
+          logits_data + row * num_classes, row_mask, mask_size, scale, log,
+          num_classes, softmax_data + row * num_classes, &buffer,
+          std::is_same<T, typename SoftmaxAccumulator<T>::type>());
+    }
+  };
+
+  const double bytes_per_row =
+      num_classes * sizeof(T) * (mask != nullptr ? 3 : 2);
+  const double cycles_per_row =
+      num_classes * (Eigen::TensorOpCost::AddCost<T>() * 3 +
+                     Eigen::TensorOpCost::MulCost<T>() +
+                     Eigen::internal::functor_traits<
+                         Eigen::internal::scalar_exp_op<T>>::Cost);
+  d.parallelFor(batch_size,
+                Eigen::TensorOpCost(bytes_per_row, num_classes * sizeof(T),
+                                    cycles_per_row),
+                compute_rows);
+}
+
 namespace functor {
 template <typename Device, typename T>
 struct SoftmaxFunctorBase {
@@ -43,8 +273,17 @@ struct SoftmaxFunctorBase {
     SoftmaxEigenImpl<Device, T>::Compute(d, logits, softmax, log);
   }
 };
+
+// Partial specialization for a CPUDevice, that computes each row with
+// vectorized passes over the logits instead of broadcasting Eigen reductions.
 template <typename T>
-struct SoftmaxFunctor<CPUDevice, T> : SoftmaxFunctorBase<CPUDevice, T> {};
+struct SoftmaxFunctor<CPUDevice, T> {
+  void operator()(const CPUDevice& d, typename TTypes<T>::ConstMatrix logits,
+                  typename TTypes<T>::Matrix softmax, const bool log) {
+    SoftmaxRowsCpu<T>(d, logits, /*mask=*/nullptr, /*mask_broadcast=*/nullptr,
+                      /*scale=*/1.0f, log, softmax);
+  }
+};
 
 #ifdef TENSORFLOW_USE_SYCL
 template <typename T>
@@ -78,6 +317,54 @@ class SoftmaxOp : public OpKernel {
   bool log_;
 };
 
+// Softmax or LogSoftmax of `logits` * `scale` + `mask`, where the optional mask
+// broadcasts to the shape of the logits. Created by the Grappler remapper from
+// attention patterns such as Softmax(Add(Mul(logits, scale), mask)).
+template <typename T>
+class FusedSoftmaxOp : public OpKernel {
+ public:
+  explicit FusedSoftmaxOp(OpKernelConstruction* context) : OpKernel(context) {
+    int num_masks;
+    OP_REQUIRES_OK(context, context->GetAttr("num_masks", &num_masks));
+    OP_REQUIRES(context, num_masks <= 1,
+                errors::InvalidArgument("_FusedSoftmax supports at most one "
+                                        "mask, got num_masks=",
+                                        num_masks));
+    has_mask_ = num_masks == 1;
+    OP_REQUIRES_OK(context, context->GetAttr("scale", &scale_));
+    OP_REQUIRES_OK(context, context->GetAttr("log", &log_));
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& logits_in = context->input(0);
+    OP_REQUIRES(context, TensorShapeUtils::IsVectorOrHigher(logits_in.shape()),
+                errors::InvalidArgument("logits must have >= 1 dimension, got ",
+                                        logits_in.shape().DebugString()));
+    SoftmaxMaskBroadcast mask_broadcast;
+    const T* mask = nullptr;
+    if (has_mask_) {
+      const Tensor& mask_in = context->input(1);
+      OP_REQUIRES_OK(context,
+                     mask_broadcast.Init(logits_in.shape(), mask_in.shape()));
+      mask = mask_in.flat<T>().data();
+    }
+
+    Tensor* softmax_out = nullptr;
+    OP_REQUIRES_OK(context, context->forward_input_or_allocate_output(
+                                {0}, 0, logits_in.shape(), &softmax_out));
+    if (logits_in.NumElements() > 0) {
+      SoftmaxRowsCpu<T>(context->eigen_device<CPUDevice>(),
+                        logits_in.flat_inner_dims<T>(), mask, &mask_broadcast,
+                        scale_, log_, softmax_out->flat_inner_dims<T>());
+    }
+  }
+
+ private:
+  bool has_mask_;
+  float scale_;
+  bool log_;
+};
+
 #define REGISTER_CPU(T)                                          \
   REGISTER_KERNEL_BUILDER(                                       \
       Name("Softmax").Device(DEVICE_CPU).TypeConstraint<T>("T"), \
@@ -91,6 +378,13 @@ TF_CALL_FLOAT_TYPES(REGISTER_CPU);
       SoftmaxOp<CPUDevice, T>);
 TF_CALL_FLOAT_TYPES(REGISTER_CPU);
 
+#undef REGISTER_CPU
+#define REGISTER_CPU(T)                                                \
+  REGISTER_KERNEL_BUILDER(                                             \
+      Name("_FusedSoftmax").Device(DEVICE_CPU).TypeConstraint<T>("T"), \
+      FusedSoftmaxOp<T>);
+TF_CALL_FLOAT_TYPES(REGISTER_CPU);
+
 #undef REGISTER_CPU
 
 #ifdef TENSORFLOW_USE_SYCL
@@ -0,0 +1,263 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <cmath>
+#include <vector>
+
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/kernels/ops_util.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+
+namespace tensorflow {
+namespace {
+
+// Softmax of logits * scale + mask computed in double precision, with the
+// mask broadcast to the shape of the logits.
+Tensor ReferenceSoftmax(const Tensor& logits, const Tensor* mask, float scale,
+                        bool log) {
+  const int rank = logits.dims();
+  const int64 num_classes = logits.dim_size(rank - 1);
+  const auto logits_strides = ComputeStride<int64>(logits.shape());
+  std::vector<int64> mask_strides(rank, 0);
+  if (mask != nullptr) {
+    int64 stride = 1;
+    for (int i = rank - 1; i >= 0; --i) {
+      const int d = i - (rank - mask->dims());
+      const int64 size = d >= 0 ? mask->dim_size(d) : 1;
+      mask_strides[i] = size == 1 ? 0 : stride;
+      stride *= size;
+    }
+  }
+
+  Tensor out(DT_FLOAT, logits.shape());
+  const auto x = logits.flat<float>();
+  auto y = out.flat<float>();
+  std::vector<double> z(num_classes);
+  for (int64 row = 0; row < logits.NumElements(); row += num_classes) {
+    double max = -INFINITY;
+    for (int64 c = 0; c < num_classes; ++c) {
+      z[c] = static_cast<double>(x(row + c)) * scale;
+      if (mask != nullptr) {
+        int64 offset = 0;
+        for (int i = 0; i < rank; ++i) {
+          offset += ((row + c) / logits_strides[i] % logits.dim_size(i)) *
+                    mask_strides[i];
+        }
+        z[c] += mask->flat<float>()(offset);
+      }
+      max = std::max(max, z[c]);
+    }
+    double sum = 0;
+    for (int64 c = 0; c < num_classes; ++c) sum += std::exp(z[c] - max);
+    for (int64 c = 0; c < num_classes; ++c) {
+      y(row + c) =
+          log ? z[c] - max - std::log(sum) : std::exp(z[c] - max) / sum;
+    }
+  }
+  return out;
+}
+
+Tensor RandomLogits(const TensorShape& shape) {
+  Tensor t(DT_FLOAT, shape);
+  t.flat<float>().setRandom();
+  t.flat<float>() = (t.flat<float>() - 0.5f) * 20.0f;
+  return t;
+}
+
+class SoftmaxOpTest : public OpsTestBase {
+ protected:
+  void RunSoftmax(const string& op, const Tensor& logits) {
+    inputs_.clear();
+    TF_ASSERT_OK(NodeDefBuilder("softmax", op)
+                     .Input(FakeInput(DT_FLOAT))
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+    AddInputFromArray<float>(
+        logits.shape(), gtl::ArraySlice<float>(logits.flat<float>().data(),
+                                               logits.NumElements()));
+    TF_ASSERT_OK(RunOpKernel());
+  }
+
+  Status RunFusedSoftmax(const Tensor& logits, const Tensor* mask, float scale,
+                         bool log) {
+    inputs_.clear();
+    std::vector<NodeDefBuilder::NodeOut> masks;
+    if (mask != nullptr) masks.push_back({"mask", 0, DT_FLOAT});
+    TF_CHECK_OK(NodeDefBuilder("fused_softmax", "_FusedSoftmax")
+                    .Input(FakeInput(DT_FLOAT))
+                    .Input(masks)
+                    .Attr("num_masks", static_cast<int>(masks.size()))
+                    .Attr("scale", scale)
+                    .Attr("log", log)
+                    .Finalize(node_def()));
+    TF_CHECK_OK(InitOp());
+    AddInputFromArray<float>(
+        logits.shape(), gtl::ArraySlice<float>(logits.flat<float>().data(),
+                                               logits.NumElements()));
+    if (mask != nullptr) {
+      AddInputFromArray<float>(
+          mask->shape(), gtl::ArraySlice<float>(mask->flat<float>().data(),
+                                                mask->NumElements()));
+    }
+    return RunOpKernel();
+  }
+};
+
+TEST_F(SoftmaxOpTest, Softmax) {
+  // Class counts that do and do not fill whole packets.
+  for (int64 num_classes : {1, 7, 16, 1001}) {
+    const Tensor logits = RandomLogits(TensorShape({5, num_classes}));
+    RunSoftmax("Softmax", logits);
+    test::ExpectTensorNear<float>(
+        ReferenceSoftmax(logits, nullptr, 1.0f, false), *GetOutput(0), 1e-6);
+  }
+}
+
+TEST_F(SoftmaxOpTest, LogSoftmax) {
+  for (int64 num_classes : {1, 7, 16, 1001}) {
+    const Tensor logits = RandomLogits(TensorShape({3, 2, num_classes}));
+    RunSoftmax("LogSoftmax", logits);
+    test::ExpectTensorNear<float>(
+        ReferenceSoftmax(logits, nullptr, 1.0f, true), *GetOutput(0), 1e-5);
+  }
+}
+
+TEST_F(SoftmaxOpTest, LargeLogits) {
+  Tensor logits(DT_FLOAT, TensorShape({2, 3}));
+  test::FillValues<float>(&logits, {1000, 1001, 1002, -1000, -1001, -1002});
+  RunSoftmax("Softmax", logits);
+  test::ExpectTensorNear<float>(ReferenceSoftmax(logits, nullptr, 1.0f, false),
+                                *GetOutput(0), 1e-6);
+}
+
+TEST_F(SoftmaxOpTest, Half) {
+  inputs_.clear();
+  TF_ASSERT_OK(NodeDefBuilder("softmax", "Softmax")
+                   .Input(FakeInput(DT_HALF))
+                   .Finalize(node_def()));
+  TF_ASSERT_OK(InitOp());
+  AddInputFromArray<Eigen::half>(
+      TensorShape({2, 3}), {Eigen::half(1.0f), Eigen::half(2.0f),
+                            Eigen::half(3.0f), Eigen::half(0.0f),
+                            Eigen::half(0.0f), Eigen::half(0.0f)});
+  TF_ASSERT_OK(RunOpKernel());
+  Tensor expected(DT_HALF, TensorShape({2, 3}));
+  test::FillValues<Eigen::half>(
+      &expected, {Eigen::half(0.09003f), Eigen::half(0.24473f),
+                  Eigen::half(0.66524f), Eigen::half(1.0f / 3),
+                  Eigen::half(1.0f / 3), Eigen::half(1.0f / 3)});
+  test::ExpectTensorNear<Eigen::half>(expected, *GetOutput(0), 1e-3);
+}
+
+TEST_F(SoftmaxOpTest, FusedSoftmaxWithScale) {
+  const Tensor logits = RandomLogits(TensorShape({4, 33}));
+  TF_ASSERT_OK(RunFusedSoftmax(logits, nullptr, 0.125f, false));
+  test::ExpectTensorNear<float>(
+      ReferenceSoftmax(logits, nullptr, 0.125f, false), *GetOutput(0), 1e-6);
+}
+
+TEST_F(SoftmaxOpTest, FusedSoftmaxWithAttentionMask) {
+  // [batch, heads, from, to] scores with a [batch, 1, 1, to] mask.
+  const Tensor logits = RandomLogits(TensorShape({2, 3, 5, 40}));
+  Tensor mask = RandomLogits(TensorShape({2, 1, 1, 40}));
+  mask.flat<float>()(7) = -10000.0f;
+  for (bool log : {false, true}) {
+    TF_ASSERT_OK(RunFusedSoftmax(logits, &mask, 0.5f, log));
+    test::ExpectTensorNear<float>(ReferenceSoftmax(logits, &mask, 0.5f, log),
+                                  *GetOutput(0), 1e-5);
+  }
+}
+
+TEST_F(SoftmaxOpTest, FusedSoftmaxWithBroadcastMasks) {
+  const Tensor logits = RandomLogits(TensorShape({2, 3, 5, 9}));
+  for (const TensorShape& mask_shape :
+       {TensorShape({}), TensorShape({9}), TensorShape({5, 9}),
+        TensorShape({3, 1, 1}), TensorShape({2, 1, 5, 9})}) {
+    const Tensor mask = RandomLogits(mask_shape);
+    TF_ASSERT_OK(RunFusedSoftmax(logits, &mask, 1.0f, false));
+    test::ExpectTensorNear<float>(ReferenceSoftmax(logits, &mask, 1.0f, false),
+                                  *GetOutput(0), 1e-6);
+  }
+}
+
+TEST_F(SoftmaxOpTest, FusedSoftmaxInvalidMask) {
+  const Tensor logits = RandomLogits(TensorShape({2, 3}));
+  const Tensor mask = RandomLogits(TensorShape({2, 2}));
+  const Status status = RunFusedSoftmax(logits, &mask, 1.0f, false);
+  EXPECT_TRUE(errors::IsInvalidArgument(status)) << status;
+}
+
+// Attention softmax over [batch, heads, seq_len, seq_len] scores, either
+// fused or as the Mul + Add + Softmax graph that BERT builds.
+Graph* AttentionSoftmax(bool fused, int batch, int heads, int seq_len) {
+  Graph* g = new Graph(OpRegistry::Global());
+  Tensor scores = RandomLogits(TensorShape({batch, heads, seq_len, seq_len}));
+  Tensor mask = RandomLogits(TensorShape({batch, 1, 1, seq_len}));
+  Tensor scale(DT_FLOAT, TensorShape({}));
+  scale.scalar<float>()() = 0.125f;
+  Node* scores_node = test::graph::Constant(g, scores);
+  Node* mask_node = test::graph::Constant(g, mask);
+  Node* ret;
+  if (fused) {
+    TF_CHECK_OK(NodeBuilder(g->NewName("n"), "_FusedSoftmax")
+                    .Input(scores_node)
+                    .Input(std::vector<NodeBuilder::NodeOut>({mask_node}))
+                    .Attr("num_masks", 1)
+                    .Attr("scale", 0.125f)
+                    .Finalize(g, &ret));
+  } else {
+    Node* scaled = test::graph::Binary(g, "Mul", scores_node,
+                                       test::graph::Constant(g, scale));
+    Node* masked = test::graph::Binary(g, "AddV2", scaled, mask_node);
+    TF_CHECK_OK(NodeBuilder(g->NewName("n"), "Softmax")
+                    .Input(masked)
+                    .Finalize(g, &ret));
+  }
+  return g;
+}
+
+static void BM_AttentionSoftmax(int iters, bool fused, int seq_len) {
+  const int batch = 8;
+  const int heads = 12;
+  const int64 num_elements =
+      static_cast<int64>(iters) * batch * heads * seq_len * seq_len;
+  testing::ItemsProcessed(num_elements);
+  testing::BytesProcessed(num_elements * sizeof(float) * 2);
+  testing::UseRealTime();
+  test::Benchmark("cpu", AttentionSoftmax(fused, batch, heads, seq_len))
+      .Run(iters);
+}
+
+static void BM_AttentionSoftmaxUnfused(int iters, int seq_len) {
+  BM_AttentionSoftmax(iters, /*fused=*/false, seq_len);
+}
+BENCHMARK(BM_AttentionSoftmaxUnfused)->Arg(128)->Arg(384);
+
+static void BM_AttentionSoftmaxFused(int iters, int seq_len) {
+  BM_AttentionSoftmax(iters, /*fused=*/true, seq_len);
+}
+BENCHMARK(BM_AttentionSoftmaxFused)->Arg(128)->Arg(384);
+
+}  // namespace
+}  // namespace tensorflow
@@ -0,0 +1,179 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <stdlib.h>
+
+#include <vector>
+
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/graph/graph.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/graph/testlib.h"
+#include "tensorflow/core/kernels/training_op_helpers.h"
+#include "tensorflow/core/lib/core/blocking_counter.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/public/session.h"
+#include "tensorflow/core/public/session_options.h"
+
+namespace tensorflow {
+namespace {
+
+// SparseUpdateCombiner reads TF_COMBINE_SPARSE_APPLY_UPDATES once per process,
+// so it is set before any test runs.
+const bool kCombinerEnvSet = []() {
+  setenv("TF_COMBINE_SPARSE_APPLY_UPDATES", "true", 1);
+  return true;
+}();
+
+Node* Variable(Graph* g, int m, int n) {
+  return test::graph::Var(g, DT_FLOAT, TensorShape({m, n}));
+}
+
+Node* Fill(Graph* g, int m, int n, float val) {
+  Tensor data(DT_FLOAT, TensorShape({m, n}));
+  data.flat<float>().setConstant(val);
+  return test::graph::Constant(g, data);
+}
+
+Node* Random(Graph* g, int m, int n) {
+  Tensor data(DT_FLOAT, TensorShape({m, n}));
+  data.flat<float>().setRandom();
+  return test::graph::Constant(g, data);
+}
+
+Node* Scalar(Graph* g, float val) {
+  return test::graph::Constant(g, test::AsScalar<float>(val));
+}
+
+Node* Indices(Graph* g, const std::vector<int32>& indices) {
+  return test::graph::Constant(g, test::AsTensor<int32>(indices));
+}
+
+Node* LockedSparseApplyAdagrad(Graph* g, Node* var, Node* accum, Node* lr,
+                               Node* grad, Node* indices) {
+  Node* ret;
+  TF_CHECK_OK(NodeBuilder(g->NewName("n"), "SparseApplyAdagrad")
+                  .Input(var)
+                  .Input(accum)
+                  .Input(lr)
+                  .Input(grad)
+                  .Input(indices)
+                  .Attr("use_locking", true)
+                  .Finalize(g, &ret));
+  return ret;
+}
+
+TEST(SparseUpdateCombinerTest, ConcurrentLockedUpdatesMatchSequentialUpdates) {
+  ASSERT_TRUE(kCombinerEnvSet);
+  ASSERT_TRUE(SparseUpdateCombiner::Enabled());
+  constexpr int kNumOps = 16;
+  constexpr int kMaxRounds = 20;
+  constexpr int kRows = 64;
+  constexpr int kCols = 32;
+  Graph g(OpRegistry::Global());
+  Node* var = Variable(&g, kRows, kCols);
+  Node* accum = Variable(&g, kRows, kCols);
+  Node* sequential_var = Variable(&g, kRows, kCols);
+  Node* sequential_accum = Variable(&g, kRows, kCols);
+  Node* ones = Fill(&g, kRows, kCols, 1.0f);
+  Node* initial_accum = Fill(&g, kRows, kCols, 0.1f);
+  const std::vector<string> init = {
+      test::graph::Assign(&g, var, ones)->name(),
+      test::graph::Assign(&g, accum, initial_accum)->name(),
+      test::graph::Assign(&g, sequential_var, ones)->name(),
+      test::graph::Assign(&g, sequential_accum, initial_accum)->name()};
+
+  // Every fourth op fails on an out of range index, and must not affect the
+  // others. The other ops apply the same update, so the result does not depend
+  // on their order.
+  Node* lr = Scalar(&g, 0.01);
+  Node* grad = Random(&g, 4, kCols);
+  Node* indices = Indices(&g, {0, 5, 17, kRows - 1});
+  Node* bad_grad = Random(&g, 1, kCols);
+  Node* bad_indices = Indices(&g, {kRows});
+  std::vector<string> ops;
+  Node* sequential_op = nullptr;
+  for (int i = 0; i < kNumOps; ++i) {
+    if (i % 4 == 3) {
+      ops.push_back(
+          LockedSparseApplyAdagrad(&g, var, accum, lr, bad_grad, bad_indices)
+              ->name());
+      continue;
+    }
+    ops.push_back(
+        LockedSparseApplyAdagrad(&g, var, accum, lr, grad, indices)->name());
+    Node* op = LockedSparseApplyAdagrad(&g, sequential_var, sequential_accum,
+                                        lr, grad, indices);
+    if (sequential_op != nullptr) g.AddControlEdge(sequential_op, op);
+    sequential_op = op;
+  }
+
+  GraphDef gdef;
+  g.ToGraphDef(&gdef);
+  SessionOptions options;
+  options.config.set_inter_op_parallelism_threads(kNumOps);
+  std::unique_ptr<Session> session(NewSession(options));
+  TF_ASSERT_OK(session->Create(gdef));
+  TF_ASSERT_OK(session->Run({}, {}, init, nullptr));
+
+  // Runs rounds of concurrent updates until some of them were combined.
+  thread::ThreadPool pool(Env::Default(), "apply", kNumOps);
+  const int64 num_combined_before =
+      SparseUpdateCombiner::NumCombinedUpdatesForTesting();
+  for (int round = 0; round < kMaxRounds; ++round) {
+    std::vector<Status> statuses(kNumOps);
+    BlockingCounter counter(kNumOps);
+    for (int i = 0; i < kNumOps; ++i) {
+      pool.Schedule([&, i]() {
+        statuses[i] = session->Run({}, {}, {ops[i]}, nullptr);
+        counter.DecrementCount();
+      });
+    }
+    counter.Wait();
+    for (int i = 0; i < kNumOps; ++i) {
+      if (i % 4 == 3) {
+        EXPECT_TRUE(errors::IsInvalidArgument(statuses[i])) << statuses[i];
+      } else {
+        TF_EXPECT_OK(statuses[i]);
+      }
+    }
+    // The combiner is freed once the variables are no longer updated.
+    EXPECT_EQ(0, SparseUpdateCombiner::NumCombinersForTesting());
+    TF_ASSERT_OK(session->Run({}, {}, {sequential_op->name()}, nullptr));
+    if (SparseUpdateCombiner::NumCombinedUpdatesForTesting() >
+        num_combined_before) {
+      break;
+    }
+  }
+  // At least one batch applied more than one update.
+  EXPECT_GT(SparseUpdateCombiner::NumCombinedUpdatesForTesting(),
+            num_combined_before);
+
+  std::vector<Tensor> values;
+  TF_ASSERT_OK(session->Run({},
+                            {var->name(), accum->name(),
+                             sequential_var->name(), sequential_accum->name()},
+                            {}, &values));
+  test::ExpectTensorEqual<float>(values[2], values[0]);
+  test::ExpectTensorEqual<float>(values[3], values[1]);
+  TF_ASSERT_OK(session->Close());
+}
+
+}  // namespace
+}  // namespace tensorflow
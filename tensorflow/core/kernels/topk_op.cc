@@ -20,7 +20,10 @@ limitations under the License.
 #include "tensorflow/core/kernels/topk_op.h"
 
 #include <algorithm>
+#include <cstring>
 #include <numeric>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
 #include "tensorflow/core/framework/op_kernel.h"
@@ -97,6 +100,294 @@ class TopK : public OpKernel {
   bool sorted_;
 };
 
+namespace {
+
+// Rows shorter than this are processed with a heap of size k (or a full sort
+// if k covers the row), which has the lowest overhead for short rows.
+constexpr int64 kTopKMinColumnsForSelection = 512;
+
+// Rows are selected by threshold filtering if they are at least this many
+// times longer than k, and by radix select otherwise.
+constexpr int64 kTopKFilterRatio = 16;
+
+// Elements are filtered against the current threshold in blocks, and only
+// blocks containing at least one candidate are scanned element by element.
+constexpr int64 kTopKFilterBlockSize = 256;
+constexpr int kTopKMinBufferedCandidates = 8;
+
+// A single row is split across threads only in chunks of at least this size.
+constexpr int64 kTopKMinColumnsPerChunk = 32 * 1024;
+
+// Returns true if `a` ranks above `b` in TopK order: larger values first, with
+// NaN above every other value.
+template <typename T>
+bool TopKGreater(const T& a, const T& b) {
+  return a > b || (Eigen::numext::isnan(a) && !Eigen::numext::isnan(b));
+}
+
+// Orders indices into `row` by TopKGreater, breaking ties by the lower index.
+template <typename T>
+struct TopKIndexComparator {
+  bool operator()(const int32 a, const int32 b) const {
+    if (TopKGreater(row[a], row[b])) return true;
+    if (TopKGreater(row[b], row[a])) return false;
+    return a < b;
+  }
+  const T* row;
+};
+
+template <typename T>
+using HasPacketCompare =
+    std::integral_constant<bool, std::is_same<T, float>::value ||
+                                     std::is_same<T, double>::value>;
+
+// Returns true if any of the `n` elements of `x` may rank above `threshold`,
+// which must not be NaN.
+template <typename T>
+bool AnyAbove(const T* x, int64 n, T threshold, std::true_type) {
+  typedef typename Eigen::internal::packet_traits<T>::type Packet;
+  constexpr int kPacketSize = Eigen::internal::unpacket_traits<Packet>::size;
+  const Packet threshold_packet = Eigen::internal::pset1<Packet>(threshold);
+  const Packet all_ones =
+      Eigen::internal::pcmp_eq(threshold_packet, threshold_packet);
+  Packet all_below = all_ones;
+  int64 i = 0;
+  for (; i + kPacketSize <= n; i += kPacketSize) {
+    // NaN compares false, so it clears the lane like a larger value does.
+    all_below = Eigen::internal::pand(
+        all_below,
+        Eigen::internal::pcmp_le(Eigen::internal::ploadu<Packet>(x + i),
+                                 threshold_packet));
+  }
+  T below[kPacketSize];
+  T ones[kPacketSize];
+  Eigen::internal::pstoreu(below, all_below);
+  Eigen::internal::pstoreu(ones, all_ones);
+  if (std::memcmp(below, ones, sizeof(below)) != 0) return true;
+  for (; i < n; ++i) {
+    if (!(x[i] <= threshold)) return true;
+  }
+  return false;
+}
+
+template <typename T>
+bool AnyAbove(const T* x, int64 n, T threshold, std::false_type) {
+  bool any_above = false;
+  for (int64 i = 0; i < n; ++i) any_above |= !(x[i] <= threshold);
+  return any_above;
+}
+
+// Keeps the top `k` of `candidates` and returns the smallest of them.
+template <typename T>
+T TruncateCandidates(const T* row, int k, std::vector<int32>* candidates) {
+  std::nth_element(candidates->begin(), candidates->begin() + k - 1,
+                   candidates->end(), TopKIndexComparator<T>{row});
+  candidates->resize(k);
+  return row[candidates->back()];
+}
+
+// Writes the indices of the top `k` elements of row[begin, end) to
+// `candidates`, in no particular order.
+//
+// The first `k` elements seed a threshold, the k-th largest value seen so far.
+// Elements are visited in index order, so a later element only enters the top
+// k if it is strictly greater than the threshold (or NaN). Such elements are
+// buffered, and the buffer is truncated back to `k` when it fills up, which
+// raises the threshold. For random inputs only O(k log(n / k)) elements pass
+// the filter, so the cost is dominated by the vectorized block comparisons.
+template <typename T>
+void FilterTopK(const T* row, int64 begin, int64 end, int k,
+                std::vector<int32>* candidates) {
+  const size_t num_kept = k;
+  const size_t capacity = std::max(2 * k, k + kTopKMinBufferedCandidates);
+  candidates->clear();
+  candidates->reserve(capacity);
+
+  int64 i = begin;
+  for (; i < end && candidates->size() < num_kept; ++i) {
+    candidates->push_back(i);
+  }
+  if (i == end) return;
+  T threshold = TruncateCandidates(row, k, candidates);
+
+  // Nothing ranks above a NaN threshold, as later ties lose to lower indices.
+  while (i < end && !Eigen::numext::isnan(threshold)) {
+    const int64 block_end = std::min(i + kTopKFilterBlockSize, end);
+    if (AnyAbove(row + i, block_end - i, threshold, HasPacketCompare<T>())) {
+      for (; i < block_end; ++i) {
+        if (row[i] <= threshold) continue;
+        candidates->push_back(i);
+        if (candidates->size() == capacity) {
+          threshold = TruncateCandidates(row, k, candidates);
+          if (Eigen::numext::isnan(threshold)) break;
+        }
+      }
+    }
+    i = block_end;
+  }
+  if (candidates->size() > num_kept) TruncateCandidates(row, k, candidates);
+}
+
+// Maps T to an unsigned integer with the same order as TopKGreater. -0.0 and
+// +0.0 have the same key, and NaN has the largest key.
+template <typename T, typename Enable = void>
+struct TopKRadixKey {
+  typedef typename std::make_unsigned<T>::type type;
+  static type Get(const T x) {
+    constexpr type kSignBit =
+        std::is_signed<T>::value ? type(1) << (8 * sizeof(T) - 1) : 0;
+    return static_cast<type>(x) ^ kSignBit;
+  }
+};
+
+template <typename Bits, typename F>
+Bits FloatRadixKey(F x) {
+  if (Eigen::numext::isnan(x)) return ~Bits(0);
+  if (x == F(0)) x = F(0);
+  Bits bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  constexpr Bits kSignBit = Bits(1) << (8 * sizeof(Bits) - 1);
+  return (bits & kSignBit) ? ~bits : (bits | kSignBit);
+}
+
+template <>
+struct TopKRadixKey<float> {
+  typedef uint32 type;
+  static type Get(const float x) { return FloatRadixKey<uint32>(x); }
+};
+
+template <>
+struct TopKRadixKey<double> {
+  typedef uint64 type;
+  static type Get(const double x) { return FloatRadixKey<uint64>(x); }
+};
+
+template <>
+struct TopKRadixKey<Eigen::half> {
+  typedef uint32 type;
+  static type Get(const Eigen::half x) {
+    return FloatRadixKey<uint32>(static_cast<float>(x));
+  }
+};
+
+template <>
+struct TopKRadixKey<bfloat16> {
+  typedef uint32 type;
+  static type Get(const bfloat16 x) {
+    return FloatRadixKey<uint32>(static_cast<float>(x));
+  }
+};
+
+// Writes the indices of the top `k` elements of row[0, n) to `top_k`, in no
+// particular order, with a most significant digit first radix select.
+//
+// Each pass histograms one byte of the keys that are still undecided. Keys in
+// higher buckets are selected, keys in lower buckets are dropped, and only the
+// bucket that contains the k-th key is refined by the next pass. Undecided
+// elements are kept in index order, so ties go to the lower indices.
+template <typename T>
+void RadixSelectTopK(const T* row, int64 n, int k, int32* top_k) {
+  typedef typename TopKRadixKey<T>::type Key;
+  constexpr int kRadixBits = 8;
+  constexpr int kNumBuckets = 1 << kRadixBits;
+  constexpr int kFirstShift = 8 * sizeof(Key) - kRadixBits;
+
+  std::vector<Key> keys(n);
+  for (int64 i = 0; i < n; ++i) keys[i] = TopKRadixKey<T>::Get(row[i]);
+
+  std::vector<int32> undecided;
+  std::vector<int32> next_undecided;
+  int num_selected = 0;
+  int remaining = k;
+  for (int shift = kFirstShift; shift >= 0; shift -= kRadixBits) {
+    // All elements are undecided before the first pass.
+    const bool first_pass = shift == kFirstShift;
+    const int64 num_undecided = first_pass ? n : undecided.size();
+    const auto index_at = [&](int64 i) -> int32 {
+      return first_pass ? i : undecided[i];
+    };
+
+    int64 histogram[kNumBuckets] = {};
+    for (int64 i = 0; i < num_undecided; ++i) {
+      ++histogram[(keys[index_at(i)] >> shift) & (kNumBuckets - 1)];
+    }
+    int bucket = kNumBuckets - 1;
+    int64 num_above = 0;
+    while (num_above + histogram[bucket] < remaining) {
+      num_above += histogram[bucket--];
+    }
+
+    next_undecided.clear();
+    next_undecided.reserve(histogram[bucket]);
+    for (int64 i = 0; i < num_undecided; ++i) {
+      const int32 index = index_at(i);
+      const int digit = (keys[index] >> shift) & (kNumBuckets - 1);
+      if (digit > bucket) {
+        top_k[num_selected++] = index;
+      } else if (digit == bucket) {
+        next_undecided.push_back(index);
+      }
+    }
+    remaining -= num_above;
+    undecided.swap(next_undecided);
+    if (remaining == static_cast<int64>(undecided.size())) break;
+  }
+  // Either all undecided elements are selected, or they all have equal keys.
+  std::copy(undecided.begin(), undecided.begin() + remaining,
+            top_k + num_selected);
+}
+
+// Sorts `top_k` into TopK order. Comparing precomputed keys is considerably
+// faster than gathering both values for every comparison.
+template <typename T>
+void SortTopK(const T* row, int k, int32* top_k) {
+  typedef typename TopKRadixKey<T>::type Key;
+  std::vector<std::pair<Key, int32>> keyed(k);
+  for (int i = 0; i < k; ++i) {
+    // Inverted keys sort in ascending order to descending values, and ties
+    // are broken by ascending indices.
+    keyed[i] = {~TopKRadixKey<T>::Get(row[top_k[i]]), top_k[i]};
+  }
+  std::sort(keyed.begin(), keyed.end());
+  for (int i = 0; i < k; ++i) top_k[i] = keyed[i].second;
+}
+
+// Writes the indices of the top `k` elements of a row of `num_cols` elements
+// to `top_k`, using threshold filtering if k is small compared to the row and
+// radix select otherwise.
+template <typename T>
+void SelectTopK(const T* row, int64 num_cols, int k, bool sorted,
+                int32* top_k, std::vector<int32>* candidates) {
+  if (k == num_cols) {
+    // All columns are selected, and always returned in sorted order.
+    std::iota(top_k, top_k + k, 0);
+    sorted = true;
+  } else if (k * kTopKFilterRatio <= num_cols) {
+    FilterTopK(row, 0, num_cols, k, candidates);
+    std::copy(candidates->begin(), candidates->end(), top_k);
+  } else {
+    RadixSelectTopK(row, num_cols, k, top_k);
+  }
+  if (sorted) SortTopK(row, k, top_k);
+}
+
+// Returns the number of chunks to split every row into, so that rows longer
+// than kTopKMinColumnsPerChunk can use all threads if there are only few rows.
+int64 NumTopKChunksPerRow(int64 num_rows, int64 num_cols, int k,
+                          int num_threads) {
+  if (num_rows >= num_threads) return 1;
+  const int64 num_chunks =
+      std::min<int64>(Eigen::divup<int64>(num_threads, num_rows),
+                      num_cols / kTopKMinColumnsPerChunk);
+  // The per-chunk candidates must be few compared to the chunk itself.
+  if (num_chunks <= 1 || k * kTopKFilterRatio > num_cols / num_chunks) {
+    return 1;
+  }
+  return num_chunks;
+}
+
+}  // namespace
+
 namespace functor {
 
 template <typename T>
@@ -136,9 +427,63 @@ struct TopKFunctor<CPUDevice, T> {
       return Status::OK();
     }
 
+    auto worker_threads = *(context->device()->tensorflow_cpu_worker_threads());
+    const double cmp_cost = 3 * Eigen::TensorOpCost::AddCost<int32>() +
+                            Eigen::TensorOpCost::AddCost<T>();
+
+    // Very long rows, e.g. vocabulary logits in beam search, are split into
+    // chunks whose top k are selected in parallel and then merged.
+    const int64 num_chunks = NumTopKChunksPerRow(num_rows, num_cols, k,
+                                                 worker_threads.num_threads);
+    if (num_chunks > 1) {
+      const int64 chunk_size = Eigen::divup(num_cols, num_chunks);
+      std::vector<std::vector<int32>> chunk_top_k(num_rows * num_chunks);
+      auto SelectChunks = [&](int64 start, int64 limit) {
+        for (int64 i = start; i < limit; ++i) {
+          const int64 begin = (i % num_chunks) * chunk_size;
+          const int64 end = std::min(begin + chunk_size, num_cols);
+          FilterTopK(&input(i / num_chunks, 0), begin, end, k, &chunk_top_k[i]);
+        }
+      };
+      Shard(worker_threads.num_threads, worker_threads.workers,
+            num_rows * num_chunks, chunk_size * cmp_cost, SelectChunks);
+
+      auto MergeChunks = [&](int64 start_batch, int64 limit_batch) {
+        std::vector<int32> candidates;
+        for (int64 b = start_batch; b < limit_batch; ++b) {
+          const T* input_data = &input(b, 0);
+          candidates.clear();
+          for (int64 c = 0; c < num_chunks; ++c) {
+            const auto& top_k = chunk_top_k[b * num_chunks + c];
+            candidates.insert(candidates.end(), top_k.begin(), top_k.end());
+          }
+          TruncateCandidates(input_data, k, &candidates);
+          std::copy(candidates.begin(), candidates.end(), &indices(b, 0));
+          if (sorted) SortTopK(input_data, k, &indices(b, 0));
+          std::transform(&indices(b, 0), &indices(b, k), &values(b, 0),
+                         [input_data](const int32 loc) {
+                           return input_data[loc];
+                         });
+        }
+      };
+      Shard(worker_threads.num_threads, worker_threads.workers, num_rows,
+            num_chunks * k * cmp_cost, MergeChunks);
+      return Status::OK();
+    }
+
     auto SortIndices = [&](int start_batch, int limit_batch) {
+      std::vector<int32> candidates;
       for (int32 b = start_batch; b < limit_batch; ++b) {
         const T* input_data = &input(b, 0);
+        if (num_cols >= kTopKMinColumnsForSelection) {
+          SelectTopK(input_data, num_cols, k, sorted, &indices(b, 0),
+                     &candidates);
+          std::transform(&indices(b, 0), &indices(b, k), &values(b, 0),
+                         [input_data](const int32 loc) {
+                           return input_data[loc];
+                         });
+          continue;
+        }
         const auto stable_comp = [input_data](const int32 a, const int32 b) {
           if (input_data[b] < input_data[a]) {
             return true;
@@ -151,11 +496,6 @@ struct TopKFunctor<CPUDevice, T> {
         const auto comp = [input_data](const int32 a, const int32 b) {
           return input_data[b] < input_data[a];
         };
-        // TODO(ebrevdo): For large k < num_cols, instead of using
-        // TopN, it may be faster to create a temporary vector of
-        // values 0..num_cols - 1 and then use std::partial_sort_copy
-        // of this into indices. Choosing the appropriate minimum k or
-        // ratio of k/num_cols will require some experimentation.
         if (k == num_cols) {
           auto* begin = &indices(b, 0);
           auto* end = &indices(b, k);
@@ -209,8 +549,6 @@ struct TopKFunctor<CPUDevice, T> {
 
     // Guesstimate of cost; 4*N*log(K) where N == num_cols.
     // If K == N, assume the cost is N*log(K + 1).
-    const double cmp_cost = 3 * Eigen::TensorOpCost::AddCost<int32>() +
-                            Eigen::TensorOpCost::AddCost<T>();
     const double base_cost =
         cmp_cost *
         static_cast<double>(num_cols *
@@ -221,7 +559,6 @@ struct TopKFunctor<CPUDevice, T> {
     const int64 final_cost = (total_cost >= static_cast<double>(kint64max))
                                  ? kint64max
                                  : static_cast<int64>(total_cost);
-    auto worker_threads = *(context->device()->tensorflow_cpu_worker_threads());
     Shard(worker_threads.num_threads, worker_threads.workers, num_rows,
           final_cost, SortIndices);
 
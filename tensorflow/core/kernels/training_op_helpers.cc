@@ -15,11 +15,16 @@ limitations under the License.
 
 #include "tensorflow/core/kernels/training_op_helpers.h"
 
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <utility>
+
+#include "tensorflow/core/util/env_var.h"
 #include "tensorflow/core/util/ptr_util.h"
 
 namespace tensorflow {
 
-
 void MaybeForwardRefInputToRefOutput(OpKernelContext* ctx, int input,
                                      int output) {
   if (ctx->input_dtype(input) != DT_RESOURCE) {
@@ -27,4 +32,118 @@ void MaybeForwardRefInputToRefOutput(OpKernelContext* ctx, int input,
   }
 }
 
+namespace {
+
+typedef std::pair<const mutex*, const mutex*> CombinerKey;
+
+mutex* combiners_mu() {
+  static mutex* mu = new mutex;
+  return mu;
+}
+
+std::map<CombinerKey, SparseUpdateCombiner*>* combiners() {
+  static auto* combiners = new std::map<CombinerKey, SparseUpdateCombiner*>;
+  return combiners;
+}
+
+std::atomic<int64> num_combined_updates(0);
+
+}  // namespace
+
+bool SparseUpdateCombiner::Enabled() {
+  static const bool enabled = [] {
+    bool result;
+    Status status =
+        ReadBoolFromEnvVar("TF_COMBINE_SPARSE_APPLY_UPDATES", false, &result);
+    if (!status.ok()) {
+      LOG(ERROR) << status.error_message();
+      return false;
+    }
+    return result;
+  }();
+  return enabled;
+}
+
+Status SparseUpdateCombiner::Apply(const mutex* mu0, const mutex* mu1,
+                                   Update update,
+                                   const LockedRunner& run_locked) {
+  const CombinerKey key(std::min(mu0, mu1), std::max(mu0, mu1));
+  SparseUpdateCombiner* combiner;
+  {
+    mutex_lock l(*combiners_mu());
+    SparseUpdateCombiner*& entry = (*combiners())[key];
+    if (entry == nullptr) {
+      entry = new SparseUpdateCombiner;
+    }
+    combiner = entry;
+    ++combiner->users_;
+  }
+  Status status = combiner->ApplyBatched(std::move(update), run_locked);
+  {
+    // The combiner of variables that are no longer updated is deleted, since
+    // the address of their mutexes may be reused by other variables.
+    mutex_lock l(*combiners_mu());
+    if (--combiner->users_ == 0) {
+      combiners()->erase(key);
+      delete combiner;
+    }
+  }
+  return status;
+}
+
+Status SparseUpdateCombiner::ApplyBatched(Update update,
+                                          const LockedRunner& run_locked) {
+  PendingUpdate self;
+  self.update = std::move(update);
+  std::vector<PendingUpdate*> batch;
+  {
+    mutex_lock l(mu_);
+    pending_.push_back(&self);
+    if (!applying_) {
+      applying_ = true;
+      self.applies = true;
+    }
+    while (!self.done && !self.applies) {
+      self.cv.wait(l);
+    }
+    if (self.done) return self.status;
+    // No other caller is applying, and the queue holds at least this update.
+    batch.swap(pending_);
+  }
+  if (batch.size() > 1) {
+    num_combined_updates.fetch_add(batch.size(), std::memory_order_relaxed);
+  }
+  run_locked([&batch]() {
+    for (PendingUpdate* pending : batch) {
+      pending->status = pending->update();
+    }
+  });
+  {
+    // Only the callers whose update was applied, and the caller of the first
+    // update queued since, are woken up. A caller cannot return, and thus
+    // destroy its PendingUpdate, before mu_ is released.
+    mutex_lock l(mu_);
+    for (PendingUpdate* pending : batch) {
+      pending->done = true;
+      if (pending != &self) pending->cv.notify_one();
+    }
+    if (pending_.empty()) {
+      applying_ = false;
+    } else {
+      pending_.front()->applies = true;
+      pending_.front()->cv.notify_one();
+    }
+  }
+  return self.status;
+}
+
+size_t SparseUpdateCombiner::NumCombinersForTesting() {
+  mutex_lock l(*combiners_mu());
+  return combiners()->size();
+}
+
+int64 SparseUpdateCombiner::NumCombinedUpdatesForTesting() {
+  return num_combined_updates.load(std::memory_order_relaxed);
+}
+
 }  // end namespace tensorflow
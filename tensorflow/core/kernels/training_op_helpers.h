@@ -16,6 +16,9 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_KERNELS_TRAINING_OP_HELPERS_H_
 #define TENSORFLOW_CORE_KERNELS_TRAINING_OP_HELPERS_H_
 
+#include <functional>
+#include <vector>
+
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/variant_op_registry.h"
@@ -191,6 +194,61 @@ VariableInputLockHolder MaybeLockVariableInputMutexesInOrder(
 void MaybeForwardRefInputToRefOutput(OpKernelContext* ctx, int input,
                                      int output);
 
+// Lets concurrent sparse apply ops that update the same variables under
+// exclusive locks apply each other's updates. The op that finds no other one
+// applying takes the variable locks once and applies every update queued so
+// far, in order, while the ops that queued them wait. A convoy on the locks of
+// a hot variable thus becomes one lock acquisition per batch of updates, and
+// an update waits for at most the batch in progress before its own. Updates
+// are applied one after the other, exactly as if each op had taken the locks
+// itself. Each waiting op has its own condition variable: a finished batch
+// wakes up the ops it applied, and the op of the next update queued, which
+// applies the next batch.
+//
+// Enabled by setting the environment variable TF_COMBINE_SPARSE_APPLY_UPDATES
+// to true.
+class SparseUpdateCombiner {
+ public:
+  // Applies one update. Called with the variable locks held.
+  typedef std::function<Status()> Update;
+  // Takes the variable locks and calls `apply` while holding them.
+  typedef std::function<void(const std::function<void()>& apply)> LockedRunner;
+
+  static bool Enabled();
+
+  // Applies `update` to the variables guarded by `mu0` and `mu1`, batched with
+  // the concurrent updates of the same variables, and returns its status.
+  // `run_locked` is used if this caller applies the batch.
+  static Status Apply(const mutex* mu0, const mutex* mu1, Update update,
+                      const LockedRunner& run_locked);
+
+  // Returns the number of pairs of variables with updates in progress.
+  static size_t NumCombinersForTesting();
+
+  // Returns the number of updates applied in a batch with other updates.
+  static int64 NumCombinedUpdatesForTesting();
+
+ private:
+  // Guarded by the mu_ of the combiner it is queued on.
+  struct PendingUpdate {
+    Update update;
+    Status status;
+    bool done = false;
+    // Set when the caller must apply the next batch.
+    bool applies = false;
+    condition_variable cv;
+  };
+
+  Status ApplyBatched(Update update, const LockedRunner& run_locked)
+      TF_LOCKS_EXCLUDED(mu_);
+
+  mutex mu_;
+  bool applying_ TF_GUARDED_BY(mu_) = false;
+  std::vector<PendingUpdate*> pending_ TF_GUARDED_BY(mu_);
+  // Guarded by the registry lock in the .cc file.
+  int users_ = 0;
+};
+
 // This is for use with ResourceVariables to ensure *tensor has a
 // reference count of 1 before you update it.
 // REQUIRES: If you pass in variable->tensor(), *variable->mu() must be held.
@@ -1633,55 +1633,101 @@ class SparseApplyAdagradOp : public OpKernel {
 
   void Compute(OpKernelContext* ctx) override TF_NO_THREAD_SAFETY_ANALYSIS {
     const bool sparse = true;
-    auto locks = MaybeLockVariableInputMutexesInOrder<CPUDevice, T>(
-        ctx, use_exclusive_lock_, sparse, {0, 1});
+    if (use_exclusive_lock_ && SparseUpdateCombiner::Enabled()) {
+      ComputeCombined(ctx);
+      if (!ctx->status().ok()) return;
+    } else {
+      auto locks = MaybeLockVariableInputMutexesInOrder<CPUDevice, T>(
+          ctx, use_exclusive_lock_, sparse, {0, 1});
+      OP_REQUIRES_OK(ctx, ApplyLocked(ctx));
+    }
+
+    MaybeForwardRefInputToRefOutput(ctx, 0, 0);
+  }
+
+ private:
+  // Applies the update of `ctx` through a SparseUpdateCombiner, possibly
+  // together with the updates of concurrent ops on the same variables.
+  void ComputeCombined(OpKernelContext* ctx) TF_NO_THREAD_SAFETY_ANALYSIS {
+    const bool sparse = true;
+    // GetTrainingVariableMutex fails ctx on an invalid variable.
+    Var* var_resource;
+    const mutex* var_mu = GetTrainingVariableMutex<CPUDevice, T>(
+        ctx, 0, sparse, &var_resource);
+    core::ScopedUnref unref_var(var_resource);
+    if (var_mu == nullptr) return;
+    Var* accum_resource;
+    const mutex* accum_mu = GetTrainingVariableMutex<CPUDevice, T>(
+        ctx, 1, sparse, &accum_resource);
+    core::ScopedUnref unref_accum(accum_resource);
+    if (accum_mu == nullptr) return;
+    OP_REQUIRES_OK(
+        ctx, SparseUpdateCombiner::Apply(
+                 var_mu, accum_mu, [this, ctx]() { return ApplyLocked(ctx); },
+                 [this, ctx](const std::function<void()>& apply) {
+                   auto locks =
+                       MaybeLockVariableInputMutexesInOrder<CPUDevice, T>(
+                           ctx, use_exclusive_lock_, sparse, {0, 1});
+                   apply();
+                 }));
+  }
+
+  // Applies the update of `ctx`. Requires the variable locks to be held if
+  // use_exclusive_lock_ is true.
+  Status ApplyLocked(OpKernelContext* ctx) TF_NO_THREAD_SAFETY_ANALYSIS {
+    const bool sparse = true;
     Tensor var;
-    OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<CPUDevice, T>(
-                            ctx, 0, use_exclusive_lock_, sparse, &var));
+    TF_RETURN_IF_ERROR(GetInputTensorFromVariable<CPUDevice, T>(
+        ctx, 0, use_exclusive_lock_, sparse, &var));
     Tensor accum;
-    OP_REQUIRES_OK(ctx, GetInputTensorFromVariable<CPUDevice, T>(
-                            ctx, 1, use_exclusive_lock_, sparse, &accum));
-    OP_REQUIRES(
-        ctx, var.IsInitialized(),
-        errors::FailedPrecondition(
-            "Attempting to use uninitialized variables: ", requested_input(0)));
-    OP_REQUIRES(
-        ctx, accum.IsInitialized(),
-        errors::FailedPrecondition(
-            "Attempting to use uninitialized variables: ", requested_input(1)));
-    OP_REQUIRES(
-        ctx, var.shape().IsSameSize(accum.shape()),
-        errors::InvalidArgument("var and accum do not have the same shape",
-                                var.shape().DebugString(), " ",
-                                accum.shape().DebugString()));
-    OP_REQUIRES(ctx, TensorShapeUtils::IsVectorOrHigher(var.shape()),
-                errors::InvalidArgument("var must be at least 1 dimensional"));
+    TF_RETURN_IF_ERROR(GetInputTensorFromVariable<CPUDevice, T>(
+        ctx, 1, use_exclusive_lock_, sparse, &accum));
+    if (!var.IsInitialized()) {
+      return errors::FailedPrecondition(
+          "Attempting to use uninitialized variables: ", requested_input(0));
+    }
+    if (!accum.IsInitialized()) {
+      return errors::FailedPrecondition(
+          "Attempting to use uninitialized variables: ", requested_input(1));
+    }
+    if (!var.shape().IsSameSize(accum.shape())) {
+      return errors::InvalidArgument("var and accum do not have the same shape",
+                                     var.shape().DebugString(), " ",
+                                     accum.shape().DebugString());
+    }
+    if (!TensorShapeUtils::IsVectorOrHigher(var.shape())) {
+      return errors::InvalidArgument("var must be at least 1 dimensional");
+    }
 
     const Tensor& lr = ctx->input(2);
-    OP_REQUIRES(ctx, TensorShapeUtils::IsScalar(lr.shape()),
-                errors::InvalidArgument("lr is not a scalar: ",
-                                        lr.shape().DebugString()));
+    if (!TensorShapeUtils::IsScalar(lr.shape())) {
+      return errors::InvalidArgument("lr is not a scalar: ",
+                                     lr.shape().DebugString());
+    }
     const Tensor& grad = ctx->input(3);
     const Tensor& indices = ctx->input(4);
-    OP_REQUIRES(ctx, TensorShapeUtils::IsVector(indices.shape()),
-                errors::InvalidArgument("indices must be one-dimensional"));
+    if (!TensorShapeUtils::IsVector(indices.shape())) {
+      return errors::InvalidArgument("indices must be one-dimensional");
+    }
 
     int64 inner_dim = 1;
     for (int d = 1; d < var.dims(); d++) {
-      OP_REQUIRES(ctx, var.dim_size(d) == grad.dim_size(d),
-                  errors::InvalidArgument(strings::StrCat(
-                      "var and grad must match in dimension ", d)));
+      if (var.dim_size(d) != grad.dim_size(d)) {
+        return errors::InvalidArgument(
+            strings::StrCat("var and grad must match in dimension ", d));
+      }
       inner_dim *= grad.dim_size(d);
     }
     const Tindex N = indices.dim_size(0);
-    OP_REQUIRES(
-        ctx, grad.dim_size(0) == N,
-        errors::InvalidArgument(
-            "grad must be the same size as indices in the first dimension."));
+    if (grad.dim_size(0) != N) {
+      return errors::InvalidArgument(
+          "grad must be the same size as indices in the first dimension.");
+    }
 
-    OP_REQUIRES(ctx, inner_dim > 0,
-                errors::InvalidArgument(
-                    "Inner dimension should be greater than zero."));
+    if (inner_dim <= 0) {
+      return errors::InvalidArgument(
+          "Inner dimension should be greater than zero.");
+    }
 
     // This op is implemented only for CPU device.
     const auto& d = ctx->eigen_cpu_device();
@@ -1703,10 +1749,11 @@ class SparseApplyAdagradOp : public OpKernel {
 
         for (Tindex i = 0; i < N; ++i) {
           const Tindex index = internal::SubtleMustCopy(indices_vec(i));
-          OP_REQUIRES(ctx, FastBoundsCheck(index, first_dim_size),
-                      errors::InvalidArgument(
-                          strings::StrCat("Index ", index, " at offset ", i,
-                                          " in indices is out of range")));
+          if (!FastBoundsCheck(index, first_dim_size)) {
+            return errors::InvalidArgument(
+                strings::StrCat("Index ", index, " at offset ", i,
+                                " in indices is out of range"));
+          }
         }
 
         const auto shard = [&](Tindex start_idx, Tindex end_idx) -> void {
@@ -1734,10 +1781,11 @@ class SparseApplyAdagradOp : public OpKernel {
 
         for (Tindex i = 0; i < N; ++i) {
           const Tindex index = internal::SubtleMustCopy(indices_vec(i));
-          OP_REQUIRES(ctx, FastBoundsCheck(index, first_dim_size),
-                      errors::InvalidArgument(
-                          strings::StrCat("Index ", index, " at offset ", i,
-                                          " in indices is out of range")));
+          if (!FastBoundsCheck(index, first_dim_size)) {
+            return errors::InvalidArgument(
+                strings::StrCat("Index ", index, " at offset ", i,
+                                " in indices is out of range"));
+          }
         }
 
         const auto shard = [&](Tindex start_idx, Tindex end_idx) -> void {
@@ -1755,11 +1803,9 @@ class SparseApplyAdagradOp : public OpKernel {
         d.parallelFor(N, cost, shard);
       }
     }
-
-    MaybeForwardRefInputToRefOutput(ctx, 0, 0);
+    return Status::OK();
   }
 
- private:
   bool use_exclusive_lock_;
   bool update_slots_;
 };
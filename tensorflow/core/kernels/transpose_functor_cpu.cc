@@ -15,6 +15,7 @@ limitations under the License.
 
 #define EIGEN_USE_THREADS
 
+#include <algorithm>
 #include <complex>
 
 #include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
@@ -31,6 +32,243 @@ typedef Eigen::ThreadPoolDevice CPUDevice;
 namespace tensorflow {
 namespace {
 
+// Number of elements along each side of the blocks processed by the tiled
+// transpose. Large enough to amortize the index computations per block, small
+// enough that the source rows and destination columns of a block stay in L1.
+constexpr int64 kTransposeBlockSize = 32;
+
+template <typename T, bool conjugate>
+inline void TransposeScalarTile(const T* src, int64 src_stride, T* dst,
+                                int64 dst_stride, int64 rows, int64 cols) {
+  for (int64 i = 0; i < rows; ++i) {
+    for (int64 j = 0; j < cols; ++j) {
+      if (conjugate) {
+        dst[j * dst_stride + i] = Eigen::numext::conj(src[i * src_stride + j]);
+      } else {
+        dst[j * dst_stride + i] = src[i * src_stride + j];
+      }
+    }
+  }
+}
+
+// In-register transpose of a square tile of `kSize` x `kSize` elements, built
+// on Eigen's packet primitives so that it maps to SSE/AVX/AVX-512 or NEON
+// shuffles depending on the build. Elements are moved bit for bit, so 4- and
+// 8-byte integers are routed through float and double packets.
+template <typename T, bool conjugate>
+struct MicroTranspose {
+  static constexpr int kSize = 1;
+  static void Run(const T* src, int64 src_stride, T* dst, int64 dst_stride) {}
+};
+
+template <typename Scalar, typename Bits>
+struct PacketMicroTranspose {
+  typedef typename Eigen::internal::packet_traits<Scalar>::type Packet;
+  static constexpr int kSize =
+      Eigen::internal::packet_traits<Scalar>::Vectorizable
+          ? Eigen::internal::unpacket_traits<Packet>::size
+          : 1;
+  static_assert(sizeof(Scalar) == sizeof(Bits), "Mismatched element size");
+
+  static EIGEN_ALWAYS_INLINE void Run(const Bits* src, int64 src_stride,
+                                      Bits* dst, int64 dst_stride) {
+    Eigen::internal::PacketBlock<Packet, kSize> block;
+    for (int i = 0; i < kSize; ++i) {
+      block.packet[i] = Eigen::internal::ploadu<Packet>(
+          reinterpret_cast<const Scalar*>(src + i * src_stride));
+    }
+    Eigen::internal::ptranspose(block);
+    for (int i = 0; i < kSize; ++i) {
+      Eigen::internal::pstoreu(reinterpret_cast<Scalar*>(dst + i * dst_stride),
+                               block.packet[i]);
+    }
+  }
+};
+
+template <>
+struct MicroTranspose<uint32, false> : PacketMicroTranspose<float, uint32> {};
+template <>
+struct MicroTranspose<uint64, false> : PacketMicroTranspose<double, uint64> {};
+
+// Transposes the `rows` x `cols` matrix at `src` (with row stride
+// `src_stride`) into `dst` (with row stride `dst_stride`), one
+// kTransposeBlockSize block at a time, using in-register micro tiles for the
+// interior of each block.
+template <typename T, bool conjugate>
+void TransposeBlock(const T* src, int64 src_stride, T* dst, int64 dst_stride,
+                    int64 rows, int64 cols) {
+  typedef MicroTranspose<T, conjugate> Micro;
+  constexpr int64 k = Micro::kSize;
+  for (int64 j0 = 0; j0 < cols; j0 += kTransposeBlockSize) {
+    const int64 block_cols = std::min(kTransposeBlockSize, cols - j0);
+    const T* block_src = src + j0;
+    T* block_dst = dst + j0 * dst_stride;
+    if (k == 1) {
+      TransposeScalarTile<T, conjugate>(block_src, src_stride, block_dst,
+                                        dst_stride, rows, block_cols);
+      continue;
+    }
+    int64 i = 0;
+    for (; i + k <= rows; i += k) {
+      int64 j = 0;
+      for (; j + k <= block_cols; j += k) {
+        Micro::Run(block_src + i * src_stride + j, src_stride,
+                   block_dst + j * dst_stride + i, dst_stride);
+      }
+      TransposeScalarTile<T, conjugate>(
+          block_src + i * src_stride + j, src_stride,
+          block_dst + j * dst_stride + i, dst_stride, k, block_cols - j);
+    }
+    TransposeScalarTile<T, conjugate>(block_src + i * src_stride, src_stride,
+                                      block_dst + i, dst_stride, rows - i,
+                                      block_cols);
+  }
+}
+
+// Cache-blocked transpose for trivially copyable types.
+//
+// Singleton dimensions are dropped and dimensions that stay adjacent in the
+// output are merged, so e.g. NHWC <-> NCHW becomes a batch of 2-D transposes.
+// If the innermost input dimension stays innermost, contiguous runs are copied
+// as a whole. Otherwise the innermost input dimension and the input dimension
+// that becomes innermost in the output form a 2-D transpose, which is tiled and
+// parallelized over blocks of rows and over all the remaining dimensions.
+template <typename T, bool conjugate>
+void TransposeTiled(const CPUDevice& device, const Tensor& in,
+                    const gtl::ArraySlice<int32> perm, Tensor* out) {
+  const T* p = reinterpret_cast<const T*>(in.tensor_data().data());
+  T* q = reinterpret_cast<T*>(const_cast<char*>((out->tensor_data().data())));
+  const int64 num_elements = in.NumElements();
+  if (num_elements == 0) return;
+
+  // Drop singleton dimensions.
+  TensorShape squeezed_shape;
+  internal::TransposePermsVec squeezed_index(in.dims(), -1);
+  for (int i = 0; i < in.dims(); ++i) {
+    if (in.dim_size(i) != 1) {
+      squeezed_index[i] = squeezed_shape.dims();
+      squeezed_shape.AddDim(in.dim_size(i));
+    }
+  }
+  internal::TransposePermsVec squeezed_perm;
+  for (int32 d : perm) {
+    if (squeezed_index[d] >= 0) squeezed_perm.push_back(squeezed_index[d]);
+  }
+
+  // Merge dimensions. ReduceTransposeDimensions returns the merged input shape
+  // and, for each merged input dimension, its position in the output.
+  internal::TransposeDimsVec dims;
+  internal::TransposePermsVec out_position;
+  if (squeezed_shape.dims() > 1) {
+    internal::ReduceTransposeDimensions(squeezed_shape, squeezed_perm,
+                                        &out_position, &dims);
+  }
+  const int ndims = dims.size();
+
+  // Only a copy (or conjugation) is left to do.
+  if (ndims <= 1) {
+    auto copy_fn = [p, q](int64 begin, int64 end) {
+      for (int64 i = begin; i < end; ++i) {
+        q[i] = conjugate ? Eigen::numext::conj(p[i]) : p[i];
+      }
+    };
+    device.parallelFor(num_elements,
+                       Eigen::TensorOpCost(sizeof(T), sizeof(T), 1), copy_fn);
+    return;
+  }
+
+  internal::TransposeDimsVec in_strides(ndims);
+  internal::TransposeDimsVec out_dims(ndims);
+  internal::TransposeDimsVec out_strides(ndims);
+  in_strides[ndims - 1] = 1;
+  for (int i = ndims - 1; i > 0; --i) {
+    in_strides[i - 1] = in_strides[i] * dims[i];
+  }
+  for (int i = 0; i < ndims; ++i) out_dims[out_position[i]] = dims[i];
+  out_strides[ndims - 1] = 1;
+  for (int i = ndims - 1; i > 0; --i) {
+    out_strides[i - 1] = out_strides[i] * out_dims[i];
+  }
+
+  // Input dimensions that are not part of the inner 2-D problem, listed in
+  // output order so that consecutive work units write nearby memory.
+  const int inner_in = ndims - 1;
+  int row_in = -1;
+  for (int i = 0; i < ndims; ++i) {
+    if (out_position[i] == ndims - 1) row_in = i;
+  }
+  internal::TransposePermsVec outer_in;
+  for (int o = 0; o < ndims; ++o) {
+    for (int i = 0; i < ndims; ++i) {
+      if (out_position[i] == o && i != inner_in && i != row_in) {
+        outer_in.push_back(i);
+      }
+    }
+  }
+  auto outer_offsets = [&](int64 index, int64* in_offset, int64* out_offset) {
+    *in_offset = 0;
+    *out_offset = 0;
+    for (int k = outer_in.size() - 1; k >= 0; --k) {
+      const int i = outer_in[k];
+      const int64 coord = index % dims[i];
+      index /= dims[i];
+      *in_offset += coord * in_strides[i];
+      *out_offset += coord * out_strides[out_position[i]];
+    }
+  };
+  int64 num_outer = 1;
+  for (int i : outer_in) num_outer *= dims[i];
+
+  if (row_in == inner_in) {
+    // The innermost dimension is preserved: copy contiguous runs.
+    const int64 run = dims[inner_in];
+    auto copy_runs = [&, p, q, run](int64 begin, int64 end) {
+      for (int64 r = begin; r < end; ++r) {
+        int64 in_offset, out_offset;
+        outer_offsets(r, &in_offset, &out_offset);
+        const T* src = p + in_offset;
+        T* dst = q + out_offset;
+        for (int64 i = 0; i < run; ++i) {
+          dst[i] = conjugate ? Eigen::numext::conj(src[i]) : src[i];
+        }
+      }
+    };
+    device.parallelFor(
+        num_outer,
+        Eigen::TensorOpCost(
+            run * sizeof(T), run * sizeof(T),
+            run + ndims * Eigen::TensorOpCost::DivCost<int64>()),
+        copy_runs);
+    return;
+  }
+
+  // Inner 2-D problem: rows are indexed by `row_in` (contiguous in the output)
+  // and columns by `inner_in` (contiguous in the input).
+  const int64 rows = dims[row_in];
+  const int64 cols = dims[inner_in];
+  const int64 src_stride = in_strides[row_in];
+  const int64 dst_stride = out_strides[out_position[inner_in]];
+  const int64 row_blocks =
+      (rows + kTransposeBlockSize - 1) / kTransposeBlockSize;
+  auto transpose_blocks = [&, p, q](int64 begin, int64 end) {
+    for (int64 unit = begin; unit < end; ++unit) {
+      const int64 outer = unit / row_blocks;
+      const int64 i0 = (unit % row_blocks) * kTransposeBlockSize;
+      int64 in_offset, out_offset;
+      outer_offsets(outer, &in_offset, &out_offset);
+      TransposeBlock<T, conjugate>(
+          p + in_offset + i0 * src_stride, src_stride, q + out_offset + i0,
+          dst_stride, std::min(kTransposeBlockSize, rows - i0), cols);
+    }
+  };
+  const int64 unit_elements = std::min(kTransposeBlockSize, rows) * cols;
+  device.parallelFor(num_outer * row_blocks,
+                     Eigen::TensorOpCost(unit_elements * sizeof(T),
+                                         unit_elements * sizeof(T),
+                                         unit_elements),
+                     transpose_blocks);
+}
+
 template <typename T, bool conjugate>
 void TransposeSimple(const CPUDevice& device, const Tensor& in,
                      const gtl::ArraySlice<int32> perm, Tensor* out) {
@@ -71,6 +309,16 @@ template <typename T, bool conjugate>
 struct Transpose<CPUDevice, T, conjugate> {
   static void run(const CPUDevice& d, const Tensor& in,
                   const gtl::ArraySlice<int32> perm, Tensor* out) {
+    TransposeTiled<T, conjugate>(d, in, perm, out);
+  }
+};
+
+// Strings are not trivially copyable and go through Eigen.
+template <bool conjugate>
+struct Transpose<CPUDevice, tstring, conjugate> {
+  static void run(const CPUDevice& d, const Tensor& in,
+                  const gtl::ArraySlice<int32> perm, Tensor* out) {
+    typedef tstring T;
     switch (in.dims()) {
       case 2:
         internal::TransposeUsingEigen<CPUDevice, T, 2>(d, in, perm, conjugate,
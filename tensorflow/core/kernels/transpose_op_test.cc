@@ -0,0 +1,193 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <vector>
+
+#include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/graph/node_builder.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/kernels/ops_util.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/random/simple_philox.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/public/session_options.h"
+
+namespace tensorflow {
+namespace {
+
+// Reference transpose computed one element at a time.
+template <typename T>
+Tensor ReferenceTranspose(const Tensor& in, const std::vector<int32>& perm,
+                          bool conjugate) {
+  TensorShape out_shape;
+  for (int32 d : perm) out_shape.AddDim(in.dim_size(d));
+  Tensor out(in.dtype(), out_shape);
+  const auto in_strides = ComputeStride<int64>(in.shape());
+  const auto out_strides = ComputeStride<int64>(out_shape);
+  const auto in_flat = in.flat<T>();
+  auto out_flat = out.flat<T>();
+  for (int64 o = 0; o < out.NumElements(); ++o) {
+    int64 t = o;
+    int64 i = 0;
+    for (int d = 0; d < perm.size(); ++d) {
+      i += (t / out_strides[d]) * in_strides[perm[d]];
+      t %= out_strides[d];
+    }
+    out_flat(o) = conjugate ? Eigen::numext::conj(in_flat(i)) : in_flat(i);
+  }
+  return out;
+}
+
+class TransposeOpTest : public OpsTestBase {
+ protected:
+  template <typename T>
+  void RunRandomShapes(DataType dtype, const string& op) {
+    random::PhiloxRandom philox(301, 17);
+    random::SimplePhilox rnd(&philox);
+    for (int iter = 0; iter < 200; ++iter) {
+      const int ndims = 2 + rnd.Uniform(5);
+      TensorShape shape;
+      std::vector<int32> perm(ndims);
+      for (int d = 0; d < ndims; ++d) {
+        // Mix singleton, tiny and block-sized dimensions.
+        const int64 size =
+            rnd.OneIn(5) ? 1 : 1 + rnd.Uniform(iter % 4 ? 9 : 40);
+        shape.AddDim(size);
+        perm[d] = d;
+      }
+      for (int d = ndims - 1; d > 0; --d) {
+        std::swap(perm[d], perm[rnd.Uniform(d + 1)]);
+      }
+
+      Tensor input(dtype, shape);
+      input.flat<T>().setRandom();
+      Tensor perm_tensor(DT_INT32, TensorShape({ndims}));
+      std::copy(perm.begin(), perm.end(), perm_tensor.flat<int32>().data());
+
+      inputs_.clear();
+      TF_ASSERT_OK(NodeDefBuilder("transpose", op)
+                       .Input(FakeInput(dtype))
+                       .Input(FakeInput(DT_INT32))
+                       .Finalize(node_def()));
+      TF_ASSERT_OK(InitOp());
+      AddInputFromArray<T>(shape, gtl::ArraySlice<T>(input.flat<T>().data(),
+                                                     input.NumElements()));
+      AddInputFromArray<int32>(TensorShape({ndims}), perm);
+      TF_ASSERT_OK(RunOpKernel());
+      test::ExpectTensorEqual<T>(
+          ReferenceTranspose<T>(input, perm, op == "ConjugateTranspose"),
+          *GetOutput(0));
+    }
+  }
+};
+
+TEST_F(TransposeOpTest, RandomShapesFloat) {
+  RunRandomShapes<float>(DT_FLOAT, "Transpose");
+}
+
+TEST_F(TransposeOpTest, RandomShapesDouble) {
+  RunRandomShapes<double>(DT_DOUBLE, "Transpose");
+}
+
+TEST_F(TransposeOpTest, RandomShapesUint8) {
+  RunRandomShapes<uint8>(DT_UINT8, "Transpose");
+}
+
+TEST_F(TransposeOpTest, RandomShapesInt16) {
+  RunRandomShapes<int16>(DT_INT16, "Transpose");
+}
+
+TEST_F(TransposeOpTest, RandomShapesConjugateComplex64) {
+  RunRandomShapes<complex64>(DT_COMPLEX64, "ConjugateTranspose");
+}
+
+TEST_F(TransposeOpTest, RandomShapesConjugateComplex128) {
+  RunRandomShapes<complex128>(DT_COMPLEX128, "ConjugateTranspose");
+}
+
+template <typename T>
+static Graph* TransposeGraph(const TensorShape& shape,
+                             const std::vector<int32>& perm) {
+  Graph* g = new Graph(OpRegistry::Global());
+  Tensor data(DataTypeToEnum<T>::value, shape);
+  data.flat<T>().setRandom();
+  Tensor perm_tensor(DT_INT32,
+                     TensorShape({static_cast<int64>(perm.size())}));
+  std::copy(perm.begin(), perm.end(), perm_tensor.flat<int32>().data());
+  test::graph::Binary(g, "Transpose", test::graph::Constant(g, data),
+                      test::graph::Constant(g, perm_tensor));
+  return g;
+}
+
+template <typename T>
+static void RunTransposeBenchmark(int iters, const TensorShape& shape,
+                                  const std::vector<int32>& perm) {
+  const int64 num_items = static_cast<int64>(iters) * shape.num_elements();
+  testing::ItemsProcessed(num_items);
+  testing::BytesProcessed(num_items * sizeof(T) * 2);
+  testing::UseRealTime();
+  test::Benchmark("cpu", TransposeGraph<T>(shape, perm)).Run(iters);
+}
+
+static void BM_Transpose2D_float(int iters, int rows, int cols) {
+  RunTransposeBenchmark<float>(iters, TensorShape({rows, cols}), {1, 0});
+}
+
+BENCHMARK(BM_Transpose2D_float)
+    ->ArgPair(128, 128)
+    ->ArgPair(1024, 1024)
+    ->ArgPair(4096, 1000);
+
+static void BM_Transpose2D_uint8(int iters, int rows, int cols) {
+  RunTransposeBenchmark<uint8>(iters, TensorShape({rows, cols}), {1, 0});
+}
+
+BENCHMARK(BM_Transpose2D_uint8)->ArgPair(1024, 1024)->ArgPair(4096, 1000);
+
+static void BM_TransposeNHWCToNCHW_float(int iters, int hw, int channels) {
+  RunTransposeBenchmark<float>(iters, TensorShape({8, hw, hw, channels}),
+                               {0, 3, 1, 2});
+}
+
+BENCHMARK(BM_TransposeNHWCToNCHW_float)
+    ->ArgPair(56, 64)
+    ->ArgPair(28, 256)
+    ->ArgPair(7, 2048);
+
+static void BM_TransposeNCHWToNHWC_float(int iters, int hw, int channels) {
+  RunTransposeBenchmark<float>(iters, TensorShape({8, channels, hw, hw}),
+                               {0, 2, 3, 1});
+}
+
+BENCHMARK(BM_TransposeNCHWToNHWC_float)
+    ->ArgPair(56, 64)
+    ->ArgPair(28, 256)
+    ->ArgPair(7, 2048);
+
+static void BM_Transpose3D_double(int iters, int dim) {
+  RunTransposeBenchmark<double>(iters, TensorShape({dim, dim, dim}),
+                                {2, 0, 1});
+}
+
+BENCHMARK(BM_Transpose3D_double)->Arg(32)->Arg(128);
+
+}  // namespace
+}  // namespace tensorflow
@@ -16,6 +16,7 @@ limitations under the License.
 #include <functional>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "tensorflow/core/framework/bounds_check.h"
@@ -26,6 +27,7 @@ limitations under the License.
 #include "tensorflow/core/lib/bfloat16/bfloat16.h"
 #include "tensorflow/core/lib/core/status.h"
 #include "tensorflow/core/lib/hash/hash.h"
+#include "tensorflow/core/util/work_sharder.h"
 
 namespace tensorflow {
 namespace {
@@ -68,6 +70,164 @@ struct UniqueOpHashMap<bfloat16, TIndex> {
   using map_type = std::unordered_map<bfloat16, TIndex>;
 };
 
+// Vectors with at least this many elements are uniquified in parallel.
+constexpr int64 kParallelUniqueMinElements = 64 * 1024;
+
+// Number of hash partitions per thread. More partitions than threads balance
+// the load when some partitions receive more unique elements than others.
+constexpr int kParallelUniquePartitionsPerThread = 4;
+
+// Uniquifies the vector `input` on the intra-op thread pool, producing exactly
+// the same outputs as the serial implementation: unique elements are returned
+// in the order of their first occurrence.
+//
+// The input is split into one contiguous block per thread, and each element
+// is assigned to a partition by its hash. Every block scatters the positions
+// of its elements to their partitions in input order, so that each partition
+// holds all occurrences of its elements in input order and can be uniquified
+// independently with its own hash map. The first occurrences found by all
+// partitions are then numbered by a prefix sum over the blocks, which gives
+// the output index of every unique element.
+template <typename T, typename TIndex>
+Status ParallelUnique(OpKernelContext* context, const Tensor& input, int64 axis,
+                      typename TTypes<TIndex>::Vec idx_vec, int64* uniq_size) {
+  using MapType = typename UniqueOpHashMap<T, TIndex>::map_type;
+  using KeyType = typename MapType::key_type;
+
+  const auto Tin = input.flat<T>();
+  const int64 N = Tin.size();
+  const auto& worker_threads =
+      *context->device()->tensorflow_cpu_worker_threads();
+  const int64 num_blocks = worker_threads.num_threads;
+  const int64 block_size = Eigen::divup(N, num_blocks);
+  const int64 num_partitions = std::min<int64>(
+      num_blocks * kParallelUniquePartitionsPerThread, kuint16max);
+  const int64 partition_size = Eigen::divup(N, num_partitions);
+
+  // Runs `fn(i)` for every i in [0, n) with one shard per unit of work.
+  const auto parallel_for = [&worker_threads](
+                                int64 n, int64 cost_per_unit,
+                                const std::function<void(int64)>& fn) {
+    Shard(worker_threads.num_threads, worker_threads.workers, n, cost_per_unit,
+          [&fn](int64 start, int64 limit) {
+            for (int64 i = start; i < limit; ++i) fn(i);
+          });
+  };
+  const auto block_begin = [&](int64 b) { return std::min(b * block_size, N); };
+
+  // Assign elements to partitions and count them per block. The hash is mixed
+  // because std::hash is the identity function for integers.
+  std::vector<uint16> partition(N);
+  std::vector<int64> offsets(num_blocks * num_partitions, 0);
+  parallel_for(num_blocks, 50 * block_size, [&](int64 b) {
+    typename MapType::hasher hasher;
+    int64* block_counts = &offsets[b * num_partitions];
+    for (int64 i = block_begin(b); i < block_begin(b + 1); ++i) {
+      const uint64 h = static_cast<uint64>(hasher(KeyType(Tin(i))));
+      const uint16 p = ((h * 0x9E3779B97F4A7C15ULL) >> 32) % num_partitions;
+      partition[i] = p;
+      ++block_counts[p];
+    }
+  });
+
+  // Lay out the partitions one after another, each of them ordered by block.
+  std::vector<int64> partition_begin(num_partitions + 1);
+  int64 offset = 0;
+  for (int64 p = 0; p < num_partitions; ++p) {
+    partition_begin[p] = offset;
+    for (int64 b = 0; b < num_blocks; ++b) {
+      const int64 count = offsets[b * num_partitions + p];
+      offsets[b * num_partitions + p] = offset;
+      offset += count;
+    }
+  }
+  partition_begin[num_partitions] = offset;
+
+  // Positions and ranks are TIndex, like the output indices, so that they
+  // hold any index of an input that out_idx can address.
+  std::vector<TIndex> positions(N);
+  parallel_for(num_blocks, 10 * block_size, [&](int64 b) {
+    int64* block_offsets = &offsets[b * num_partitions];
+    for (int64 i = block_begin(b); i < block_begin(b + 1); ++i) {
+      positions[block_offsets[partition[i]]++] = i;
+    }
+  });
+
+  // Uniquify each partition. `idx_vec` temporarily holds the index of every
+  // element within its partition, and `partition` is reused to mark the first
+  // occurrence of every unique element.
+  std::vector<std::vector<TIndex>> first_positions(num_partitions);
+  std::vector<std::vector<TIndex>> counts(num_partitions);
+  uint16* is_first = partition.data();
+  parallel_for(num_partitions, 100 * partition_size, [&](int64 p) {
+    MapType uniq;
+    uniq.reserve(2 * (partition_begin[p + 1] - partition_begin[p]));
+    for (int64 i = partition_begin[p]; i < partition_begin[p + 1]; ++i) {
+      const TIndex pos = positions[i];
+      auto it = uniq.emplace(Tin(pos), first_positions[p].size());
+      idx_vec(pos) = it.first->second;
+      is_first[pos] = it.second;
+      if (it.second) {
+        first_positions[p].push_back(pos);
+        counts[p].push_back(1);
+      } else {
+        ++counts[p][it.first->second];
+      }
+    }
+  });
+
+  // Number the first occurrences in input order.
+  std::vector<TIndex> rank(N);
+  std::vector<int64> block_offsets(num_blocks + 1, 0);
+  parallel_for(num_blocks, block_size, [&](int64 b) {
+    int64 num_first = 0;
+    for (int64 i = block_begin(b); i < block_begin(b + 1); ++i) {
+      num_first += is_first[i];
+    }
+    block_offsets[b + 1] = num_first;
+  });
+  for (int64 b = 0; b < num_blocks; ++b) {
+    block_offsets[b + 1] += block_offsets[b];
+  }
+  parallel_for(num_blocks, block_size, [&](int64 b) {
+    TIndex r = block_offsets[b];
+    for (int64 i = block_begin(b); i < block_begin(b + 1); ++i) {
+      if (is_first[i]) rank[i] = r++;
+    }
+  });
+
+  *uniq_size = block_offsets[num_blocks];
+  TensorShape output_shape(input.shape());
+  output_shape.set_dim(axis, *uniq_size);
+  Tensor* uniq_output = nullptr;
+  TF_RETURN_IF_ERROR(context->allocate_output(0, output_shape, &uniq_output));
+  auto Tout = uniq_output->flat<T>();
+  TIndex* count_output = nullptr;
+  if (context->num_outputs() > 2) {
+    Tensor* output = nullptr;
+    TF_RETURN_IF_ERROR(
+        context->allocate_output(2, TensorShape({*uniq_size}), &output));
+    count_output = output->vec<TIndex>().data();
+  }
+
+  // Translate the partition-local indices to output indices.
+  parallel_for(num_partitions, 10 * partition_size, [&](int64 p) {
+    std::vector<TIndex> output_index(first_positions[p].size());
+    for (size_t u = 0; u < first_positions[p].size(); ++u) {
+      const TIndex pos = first_positions[p][u];
+      output_index[u] = rank[pos];
+      Tout(rank[pos]) = Tin(pos);
+      if (count_output != nullptr) count_output[rank[pos]] = counts[p][u];
+    }
+    for (int64 i = partition_begin[p]; i < partition_begin[p + 1]; ++i) {
+      const TIndex pos = positions[i];
+      idx_vec(pos) = output_index[idx_vec(pos)];
+    }
+  });
+
+  return Status::OK();
+}
+
 // `UniqueOp` computes the unique elements in the input tensor.
 //
 // * `T` is the element type.
@@ -150,6 +310,14 @@ class UniqueOp : public OpKernel {
       auto Tin = input.flat<T>();
       const int64 N = static_cast<int64>(Tin.size());
 
+      if (N >= kParallelUniqueMinElements &&
+          context->device()->tensorflow_cpu_worker_threads()->num_threads > 1) {
+        // ParallelUnique also computes the counts for UniqueWithCounts.
+        OP_REQUIRES_OK(context, ParallelUnique<T, TIndex>(
+                                    context, input, axis, idx_vec, &uniq_size));
+        return;
+      }
+
       typename UniqueOpHashMap<T, TIndex>::map_type uniq;
       uniq.reserve(2 * N);
       for (Eigen::Index i = 0, j = 0; i < N; ++i) {
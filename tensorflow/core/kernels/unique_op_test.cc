@@ -13,10 +13,15 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include <cmath>
 #include <functional>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 #include "tensorflow/core/common_runtime/kernel_benchmark_testlib.h"
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor.pb.h"
 #include "tensorflow/core/framework/tensor_shape.pb.h"
@@ -28,6 +33,7 @@ limitations under the License.
 #include "tensorflow/core/kernels/ops_testutil.h"
 #include "tensorflow/core/kernels/ops_util.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/platform/test_benchmark.h"
 
@@ -37,6 +43,92 @@ namespace {
 
 const int kMaxStrLen = 40;
 
+class UniqueOpTest : public OpsTestBase {
+ protected:
+  // Runs `op` on `input` and checks the outputs against a serial reference.
+  // The input is large enough to be uniquified in parallel.
+  template <typename T>
+  void RunAndCheck(const string& op, const std::vector<T>& input) {
+    inputs_.clear();
+    TF_ASSERT_OK(NodeDefBuilder("unique", op)
+                     .Input(FakeInput(DataTypeToEnum<T>::value))
+                     .Attr("out_idx", DT_INT64)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+    AddInputFromArray<T>(TensorShape({static_cast<int64>(input.size())}),
+                         input);
+    TF_ASSERT_OK(RunOpKernel());
+
+    // `std::unordered_map` treats every NaN as a distinct key, like the op.
+    std::unordered_map<T, int64> uniq;
+    std::vector<T> expected_y;
+    std::vector<int64> expected_idx;
+    std::vector<int64> expected_count;
+    for (const T& x : input) {
+      auto it = uniq.emplace(x, expected_y.size());
+      if (it.second) {
+        expected_y.push_back(x);
+        expected_count.push_back(0);
+      }
+      expected_idx.push_back(it.first->second);
+      ++expected_count[it.first->second];
+    }
+
+    const auto y = GetOutput(0)->vec<T>();
+    ASSERT_EQ(expected_y.size(), y.size());
+    for (int64 i = 0; i < y.size(); ++i) {
+      ExpectSameValue(expected_y[i], y(i));
+    }
+    test::ExpectTensorEqual<int64>(*GetOutput(1),
+                                   test::AsTensor<int64>(expected_idx));
+    if (op == "UniqueWithCounts") {
+      test::ExpectTensorEqual<int64>(*GetOutput(2),
+                                     test::AsTensor<int64>(expected_count));
+    }
+  }
+
+  template <typename T>
+  void ExpectSameValue(const T& expected, const T& actual) {
+    EXPECT_EQ(expected, actual);
+  }
+
+  void ExpectSameValue(float expected, float actual) {
+    // The first occurrence of 0.0 or -0.0 determines the sign of the output.
+    EXPECT_EQ(std::isnan(expected), std::isnan(actual));
+    EXPECT_EQ(std::signbit(expected), std::signbit(actual));
+    if (!std::isnan(expected)) EXPECT_EQ(expected, actual);
+  }
+};
+
+TEST_F(UniqueOpTest, LargeInt32) {
+  std::vector<int32> input(300000);
+  for (int32& x : input) x = std::rand() % 20000 - 10000;
+  RunAndCheck<int32>("Unique", input);
+}
+
+TEST_F(UniqueOpTest, LargeInt64WithCounts) {
+  for (int64 max_int : {1, 100, 1000000}) {
+    std::vector<int64> input(200000);
+    for (int64& x : input) x = (std::rand() % max_int) << 32;
+    RunAndCheck<int64>("UniqueWithCounts", input);
+  }
+}
+
+TEST_F(UniqueOpTest, LargeFloatWithCounts) {
+  std::vector<float> input(200000);
+  for (float& x : input) {
+    const int r = std::rand() % 5000;
+    x = r == 0 ? NAN : r == 1 ? -0.0f : r == 2 ? 0.0f : r * 0.25f;
+  }
+  RunAndCheck<float>("UniqueWithCounts", input);
+}
+
+TEST_F(UniqueOpTest, LargeString) {
+  std::vector<tstring> input(100000);
+  for (tstring& x : input) x = strings::StrCat("s", std::rand() % 30000);
+  RunAndCheck<tstring>("UniqueWithCounts", input);
+}
+
 TensorProto GetRandomInt32TensorProto(int dim, int max_int) {
   TensorProto tensor_proto;
   tensor_proto.set_dtype(DT_INT32);
@@ -23,8 +23,12 @@ limitations under the License.
 
 #include "tensorflow/core/kernels/where_op.h"
 
+#include <algorithm>
+#include <cstring>
 #include <memory>
 #include <numeric>
+#include <vector>
+
 #include "third_party/eigen3/unsupported/Eigen/CXX11/Tensor"
 #include "tensorflow/core/framework/bounds_check.h"
 #include "tensorflow/core/framework/op_kernel.h"
@@ -36,6 +40,7 @@ limitations under the License.
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/macros.h"
 #include "tensorflow/core/platform/types.h"
+#include "tensorflow/core/util/work_sharder.h"
 
 #if GOOGLE_CUDA || TENSORFLOW_USE_ROCM
 #include "tensorflow/core/common_runtime/gpu/gpu_event_mgr.h"
@@ -54,9 +59,21 @@ namespace tensorflow {
 typedef Eigen::ThreadPoolDevice CPUDevice;
 typedef Eigen::GpuDevice GPUDevice;
 
-namespace functor {
-
 namespace {
+
+// The CPU kernels split their input into blocks of this many elements, which
+// are counted and then written in parallel.
+constexpr int64 kWhereBlockSize = 32 * 1024;
+
+// Returns a word with the high bit of each of the eight bytes at `p` set if
+// that byte is non-zero.
+inline uint64 NonZeroBytes(const void* p) {
+  constexpr uint64 kLowBits = 0x7F7F7F7F7F7F7F7FULL;
+  uint64 word;
+  std::memcpy(&word, p, sizeof(word));
+  return (((word & kLowBits) + kLowBits) | word) & ~kLowBits;
+}
+
 template <typename T>
 int64 CountAccumulator(const T* begin, const T* end) {
   return std::accumulate(begin, end, 0LL, [](int64 accum, const T& val) {
@@ -64,22 +81,71 @@ int64 CountAccumulator(const T* begin, const T* end) {
   });
 }
 
+// Counts eight one-byte elements at a time.
+template <typename T>
+int64 CountNonZeroBytes(const T* begin, const T* end) {
+  static_assert(sizeof(T) == 1, "T must be a one-byte type");
+  int64 count = 0;
+  const T* p = begin;
+  for (; end - p >= 8; p += 8) {
+    // Sums the high bits of all bytes into the top byte.
+    count += ((NonZeroBytes(p) >> 7) * 0x0101010101010101ULL) >> 56;
+  }
+  for (; p < end; ++p) count += (*p != T(0));
+  return count;
+}
+
 template <>
 int64 CountAccumulator<bool>(const bool* begin, const bool* end) {
-  return std::accumulate(begin, end, 0LL);
+  return CountNonZeroBytes(begin, end);
 }
 
-}  // namespace
+template <>
+int64 CountAccumulator<uint8>(const uint8* begin, const uint8* end) {
+  return CountNonZeroBytes(begin, end);
+}
 
+template <>
+int64 CountAccumulator<int8>(const int8* begin, const int8* end) {
+  return CountNonZeroBytes(begin, end);
+}
+
+// Returns the position of the first non-zero element in [begin, end), or
+// `end` if there is none. One-byte elements are skipped eight at a time.
 template <typename T>
-struct NumTrue<CPUDevice, T, int64> {
-  static Status Compute(OpKernelContext* ctx, const CPUDevice& d,
-                        typename TTypes<T>::ConstFlat input,
-                        TTypes<int64>::UnalignedScalar num_true) {
-    num_true() = CountAccumulator<T>(input.data(), input.data() + input.size());
-    return Status::OK();
+const T* FindNonZero(const T* begin, const T* end) {
+  const T* p = begin;
+  if (sizeof(T) == 1) {
+    while (end - p >= 8 && NonZeroBytes(p) == 0) p += 8;
   }
-};
+  while (p < end && *p == T(0)) ++p;
+  return p;
+}
+
+// Counts the non-zero elements of each block of `input` in parallel, and
+// returns the exclusive prefix sums of the counts in `block_offsets`, which
+// has one more element than there are blocks.
+template <typename T>
+void CountTruePerBlock(OpKernelContext* ctx, const T* input, int64 size,
+                       int64 block_size, std::vector<int64>* block_offsets) {
+  const int64 num_blocks = Eigen::divup(size, block_size);
+  block_offsets->assign(num_blocks + 1, 0);
+  const auto& worker_threads = *ctx->device()->tensorflow_cpu_worker_threads();
+  Shard(worker_threads.num_threads, worker_threads.workers, num_blocks,
+        block_size * sizeof(T), [&](int64 start, int64 limit) {
+          for (int64 b = start; b < limit; ++b) {
+            (*block_offsets)[b + 1] = CountAccumulator<T>(
+                input + b * block_size,
+                input + std::min(size, (b + 1) * block_size));
+          }
+        });
+  std::partial_sum(block_offsets->begin(), block_offsets->end(),
+                   block_offsets->begin());
+}
+
+}  // namespace
+
+namespace functor {
 
 template <int DIMS, typename T, typename TIndex>
 struct Where<CPUDevice, DIMS, T, TIndex> {
@@ -93,10 +159,14 @@ struct Where<CPUDevice, DIMS, T, TIndex> {
     }
   }
 
-  EIGEN_ALWAYS_INLINE static Status Compute(
-      OpKernelContext* ctx, const CPUDevice& d,
-      typename TTypes<T, DIMS>::ConstTensor input,
-      typename TTypes<int64>::Matrix output, TIndex* found_true) {
+  // Writes the indices of the true elements in each block of kWhereBlockSize
+  // elements of the input in parallel, starting at the row given by
+  // `block_offsets`.
+  static Status Compute(OpKernelContext* ctx, const CPUDevice& d,
+                        typename TTypes<T, DIMS>::ConstTensor input,
+                        const std::vector<int64>& block_offsets,
+                        typename TTypes<int64>::Matrix output,
+                        TIndex* found_true) {
     Eigen::DSizes<Eigen::DenseIndex, DIMS> dims = input.dimensions();
     Eigen::DSizes<TIndex, DIMS> strides;
 
@@ -109,15 +179,33 @@ struct Where<CPUDevice, DIMS, T, TIndex> {
       strides[i] = strides[i + 1] * dims[i + 1];
     }
 
-    Eigen::DenseIndex output_size = output.dimension(0);
-    for (Eigen::DenseIndex n = 0; n < input.size(); ++n) {
-      if (input.data()[n] != T(0)) {
-        if (FastBoundsCheck(*found_true, output_size)) {
-          WriteIndexRowMajor(output, strides, *found_true, n);
-        }
-        ++*found_true;
-      }
-    }
+    const T* data = input.data();
+    const int64 size = input.size();
+    const int64 num_blocks = block_offsets.size() - 1;
+    std::vector<TIndex> block_found_true(num_blocks, 0);
+    const auto& worker_threads =
+        *ctx->device()->tensorflow_cpu_worker_threads();
+    Shard(worker_threads.num_threads, worker_threads.workers, num_blocks,
+          kWhereBlockSize * (sizeof(T) + DIMS),
+          [&](int64 start, int64 limit) {
+            for (int64 b = start; b < limit; ++b) {
+              const T* end = data + std::min(size, (b + 1) * kWhereBlockSize);
+              // A block may not write past the rows reserved for it, in case
+              // the input changed after it was counted.
+              const int64 output_limit = block_offsets[b + 1];
+              TIndex true_n = block_offsets[b];
+              for (const T* p = FindNonZero(data + b * kWhereBlockSize, end);
+                   p < end; p = FindNonZero(p + 1, end)) {
+                if (true_n < output_limit) {
+                  WriteIndexRowMajor(output, strides, true_n, p - data);
+                }
+                ++true_n;
+              }
+              block_found_true[b] = true_n - block_offsets[b];
+            }
+          });
+    *found_true = std::accumulate(block_found_true.begin(),
+                                  block_found_true.end(), TIndex(0));
     return Status::OK();
   }
 };
@@ -140,28 +228,24 @@ class WhereCPUOp : public OpKernel {
 
     const int input_dims = input.dims();
 
-    int64 num_true;
-    TTypes<int64>::UnalignedScalar num_true_t(&num_true);
+    // Count the true elements of each block of the input, so that the blocks
+    // can write their indices in parallel below.
+    std::vector<int64> block_offsets;
+    CountTruePerBlock(context, input.flat<T>().data(), input.NumElements(),
+                      kWhereBlockSize, &block_offsets);
+    const int64 num_true = block_offsets.back();
 
-    Status s = functor::NumTrue<CPUDevice, T, int64>::Compute(
-        context, context->eigen_device<CPUDevice>(), input.flat<T>(),
-        num_true_t);
-    OP_REQUIRES_OK(context, s);
     TensorShape output_shape({num_true, input_dims});
     Tensor* output = nullptr;
     OP_REQUIRES_OK(context, context->allocate_output(0, output_shape, &output));
 
-    // TODO(ebrevdo): Replace single-threaded copy with a
-    // multithreaded block copy by getting block counts above instead
-    // of a global NumTrue, then having each block filled in in
-    // separate threads below.
     int64 found_true = 0;
 
 #define HANDLE_DIM(NDIM)                                                      \
   case NDIM: {                                                                \
     Status s = functor::Where<CPUDevice, NDIM, T, int64>::Compute(            \
         context, context->eigen_device<CPUDevice>(), input.tensor<T, NDIM>(), \
-        output->matrix<int64>(), &found_true);                                \
+        block_offsets, output->matrix<int64>(), &found_true);                 \
     OP_REQUIRES_OK(context, s);                                               \
   } break;
 
@@ -183,11 +267,11 @@ class WhereCPUOp : public OpKernel {
 #undef HANDLE_DIM
 
     OP_REQUIRES(
-        context, found_true == num_true_t(),
+        context, found_true == num_true,
         errors::InvalidArgument(
             "WhereOp: Race condition between counting the number of true "
             "elements and writing them.  When counting, saw ",
-            num_true_t(), " elements; but when writing their indices, saw ",
+            num_true, " elements; but when writing their indices, saw ",
             found_true, " elements."));
   }
 
@@ -204,6 +288,121 @@ TF_CALL_bool(REGISTER_WHERE_OP);
 
 #undef REGISTER_WHERE_OP
 
+// Selects the slices of `tensor` along `axis` for which the 1-D `mask` is
+// true. This computes GatherV2(tensor, Squeeze(Where(mask), [1]), axis) without
+// materializing the indices of the true elements of the mask.
+template <typename T>
+class BooleanMaskOp : public OpKernel {
+ public:
+  explicit BooleanMaskOp(OpKernelConstruction* context) : OpKernel(context) {
+    OP_REQUIRES_OK(context, context->GetAttr("axis", &axis_));
+  }
+
+  void Compute(OpKernelContext* context) override {
+    const Tensor& tensor = context->input(0);
+    const Tensor& mask = context->input(1);
+    OP_REQUIRES(context, TensorShapeUtils::IsVector(mask.shape()),
+                errors::InvalidArgument("mask must be a vector, got shape ",
+                                        mask.shape().DebugString()));
+    const int64 axis = axis_ < 0 ? axis_ + tensor.dims() : axis_;
+    OP_REQUIRES(context, 0 <= axis && axis < tensor.dims(),
+                errors::InvalidArgument("Expected axis in the range [",
+                                        -tensor.dims(), ", ", tensor.dims(),
+                                        "), but got ", axis_));
+
+    int64 outer_size = 1;
+    for (int i = 0; i < axis; ++i) outer_size *= tensor.dim_size(i);
+    int64 inner_size = 1;
+    for (int i = axis + 1; i < tensor.dims(); ++i) {
+      inner_size *= tensor.dim_size(i);
+    }
+    const int64 axis_size = tensor.dim_size(axis);
+
+    // Every block of the mask selects from at least kWhereBlockSize elements.
+    const bool* mask_data = mask.vec<bool>().data();
+    const int64 mask_size = mask.NumElements();
+    const int64 block_size =
+        std::max<int64>(1, kWhereBlockSize / std::max<int64>(1, inner_size));
+    std::vector<int64> block_offsets;
+    CountTruePerBlock(context, mask_data, mask_size, block_size,
+                      &block_offsets);
+    const int64 num_true = block_offsets.back();
+
+    // Like GatherV2, reject the indices that are out of range.
+    if (mask_size > axis_size) {
+      const bool* bad =
+          FindNonZero(mask_data + axis_size, mask_data + mask_size);
+      OP_REQUIRES(context, bad == mask_data + mask_size,
+                  errors::InvalidArgument(
+                      "indices[", CountAccumulator(mask_data, bad),
+                      "] = ", bad - mask_data, " is not in [0, ", axis_size,
+                      ")"));
+    }
+
+    TensorShape output_shape(tensor.shape());
+    output_shape.set_dim(axis, num_true);
+    Tensor* output = nullptr;
+    OP_REQUIRES_OK(context, context->allocate_output(0, output_shape, &output));
+    if (output->NumElements() == 0) return;
+
+    // Every unit of work copies the slices selected by one block of the mask
+    // from one outer slice of the tensor, copying runs of consecutive slices at
+    // once.
+    const T* input_data = tensor.flat<T>().data();
+    T* output_data = output->flat<T>().data();
+    const int64 num_blocks = block_offsets.size() - 1;
+    const auto& worker_threads =
+        *context->device()->tensorflow_cpu_worker_threads();
+    Shard(worker_threads.num_threads, worker_threads.workers,
+          outer_size * num_blocks, block_size * inner_size * sizeof(T),
+          [&](int64 start, int64 limit) {
+            for (int64 unit = start; unit < limit; ++unit) {
+              const int64 outer = unit / num_blocks;
+              const int64 b = unit % num_blocks;
+              // Mask elements past the axis are false, as checked above.
+              const bool* end =
+                  mask_data + std::min(std::min(axis_size, mask_size),
+                                       (b + 1) * block_size);
+              const T* input_slices =
+                  input_data + outer * axis_size * inner_size;
+              T* output_slices = output_data + outer * num_true * inner_size;
+              T* out = output_slices + block_offsets[b] * inner_size;
+              // Do not write past the rows reserved for this block, in case the
+              // mask changed after it was counted.
+              T* out_end = output_slices + block_offsets[b + 1] * inner_size;
+              for (const bool* p = FindNonZero(mask_data + b * block_size, end);
+                   p < end;) {
+                const bool* run_end = p;
+                while (run_end < end && *run_end) ++run_end;
+                const int64 n = std::min<int64>((run_end - p) * inner_size,
+                                                out_end - out);
+                std::copy_n(input_slices + (p - mask_data) * inner_size, n,
+                            out);
+                out += n;
+                p = FindNonZero(run_end, end);
+              }
+            }
+          });
+  }
+
+ private:
+  int64 axis_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(BooleanMaskOp);
+};
+
+#define REGISTER_BOOLEAN_MASK_OP(T)                                   \
+  REGISTER_KERNEL_BUILDER(                                            \
+      Name("_BooleanMask").Device(DEVICE_CPU).TypeConstraint<T>("T"), \
+      BooleanMaskOp<T>);
+
+TF_CALL_ALL_TYPES(REGISTER_BOOLEAN_MASK_OP);
+TF_CALL_QUANTIZED_TYPES(REGISTER_BOOLEAN_MASK_OP);
+TF_CALL_quint16(REGISTER_BOOLEAN_MASK_OP);
+TF_CALL_qint16(REGISTER_BOOLEAN_MASK_OP);
+
+#undef REGISTER_BOOLEAN_MASK_OP
+
 #if GOOGLE_CUDA || TENSORFLOW_USE_ROCM
 
 namespace functor {
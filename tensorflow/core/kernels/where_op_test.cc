@@ -0,0 +1,201 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include <functional>
+#include <vector>
+
+#include "tensorflow/core/framework/fake_input.h"
+#include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/kernels/ops_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace {
+
+// Larger than the blocks of 32K elements that the CPU kernels count and write
+// in parallel, so that the inputs below span several blocks.
+constexpr int64 kMultiBlockSize = 3 * 32 * 1024 + 17;
+
+std::vector<bool> MakeMask(int64 size, const std::function<bool(int64)>& f) {
+  std::vector<bool> mask(size);
+  for (int64 i = 0; i < size; ++i) mask[i] = f(i);
+  return mask;
+}
+
+bool Sparse(int64 i) { return i % 7 == 0 || i % 11 == 3; }
+
+class WhereOpTest : public OpsTestBase {
+ protected:
+  void MakeOp(DataType type) {
+    TF_ASSERT_OK(NodeDefBuilder("where", "Where")
+                     .Input(FakeInput(type))
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+  }
+
+  // Runs Where on a 1-D bool input and checks the indices against a serial
+  // scan of `mask`.
+  void RunAndCheck1D(const std::vector<bool>& mask) {
+    MakeOp(DT_BOOL);
+    const int64 size = mask.size();
+    AddInput<bool>(TensorShape({size}), [&mask](int i) { return mask[i]; });
+    TF_ASSERT_OK(RunOpKernel());
+    std::vector<int64> expected;
+    for (int64 i = 0; i < size; ++i) {
+      if (mask[i]) expected.push_back(i);
+    }
+    Tensor expected_tensor(
+        DT_INT64, TensorShape({static_cast<int64>(expected.size()), 1}));
+    std::copy(expected.begin(), expected.end(),
+              expected_tensor.flat<int64>().data());
+    test::ExpectTensorEqual<int64>(expected_tensor, *GetOutput(0));
+  }
+};
+
+TEST_F(WhereOpTest, MultiBlock) {
+  RunAndCheck1D(MakeMask(kMultiBlockSize, Sparse));
+}
+
+TEST_F(WhereOpTest, MultiBlockAllFalse) {
+  RunAndCheck1D(MakeMask(kMultiBlockSize, [](int64) { return false; }));
+}
+
+TEST_F(WhereOpTest, MultiBlockAllTrue) {
+  RunAndCheck1D(MakeMask(kMultiBlockSize, [](int64) { return true; }));
+}
+
+TEST_F(WhereOpTest, MultiBlock2D) {
+  // Blocks split the rows, so the coordinates of a block's first element are
+  // not those of a row start.
+  const int64 rows = 301;
+  const int64 cols = 401;
+  MakeOp(DT_FLOAT);
+  AddInput<float>(TensorShape({rows, cols}),
+                  [](int i) { return Sparse(i) ? 1.0f : 0.0f; });
+  TF_ASSERT_OK(RunOpKernel());
+  std::vector<int64> expected;
+  for (int64 i = 0; i < rows * cols; ++i) {
+    if (Sparse(i)) {
+      expected.push_back(i / cols);
+      expected.push_back(i % cols);
+    }
+  }
+  Tensor expected_tensor(
+      DT_INT64, TensorShape({static_cast<int64>(expected.size() / 2), 2}));
+  std::copy(expected.begin(), expected.end(),
+            expected_tensor.flat<int64>().data());
+  test::ExpectTensorEqual<int64>(expected_tensor, *GetOutput(0));
+}
+
+class BooleanMaskOpTest : public OpsTestBase {
+ protected:
+  void MakeOp(int64 axis) {
+    TF_ASSERT_OK(NodeDefBuilder("boolean_mask", "_BooleanMask")
+                     .Input(FakeInput(DT_INT32))
+                     .Input(FakeInput(DT_BOOL))
+                     .Attr("axis", axis)
+                     .Finalize(node_def()));
+    TF_ASSERT_OK(InitOp());
+  }
+
+  // Runs _BooleanMask on a [outer, axis_size, inner] tensor holding 0, 1, ...
+  // and checks the result against GatherV2 of the indices of the true
+  // elements of `mask`, which may be shorter than the axis.
+  void RunAndCheck(int64 outer, int64 axis_size, int64 inner,
+                   const std::vector<bool>& mask) {
+    MakeOp(1);
+    AddInput<int32>(TensorShape({outer, axis_size, inner}),
+                    [](int i) { return i; });
+    const int64 mask_size = mask.size();
+    AddInput<bool>(TensorShape({mask_size}),
+                   [&mask](int i) { return mask[i]; });
+    TF_ASSERT_OK(RunOpKernel());
+
+    std::vector<int32> expected;
+    int64 num_true = 0;
+    for (int64 a = 0; a < mask_size; ++a) num_true += mask[a];
+    for (int64 o = 0; o < outer; ++o) {
+      for (int64 a = 0; a < mask_size; ++a) {
+        if (!mask[a]) continue;
+        for (int64 i = 0; i < inner; ++i) {
+          expected.push_back((o * axis_size + a) * inner + i);
+        }
+      }
+    }
+    Tensor expected_tensor(DT_INT32, TensorShape({outer, num_true, inner}));
+    std::copy(expected.begin(), expected.end(),
+              expected_tensor.flat<int32>().data());
+    test::ExpectTensorEqual<int32>(expected_tensor, *GetOutput(0));
+  }
+};
+
+TEST_F(BooleanMaskOpTest, Small) {
+  RunAndCheck(2, 5, 3, {true, false, false, true, true});
+}
+
+TEST_F(BooleanMaskOpTest, MaskShorterThanAxis) {
+  RunAndCheck(2, 5, 3, {false, true, true});
+}
+
+TEST_F(BooleanMaskOpTest, AllFalse) {
+  RunAndCheck(2, 5, 3, {false, false, false, false, false});
+}
+
+TEST_F(BooleanMaskOpTest, AllTrue) {
+  RunAndCheck(2, 5, 3, {true, true, true, true, true});
+}
+
+TEST_F(BooleanMaskOpTest, MultiBlock) {
+  // With two elements per slice, every block covers 16K slices.
+  RunAndCheck(3, kMultiBlockSize, 2, MakeMask(kMultiBlockSize, Sparse));
+}
+
+TEST_F(BooleanMaskOpTest, MultiBlockMaskShorterThanAxis) {
+  // The mask ends in the middle of a block.
+  RunAndCheck(3, kMultiBlockSize, 2, MakeMask(kMultiBlockSize - 20000, Sparse));
+}
+
+TEST_F(BooleanMaskOpTest, MultiBlockAllFalse) {
+  RunAndCheck(2, kMultiBlockSize, 1,
+              MakeMask(kMultiBlockSize, [](int64) { return false; }));
+}
+
+TEST_F(BooleanMaskOpTest, MultiBlockAllTrue) {
+  RunAndCheck(2, kMultiBlockSize, 1,
+              MakeMask(kMultiBlockSize, [](int64) { return true; }));
+}
+
+TEST_F(BooleanMaskOpTest, TrueMaskElementPastAxis) {
+  MakeOp(0);
+  AddInputFromArray<int32>(TensorShape({2, 2}), {1, 2, 3, 4});
+  AddInputFromArray<bool>(TensorShape({3}), {true, false, true});
+  EXPECT_TRUE(errors::IsInvalidArgument(RunOpKernel()));
+}
+
+TEST_F(BooleanMaskOpTest, FalseMaskElementPastAxis) {
+  MakeOp(0);
+  AddInputFromArray<int32>(TensorShape({2, 2}), {1, 2, 3, 4});
+  AddInputFromArray<bool>(TensorShape({3}), {false, true, false});
+  TF_ASSERT_OK(RunOpKernel());
+  test::ExpectTensorEqual<int32>(
+      test::AsTensor<int32>({3, 4}, TensorShape({1, 2})), *GetOutput(0));
+}
+
+}  // namespace
+}  // namespace tensorflow
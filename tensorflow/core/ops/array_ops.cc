@@ -1833,6 +1833,44 @@ REGISTER_OP("Where")
       return Status::OK();
     });
 
+REGISTER_OP("_BooleanMask")
+    .Input("tensor: T")
+    .Input("mask: bool")
+    .Output("output: T")
+    .Attr("T: type")
+    .Attr("axis: int = 0")
+    .SetShapeFn([](InferenceContext* c) {
+      ShapeHandle unused;
+      TF_RETURN_IF_ERROR(c->WithRank(c->input(1), 1, &unused));
+      ShapeHandle tensor = c->input(0);
+      if (!c->RankKnown(tensor)) {
+        c->set_output(0, c->UnknownShape());
+        return Status::OK();
+      }
+      int64 axis;
+      TF_RETURN_IF_ERROR(c->GetAttr("axis", &axis));
+      const int32 rank = c->Rank(tensor);
+      if (axis < -rank || axis >= rank) {
+        return errors::InvalidArgument("Expected axis in the range [", -rank,
+                                       ", ", rank, "), but got ", axis);
+      }
+      if (axis < 0) axis += rank;
+      ShapeHandle output;
+      TF_RETURN_IF_ERROR(
+          c->ReplaceDim(tensor, axis, c->UnknownDim(), &output));
+      c->set_output(0, output);
+      return Status::OK();
+    })
+    .Doc(R"doc(
+Selects the slices of `tensor` along `axis` where the 1-D `mask` is true.
+
+Computes `GatherV2(tensor, Squeeze(Where(mask), [1]), axis)` without
+materializing the indices of the true elements of `mask`.
+
+NOTE Do not invoke this operator directly in Python. Grappler is expected to
+create these operators.
+)doc");
+
 // --------------------------------------------------------------------------
 REGISTER_OP("BroadcastArgs")
     .Input("s0: T")
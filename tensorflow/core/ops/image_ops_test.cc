@@ -171,6 +171,56 @@ TEST(ImageOpsTest, DecodeAndCropJpeg_InvalidCropWindow) {
   INFER_OK(op, "[];[?]", "[?,?,?]");
 }
 
+TEST(ImageOpsTest, DecodeAndCropResizeJpeg_ShapeFn) {
+  ShapeInferenceTestOp op("DecodeAndCropResizeJpeg");
+  op.input_tensors.resize(3);
+  TF_ASSERT_OK(NodeDefBuilder("test", "DecodeAndCropResizeJpeg")
+                   .Input({"img", 0, DT_STRING})
+                   .Input({"crop_window", 1, DT_INT32})
+                   .Input({"size", 2, DT_INT32})
+                   .Attr("channels", 1)
+                   .Finalize(&op.node_def));
+
+  // Rank and size checks.
+  INFER_ERROR("Shape must be rank 0 but is rank 1", op, "[1];?;?");
+  INFER_ERROR("Dimension must be 4 but is 3", op, "[];[3];?");
+  INFER_ERROR("Dimension must be 2 but is 3", op, "[];[4];[3]");
+
+  INFER_OK(op, "[];[4];[2]", "[?,?,1]");
+  Tensor size_tensor = test::AsTensor<int32>({20, 30});
+  op.input_tensors[2] = &size_tensor;
+  INFER_OK(op, "[];[4];[2]", "[20,30,1]");
+
+  TF_ASSERT_OK(NodeDefBuilder("test", "DecodeAndCropResizeJpeg")
+                   .Input({"img", 0, DT_STRING})
+                   .Input({"crop_window", 1, DT_INT32})
+                   .Input({"size", 2, DT_INT32})
+                   .Attr("channels", 0)
+                   .Finalize(&op.node_def));
+  INFER_ERROR("channels must be 1 or 3, got 0", op, "[];[4];[2]");
+}
+
+TEST(ImageOpsTest, BatchDecodeAndCropResizeJpeg_ShapeFn) {
+  ShapeInferenceTestOp op("BatchDecodeAndCropResizeJpeg");
+  op.input_tensors.resize(3);
+  TF_ASSERT_OK(NodeDefBuilder("test", "BatchDecodeAndCropResizeJpeg")
+                   .Input({"img", 0, DT_STRING})
+                   .Input({"crop_windows", 1, DT_INT32})
+                   .Input({"size", 2, DT_INT32})
+                   .Finalize(&op.node_def));
+
+  // Rank and size checks.
+  INFER_ERROR("Shape must be rank 1 but is rank 0", op, "[];?;?");
+  INFER_ERROR("Shape must be rank 2 but is rank 1", op, "[5];[4];?");
+  INFER_ERROR("Dimensions must be equal, but are 5 and 6", op, "[5];[6,4];?");
+  INFER_ERROR("Dimension must be 4 but is 3", op, "[5];[5,3];?");
+
+  INFER_OK(op, "[?];[5,4];[2]", "[d1_0,?,?,3]");
+  Tensor size_tensor = test::AsTensor<int32>({20, 30});
+  op.input_tensors[2] = &size_tensor;
+  INFER_OK(op, "[5];[?,4];[2]", "[d0_0,20,30,3]");
+}
+
 TEST(ImageOpsTest, EncodeImage_ShapeFn) {
   for (const char* op_name : {"EncodeJpeg", "EncodePng"}) {
     ShapeInferenceTestOp op(op_name);
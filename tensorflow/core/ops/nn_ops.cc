@@ -256,6 +256,24 @@ REGISTER_OP("_FusedBatchNormEx")
 expected to create these operators.
 )doc");
 
+REGISTER_OP("_FusedMoments")
+    .Input("x: T")
+    .Input("reduction_indices: Tidx")
+    .Output("mean: T")
+    .Output("variance: T")
+    .Attr("T: {half, bfloat16, float, double}")
+    .Attr("Tidx: {int32, int64} = DT_INT32")
+    .Attr("keep_dims: bool = false")
+    .SetShapeFn([](InferenceContext* c) {
+      TF_RETURN_IF_ERROR(shape_inference::ReductionShape(c));
+      c->set_output(1, c->output(0));
+      return Status::OK();
+    })
+    .Doc(R"doc(
+*NOTE*: Do not invoke this operator directly in Python. Grappler is
+expected to create these operators.
+)doc");
+
 REGISTER_OP("FusedBatchNormGrad")
     .Input("y_backprop: T")
     .Input("x: T")
@@ -1206,6 +1224,24 @@ REGISTER_OP("LogSoftmax")
 
 // --------------------------------------------------------------------------
 
+REGISTER_OP("_FusedSoftmax")
+    .Input("logits: T")
+    .Input("mask: num_masks * T")
+    .Output("softmax: T")
+    .Attr("T: {half, bfloat16, float, double}")
+    .Attr("num_masks: int >= 0 = 0")
+    .Attr("scale: float = 1.0")
+    .Attr("log: bool = false")
+    .SetShapeFn([](InferenceContext* c) {
+      return shape_inference::UnchangedShapeWithRankAtLeast(c, 1);
+    })
+    .Doc(R"doc(
+*NOTE*: Do not invoke this operator directly in Python. Grappler is
+expected to create these operators.
+)doc");
+
+// --------------------------------------------------------------------------
+
 REGISTER_OP("SoftmaxCrossEntropyWithLogits")
     .Input("features: T")
     .Input("labels: T")
@@ -274,6 +274,30 @@ TEST(NNOpsTest, FusedBatchNorm_ShapeFn) {
            "[d0_1|d1_0|d2_0|d3_0|d4_0];[d0_1|d1_0|d2_0|d3_0|d4_0]");
 }
 
+TEST(NNOpsTest, FusedMoments_ShapeFn) {
+  ShapeInferenceTestOp op("_FusedMoments");
+  auto set_keep_dims = [&op](bool keep_dims) {
+    TF_ASSERT_OK(NodeDefBuilder("test", "_FusedMoments")
+                     .Input(FakeInput(DT_FLOAT))
+                     .Input(FakeInput(DT_INT32))
+                     .Attr("keep_dims", keep_dims)
+                     .Finalize(&op.node_def));
+  };
+
+  set_keep_dims(false);
+  INFER_OK(op, "[2,3,4];[2]", "?;?");
+
+  Tensor axes = test::AsTensor<int32>({0, 2});
+  op.input_tensors.resize(2);
+  op.input_tensors[1] = &axes;
+  INFER_OK(op, "[2,3,4];[2]", "[d0_1];[d0_1]");
+  set_keep_dims(true);
+  INFER_OK(op, "[2,3,4];[2]", "[1,d0_1,1];[1,d0_1,1]");
+
+  axes = test::AsTensor<int32>({3});
+  INFER_ERROR("Invalid reduction dimension", op, "[2,3,4];[1]");
+}
+
 TEST(NNOpsTest, FusedBatchNormGrad_ShapeFn) {
   ShapeInferenceTestOp op("FusedBatchNormGrad");
   auto set_op = [&op](string data_format) {
@@ -2632,6 +2632,87 @@ class PredictionOpsTest(test_util.TensorFlowTestCase):
       logits = session.run(predict_op)
       self.assertAllClose(expected_logits, logits)
 
+  @test_util.run_deprecated_v1
+  def testPredictionManyExamplesAfterUpdate(self):
+    """Tests predicting more examples than fit a block, before and after."""
+    with self.cached_session() as session:
+      tree_ensemble_config = boosted_trees_pb2.TreeEnsemble()
+      text_format.Merge(
+          """
+        trees {
+          nodes {
+            bucketized_split {
+              feature_id: 0
+              threshold: 4
+              left_id: 1
+              right_id: 2
+            }
+          }
+          nodes {
+            leaf {
+              scalar: 1.0
+            }
+          }
+          nodes {
+            categorical_split {
+              feature_id: 1
+              value: 2
+              left_id: 3
+              right_id: 4
+            }
+          }
+          nodes {
+            leaf {
+              scalar: 10.0
+            }
+          }
+          nodes {
+            leaf {
+              scalar: 100.0
+            }
+          }
+        }
+        trees {
+          nodes {
+            leaf {
+              scalar: 0.5
+            }
+          }
+        }
+        tree_weights: 1.0
+        tree_weights: 2.0
+      """, tree_ensemble_config)
+
+      tree_ensemble = boosted_trees_ops.TreeEnsemble(
+          'ensemble', serialized_proto=tree_ensemble_config.SerializeToString())
+      tree_ensemble_handle = tree_ensemble.resource_handle
+      resources.initialize_resources(resources.shared_resources()).run()
+
+      num_examples = 150
+      feature_0_values = np.arange(num_examples, dtype=np.int32) % 10
+      feature_1_values = np.arange(num_examples, dtype=np.int32) % 3
+      first_tree_logits = np.where(
+          feature_0_values <= 4, 1.0,
+          np.where(feature_1_values == 2, 10.0, 100.0))
+
+      predict_op = boosted_trees_ops.predict(
+          tree_ensemble_handle,
+          bucketized_features=[feature_0_values, feature_1_values],
+          logits_dimension=1)
+      logits = session.run(predict_op)
+      self.assertAllClose(
+          np.expand_dims(first_tree_logits + 2.0 * 0.5, 1), logits)
+
+      # Predictions follow changes to the ensemble.
+      tree_ensemble_config.tree_weights[1] = 4.0
+      session.run(
+          tree_ensemble.deserialize(
+              stamp_token=1,
+              serialized_proto=tree_ensemble_config.SerializeToString()))
+      logits = session.run(predict_op)
+      self.assertAllClose(
+          np.expand_dims(first_tree_logits + 4.0 * 0.5, 1), logits)
+
 
 class FeatureContribsOpsTest(test_util.TensorFlowTestCase):
   """Tests feature contribs ops for model understanding."""
@@ -165,6 +165,23 @@ class TopKTest(test.TestCase):
       values = -np.sort(-inputs, axis=1)[:, :k]
       self._validateTopK(inputs, k, values, indices)
 
+  def _testLongRowTopK(self, dtype):
+    b = 2
+    n = 200000
+    # Exercises threshold filtering, with and without splitting the rows across
+    # threads, and radix select. Lots of repeated values check that ties are
+    # resolved in favour of lower indices.
+    for k in [10, 1000, 50000, n]:
+      inputs = np.random.randint(-500, 500, size=(b, n)).astype(dtype)
+      indices = np.argsort(-inputs, axis=1, kind="mergesort")[:, :k]
+      values = -np.sort(-inputs, axis=1)[:, :k]
+      self._validateTopK(inputs, k, values, indices)
+
+  def testLongRowTopK(self):
+    self._testLongRowTopK(np.float32)
+    self._testLongRowTopK(np.float64)
+    self._testLongRowTopK(np.int32)
+
   def testTopAll(self):
     inputs = [[0.1, 0.3, 0.2, 0.4], [0.1, 0.3, 0.3, 0.2]]
     self._validateTopK(inputs, 4, [[0.4, 0.3, 0.2, 0.1], [0.3, 0.3, 0.2, 0.1]],
@@ -45,8 +45,10 @@ def all_reduce(t,
       independent subdivision should begin.  Use [0] if no subdivision should
       be done.
     communication_hint: preferred collective communication.  The implementation
-      may fall back to another mechanism.  Options include `auto`, `ring`, and
-      `nccl`.
+      may fall back to another mechanism.  Options include `auto`, `ring`,
+      `nccl`, and `hierarchical_ring`, which reduces within each task before
+      reducing across tasks, and requires CPU devices and the same number of
+      devices in every task.
     timeout: If set to a non zero, set a completion timeout to detect staleness.
       If the timer goes off, a DeadlineExceededError is raised.
       The timeout value in seconds. This feature is experimental.